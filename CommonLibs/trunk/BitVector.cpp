@@ -27,9 +27,17 @@
 
 
 #include "BitVector.h"
+#include "Threads.h"
 #include <iostream>
 #include <stdio.h>
 #include <sstream>
+#include <math.h>
+#include <map>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_VITERBI
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
@@ -201,19 +209,13 @@ void BitVector::LSB8MSB()
 
 uint64_t BitVector::syndrome(Generator& gen) const
 {
-	gen.clear();
-	const char *dp = mStart;
-	while (dp<mEnd) gen.syndromeShift(*dp++);
-	return gen.state();
+	return gen.syndromeBits(mStart,size());
 }
 
 
 uint64_t BitVector::parity(Generator& gen) const
 {
-	gen.clear();
-	const char *dp = mStart;
-	while (dp<mEnd) gen.encoderShift(*dp++);
-	return gen.state();
+	return gen.parityBits(mStart,size());
 }
 
 
@@ -275,6 +277,79 @@ void BitVector::unmap(const unsigned *map, size_t mapSize, BitVector& dest) cons
 
 
 
+/*
+	The byte-wise forms work on the state grown by 8 bits, (state<<8) plus the
+	new byte in the syndrome case or the byte times x^mLen in the parity case,
+	which is at most mLen+8 bits wide.  Its top 8 bits are folded back in with
+	one lookup of mTable.  Any bits beyond a multiple of 8 take the bitwise path.
+*/
+
+const uint64_t *Generator::sharedTable(uint64_t wCoeff, unsigned wLen)
+{
+	// The tables are never freed; there are only a few polynomials.
+	static Mutex sTablesLock;
+	static map<pair<uint64_t,unsigned>,uint64_t*> sTables;
+
+	ScopedLock lock(sTablesLock);
+	uint64_t *&table = sTables[make_pair(wCoeff,wLen)];
+	if (!table) {
+		// Computed with the bitwise encoder.
+		table = new uint64_t[256];
+		Generator gen(wCoeff,wLen);
+		for (unsigned byte=0; byte<256; byte++) {
+			gen.clear();
+			for (int i=7; i>=0; i--) gen.encoderShift(byte>>i);
+			table[byte] = gen.state();
+		}
+	}
+	return table;
+}
+
+
+uint64_t Generator::syndromeBits(const char *bits, size_t len)
+{
+	clear();
+	if (mLen+8 > 64) {
+		for (size_t i=0; i<len; i++) syndromeShift(bits[i]);
+		return state();
+	}
+	if (!mTable) mTable = sharedTable(mCoeff,mLen);
+	const char *dp = bits;
+	const char *const bytesEnd = bits + 8*(len/8);
+	uint64_t st = 0;
+	while (dp<bytesEnd) {
+		st = reduce((st<<8) | packByte(dp));
+		dp += 8;
+	}
+	mState = st;
+	while (dp<bits+len) syndromeShift(*dp++);
+	return state();
+}
+
+
+uint64_t Generator::parityBits(const char *bits, size_t len)
+{
+	clear();
+	if (mLen+8 > 64) {
+		for (size_t i=0; i<len; i++) encoderShift(bits[i]);
+		return state();
+	}
+	if (!mTable) mTable = sharedTable(mCoeff,mLen);
+	const char *dp = bits;
+	const char *const bytesEnd = bits + 8*(len/8);
+	uint64_t st = 0;
+	while (dp<bytesEnd) {
+		st = reduce((st<<8) ^ ((uint64_t)packByte(dp)<<mLen));
+		dp += 8;
+	}
+	mState = st;
+	while (dp<bits+len) encoderShift(*dp++);
+	return state();
+}
+
+
+
+
 ostream& operator<<(ostream& os, const BitVector& hv)
 {
 	for (size_t i=0; i<hv.size(); i++) {
@@ -295,6 +370,7 @@ ViterbiR2O4::ViterbiR2O4()
 	computeStateTables(0);
 	computeStateTables(1);
 	computeGeneratorTable();
+	computeBranchIndex();
 }
 
 
@@ -402,6 +478,256 @@ const ViterbiR2O4::vCand& ViterbiR2O4::step(uint32_t inSample, const float *prob
 }
 
 
+
+/*
+	SIMD trellis for decodeBlock().
+
+	States are indexed by the last mOrder input bits, so state j and state j+8
+	both branch into states 2j and 2j+1.  The 16 path metrics are floats,
+	computed with the same additions in the same order as step(), so every
+	decision and every output bit is the one the scalar decoder makes.
+	Survivors are kept by register exchange, one 32-bit input history per state,
+	which is the iState of the scalar decoder.
+	Ties go to the candidate from the upper half, as in pruneCandidates(),
+	and to the lowest state, as in minCost().
+	The scalar decoder starts with every survivor in state zero, so the
+	other states start out of reach here.
+*/
+
+static const float sUnreachable = 1.0e9F;		///< initial metric of states other than zero
+
+
+void ViterbiR2O4::computeBranchIndex()
+{
+	for (unsigned b=0; b<2; b++) {
+		for (unsigned half=0; half<2; half++) {
+			for (unsigned j=0; j<mIStates/2; j++) {
+				const uint32_t state = j + half*mIStates/2;
+				const uint32_t code = mGeneratorTable[((state<<1) | b) & mCMask];
+				for (unsigned i=0; i<4; i++) mBranchIndex[b][half][4*j+i] = 4*code+i;
+			}
+		}
+	}
+}
+
+
+#ifdef HAVE_X86_VITERBI
+
+/** Add-compare-select on four states of each half; returns the decisions, all ones where the upper half won. */
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128 acsMetrics(__m128 lo, __m128 hi, __m128i costs, __m128i loIndex, __m128i hiIndex, __m128& decision)
+{
+	const __m128 a = _mm_add_ps(lo,_mm_castsi128_ps(_mm_shuffle_epi8(costs,loIndex)));
+	const __m128 c = _mm_add_ps(hi,_mm_castsi128_ps(_mm_shuffle_epi8(costs,hiIndex)));
+	decision = _mm_cmpnlt_ps(a,c);
+	return _mm_blendv_ps(a,c,decision);
+}
+
+/** Return the first state at the minimum metric. */
+__attribute__((target("sse4.1"), always_inline))
+static inline unsigned bestState(__m128 m0, __m128 m1, __m128 m2, __m128 m3)
+{
+	__m128 minimum = _mm_min_ps(_mm_min_ps(m0,m1),_mm_min_ps(m2,m3));
+	minimum = _mm_min_ps(minimum,_mm_shuffle_ps(minimum,minimum,_MM_SHUFFLE(2,3,0,1)));
+	minimum = _mm_min_ps(minimum,_mm_shuffle_ps(minimum,minimum,_MM_SHUFFLE(1,0,3,2)));
+	const unsigned mask = _mm_movemask_ps(_mm_cmpeq_ps(m0,minimum))
+		| (_mm_movemask_ps(_mm_cmpeq_ps(m1,minimum)) << 4)
+		| (_mm_movemask_ps(_mm_cmpeq_ps(m2,minimum)) << 8)
+		| (_mm_movemask_ps(_mm_cmpeq_ps(m3,minimum)) << 12);
+	return __builtin_ctz(mask);
+}
+
+__attribute__((target("sse4.1")))
+static void decodeSSE41(const uint8_t branchIndex[2][2][32], const float *costs,
+	unsigned steps, unsigned deferral, char *target)
+{
+	// index[b][half][p] covers states 4p..4p+3 of the half
+	__m128i index[2][2][2];
+	for (unsigned b=0; b<2; b++)
+		for (unsigned half=0; half<2; half++)
+			for (unsigned p=0; p<2; p++)
+				index[b][half][p] = _mm_loadu_si128((const __m128i*)(branchIndex[b][half]+16*p));
+
+	// metrics[i] and paths[i] hold states 4i..4i+3
+	__m128 metrics[4];
+	__m128i paths[4];
+	for (unsigned i=0; i<4; i++) {
+		metrics[i] = _mm_set1_ps(sUnreachable);
+		paths[i] = _mm_setzero_si128();
+	}
+	metrics[0] = _mm_move_ss(metrics[0],_mm_setzero_ps());
+	const __m128i inputBits = _mm_set_epi32(1,0,1,0);
+
+	for (unsigned k=0; k<steps; k++) {
+		const __m128i stepCosts = _mm_loadu_si128((const __m128i*)(costs+4*k));
+		__m128 next[4];
+		__m128i nextPaths[4];
+		for (unsigned p=0; p<2; p++) {
+			__m128 d0, d1;
+			const __m128 n0 = acsMetrics(metrics[p],metrics[p+2],stepCosts,index[0][0][p],index[0][1][p],d0);
+			const __m128 n1 = acsMetrics(metrics[p],metrics[p+2],stepCosts,index[1][0][p],index[1][1][p],d1);
+			// states j, for inputs 0 and 1, go to states 2j and 2j+1
+			next[2*p] = _mm_unpacklo_ps(n0,n1);
+			next[2*p+1] = _mm_unpackhi_ps(n0,n1);
+			const __m128i s0 = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(paths[p]),_mm_castsi128_ps(paths[p+2]),d0));
+			const __m128i s1 = _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(paths[p]),_mm_castsi128_ps(paths[p+2]),d1));
+			nextPaths[2*p] = _mm_or_si128(_mm_slli_epi32(_mm_unpacklo_epi32(s0,s1),1),inputBits);
+			nextPaths[2*p+1] = _mm_or_si128(_mm_slli_epi32(_mm_unpackhi_epi32(s0,s1),1),inputBits);
+		}
+		for (unsigned i=0; i<4; i++) {
+			metrics[i] = next[i];
+			paths[i] = nextPaths[i];
+		}
+
+		if (k>=deferral) {
+			const unsigned best = bestState(metrics[0],metrics[1],metrics[2],metrics[3]);
+			uint32_t survivors[16];
+			for (unsigned i=0; i<4; i++) _mm_storeu_si128((__m128i*)(survivors+4*i),paths[i]);
+			*target++ = (survivors[best] >> deferral) & 0x01;
+		}
+	}
+}
+
+/** As acsMetrics(), on all eight states of each half. */
+__attribute__((target("avx2"), always_inline))
+static inline __m256 acsMetrics256(__m256 lo, __m256 hi, __m256i costs, __m256i loIndex, __m256i hiIndex, __m256& decision)
+{
+	const __m256 a = _mm256_add_ps(lo,_mm256_castsi256_ps(_mm256_shuffle_epi8(costs,loIndex)));
+	const __m256 c = _mm256_add_ps(hi,_mm256_castsi256_ps(_mm256_shuffle_epi8(costs,hiIndex)));
+	decision = _mm256_cmp_ps(a,c,_CMP_NLT_US);
+	return _mm256_blendv_ps(a,c,decision);
+}
+
+__attribute__((target("avx2")))
+static void decodeAVX2(const uint8_t branchIndex[2][2][32], const float *costs,
+	unsigned steps, unsigned deferral, char *target)
+{
+	__m256i index[2][2];
+	for (unsigned b=0; b<2; b++)
+		for (unsigned half=0; half<2; half++)
+			index[b][half] = _mm256_loadu_si256((const __m256i*)branchIndex[b][half]);
+
+	__m256 lo = _mm256_set_ps(sUnreachable,sUnreachable,sUnreachable,sUnreachable,
+		sUnreachable,sUnreachable,sUnreachable,0.0F);
+	__m256 hi = _mm256_set1_ps(sUnreachable);
+	__m256i pathsLo = _mm256_setzero_si256();
+	__m256i pathsHi = _mm256_setzero_si256();
+	const __m256i inputBits = _mm256_set_epi32(1,0,1,0,1,0,1,0);
+
+	for (unsigned k=0; k<steps; k++) {
+		const __m256i stepCosts = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)(costs+4*k)));
+		__m256 d0, d1;
+		const __m256 n0 = acsMetrics256(lo,hi,stepCosts,index[0][0],index[0][1],d0);
+		const __m256 n1 = acsMetrics256(lo,hi,stepCosts,index[1][0],index[1][1],d1);
+		// in-lane unpacks give states 0-3 and 8-11, then 4-7 and 12-15
+		const __m256 m = _mm256_unpacklo_ps(n0,n1);
+		const __m256 n = _mm256_unpackhi_ps(n0,n1);
+		lo = _mm256_permute2f128_ps(m,n,0x20);
+		hi = _mm256_permute2f128_ps(m,n,0x31);
+
+		const __m256i s0 = _mm256_blendv_epi8(pathsLo,pathsHi,_mm256_castps_si256(d0));
+		const __m256i s1 = _mm256_blendv_epi8(pathsLo,pathsHi,_mm256_castps_si256(d1));
+		const __m256i u = _mm256_unpacklo_epi32(s0,s1);
+		const __m256i v = _mm256_unpackhi_epi32(s0,s1);
+		pathsLo = _mm256_or_si256(_mm256_slli_epi32(_mm256_permute2x128_si256(u,v,0x20),1),inputBits);
+		pathsHi = _mm256_or_si256(_mm256_slli_epi32(_mm256_permute2x128_si256(u,v,0x31),1),inputBits);
+
+		if (k>=deferral) {
+			const unsigned best = bestState(_mm256_castps256_ps128(lo),_mm256_extractf128_ps(lo,1),
+				_mm256_castps256_ps128(hi),_mm256_extractf128_ps(hi,1));
+			uint32_t survivors[16];
+			_mm256_storeu_si256((__m256i*)survivors,pathsLo);
+			_mm256_storeu_si256((__m256i*)(survivors+8),pathsHi);
+			*target++ = (survivors[best] >> deferral) & 0x01;
+		}
+	}
+}
+
+#endif
+
+
+void ViterbiR2O4::decodeBlock(const uint32_t *history, const float *matchCost, const float *mismatchCost,
+	char *target, size_t targetSize) const
+{
+	assert(mIRate==2 && mIStates==16);
+	const size_t steps = targetSize + mDeferral;
+
+	// Branch metrics for the four output codes of each step, summed as in getSoftCostMetrics().
+	float costs[4*steps];
+	for (size_t k=0; k<steps; k++) {
+		const uint32_t inSample = history[2*k+1] & mOMask;
+		for (uint32_t code=0; code<4; code++) {
+			const unsigned mismatched = inSample ^ code;
+			costs[4*k+code] = ((mismatched&0x01) ? mismatchCost[2*k+1] : matchCost[2*k+1])
+				+ (((mismatched>>1)&0x01) ? mismatchCost[2*k] : matchCost[2*k]);
+		}
+	}
+
+#ifdef HAVE_X86_VITERBI
+	if (kernel()==KernelAVX2) {
+		decodeAVX2(mBranchIndex,costs,steps,mDeferral,target);
+		return;
+	}
+	if (kernel()==KernelSSE41) {
+		decodeSSE41(mBranchIndex,costs,steps,mDeferral,target);
+		return;
+	}
+#endif
+	assert(0);
+}
+
+
+bool ViterbiR2O4::kernelSupported(Kernel kernel)
+{
+	switch (kernel) {
+		case KernelScalar:
+			return true;
+#ifdef HAVE_X86_VITERBI
+		case KernelSSE41:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.1");
+		case KernelAVX2:
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+
+static ViterbiR2O4::Kernel sViterbiKernel = ViterbiR2O4::KernelAuto;
+
+ViterbiR2O4::Kernel ViterbiR2O4::setKernel(Kernel kernel)
+{
+	if (kernel==KernelAuto || !kernelSupported(kernel)) {
+		if (kernelSupported(KernelAVX2)) kernel = KernelAVX2;
+		else if (kernelSupported(KernelSSE41)) kernel = KernelSSE41;
+		else kernel = KernelScalar;
+	}
+	sViterbiKernel = kernel;
+	return kernel;
+}
+
+
+ViterbiR2O4::Kernel ViterbiR2O4::kernel()
+{
+	if (sViterbiKernel==KernelAuto) return setKernel(KernelAuto);
+	return sViterbiKernel;
+}
+
+
+const char* ViterbiR2O4::kernelName(Kernel kernel)
+{
+	switch (kernel) {
+		case KernelScalar: return "scalar";
+		case KernelSSE41: return "sse4.1";
+		case KernelAVX2: return "avx2";
+		default: return "auto";
+	}
+}
+
+
 uint64_t Parity::syndrome(const BitVector& receivedCodeword)
 {
 	return receivedCodeword.syndrome(*this);
@@ -494,6 +820,11 @@ void SoftVector::decode(ViterbiR2O4 &decoder, BitVector& target) const
 		}
 	}
 
+	if (ViterbiR2O4::kernel()!=ViterbiR2O4::KernelScalar) {
+		decoder.decodeBlock(history,matchCostTable,mismatchCostTable,target.begin(),target.size());
+		return;
+	}
+
 	{
 		decoder.initializeStates();
 		// Each sample of history[] carries its history.
@@ -622,4 +953,198 @@ bool BitVector::unhex(const char* src)
 	return true;
 }
 
+
+
+
+
+
+PackedBitVector::PackedBitVector(size_t bits)
+	:mWords(NULL),mSize(0)
+{
+	resize(bits);
+}
+
+
+PackedBitVector::PackedBitVector(const PackedBitVector& other)
+	:mWords(NULL),mSize(0)
+{
+	*this = other;
+}
+
+
+PackedBitVector::PackedBitVector(const BitVector& source)
+	:mWords(NULL),mSize(0)
+{
+	resize(source.size());
+	size_t i = 0;
+	for (; i+64<=mSize; i+=64) {
+		uint64_t word = 0;
+		for (unsigned j=0; j<64; j++) word = (word<<1) | source.bit(i+j);
+		mWords[i/64] = word;
+	}
+	if (i<mSize) fillField(i,source.peekField(i,mSize-i),mSize-i);
+}
+
+
+PackedBitVector& PackedBitVector::operator=(const PackedBitVector& other)
+{
+	if (this==&other) return *this;
+	if (wordsFor(mSize)!=wordsFor(other.mSize)) {
+		delete[] mWords;
+		mWords = new uint64_t[wordsFor(other.mSize)];
+	}
+	mSize = other.mSize;
+	memcpy(mWords,other.mWords,wordsFor(mSize)*sizeof(uint64_t));
+	return *this;
+}
+
+
+void PackedBitVector::resize(size_t bits)
+{
+	delete[] mWords;
+	mSize = bits;
+	mWords = new uint64_t[wordsFor(bits)];
+	zero();
+}
+
+
+void PackedBitVector::zero()
+{
+	memset(mWords,0,wordsFor(mSize)*sizeof(uint64_t));
+}
+
+
+void PackedBitVector::trim()
+{
+	if (mSize%64) mWords[mSize/64] &= ~0ULL << (64 - mSize%64);
+}
+
+
+uint64_t PackedBitVector::peekField(size_t readIndex, unsigned length) const
+{
+	if (length==0) return 0;
+	assert(length<=64);
+	assert(readIndex+length<=mSize);
+	const size_t w = readIndex/64;
+	const unsigned offset = readIndex%64;
+	uint64_t window = mWords[w] << offset;
+	if (offset) window |= mWords[w+1] >> (64-offset);
+	return window >> (64-length);
+}
+
+
+uint64_t PackedBitVector::readField(size_t& readIndex, unsigned length) const
+{
+	const uint64_t retVal = peekField(readIndex,length);
+	readIndex += length;
+	return retVal;
+}
+
+
+void PackedBitVector::fillField(size_t writeIndex, uint64_t value, unsigned length)
+{
+	if (length==0) return;
+	assert(length<=64);
+	assert(writeIndex+length<=mSize);
+	const uint64_t mask = (length==64) ? ~0ULL : ((1ULL<<length)-1);
+	value &= mask;
+	const size_t w = writeIndex/64;
+	const unsigned end = writeIndex%64 + length;
+	if (end<=64) {
+		const unsigned shift = 64-end;
+		mWords[w] = (mWords[w] & ~(mask<<shift)) | (value<<shift);
+		return;
+	}
+	// The field spills the low end bits into the top of the next word.
+	const unsigned spill = end-64;
+	mWords[w] = (mWords[w] & ~(mask>>spill)) | (value>>spill);
+	const uint64_t low = (1ULL<<spill)-1;
+	mWords[w+1] = (mWords[w+1] & ~(low<<(64-spill))) | ((value&low)<<(64-spill));
+}
+
+
+void PackedBitVector::writeField(size_t& writeIndex, uint64_t value, unsigned length)
+{
+	fillField(writeIndex,value,length);
+	writeIndex += length;
+}
+
+
+void PackedBitVector::copyToSegment(PackedBitVector& other, size_t start) const
+{
+	assert(start+mSize<=other.mSize);
+	size_t i = 0;
+	for (; i+64<=mSize; i+=64) other.fillField(start+i,mWords[i/64],64);
+	if (i<mSize) other.fillField(start+i,peekField(i,mSize-i),mSize-i);
+}
+
+
+void PackedBitVector::segmentCopyTo(PackedBitVector& other, size_t start, size_t span) const
+{
+	assert(start+span<=mSize);
+	assert(span<=other.mSize);
+	size_t i = 0;
+	for (; i+64<=span; i+=64) other.mWords[i/64] = peekField(start+i,64);
+	if (i<span) other.fillField(i,peekField(start+i,span-i),span-i);
+}
+
+
+void PackedBitVector::operator^=(const PackedBitVector& other)
+{
+	assert(mSize==other.mSize);
+	const size_t words = wordsFor(mSize);
+	for (size_t i=0; i<words; i++) mWords[i] ^= other.mWords[i];
+}
+
+
+unsigned PackedBitVector::sum() const
+{
+	unsigned sum = 0;
+	const size_t words = wordsFor(mSize);
+	for (size_t i=0; i<words; i++) sum += __builtin_popcountll(mWords[i]);
+	return sum;
+}
+
+
+void PackedBitVector::unpackTo(BitVector& dest) const
+{
+	assert(dest.size()==mSize);
+	char *dp = dest.begin();
+	for (size_t i=0; i<mSize; i+=64) {
+		const uint64_t word = mWords[i/64];
+		const unsigned bits = (mSize-i<64) ? mSize-i : 64;
+		for (unsigned j=0; j<bits; j++) *dp++ = (word >> (63-j)) & 0x01;
+	}
+}
+
+
+void PackedBitVector::pack(unsigned char* targ) const
+{
+	const size_t bytes = (mSize+7)/8;
+	for (size_t i=0; i<bytes; i++) {
+		targ[i] = mWords[i/8] >> (56 - 8*(i%8));
+	}
+}
+
+
+void PackedBitVector::unpack(const unsigned char* src)
+{
+	const size_t bytes = (mSize+7)/8;
+	memset(mWords,0,wordsFor(mSize)*sizeof(uint64_t));
+	for (size_t i=0; i<bytes; i++) {
+		mWords[i/8] |= (uint64_t)src[i] << (56 - 8*(i%8));
+	}
+	trim();
+}
+
+
+ostream& operator<<(ostream& os, const PackedBitVector& pv)
+{
+	for (size_t i=0; i<pv.size(); i++) {
+		if (pv.bit(i)) os << '1';
+		else os << '0';
+	}
+	return os;
+}
+
 // vim: ts=4 sw=4
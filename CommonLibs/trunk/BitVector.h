@@ -45,13 +45,37 @@ class Generator {
 	uint64_t mMask;		///< mask for reading state
 	unsigned mLen;		///< number of bits used in shift register
 	unsigned mLen_1;	///< mLen - 1
+	const uint64_t *mTable;	///< x^mLen times each byte, modulo the polynomial, or NULL until needed
+
+	/** Get the table for a polynomial, shared by all generators that use it. */
+	static const uint64_t *sharedTable(uint64_t wCoeff, unsigned wLen);
+
+	/** Pack 8 char-per-bit values, first bit MSB. */
+	static unsigned packByte(const char *bits)
+	{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+		// gather the low bit of each char into the top byte, first char highest
+		uint64_t word;
+		memcpy(&word,bits,8);
+		return ((word & 0x0101010101010101ULL) * 0x8040201008040201ULL) >> 56;
+#else
+		unsigned byte = 0;
+		for (unsigned i=0; i<8; i++) byte = (byte<<1) | (bits[i] & 0x01);
+		return byte;
+#endif
+	}
+
+	/** Reduce a state that has grown by 8 bits. */
+	uint64_t reduce(uint64_t wide) const
+		{ return (wide & mMask) ^ mTable[(wide>>mLen) & 0x0ff]; }
 
 	public:
 
 	Generator(uint64_t wCoeff, unsigned wLen)
 		:mCoeff(wCoeff),mState(0),
 		mMask((1ULL<<wLen)-1),
-		mLen(wLen),mLen_1(wLen-1)
+		mLen(wLen),mLen_1(wLen-1),
+		mTable(NULL)
 	{ assert(wLen<64); }
 
 	void clear() { mState=0; }
@@ -84,6 +108,18 @@ class Generator {
 		if (fb) mState ^= mCoeff;
 	}
 
+	/**
+		Syndrome of a char-per-bit sequence, 8 bits per table lookup.
+		Same result as clear() followed by syndromeShift() of each bit.
+	*/
+	uint64_t syndromeBits(const char *bits, size_t len);
+
+	/**
+		Parity word of a char-per-bit sequence, 8 bits per table lookup.
+		Same result as clear() followed by encoderShift() of each bit.
+	*/
+	uint64_t parityBits(const char *bits, size_t len);
+
 
 };
 
@@ -144,10 +180,19 @@ class ViterbiR2O4 {
 		uint32_t mCoeffs[mIRate];					///< polynomial for each generator
 		uint32_t mStateTable[mIRate][2*mIStates];	///< precomputed generator output tables
 		uint32_t mGeneratorTable[2*mIStates];		///< precomputed coder output table
+		uint8_t mBranchIndex[2][2][2*mIStates];	///< byte shuffles from output code to branch metric, by input bit and state half
 		//@}
 	
 	public:
 
+		/** Add-compare-select implementations used by SoftVector::decode(). */
+		enum Kernel {
+			KernelScalar = 0,	///< float metrics through step()
+			KernelSSE41 = 1,	///< the same float metrics four states at a time with SSE4.1
+			KernelAVX2 = 2,		///< as KernelSSE41, eight states at a time with AVX2
+			KernelAuto = 255	///< best kernel supported by this CPU
+		};
+
 		/**
 		  A candidate sequence in a Viterbi decoder.
 		  The 32-bit state register can support a deferral of 6 with a 4th-order coder.
@@ -194,6 +239,34 @@ class ViterbiR2O4 {
 		*/
 		const vCand& step(uint32_t inSample, const float *probs, const float *iprobs);
 
+		/**
+			Decode a block on the SIMD trellis, with the same decisions as step().
+			Arguments are laid out as in the step() loop of SoftVector::decode().
+			@param history Coded bit history, one entry per coded bit.
+			@param matchCost Cost of each coded bit matching its hard decision.
+			@param mismatchCost Cost of each coded bit not matching.
+			@param target Output, one bit per step after the first deferral() steps.
+			@param targetSize Number of output bits.
+		*/
+		void decodeBlock(const uint32_t *history, const float *matchCost, const float *mismatchCost,
+			char *target, size_t targetSize) const;
+
+		/**
+			Select the kernel for all decoders.
+			Unsupported requests fall back to the best supported kernel.
+			@return The kernel actually selected.
+		*/
+		static Kernel setKernel(Kernel kernel);
+
+		/** Return the currently selected kernel. */
+		static Kernel kernel();
+
+		/** Return true if the CPU and build can run the given kernel. */
+		static bool kernelSupported(Kernel kernel);
+
+		/** Return a printable name for a kernel. */
+		static const char* kernelName(Kernel kernel);
+
 	private:
 
 		/** Branch survivors into new candidates. */
@@ -220,6 +293,12 @@ class ViterbiR2O4 {
 		*/
 		void computeGeneratorTable();
 
+		/**
+			Precompute the branch metric shuffles for decodeBlock().
+			mGeneratorTable must be defined first.
+		*/
+		void computeBranchIndex();
+
 };
 
 
@@ -368,6 +447,99 @@ std::ostream& operator<<(std::ostream&, const BitVector&);
 
 
 
+/**
+	A bit vector packed 64 bits to a word.
+	Bit 0 is the MSB of the first word, so the vector reads as one big-endian
+	bit stream and the fields match those of BitVector.  Field, copy, XOR and
+	pack operations work on whole words.  Bits past size() are kept zero.
+*/
+class PackedBitVector {
+
+	private:
+
+	uint64_t *mWords;	///< the bits, plus one zero word so a field read never needs a bounds check
+	size_t mSize;		///< number of bits
+
+	static size_t wordsFor(size_t bits) { return (bits+63)/64 + 1; }
+
+	/** Clear the bits of the last word past size(). */
+	void trim();
+
+	public:
+
+	/**@name Constructors. */
+	//@{
+	PackedBitVector(size_t bits=0);
+	PackedBitVector(const PackedBitVector& other);
+	/** Pack a char-per-bit BitVector. */
+	PackedBitVector(const BitVector& source);
+	~PackedBitVector() { delete[] mWords; }
+	//@}
+
+	PackedBitVector& operator=(const PackedBitVector& other);
+
+	size_t size() const { return mSize; }
+
+	/** Resize, zeroing the contents. */
+	void resize(size_t bits);
+
+	void zero();
+
+	/** Index a single bit. */
+	bool bit(size_t index) const
+	{
+		assert(index<mSize);
+		return (mWords[index/64] >> (63 - index%64)) & 0x01;
+	}
+
+	/** Set a single bit. */
+	void settfb(size_t index, int value)
+	{
+		assert(index<mSize);
+		const uint64_t mask = 1ULL << (63 - index%64);
+		if (value & 0x01) mWords[index/64] |= mask;
+		else mWords[index/64] &= ~mask;
+	}
+
+	/**@name Serialization and deserialization, MSB first as in BitVector. */
+	//@{
+	uint64_t peekField(size_t readIndex, unsigned length) const;
+	uint64_t readField(size_t& readIndex, unsigned length) const;
+	void fillField(size_t writeIndex, uint64_t value, unsigned length);
+	void writeField(size_t& writeIndex, uint64_t value, unsigned length);
+	//@}
+
+	/**@name Copies between packed vectors. */
+	//@{
+	/** Copy this vector into other, starting at the given bit. */
+	void copyToSegment(PackedBitVector& other, size_t start=0) const;
+	/** Copy span bits starting at the given bit into other. */
+	void segmentCopyTo(PackedBitVector& other, size_t start, size_t span) const;
+	//@}
+
+	/** XOR with another vector of the same size, as for A5 ciphering. */
+	void operator^=(const PackedBitVector& other);
+
+	/** Sum of bits. */
+	unsigned sum() const;
+
+	/**@name Conversion to and from char-per-bit and byte arrays. */
+	//@{
+	/** Unpack into a BitVector of the same size. */
+	void unpackTo(BitVector& dest) const;
+	/** Pack into a char array, as BitVector::pack(). */
+	void pack(unsigned char*) const;
+	/** Unpack from a char array, as BitVector::unpack(). */
+	void unpack(const unsigned char*);
+	//@}
+};
+
+
+std::ostream& operator<<(std::ostream&, const PackedBitVector&);
+
+
+
+
 
 
 /**
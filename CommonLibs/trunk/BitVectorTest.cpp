@@ -27,12 +27,216 @@
 
 
 #include "BitVector.h"
+#include "Timeval.h"
 #include <iostream>
 #include <cstdlib>
+#include <string.h>
  
 using namespace std;
 
 
+/**
+	Check PackedBitVector against BitVector and time field access on both.
+	@return false if they disagree anywhere.
+*/
+bool packedEquivalence()
+{
+	srandom(3);
+	unsigned mismatches = 0;
+	for (unsigned n=0; n<200; n++) {
+		BitVector v(1+random()%600);
+		for (unsigned i=0; i<v.size(); i++) v[i] = random() & 0x01;
+		PackedBitVector p(v);
+		BitVector back(v.size());
+		p.unpackTo(back);
+		for (unsigned i=0; i<v.size(); i++) mismatches += back.bit(i)!=v.bit(i);
+		if (p.sum()!=v.sum()) mismatches++;
+
+		for (unsigned k=0; k<50; k++) {
+			unsigned length = random()%65;
+			if (length>v.size()) length = v.size();
+			size_t index = random()%(v.size()-length+1);
+			if (p.peekField(index,length)!=v.peekField(index,length)) mismatches++;
+			uint64_t value = ((uint64_t)random()<<32) ^ random();
+			v.fillField(index,value,length);
+			p.fillField(index,value,length);
+		}
+		p.unpackTo(back);
+		for (unsigned i=0; i<v.size(); i++) mismatches += back.bit(i)!=v.bit(i);
+
+		unsigned char bytes[80], pbytes[80];
+		v.pack(bytes);
+		p.pack(pbytes);
+		mismatches += memcmp(bytes,pbytes,(v.size()+7)/8)!=0;
+		PackedBitVector q(v.size());
+		q.unpack(bytes);
+		for (unsigned i=0; i<v.size(); i++) mismatches += q.bit(i)!=v.bit(i);
+
+		// keystream XOR and segment copies
+		PackedBitVector ks(v.size());
+		for (unsigned i=0; i<v.size(); i++) ks.settfb(i,random());
+		q ^= ks;
+		for (unsigned i=0; i<v.size(); i++) mismatches += q.bit(i)!=(v.bit(i)^ks.bit(i));
+		size_t start = random()%v.size();
+		size_t span = random()%(v.size()-start+1);
+		PackedBitVector seg(span);
+		p.segmentCopyTo(seg,start,span);
+		PackedBitVector whole(v.size()+7);
+		seg.copyToSegment(whole,7);
+		for (unsigned i=0; i<span; i++) mismatches += whole.bit(7+i)!=v.bit(start+i);
+	}
+
+	const unsigned rounds = 100000;
+	BitVector v(456);
+	PackedBitVector p(456);
+	uint64_t check = 0;
+	Timeval start;
+	for (unsigned n=0; n<rounds; n++) {
+		for (unsigned i=0; i+57<=456; i+=57) v.fillField(i,n*i,57);
+		for (unsigned i=0; i+57<=456; i+=57) check += v.peekField(i,57);
+	}
+	long bytewise = start.elapsed();
+	start = Timeval();
+	for (unsigned n=0; n<rounds; n++) {
+		for (unsigned i=0; i+57<=456; i+=57) p.fillField(i,n*i,57);
+		for (unsigned i=0; i+57<=456; i+=57) check -= p.peekField(i,57);
+	}
+	long packed = start.elapsed();
+	cout << "packed: " << mismatches << " mismatches, " << (check ? "bad" : "ok")
+		<< " timing check, 57-bit fields BitVector " << bytewise << " ms, packed " << packed << " ms" << endl;
+	return mismatches==0 && check==0;
+}
+
+
+/**
+	Compare the table-driven parity and syndrome with the bitwise shifts for the GSM codes.
+	@return false if they disagree for any code.
+*/
+bool parityEquivalence()
+{
+	struct { const char *name; uint64_t coeff; unsigned len; unsigned blockSize; } codes[] = {
+		{ "fire", 0x10004820009ULL, 40, 224 },
+		{ "tch", 0x0b, 3, 50 },
+		{ "sch", 0x0575, 10, 25 },
+		{ "rach", 0x06f, 6, 8 },
+		{ "cs4", (1<<16) + (1<<12) + (1<<5) + 1, 16, 431+16 },
+	};
+	srandom(2);
+	bool ok = true;
+	for (unsigned c=0; c<sizeof(codes)/sizeof(codes[0]); c++) {
+		Generator gen(codes[c].coeff,codes[c].len);
+		unsigned mismatches = 0;
+		for (unsigned n=0; n<1000; n++) {
+			BitVector v(n<500 ? n : codes[c].blockSize);
+			for (unsigned i=0; i<v.size(); i++) v[i] = random() & 0x01;
+			gen.clear();
+			for (unsigned i=0; i<v.size(); i++) gen.syndromeShift(v.bit(i));
+			if (gen.state() != v.syndrome(gen)) mismatches++;
+			gen.clear();
+			for (unsigned i=0; i<v.size(); i++) gen.encoderShift(v.bit(i));
+			if (gen.state() != v.parity(gen)) mismatches++;
+		}
+
+		const unsigned blocks = 100000;
+		BitVector v(codes[c].blockSize);
+		for (unsigned i=0; i<v.size(); i++) v[i] = random() & 0x01;
+		uint64_t check = 0;
+		Timeval start;
+		for (unsigned n=0; n<blocks; n++) {
+			gen.clear();
+			for (unsigned i=0; i<v.size(); i++) gen.encoderShift(v.bit(i));
+			check += gen.state();
+		}
+		long bitwise = start.elapsed();
+		start = Timeval();
+		for (unsigned n=0; n<blocks; n++) check -= v.parity(gen);
+		long table = start.elapsed();
+		cout << "parity " << codes[c].name << ": " << mismatches << " mismatches, "
+			<< (check ? "bad" : "ok") << " timing check, bitwise "
+			<< bitwise << " ms, table " << table << " ms for " << blocks << " blocks" << endl;
+		if (mismatches || check) ok = false;
+	}
+	return ok;
+}
+
+
+/**
+	Decode XCCH-sized blocks with each Viterbi kernel; report errors and speed.
+	@return false if a SIMD kernel disagrees with the scalar decoder on noiseless
+		blocks, or makes more bit errors than it on noisy ones.
+*/
+bool viterbiBenchmark()
+{
+	const unsigned blocks = 2000;
+	const unsigned uSize = 228;
+	ViterbiR2O4 vCoder;
+	BitVector u(uSize), c(2*uSize);
+	SoftVector *clean[blocks];
+	SoftVector *received[blocks];
+	BitVector *sent[blocks];
+	srandom(1);
+	for (unsigned n=0; n<blocks; n++) {
+		for (unsigned i=0; i<uSize-4; i++) u[i] = random() & 0x01;
+		u.fill(0,uSize-4,4);
+		u.encode(vCoder,c);
+		sent[n] = new BitVector(uSize);
+		sent[n]->clone(u);
+		clean[n] = new SoftVector(c);
+		received[n] = new SoftVector(c);
+		// soft bits with enough noise to cross the slicer now and then
+		for (unsigned i=0; i<c.size(); i++) {
+			float noise = (random()%1000)/1800.0F;
+			(*received[n])[i] = c.bit(i) ? 1.0F-noise : noise;
+		}
+	}
+
+	bool ok = true;
+	BitVector scalarClean[blocks];
+	BitVector scalarDecoded[blocks];
+	unsigned scalarErrors = 0;
+	const ViterbiR2O4::Kernel kernels[] = { ViterbiR2O4::KernelScalar, ViterbiR2O4::KernelSSE41, ViterbiR2O4::KernelAVX2 };
+	for (unsigned k=0; k<3; k++) {
+		if (!ViterbiR2O4::kernelSupported(kernels[k])) continue;
+		ViterbiR2O4::setKernel(kernels[k]);
+		const bool scalar = kernels[k]==ViterbiR2O4::KernelScalar;
+		BitVector v(uSize);
+
+		unsigned cleanDifferences = 0;
+		for (unsigned n=0; n<blocks; n++) {
+			clean[n]->decode(vCoder,v);
+			if (scalar) scalarClean[n].clone(v);
+			else for (unsigned i=0; i<uSize; i++) cleanDifferences += v.bit(i) != scalarClean[n].bit(i);
+		}
+
+		unsigned errors = 0, differences = 0;
+		Timeval start;
+		for (unsigned n=0; n<blocks; n++) {
+			received[n]->decode(vCoder,v);
+			for (unsigned i=0; i<uSize; i++) errors += v.bit(i) != sent[n]->bit(i);
+			if (scalar) scalarDecoded[n].clone(v);
+			else for (unsigned i=0; i<uSize; i++) differences += v.bit(i) != scalarDecoded[n].bit(i);
+		}
+		long elapsed = start.elapsed();
+		if (scalar) scalarErrors = errors;
+		cout << "viterbi " << ViterbiR2O4::kernelName(kernels[k]) << ": " << errors << " bit errors, "
+			<< differences << " differ from scalar, " << cleanDifferences << " differ without noise, "
+			<< (elapsed ? 1000*blocks/elapsed : 0) << " blocks/sec" << endl;
+		if (cleanDifferences || errors>scalarErrors) {
+			cout << "viterbi " << ViterbiR2O4::kernelName(kernels[k]) << ": FAILED" << endl;
+			ok = false;
+		}
+	}
+	ViterbiR2O4::setKernel(ViterbiR2O4::KernelAuto);
+
+	for (unsigned n=0; n<blocks; n++) {
+		delete sent[n];
+		delete clean[n];
+		delete received[n];
+	}
+	return ok;
+}
+
+
 int main(int argc, char *argv[])
 {
 	BitVector v1("0000111100111100101011110000");
@@ -85,4 +289,8 @@ int main(int argc, char *argv[])
 	cout << "tp=" << tp << endl;
 	tp.pack(ts);
 	cout << "ts=" << ts << endl;
+
+	if (!packedEquivalence()) return 1;
+	if (!parityEquivalence()) return 1;
+	if (!viterbiBenchmark()) return 1;
 }
@@ -49,15 +49,23 @@ static const char* createConfigTable = {
 
 
 
-float ConfigurationRecord::floatNumber() const
+/** Seconds between checks for changes made to the database by other processes. */
+static const time_t sRefreshPeriod = 3;
+
+/** Seconds a replaced snapshot is kept for readers that may still be using it. */
+static const time_t sGracePeriod = 60;
+
+
+float ConfigurationRecord::parseFloat(const char* wValue)
 {
-	float val;
-	sscanf(mValue.c_str(),"%f",&val);
+	float val = 0.0F;
+	sscanf(wValue,"%f",&val);
 	return val;
 }
 
 
 ConfigurationTable::ConfigurationTable(const char* filename, const char *wCmdName, ConfigurationKeyMap wSchema)
+	:mDB(NULL),mSnapshot(NULL),mPurged(false),mRefresher(NULL)
 {
 	gLogEarly(LOG_INFO, "opening configuration table from path %s", filename);
 	// Connect to the database.
@@ -70,7 +78,7 @@ ConfigurationTable::ConfigurationTable(const char* filename, const char *wCmdNam
 	}
 	if (rc) {
 		gLogEarly(LOG_EMERG, "cannot open configuration database at %s, error message: %s", filename, sqlite3_errmsg(mDB));
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return;
 	}
@@ -144,6 +152,10 @@ ConfigurationTable::ConfigurationTable(const char* filename, const char *wCmdNam
 
 	// Init the cross checking callback to something predictable
 	mCrossCheck = NULL;
+
+	// Load the first snapshot.
+	ScopedLock lock(mLock);
+	publish(load());
 }
 
 string ConfigurationTable::getDefaultSQL(const std::string& program, const std::string& version)
@@ -276,7 +288,6 @@ string ConfigurationTable::getTeX(const std::string& program, const std::string&
 bool ConfigurationTable::defines(const string& key)
 {
 	try {
-		ScopedLock lock(mLock);
 		return lookup(key).defined();
 	} catch (ConfigurationTableKeyNotFound) {
 		// TODO: re-enable once we figure out why this message is being sent to syslog regardless of log level
@@ -533,40 +544,109 @@ ConfigurationKeyMap ConfigurationTable::getSimilarKeys(const std::string& snippe
 const ConfigurationRecord& ConfigurationTable::lookup(const string& key)
 {
 	assert(mDB);
-	checkCacheAge();
-	// We assume the caller holds mLock.
-	// So it is OK to return a reference into the cache.
-
-	// Check the cache.
-	// This is cheap.
-	ConfigurationMap::const_iterator where = mCache.find(key);
-	if (where!=mCache.end()) {
-		if (where->second.defined()) return where->second;
-		throw ConfigurationTableKeyNotFound(key);
+	// No lock: the snapshot is never modified and outlives this call.
+	const ConfigurationSnapshot* snap = snapshot();
+	ConfigurationMap::const_iterator where = snap->mRecords.find(key);
+	if (where==snap->mRecords.end()) throw ConfigurationTableKeyNotFound(key);
+	return where->second;
+}
+
+
+const ConfigurationSnapshot* ConfigurationTable::snapshot()
+{
+	ConfigurationSnapshot* snap = __atomic_load_n(&mSnapshot,__ATOMIC_ACQUIRE);
+	if (!mPurged && time(NULL) - snap->mChecked < sRefreshPeriod) return snap;
+
+	// Due for a check.  Whoever holds the lock is already checking or
+	// changing the table, so don't wait for them.
+	if (!mLock.trylock()) return snap;
+	if (mPurged || time(NULL) - mSnapshot->mChecked >= sRefreshPeriod) refresh(false);
+	snap = mSnapshot;
+	mLock.unlock();
+	return snap;
+}
+
+
+void ConfigurationTable::refresh(bool force)
+{
+	// Caller holds mLock.
+	bool purged = __atomic_exchange_n(&mPurged,false,__ATOMIC_ACQ_REL);
+	if (!force && !purged && mSnapshot) {
+		// data_version changes only when another connection writes the database.
+		int version = dataVersion();
+		if (version>=0 && version==mSnapshot->mDataVersion) {
+			mSnapshot->mChecked = time(NULL);
+			return;
+		}
 	}
+	publish(load());
+}
 
-	// Check the database.
-	// This is more expensive.
-	char *value = NULL;
-	sqlite3_single_lookup(mDB,"CONFIG",
-			"KEYSTRING",key.c_str(),"VALUESTRING",value);
-
-	// value found, cache the result
-	if (value) {
-		mCache[key] = ConfigurationRecord(value);
-	// key definition found, cache the default
-	} else if (keyDefinedInSchema(key)) {
-		mCache[key] = ConfigurationRecord(mSchema[key].getDefaultValue());
-	// total miss, cache the error
-	} else {
-		mCache[key] = ConfigurationRecord(false);
-		throw ConfigurationTableKeyNotFound(key);
+
+int ConfigurationTable::dataVersion()
+{
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(mDB,&stmt,"PRAGMA data_version")) return -1;
+	int version = -1;
+	if (sqlite3_run_query(mDB,stmt)==SQLITE_ROW) version = sqlite3_column_int(stmt,0);
+	sqlite3_finalize(stmt);
+	return version;
+}
+
+
+ConfigurationSnapshot* ConfigurationTable::load()
+{
+	// Caller holds mLock.
+	ConfigurationSnapshot* snap = new ConfigurationSnapshot;
+	snap->mDataVersion = -1;
+	snap->mRetired = 0;
+
+	// Schema defaults, then the database values over them.
+	for (ConfigurationKeyMap::const_iterator mp = mSchema.begin(); mp != mSchema.end(); mp++) {
+		snap->mRecords[mp->first] = ConfigurationRecord(mp->second.getDefaultValue());
+	}
+	if (mDB) {
+		sqlite3_stmt *stmt;
+		if (!sqlite3_prepare_statement(mDB,&stmt,"SELECT KEYSTRING,VALUESTRING FROM CONFIG")) {
+			int src = sqlite3_run_query(mDB,stmt);
+			while (src==SQLITE_ROW) {
+				const char* key = (const char*)sqlite3_column_text(stmt,0);
+				const char* value = (const char*)sqlite3_column_text(stmt,1);
+				if (key && value) snap->mRecords[key] = ConfigurationRecord(value);
+				src = sqlite3_run_query(mDB,stmt);
+			}
+			sqlite3_finalize(stmt);
+		}
+		snap->mDataVersion = dataVersion();
 	}
+	snap->mChecked = time(NULL);
+	return snap;
+}
 
-	free(value);
 
-	// Leave mLock locked.  The caller holds it still.
-	return mCache[key];
+void ConfigurationTable::publish(ConfigurationSnapshot* snap)
+{
+	// Caller holds mLock.
+	ConfigurationSnapshot* old = mSnapshot;
+	__atomic_store_n(&mSnapshot,snap,__ATOMIC_RELEASE);
+
+	for (ConfigurationHandleMap::iterator mp = mHandles.begin(); mp != mHandles.end(); mp++) {
+		ConfigurationMap::const_iterator where = snap->mRecords.find(mp->first);
+		const ConfigurationRecord* rec = (where==snap->mRecords.end()) ? NULL : &where->second;
+		__atomic_store_n(&mp->second->mRecord,rec,__ATOMIC_RELEASE);
+	}
+
+	// Readers hold a snapshot only for the length of a lookup,
+	// so anything retired a grace period ago is unused.
+	time_t now = time(NULL);
+	if (old) {
+		old->mRetired = now;
+		mRetired.push_back(old);
+	}
+	while (!mRetired.empty() && now - mRetired.front()->mRetired >= sGracePeriod) {
+		delete mRetired.front();
+		mRetired.pop_front();
+	}
 }
 
 
@@ -581,13 +661,51 @@ bool ConfigurationTable::isStatic(const string& key)
 }
 
 
+const ConfigurationHandle& ConfigurationTable::handle(const string& key)
+{
+	ScopedLock lock(mLock);
+	ConfigurationHandleMap::iterator where = mHandles.find(key);
+	if (where!=mHandles.end()) return *where->second;
+
+	ConfigurationHandle* hdl = new ConfigurationHandle(key);
+	if (mSnapshot) {
+		ConfigurationMap::const_iterator rec = mSnapshot->mRecords.find(key);
+		if (rec!=mSnapshot->mRecords.end()) hdl->mRecord = &rec->second;
+	}
+	mHandles[key] = hdl;
+
+	// Handle reads never check the snapshot age, so something else must.
+	if (!mRefresher) {
+		mRefresher = new Thread;
+		mRefresher->start((void*(*)(void*))configurationRefresher,this);
+	}
+	return *hdl;
+}
+
+
+void ConfigurationTable::refreshLoop()
+{
+	while (true) {
+		sleep(sRefreshPeriod);
+		ScopedLock lock(mLock);
+		refresh(false);
+	}
+}
+
+
+void* configurationRefresher(void* arg)
+{
+	ConfigurationTable* table = (ConfigurationTable*)arg;
+	table->refreshLoop();
+	return NULL;
+}
+
+
 
 
 string ConfigurationTable::getStr(const string& key)
 {
-	// We need the lock because rec is a reference into the cache.
 	try {
-		ScopedLock lock(mLock);
 		return lookup(key).value();
 	} catch (ConfigurationTableKeyNotFound) {
 		// Raise an alert and re-throw the exception.
@@ -611,9 +729,7 @@ bool ConfigurationTable::getBool(const string& key)
 
 long ConfigurationTable::getNum(const string& key)
 {
-	// We need the lock because rec is a reference into the cache.
 	try {
-		ScopedLock lock(mLock);
 		return lookup(key).number();
 	} catch (ConfigurationTableKeyNotFound) {
 		// Raise an alert and re-throw the exception.
@@ -626,7 +742,6 @@ long ConfigurationTable::getNum(const string& key)
 float ConfigurationTable::getFloat(const string& key)
 {
 	try {
-		ScopedLock lock(mLock);
 		return lookup(key).floatNumber();
 	} catch (ConfigurationTableKeyNotFound) {
 		// Raise an alert and re-throw the exception.
@@ -640,7 +755,6 @@ std::vector<string> ConfigurationTable::getVectorOfStrings(const string& key)
 	// Look up the string.
 	char *line=NULL;
 	try {
-		ScopedLock lock(mLock);
 		const ConfigurationRecord& rec = lookup(key);
 		line = strdup(rec.value().c_str());
 	} catch (ConfigurationTableKeyNotFound) {
@@ -671,7 +785,6 @@ std::vector<unsigned> ConfigurationTable::getVector(const string& key)
 	// Look up the string.
 	char *line=NULL;
 	try {
-		ScopedLock lock(mLock);
 		const ConfigurationRecord& rec = lookup(key);
 		line = strdup(rec.value().c_str());
 	} catch (ConfigurationTableKeyNotFound) {
@@ -702,12 +815,15 @@ bool ConfigurationTable::remove(const string& key)
 	assert(mDB);
 
 	ScopedLock lock(mLock);
-	// Clear the cache entry and the database.
-	ConfigurationMap::iterator where = mCache.find(key);
-	if (where!=mCache.end()) mCache.erase(where);
 	// Really remove it.
-	string cmd = "DELETE FROM CONFIG WHERE KEYSTRING=='"+key+"'";
-	return sqlite3_command(mDB,cmd.c_str());
+	SQLiteQuery q(mDB,"DELETE FROM CONFIG WHERE KEYSTRING==?1");
+	if (!q.bind(key).run()) return false;
+	// Publish a snapshot without it, falling back to the default if there is one.
+	ConfigurationSnapshot* snap = new ConfigurationSnapshot(*mSnapshot);
+	if (keyDefinedInSchema(key)) snap->mRecords[key] = ConfigurationRecord(mSchema[key].getDefaultValue());
+	else snap->mRecords.erase(key);
+	publish(snap);
+	return true;
 }
 
 
@@ -715,11 +831,11 @@ bool ConfigurationTable::remove(const string& key)
 void ConfigurationTable::find(const string& pat, ostream& os) const
 {
 	// Prepare the statement.
-	string cmd = "SELECT KEYSTRING,VALUESTRING FROM CONFIG WHERE KEYSTRING LIKE \"%" + pat + "%\"";
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(mDB,&stmt,cmd.c_str())) return;
+	SQLiteQuery q(mDB,"SELECT KEYSTRING,VALUESTRING FROM CONFIG WHERE KEYSTRING LIKE '%' || ?1 || '%'");
+	if (!q.valid()) return;
+	sqlite3_stmt *stmt = q.stmt();
 	// Read the result.
-	int src = sqlite3_run_query(mDB,stmt);
+	int src = q.bind(pat).step();
 	while (src==SQLITE_ROW) {
 		const char* value = (const char*)sqlite3_column_text(stmt,1);
 		os << sqlite3_column_text(stmt,0) << " ";
@@ -729,9 +845,8 @@ void ConfigurationTable::find(const string& pat, ostream& os) const
 		}
 		if (len && value) os << value << endl;
 		else os << "(disabled)" << endl;
-		src = sqlite3_run_query(mDB,stmt);
+		src = q.step();
 	}
-	sqlite3_finalize(stmt);
 }
 
 
@@ -764,16 +879,20 @@ bool ConfigurationTable::set(const string& key, const string& value)
 {
 	assert(mDB);
 	ScopedLock lock(mLock);
-	string cmd;
+	bool success;
 	if (keyDefinedInSchema(key)) {
-		cmd = "INSERT OR REPLACE INTO CONFIG (KEYSTRING,VALUESTRING,OPTIONAL,COMMENTS) VALUES (\"" + key + "\",\"" + value + "\",1,\'" + mSchema[key].getDescription() + "\')";
+		SQLiteQuery q(mDB,"INSERT OR REPLACE INTO CONFIG (KEYSTRING,VALUESTRING,OPTIONAL,COMMENTS) VALUES (?1,?2,1,?3)");
+		success = q.bind(key).bind(value).bind(mSchema[key].getDescription()).run();
 	} else {
-		cmd = "INSERT OR REPLACE INTO CONFIG (KEYSTRING,VALUESTRING,OPTIONAL) VALUES (\"" + key + "\",\"" + value + "\",1)";
+		SQLiteQuery q(mDB,"INSERT OR REPLACE INTO CONFIG (KEYSTRING,VALUESTRING,OPTIONAL) VALUES (?1,?2,1)");
+		success = q.bind(key).bind(value).run();
+	}
+	// Publish a snapshot with the new value.
+	if (success) {
+		ConfigurationSnapshot* snap = new ConfigurationSnapshot(*mSnapshot);
+		snap->mRecords[key] = ConfigurationRecord(value);
+		publish(snap);
 	}
-	
-	bool success = sqlite3_command(mDB,cmd.c_str());
-	// Cache the result.
-	if (success) mCache[key] = ConfigurationRecord(value);
 	return success;
 }
 
@@ -786,32 +905,16 @@ bool ConfigurationTable::set(const string& key, long value)
 
 void ConfigurationTable::checkCacheAge()
 {
-	// mLock is set by caller 
-	static time_t timeOfLastPurge = 0;
-	time_t now = time(NULL);
-	// purge every 3 seconds
-	// purge period cannot be configuration parameter
-	if (now - timeOfLastPurge < 3) return;
-	timeOfLastPurge = now;
-	// this is purge() without the lock
-	ConfigurationMap::iterator mp = mCache.begin();
-	while (mp != mCache.end()) {
-		ConfigurationMap::iterator prev = mp;
-		mp++;
-		mCache.erase(prev);
-	}
+	ScopedLock lock(mLock);
+	if (!mSnapshot || mPurged || time(NULL) - mSnapshot->mChecked >= sRefreshPeriod) refresh(false);
 }
 
 
 void ConfigurationTable::purge()
 {
-	ScopedLock lock(mLock);
-	ConfigurationMap::iterator mp = mCache.begin();
-	while (mp != mCache.end()) {
-		ConfigurationMap::iterator prev = mp;
-		mp++;
-		mCache.erase(prev);
-	}
+	// This may be called from inside an sqlite3 update hook,
+	// where the database cannot be used, so only flag the reload.
+	__atomic_store_n(&mPurged,true,__ATOMIC_RELEASE);
 }
 
 
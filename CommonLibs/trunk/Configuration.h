@@ -38,6 +38,7 @@
 #include <regex.h>
 
 #include <map>
+#include <list>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -75,23 +76,30 @@ class ConfigurationRecord {
 
 	std::string mValue;
 	long mNumber;
+	float mFloat;
 	bool mDefined;
 
+	static float parseFloat(const char* wValue);
+
 	public:
 
 	ConfigurationRecord(bool wDefined=true):
+		mNumber(0),
+		mFloat(0.0F),
 		mDefined(wDefined)
 	{ }
 
 	ConfigurationRecord(const std::string& wValue):
 		mValue(wValue),
 		mNumber(strtol(wValue.c_str(),NULL,0)),
+		mFloat(parseFloat(wValue.c_str())),
 		mDefined(true)
 	{ }
 
 	ConfigurationRecord(const char* wValue):
 		mValue(std::string(wValue)),
 		mNumber(strtol(wValue,NULL,0)),
+		mFloat(parseFloat(wValue)),
 		mDefined(true)
 	{ }
 
@@ -100,7 +108,7 @@ class ConfigurationRecord {
 	long number() const { return mNumber; }
 	bool defined() const { return mDefined; }
 
-	float floatNumber() const;
+	float floatNumber() const { return mFloat; }
 
 };
 
@@ -175,18 +183,95 @@ class ConfigurationKey;
 typedef std::map<std::string, ConfigurationKey> ConfigurationKeyMap;
 ConfigurationKeyMap getConfigurationKeys();
 
+
+/**
+	An immutable copy of every defined configuration value:
+	the schema defaults overlaid with the database.
+*/
+class ConfigurationSnapshot {
+
+	public:
+
+	ConfigurationMap mRecords;	///< defined values only
+	int mDataVersion;			///< sqlite data_version when built, -1 if unknown
+	volatile time_t mChecked;	///< last time the database was checked for changes
+	time_t mRetired;			///< time this snapshot was replaced
+};
+
+
+/**
+	A pre-resolved handle on one configuration key, for hot paths.
+	Reading it is a single pointer load into the current snapshot;
+	the table repoints its handles whenever it publishes a new snapshot.
+	Obtain one with ConfigurationTable::handle(); it lives as long as the table.
+*/
+class ConfigurationHandle {
+
+	private:
+
+	friend class ConfigurationTable;
+
+	const std::string mKey;
+	const ConfigurationRecord* volatile mRecord;	///< record in the current snapshot, NULL if undefined
+
+	ConfigurationHandle(const std::string& wKey)
+		:mKey(wKey),mRecord(NULL)
+	{ }
+
+	/** Throw ConfigurationTableKeyNotFound if not defined. */
+	const ConfigurationRecord& record() const
+	{
+		const ConfigurationRecord* rec = __atomic_load_n(&mRecord,__ATOMIC_ACQUIRE);
+		if (!rec) throw ConfigurationTableKeyNotFound(mKey);
+		return *rec;
+	}
+
+	public:
+
+	const std::string& key() const { return mKey; }
+
+	/** Return true if the key has a value. */
+	bool defined() const { return __atomic_load_n(&mRecord,__ATOMIC_ACQUIRE)!=NULL; }
+
+	/** Same as ConfigurationTable::getStr. */
+	std::string getStr() const { return record().value(); }
+
+	/** Same as ConfigurationTable::getBool, but throws when undefined. */
+	bool getBool() const { return record().number()!=0; }
+
+	/** Same as ConfigurationTable::getNum. */
+	long getNum() const { return record().number(); }
+
+	/** Same as ConfigurationTable::getFloat. */
+	float getFloat() const { return record().floatNumber(); }
+};
+
+typedef std::map<std::string, ConfigurationHandle*> ConfigurationHandleMap;
+
+
 /**
 	A class for maintaining a configuration key-value table,
-	based on sqlite3 and a local map-based cache.
+	based on sqlite3 and a local snapshot of all values.
 	Thread-safe, too.
+
+	Readers never lock: they look keys up in the current snapshot, which is
+	never modified once published.  set() and remove() publish a modified
+	copy.  Changes made to the database by other processes are picked up
+	by reloading the snapshot when the database has changed, checked at
+	most every few seconds.  Replaced snapshots are kept for a grace period
+	before being freed, so readers never see freed memory.
 */
 class ConfigurationTable {
 
 	private:
 
 	sqlite3* mDB;				///< database connection
-	ConfigurationMap mCache;	///< cache of recently access configuration values
-	mutable Mutex mLock;		///< control for multithreaded access to the cache
+	ConfigurationSnapshot* mSnapshot;	///< current snapshot, read without locking
+	std::list<ConfigurationSnapshot*> mRetired;	///< replaced snapshots, oldest first
+	volatile bool mPurged;		///< set by purge(), forces a reload
+	ConfigurationHandleMap mHandles;	///< handles given out by handle()
+	Thread* mRefresher;			///< keeps handles fresh, started with the first handle
+	mutable Mutex mLock;		///< control for multithreaded changes to the snapshot
 	std::vector<std::string> (*mCrossCheck)(const std::string&);	///< cross check callback pointer
 
 	public:
@@ -219,6 +304,12 @@ class ConfigurationTable {
 	/** Return true if this key is identified as static. */
 	bool isStatic(const std::string& key);
 
+	/**
+		Get a handle for fast repeated reads of a key.
+		The key need not be defined yet.
+	*/
+	const ConfigurationHandle& handle(const std::string& key);
+
 	/**
 		Get a string parameter from the table.
 		Throw ConfigurationTableKeyNotFound if not found.
@@ -287,24 +378,48 @@ class ConfigurationTable {
 	/** Execute the application specific value cross checking logic. */
 	std::vector<std::string> crossCheck(const std::string& key);
 
-	/** purege cache if it exceeds a certain age */
+	/** Reload the snapshot if the database changed since it was last checked a few seconds ago. */
 	void checkCacheAge();
 
-	/** Delete all records from the cache. */
+	/**
+		Force a reload of the snapshot on the next read.
+		Safe to call from an sqlite3 update hook.
+	*/
 	void purge();
 
+	/** Check the database for changes and reload if needed, forever.  For the refresher thread. */
+	void refreshLoop();
+
 
 	private:
 
 	/**
-		Attempt to lookup a record, cache if needed.
+		Find a record in the current snapshot, without locking.
 		Throw ConfigurationTableKeyNotFound if not found.
-		Caller should hold mLock because the returned reference points into the cache.
+		The reference stays valid for the snapshot grace period, so copy from it at once.
 	*/
 	const ConfigurationRecord& lookup(const std::string& key);
 
+	/** Get the current snapshot, reloading first if it is due and nobody else is. */
+	const ConfigurationSnapshot* snapshot();
+
+	/** Reload from the database if it changed or a purge was requested; caller holds mLock. */
+	void refresh(bool force);
+
+	/** Read the sqlite data_version, -1 if not supported. */
+	int dataVersion();
+
+	/** Build a snapshot from the schema and the database; caller holds mLock. */
+	ConfigurationSnapshot* load();
+
+	/** Make a snapshot current, repoint the handles and retire the old one; caller holds mLock. */
+	void publish(ConfigurationSnapshot* snap);
+
 };
 
+/** Runs ConfigurationTable::refreshLoop on the table passed as the argument. */
+void* configurationRefresher(void*);
+
 
 typedef std::map<HashString, std::string> HashStringMap;
 
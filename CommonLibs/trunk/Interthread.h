@@ -32,6 +32,8 @@
 #include <map>
 #include <vector>
 #include <queue>
+#include <sched.h>
+#include <unistd.h>
 
 
 
@@ -380,6 +382,213 @@ template <class T> class InterthreadQueueWithWait {
 
 
 
+/** How an InterthreadRing waits for data or space. */
+enum InterthreadRingWait {
+	RingBlocking,	///< spin briefly, then sleep on a Signal
+	RingSpinning	///< spin, then yield the processor; never sleeps
+};
+
+
+/**
+	Bounded lock-free pointer FIFO for exactly one writer thread and one reader thread.
+	Reads and writes that find data or space touch no lock.  A blocked thread
+	sets mSleeping before it sleeps, and the other side takes the lock to signal
+	only when it is the one to clear that flag, so once per sleep.
+	The read, timeout and delete semantics follow InterthreadQueue,
+	but clear() and flushNoDelete() must be called from the reader thread.
+*/
+template <class T> class InterthreadRing {
+
+	private:
+
+	/** Polls before a waiting thread yields or sleeps; none with one CPU, where the other side cannot run meanwhile. */
+	static unsigned spinLimit()
+	{
+		static const unsigned limit = (sysconf(_SC_NPROCESSORS_ONLN)>1) ? 200 : 0;
+		return limit;
+	}
+
+	T** mSlots;
+	size_t mMask;			///< capacity-1, capacity is a power of 2
+	InterthreadRingWait mWaitMode;
+
+	char mPad0[64];
+	size_t mHead;			///< count of reads, written by the reader only
+	char mPad1[64];
+	size_t mTail;			///< count of writes, written by the writer only
+	char mPad2[64];
+	int mSleeping;			///< a thread is asleep or about to sleep on mSignal
+
+	mutable Mutex mLock;
+	Signal mSignal;
+
+	bool hasData() const
+		{ return __atomic_load_n(&mTail,__ATOMIC_SEQ_CST) != __atomic_load_n(&mHead,__ATOMIC_SEQ_CST); }
+
+	bool hasSpace() const
+		{ return __atomic_load_n(&mTail,__ATOMIC_SEQ_CST) - __atomic_load_n(&mHead,__ATOMIC_SEQ_CST) <= mMask; }
+
+	/** Wake the other side if it is asleep. */
+	void wake()
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&mSleeping,__ATOMIC_RELAXED)==0) return;
+		if (__atomic_exchange_n(&mSleeping,0,__ATOMIC_SEQ_CST)==0) return;
+		ScopedLock lock(mLock);
+		mSignal.broadcast();
+	}
+
+	/**
+		Wait a little for ready() to become true.
+		@param spins Polls so far, updated.
+		@param deadline Time limit for sleeping, or NULL.
+	*/
+	void pause(unsigned& spins, bool (InterthreadRing::*ready)() const, const Timeval *deadline)
+	{
+		if (spins<spinLimit()) {
+			spins++;
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_ia32_pause();
+#endif
+			return;
+		}
+		if (mWaitMode==RingSpinning) {
+			sched_yield();
+			return;
+		}
+		ScopedLock lock(mLock);
+		__atomic_store_n(&mSleeping,1,__ATOMIC_SEQ_CST);
+		if ((this->*ready)()) return;
+		if (!deadline) mSignal.wait(mLock);
+		else if (!deadline->passed()) mSignal.wait(mLock,deadline->remaining());
+	}
+
+	InterthreadRing(const InterthreadRing&);
+	InterthreadRing& operator=(const InterthreadRing&);
+
+	public:
+
+	/**
+		@param capacity Maximum number of queued elements, rounded up to a power of 2.
+		@param waitMode How read() and write() wait.
+	*/
+	InterthreadRing(size_t capacity=64, InterthreadRingWait waitMode=RingBlocking)
+		:mWaitMode(waitMode),mHead(0),mTail(0),mSleeping(0)
+	{
+		size_t size = 1;
+		while (size<capacity) size <<= 1;
+		mSlots = new T*[size];
+		mMask = size-1;
+	}
+
+	~InterthreadRing()
+	{
+		clear();
+		delete[] mSlots;
+	}
+
+	/** Delete contents.  Reader side only. */
+	void clear()
+	{
+		while (T* val = readNoBlock()) delete val;
+	}
+
+	/** Empty the queue, but don't delete.  Reader side only. */
+	void flushNoDelete()
+	{
+		while (readNoBlock()) {}
+	}
+
+	size_t size() const
+		{ return __atomic_load_n(&mTail,__ATOMIC_ACQUIRE) - __atomic_load_n(&mHead,__ATOMIC_ACQUIRE); }
+
+	size_t capacity() const { return mMask+1; }
+
+	/**
+		Non-blocking read.
+		@return Pointer to object or NULL if the ring is empty.
+	*/
+	T* readNoBlock()
+	{
+		const size_t head = mHead;
+		if (head==__atomic_load_n(&mTail,__ATOMIC_ACQUIRE)) return NULL;
+		T* retVal = mSlots[head & mMask];
+		__atomic_store_n(&mHead,head+1,__ATOMIC_RELEASE);
+		wake();
+		return retVal;
+	}
+
+	/**
+		Blocking read.
+		@return Pointer to object (will not be NULL).
+	*/
+	T* read()
+	{
+		unsigned spins = 0;
+		T* retVal;
+		while ((retVal = readNoBlock())==NULL) pause(spins,&InterthreadRing::hasData,NULL);
+		return retVal;
+	}
+
+	/**
+		Blocking read with a timeout.
+		@param timeout The read timeout in ms.
+		@return Pointer to object or NULL on timeout.
+	*/
+	T* read(unsigned timeout)
+	{
+		if (timeout==0) return readNoBlock();
+		Timeval deadline(timeout);
+		unsigned spins = 0;
+		T* retVal;
+		while ((retVal = readNoBlock())==NULL) {
+			if (deadline.passed()) return NULL;
+			pause(spins,&InterthreadRing::hasData,&deadline);
+		}
+		return retVal;
+	}
+
+	/**
+		Non-blocking write.
+		@return false if the ring is full; the caller still owns val.
+	*/
+	bool writeNoBlock(T* val)
+	{
+		const size_t tail = mTail;
+		if (tail-__atomic_load_n(&mHead,__ATOMIC_ACQUIRE) > mMask) return false;
+		mSlots[tail & mMask] = val;
+		__atomic_store_n(&mTail,tail+1,__ATOMIC_RELEASE);
+		wake();
+		return true;
+	}
+
+	/** Write, waiting for space if the ring is full. */
+	void write(T* val)
+	{
+		unsigned spins = 0;
+		while (!writeNoBlock(val)) pause(spins,&InterthreadRing::hasSpace,NULL);
+	}
+
+	/**
+		Write, waiting up to a timeout for space.
+		@param timeout The timeout in ms.
+		@return false on timeout; the caller still owns val.
+	*/
+	bool write(T* val, unsigned timeout)
+	{
+		Timeval deadline(timeout);
+		unsigned spins = 0;
+		while (!writeNoBlock(val)) {
+			if (deadline.passed()) return false;
+			pause(spins,&InterthreadRing::hasSpace,&deadline);
+		}
+		return true;
+	}
+};
+
+
+
+
 
 /** Thread-safe map of pointers to class D, keyed by class K. */
 template <class K, class D > class InterthreadMap {
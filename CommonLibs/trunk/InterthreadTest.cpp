@@ -90,7 +90,60 @@ void* mapReader(void*)
 
 
 
+/*
+	Handoff benchmarks: a stream of items from one writer to one reader,
+	and a ping-pong where each item waits for the previous reply, as a burst
+	waits for its decoder.  Q is InterthreadQueue<int> or InterthreadRing<int>.
+*/
 
+static const int sStreamItems = 1000000;
+static const int sPingPongItems = 100000;
+
+template <class Q> struct BenchQueues {
+	Q *forward;
+	Q *reply;
+};
+
+template <class Q> void* streamReader(void *arg)
+{
+	BenchQueues<Q> *q = (BenchQueues<Q>*)arg;
+	static int sum;
+	for (int i=0; i<sStreamItems; i++) sum += *q->forward->read();
+	return NULL;
+}
+
+template <class Q> void* pongThread(void *arg)
+{
+	BenchQueues<Q> *q = (BenchQueues<Q>*)arg;
+	for (int i=0; i<sPingPongItems; i++) q->reply->write(q->forward->read());
+	return NULL;
+}
+
+template <class Q> void handoffBenchmark(const char *name, Q& forward, Q& reply)
+{
+	static int item = 1;
+	BenchQueues<Q> q = { &forward, &reply };
+
+	Thread reader;
+	Timeval start;
+	reader.start(streamReader<Q>,&q);
+	for (int i=0; i<sStreamItems; i++) forward.write(&item);
+	reader.join();
+	long streamMs = start.elapsed();
+
+	Thread pong;
+	start = Timeval();
+	pong.start(pongThread<Q>,&q);
+	for (int i=0; i<sPingPongItems; i++) {
+		forward.write(&item);
+		reply.read();
+	}
+	pong.join();
+	long pingPongMs = start.elapsed();
+
+	COUT(name << ": stream " << (streamMs ? sStreamItems/streamMs : 0) << " items/ms, ping-pong "
+		<< (sPingPongItems ? 1000*pingPongMs/sPingPongItems : 0) << " us/round trip");
+}
 
 
 int main(int argc, char *argv[])
@@ -109,6 +162,14 @@ int main(int argc, char *argv[])
 	qWriterThread.join();
 	mapReaderThread.join();
 	mapWriterThread.join();
+
+	// Every item is read back, so the destructors have nothing to delete.
+	InterthreadQueue<int> queueForward, queueReply;
+	handoffBenchmark("InterthreadQueue",queueForward,queueReply);
+	InterthreadRing<int> blockingForward(256), blockingReply(256);
+	handoffBenchmark("InterthreadRing blocking",blockingForward,blockingReply);
+	InterthreadRing<int> spinningForward(256,RingSpinning), spinningReply(256,RingSpinning);
+	handoffBenchmark("InterthreadRing spinning",spinningForward,spinningReply);
 }
 
 
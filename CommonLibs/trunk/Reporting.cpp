@@ -27,6 +27,7 @@
 #include "Logger.h"
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 
 static const char* createReportingTable = {
 	"CREATE TABLE IF NOT EXISTS REPORTING ("
@@ -38,14 +39,45 @@ static const char* createReportingTable = {
 };
 
 
-ReportingTable::ReportingTable(const char* filename)
+namespace {
+
+/** An entry's updates, taken out of it for the next commit. */
+struct Outstanding {
+	const std::string* name;
+	ReportEntry* entry;
+	unsigned count;
+	unsigned maxVal;
+};
+
+}
+
+/** Raise an entry's pending max to at least newVal. */
+static void raiseMax(ReportEntry* entry, unsigned newVal)
+{
+	unsigned cur = __atomic_load_n(&entry->maxVal, __ATOMIC_RELAXED);
+	while (newVal > cur) {
+		if (__atomic_compare_exchange_n(&entry->maxVal, &cur, newVal, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+	}
+}
+
+
+/** Bind and run one of the commit UPDATE statements. */
+static bool runUpdate(SQLiteQuery& q, unsigned value, time_t now, const std::string& name)
+{
+	q.reset();
+	return q.bind(value).bind(now).bind(name).run();
+}
+
+
+ReportingTable::ReportingTable(const char* filename, unsigned commitPeriod)
+	:mFacility(LOG_LOCAL7),mIndex(new ReportIndex),mCommitPeriod(commitPeriod ? commitPeriod : 1)
 {
 	gLogEarly(LOG_INFO | mFacility, "opening reporting table from path %s", filename);
 	// Connect to the database.
 	int rc = sqlite3_open(filename,&mDB);
 	if (rc) {
 		gLogEarly(LOG_EMERG | mFacility, "cannot open reporting database at %s, error message: %s", filename, sqlite3_errmsg(mDB));
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return;
 	}
@@ -58,23 +90,44 @@ ReportingTable::ReportingTable(const char* filename)
 		gLogEarly(LOG_EMERG | mFacility, "Cannot enable WAL mode on database at %s, error message: %s", filename, sqlite3_errmsg(mDB));
 	}
 	// Start the commit thread
-	mBatchCommitter.start((void*(*)(void*))reportingBatchCommitter,NULL);
+	mBatchCommitter.start((void*(*)(void*))reportingBatchCommitter,this);
+}
+
+
+ReportEntry* ReportingTable::entry(const char* paramName)
+{
+	// Fast path: the published index is never modified, so no lock is needed.
+	ReportIndex* index = __atomic_load_n(&mIndex, __ATOMIC_ACQUIRE);
+	ReportIndex::const_iterator it = index->find(paramName);
+	if (it != index->end()) return it->second;
+
+	// Slow path: publish a copy of the index with the new entry.
+	// The old index stays allocated since other threads may still be reading it.
+	ScopedLock lock(mLock);
+	index = mIndex;
+	it = index->find(paramName);
+	if (it != index->end()) return it->second;
+	ReportEntry* newEntry = new ReportEntry;
+	newEntry->count = 0;
+	newEntry->maxVal = 0;
+	ReportIndex* newIndex = new ReportIndex(*index);
+	(*newIndex)[paramName] = newEntry;
+	mRetired.push_back(index);
+	__atomic_store_n(&mIndex, newIndex, __ATOMIC_RELEASE);
+	return newEntry;
 }
 
 
 bool ReportingTable::create(const char* paramName)
 {
-	// add this report name to the batch map
-	mLock.lock();
-	if (mBatch.find(paramName) == mBatch.end()) {
-		mBatch[paramName] = 0;
-	}
-	mLock.unlock();
+	// add this report name to the in-memory index
+	entry(paramName);
 
 	// and to the database
-	char cmd[200];
-	sprintf(cmd,"INSERT OR IGNORE INTO REPORTING (NAME,CLEAREDTIME) VALUES (\"%s\",%ld)", paramName, time(NULL));
-	if (!sqlite3_command(mDB,cmd)) {
+	if (!mDB) return false;
+	ScopedLock lock(mDBLock);
+	SQLiteQuery q(mDB,"INSERT OR IGNORE INTO REPORTING (NAME,CLEAREDTIME) VALUES (?1,?2)");
+	if (!q.bind(paramName).bind(time(NULL)).run()) {
 		gLogEarly(LOG_CRIT|mFacility, "cannot create reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
 		return false;
 	}
@@ -85,10 +138,7 @@ bool ReportingTable::create(const char* paramName)
 
 bool ReportingTable::incr(const char* paramName)
 {
-	mLock.lock();
-	mBatch[paramName]++;
-	mLock.unlock();
-
+	__atomic_add_fetch(&entry(paramName)->count, 1, __ATOMIC_RELAXED);
 	return true;
 }
 
@@ -96,21 +146,21 @@ bool ReportingTable::incr(const char* paramName)
 
 bool ReportingTable::max(const char* paramName, unsigned newVal)
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=MAX(VALUE,%u), UPDATETIME=%ld WHERE NAME=\"%s\"", newVal, time(NULL), paramName);
-	if (!sqlite3_command(mDB,cmd)) {
-		gLogEarly(LOG_CRIT|mFacility, "cannot maximize reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
-		return false;
-	}
+	raiseMax(entry(paramName), newVal);
 	return true;
 }
 
 
 bool ReportingTable::clear(const char* paramName)
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=%ld WHERE NAME=\"%s\"", time(NULL), paramName);
-	if (!sqlite3_command(mDB,cmd)) {
+	if (!mDB) return false;
+	// Hold the db lock across both steps so a concurrent commit cannot write the old values back.
+	ScopedLock lock(mDBLock);
+	ReportEntry* e = entry(paramName);
+	__atomic_store_n(&e->count, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&e->maxVal, 0, __ATOMIC_RELAXED);
+	SQLiteQuery q(mDB,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=?1 WHERE NAME=?2");
+	if (!q.bind(time(NULL)).bind(paramName).run()) {
 		gLogEarly(LOG_CRIT|mFacility, "cannot clear reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
 		return false;
 	}
@@ -121,9 +171,15 @@ bool ReportingTable::clear(const char* paramName)
 
 bool ReportingTable::clear()
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=%ld", time(NULL));
-	if (!sqlite3_command(mDB,cmd)) {
+	if (!mDB) return false;
+	ScopedLock lock(mDBLock);
+	ReportIndex* index = __atomic_load_n(&mIndex, __ATOMIC_ACQUIRE);
+	for (ReportIndex::const_iterator it = index->begin(); it != index->end(); ++it) {
+		__atomic_store_n(&it->second->count, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&it->second->maxVal, 0, __ATOMIC_RELAXED);
+	}
+	SQLiteQuery q(mDB,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=?1");
+	if (!q.bind(time(NULL)).run()) {
 		gLogEarly(LOG_CRIT|mFacility, "cannot clear reporting table, error message: %s", sqlite3_errmsg(mDB));
 		return false;
 	}
@@ -167,50 +223,60 @@ bool ReportingTable::clear(const char* baseName, unsigned index)
 
 bool ReportingTable::commit()
 {
-	ReportBatch oustanding;
-	ReportBatch::iterator mp;
-	unsigned oustandingCount = 0;
-
-	// copy out to free up access to mBatch as quickly as possible
-	mLock.lock();
-	mp = mBatch.begin();
-	while (mp != mBatch.end()) {
-		if (mp->second > 0) {
-			oustanding[mp->first] = mp->second;
-			mBatch[mp->first] = 0;
-			oustandingCount++;
-		}
-		mp++;
+	if (!mDB) return false;
+	ScopedLock lock(mDBLock);
+
+	// Take the outstanding values out of the entries.
+	// Updates that land after this point go into the next batch.
+	std::vector<Outstanding> outstanding;
+	ReportIndex* index = __atomic_load_n(&mIndex, __ATOMIC_ACQUIRE);
+	for (ReportIndex::const_iterator it = index->begin(); it != index->end(); ++it) {
+		Outstanding o;
+		o.name = &it->first;
+		o.entry = it->second;
+		o.count = __atomic_exchange_n(&it->second->count, 0, __ATOMIC_RELAXED);
+		o.maxVal = __atomic_exchange_n(&it->second->maxVal, 0, __ATOMIC_RELAXED);
+		if (o.count || o.maxVal) outstanding.push_back(o);
 	}
-	mLock.unlock();
-
-	// now actually write them into the db if needed
-	if (oustandingCount > 0) {
-		Timeval timer;
-		char cmd[200];
-
-		// TODO : could wrap this in a BEGIN; COMMIT; pair to transactionize these X UPDATEs
-		mp = oustanding.begin();
-		while (mp != oustanding.end()) {
-			sprintf(cmd,"UPDATE REPORTING SET VALUE=VALUE+%u, UPDATETIME=%ld WHERE NAME=\"%s\"", mp->second, time(NULL), mp->first.c_str());
-			if (!sqlite3_command(mDB,cmd)) {
-				LOG(CRIT) << "could not increment reporting parameter " << mp->first << ", error message: " << sqlite3_errmsg(mDB);
-			}
-			mp++;
+	if (outstanding.empty()) return true;
+
+	// Write them all in one transaction.
+	Timeval timer;
+	time_t now = time(NULL);
+	bool ok;
+	{
+		SQLiteTransaction transaction(mDB);
+		SQLiteQuery incrQuery(mDB,"UPDATE REPORTING SET VALUE=VALUE+?1, UPDATETIME=?2 WHERE NAME=?3");
+		SQLiteQuery maxQuery(mDB,"UPDATE REPORTING SET VALUE=MAX(VALUE,?1), UPDATETIME=?2 WHERE NAME=?3");
+		ok = transaction.active() && incrQuery.valid() && maxQuery.valid();
+		for (unsigned i = 0; ok && i < outstanding.size(); i++) {
+			const Outstanding& o = outstanding[i];
+			if (o.count) ok = runUpdate(incrQuery, o.count, now, *o.name);
+			if (ok && o.maxVal) ok = runUpdate(maxQuery, o.maxVal, now, *o.name);
 		}
+		ok = ok && transaction.commit();
+		if (!ok) LOG(CRIT) << "could not commit " << outstanding.size() << " reporting parameters, error message: " << sqlite3_errmsg(mDB);
+	}
 
-		LOG(INFO) << "wrote " << oustandingCount << " entries in " << timer.elapsed() << "ms";
+	if (!ok) {
+		// Put the values back so the next commit retries them.
+		for (unsigned i = 0; i < outstanding.size(); i++) {
+			__atomic_add_fetch(&outstanding[i].entry->count, outstanding[i].count, __ATOMIC_RELAXED);
+			raiseMax(outstanding[i].entry, outstanding[i].maxVal);
+		}
+		return false;
 	}
 
+	LOG(INFO) << "wrote " << outstanding.size() << " entries in " << timer.elapsed() << "ms";
 	return true;
 }
 
-extern ReportingTable gReports;
-void* reportingBatchCommitter(void*)
+void* reportingBatchCommitter(void* arg)
 {
+	ReportingTable* table = (ReportingTable*)arg;
 	while (true) {
-		sleep(10);
-		gReports.commit();
+		sleep(table->commitPeriod());
+		table->commit();
 	}
 
 	return NULL;
@@ -29,15 +29,32 @@
 #include <sqlite3util.h>
 #include <ostream>
 #include <map>
+#include <list>
 #include <string>
 #include <Threads.h>
 #include <Timeval.h>
 
-typedef std::map<std::string, unsigned> ReportBatch;
+/**
+	In-memory state of one parameter between commits.
+	Both fields are updated with atomic operations only.
+*/
+struct ReportEntry {
+	unsigned count;			///< increments not yet stored in the db
+	unsigned maxVal;		///< largest max() value not yet stored in the db
+};
+
+/** Parameter name to entry; never modified once published. */
+typedef std::map<std::string, ReportEntry*> ReportIndex;
 
 /**
 	Collect performance statistics into a database.
 	Parameters are counters or max/min trackers, all integer.
+
+	Updates only touch memory: incr() and max() find the parameter in an
+	immutable index and update its entry atomically, without taking a lock.
+	Adding a parameter copies the index under mLock and publishes the copy.
+	A background thread commits the accumulated values to the database in
+	a single transaction every commit period.
 */
 class ReportingTable {
 
@@ -45,19 +62,25 @@ class ReportingTable {
 
 	sqlite3* mDB;				///< database connection
 	int mFacility;				///< rsyslogd facility
-	ReportBatch mBatch;			///< batch of report updates, not yet stored in the db
-	mutable Mutex mLock;		///< control for multithreaded read/write access to the batch
+	ReportIndex* mIndex;		///< current index, read without locking
+	std::list<ReportIndex*> mRetired;	///< superseded indexes, which readers may still hold
+	mutable Mutex mLock;		///< serializes changes to the index
+	mutable Mutex mDBLock;		///< serializes use of the database connection
+	unsigned mCommitPeriod;		///< seconds between batch commits
 	Thread mBatchCommitter;		///< thread responsible for committing batches of report updates to the db
 
-
+	/** Find a parameter's entry, adding it to the index if needed. */
+	ReportEntry* entry(const char* paramName);
 
 	public:
 
 	/**
 		Open the database connection;
 		create the table if it does not exist yet.
+		@param filename The database file path.
+		@param commitPeriod Seconds between batch commits.
 	*/
-	ReportingTable(const char* filename);
+	ReportingTable(const char* filename, unsigned commitPeriod=10);
 
 	/** Create a new parameter. */
 	bool create(const char* paramName);
@@ -89,11 +112,14 @@ class ReportingTable {
 	/** Dump the database to a stream. */
 	void dump(std::ostream&) const;
 
-	/** Commit outstanding report updates to the database */
+	/** Commit outstanding report updates to the database in one transaction. */
 	bool commit();
+
+	/** Get the number of seconds between batch commits. */
+	unsigned commitPeriod() const { return mCommitPeriod; }
 };
 
-/** Periodically triggers ReportingTable::commit(). */
+/** Periodically triggers ReportingTable::commit() on the table passed as the argument. */
 void* reportingBatchCommitter(void*);
 
 #endif
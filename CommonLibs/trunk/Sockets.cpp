@@ -204,6 +204,76 @@ int DatagramSocket::read(char* buffer)
 }
 
 
+int DatagramSocket::writeBatch(const char* const* buffers, const size_t* lengths, unsigned count)
+{
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[MAX_UDP_BATCH];
+	struct iovec iovs[MAX_UDP_BATCH];
+	unsigned sent = 0;
+	while (sent<count) {
+		unsigned num = count-sent;
+		if (num>MAX_UDP_BATCH) num = MAX_UDP_BATCH;
+		memset(msgs,0,num*sizeof(msgs[0]));
+		for (unsigned i=0; i<num; i++) {
+			assert(lengths[sent+i]<=MAX_UDP_LENGTH);
+			iovs[i].iov_base = (void*)buffers[sent+i];
+			iovs[i].iov_len = lengths[sent+i];
+			msgs[i].msg_hdr.msg_name = mDestination;
+			msgs[i].msg_hdr.msg_namelen = addressSize();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		int retVal = sendmmsg(mSocketFD, msgs, num, 0);
+		if (retVal == -1) {
+			perror("DatagramSocket::writeBatch() failed");
+			return sent ? (int)sent : -1;
+		}
+		sent += retVal;
+	}
+	return sent;
+#else
+	for (unsigned i=0; i<count; i++) {
+		if (write(buffers[i],lengths[i]) == -1) return i ? (int)i : -1;
+	}
+	return count;
+#endif
+}
+
+
+int DatagramSocket::readBatch(char* const* buffers, int* lengths, unsigned count)
+{
+	if (count==0) return 0;
+#ifdef HAVE_RECVMMSG
+	if (count>MAX_UDP_BATCH) count = MAX_UDP_BATCH;
+	struct mmsghdr msgs[MAX_UDP_BATCH];
+	struct iovec iovs[MAX_UDP_BATCH];
+	memset(msgs,0,count*sizeof(msgs[0]));
+	for (unsigned i=0; i<count; i++) {
+		iovs[i].iov_base = buffers[i];
+		iovs[i].iov_len = MAX_UDP_LENGTH;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	// Only the first return address is kept.
+	msgs[0].msg_hdr.msg_name = mSource;
+	msgs[0].msg_hdr.msg_namelen = sizeof(mSource);
+	int retVal = recvmmsg(mSocketFD, msgs, count, MSG_WAITFORONE, NULL);
+	if ((retVal==-1) && (errno!=EAGAIN)) {
+		perror("DatagramSocket::readBatch() failed");
+		throw SocketError();
+	}
+	for (int i=0; i<retVal; i++) lengths[i] = msgs[i].msg_len;
+	return retVal;
+#else
+	int length = read(buffers[0]);
+	if (length==-1) return -1;
+	lengths[0] = length;
+	return 1;
+#endif
+}
+
+
+
 int DatagramSocket::read(char* buffer, unsigned timeout)
 {
 	fd_set fds;
@@ -43,6 +43,9 @@
 
 #define MAX_UDP_LENGTH 1500
 
+/** Maximum number of packets moved by one readBatch or writeBatch system call. */
+#define MAX_UDP_BATCH 16
+
 /** A function to resolve IP host names. */
 bool resolveAddress(struct sockaddr_in *address, const char *host, unsigned short port);
 
@@ -119,6 +122,27 @@ public:
 	int read(char* buffer, unsigned timeout);
 
 
+	/**
+		Send several binary packets to mDestination,
+		in as few system calls as the OS allows (sendmmsg).
+		@param buffers The packets.
+		@param lengths Their lengths, each no more than MAX_UDP_LENGTH.
+		@param count The number of packets.
+		@return The number of packets sent, or -1 on error.
+	*/
+	int writeBatch(const char* const* buffers, const size_t* lengths, unsigned count);
+
+	/**
+		Receive one or more packets, blocking until at least one arrives
+		and then taking whatever else is already queued (recvmmsg).
+		@param buffers Up to MAX_UDP_BATCH char[MAX_UDP_LENGTH] procured by the caller.
+		@param lengths Returns the length of each packet received.
+		@param count The number of buffers.
+		@return The number of packets received or -1 on non-blocking pass.
+	*/
+	int readBatch(char* const* buffers, int* lengths, unsigned count);
+
+
 	/** Send a packet to a given destination, other than the default. */
 	int send(const struct sockaddr *dest, const char * buffer, size_t length);
 
@@ -30,6 +30,7 @@
 #include "Threads.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 static const int gNumToSend = 10;
@@ -98,6 +99,27 @@ int main(int argc, char * argv[] )
 
   readerThreadIP.join();
   readerThreadUnix.join();
+
+  // Batched transfer: several packets each way per system call.
+  UDPSocket batchSource(5062, "127.0.0.1", 5935);
+  UDPSocket batchDest(5935, "127.0.0.1", 5062);
+  const char* packets[gNumToSend];
+  size_t lengths[gNumToSend];
+  for (int i=0; i<gNumToSend; i++) {
+    packets[i] = "Hello batch land";
+    lengths[i] = strlen(packets[i])+1;
+  }
+  COUT("batch sent: " << batchSource.writeBatch(packets,lengths,gNumToSend));
+  char buffers[gNumToSend][MAX_UDP_LENGTH];
+  char* bufferPtrs[gNumToSend];
+  for (int i=0; i<gNumToSend; i++) bufferPtrs[i] = buffers[i];
+  int readLengths[gNumToSend];
+  int rc = 0;
+  while (rc<gNumToSend) {
+    int count = batchDest.readBatch(bufferPtrs,readLengths,gNumToSend-rc);
+    COUT("batch read: " << count << " x " << buffers[0]);
+    rc += count;
+  }
 }
 
 // vim: ts=4 sw=4
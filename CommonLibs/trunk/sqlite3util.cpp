@@ -7,10 +7,16 @@
 #include "sqlite3.h"
 #include "sqlite3util.h"
 
+#include "Threads.h"
+
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 
+#include <list>
+#include <map>
+#include <string>
+
 
 // Wrappers to sqlite operations.
 // These will eventually get moved to commonlibs.
@@ -19,16 +25,23 @@ const char* enableWAL = {
 	"PRAGMA journal_mode=WAL"
 };
 
+
+/** Sleep before another try at a busy database, doubling from 200 us to about 50 ms. */
+static void busyBackoff(unsigned attempt)
+{
+	usleep(200U << (attempt<8 ? attempt : 8));
+}
+
 int sqlite3_prepare_statement(sqlite3* DB, sqlite3_stmt **stmt, const char* query, unsigned retries)
 {
         int src = SQLITE_BUSY;
 
 	for (unsigned i = 0; i < retries; i++) {
+		if (i) busyBackoff(i-1);
 		src = sqlite3_prepare_v2(DB,query,strlen(query),stmt,NULL);
 		if (src != SQLITE_BUSY && src != SQLITE_LOCKED) {
 			break;
 		}
-		usleep(200);
 	}
         if (src) {
                 fprintf(stderr,"sqlite3_prepare_v2 failed for \"%s\": %s\n",query,sqlite3_errmsg(DB));
@@ -41,13 +54,13 @@ int sqlite3_run_query(sqlite3* DB, sqlite3_stmt *stmt, unsigned retries)
 {
 	int src = SQLITE_BUSY;
 
-        for (unsigned i = 0; i < retries; i++) {
-                src = sqlite3_step(stmt);
+	for (unsigned i = 0; i < retries; i++) {
+		if (i) busyBackoff(i-1);
+		src = sqlite3_step(stmt);
 		if (src != SQLITE_BUSY && src != SQLITE_LOCKED) {
-                        break;
-                }
-                usleep(200);
-        }
+			break;
+		}
+	}
 	if ((src!=SQLITE_DONE) && (src!=SQLITE_ROW)) {
 		fprintf(stderr,"sqlite3_run_query failed: %s: %s\n", sqlite3_sql(stmt), sqlite3_errmsg(DB));
 	}
@@ -55,20 +68,220 @@ int sqlite3_run_query(sqlite3* DB, sqlite3_stmt *stmt, unsigned retries)
 }
 
 
+
+// Per-connection statement cache.
+// Idle statements are kept by query text, least recently returned first,
+// up to a limit per connection; statements on loan are not tracked.
+
+namespace {
+
+typedef std::list<sqlite3_stmt*> StatementList;
+typedef std::multimap<std::string,StatementList::iterator> StatementIndex;
+
+struct StatementCache {
+	StatementList mIdle;		///< oldest first
+	StatementIndex mIndex;		///< query text to entries of mIdle
+};
+
+typedef std::map<sqlite3*,StatementCache*> StatementCacheMap;
+
+/** Idle statements kept per connection. */
+const unsigned sStatementCacheSize = 64;
+
+struct StatementCaches {
+	Mutex mLock;
+	StatementCacheMap mMap;
+};
+
+// Configuration and reporting tables open databases during static
+// initialization, so the caches cannot be plain globals.
+StatementCaches& statementCaches()
+{
+	static StatementCaches* caches = new StatementCaches;
+	return *caches;
+}
+
+}
+
+
+sqlite3_stmt* sqlite3_cached_statement(sqlite3* DB, const char* query, unsigned retries)
+{
+	StatementCaches& caches = statementCaches();
+	caches.mLock.lock();
+	StatementCacheMap::iterator cache = caches.mMap.find(DB);
+	if (cache!=caches.mMap.end()) {
+		StatementIndex::iterator where = cache->second->mIndex.find(query);
+		if (where!=cache->second->mIndex.end()) {
+			sqlite3_stmt* stmt = *where->second;
+			cache->second->mIdle.erase(where->second);
+			cache->second->mIndex.erase(where);
+			caches.mLock.unlock();
+			return stmt;
+		}
+	}
+	caches.mLock.unlock();
+	// Not cached, or all on loan.
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return NULL;
+	return stmt;
+}
+
+
+void sqlite3_release_statement(sqlite3* DB, sqlite3_stmt* stmt)
+{
+	if (!stmt) return;
+	// Ready it for the next user, and end any read it left open.
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	StatementCaches& caches = statementCaches();
+	ScopedLock lock(caches.mLock);
+	StatementCache* cache;
+	StatementCacheMap::iterator where = caches.mMap.find(DB);
+	if (where==caches.mMap.end()) {
+		cache = new StatementCache;
+		caches.mMap[DB] = cache;
+	} else {
+		cache = where->second;
+	}
+	StatementList::iterator entry = cache->mIdle.insert(cache->mIdle.end(),stmt);
+	cache->mIndex.insert(StatementIndex::value_type(sqlite3_sql(stmt),entry));
+	if (cache->mIdle.size() <= sStatementCacheSize) return;
+	// Evict the least recently used.
+	sqlite3_stmt* oldest = cache->mIdle.front();
+	std::pair<StatementIndex::iterator,StatementIndex::iterator> range = cache->mIndex.equal_range(sqlite3_sql(oldest));
+	for (StatementIndex::iterator itr = range.first; itr != range.second; ++itr) {
+		if (itr->second != cache->mIdle.begin()) continue;
+		cache->mIndex.erase(itr);
+		break;
+	}
+	cache->mIdle.pop_front();
+	sqlite3_finalize(oldest);
+}
+
+
+int sqlite3_close_cached(sqlite3* DB)
+{
+	StatementCaches& caches = statementCaches();
+	caches.mLock.lock();
+	StatementCacheMap::iterator where = caches.mMap.find(DB);
+	if (where!=caches.mMap.end()) {
+		StatementCache* cache = where->second;
+		caches.mMap.erase(where);
+		for (StatementList::iterator itr = cache->mIdle.begin(); itr != cache->mIdle.end(); ++itr) {
+			sqlite3_finalize(*itr);
+		}
+		delete cache;
+	}
+	caches.mLock.unlock();
+	return sqlite3_close(DB);
+}
+
+
+
+SQLiteQuery::SQLiteQuery(sqlite3* DB, const char* query, unsigned retries)
+	:mDB(DB),mRetries(retries),mParam(0)
+{
+	mStmt = sqlite3_cached_statement(DB,query,retries);
+}
+
+
+SQLiteQuery::~SQLiteQuery()
+{
+	sqlite3_release_statement(mDB,mStmt);
+}
+
+
+SQLiteQuery& SQLiteQuery::bind(const char* value)
+{
+	if (!mStmt) return *this;
+	if (value) sqlite3_bind_text(mStmt,++mParam,value,-1,SQLITE_TRANSIENT);
+	else sqlite3_bind_null(mStmt,++mParam);
+	return *this;
+}
+
+
+SQLiteQuery& SQLiteQuery::bind(const std::string& value)
+{
+	if (mStmt) sqlite3_bind_text(mStmt,++mParam,value.data(),value.size(),SQLITE_TRANSIENT);
+	return *this;
+}
+
+
+SQLiteQuery& SQLiteQuery::bind(sqlite3_int64 value)
+{
+	if (mStmt) sqlite3_bind_int64(mStmt,++mParam,value);
+	return *this;
+}
+
+
+SQLiteQuery& SQLiteQuery::bind(double value)
+{
+	if (mStmt) sqlite3_bind_double(mStmt,++mParam,value);
+	return *this;
+}
+
+
+int SQLiteQuery::step()
+{
+	if (!mStmt) return SQLITE_ERROR;
+	return sqlite3_run_query(mDB,mStmt,mRetries);
+}
+
+
+bool SQLiteQuery::run()
+{
+	int src = step();
+	while (src==SQLITE_ROW) src = step();
+	return src==SQLITE_DONE;
+}
+
+
+void SQLiteQuery::reset()
+{
+	if (!mStmt) return;
+	sqlite3_reset(mStmt);
+	sqlite3_clear_bindings(mStmt);
+	mParam = 0;
+}
+
+
+
+SQLiteTransaction::SQLiteTransaction(sqlite3* DB, unsigned retries)
+	:mDB(DB),mRetries(retries)
+{
+	mOpen = sqlite3_command(DB,"BEGIN IMMEDIATE",retries);
+}
+
+
+bool SQLiteTransaction::commit()
+{
+	if (!mOpen) return false;
+	if (!sqlite3_command(mDB,"COMMIT",mRetries)) return false;
+	mOpen = false;
+	return true;
+}
+
+
+void SQLiteTransaction::rollback()
+{
+	if (!mOpen) return;
+	sqlite3_command(mDB,"ROLLBACK",mRetries);
+	mOpen = false;
+}
+
+
+
+// The lookups below can only bind values; table and column names
+// stay in the query text, which is then the same on every call.
+
 bool sqlite3_exists(sqlite3* DB, const char *tableName,
 		const char* keyName, const char* keyData, unsigned retries)
 {
-	size_t stringSize = 100 + strlen(tableName) + strlen(keyName) + strlen(keyData);
-	char query[stringSize];
-	sprintf(query,"SELECT * FROM %s WHERE %s == \"%s\"",tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return false;
-	// Read the result.
-	int src = sqlite3_run_query(DB,stmt,retries);
-	sqlite3_finalize(stmt);
+	std::string query = std::string("SELECT 1 FROM ") + tableName + " WHERE " + keyName + " == ?1";
+	SQLiteQuery q(DB,query.c_str(),retries);
+	if (!q.valid()) return false;
 	// Anything there?
-	return (src == SQLITE_ROW);
+	return q.bind(keyData).step() == SQLITE_ROW;
 }
 
 
@@ -77,21 +290,22 @@ bool sqlite3_single_lookup(sqlite3* DB, const char *tableName,
 		const char* keyName, const char* keyData,
 		const char* valueName, unsigned &valueData, unsigned retries)
 {
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + strlen(keyData);
-	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == \"%s\"",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return false;
-	// Read the result.
-	int src = sqlite3_run_query(DB,stmt,retries);
-	bool retVal = false;
-	if (src == SQLITE_ROW) {
-		valueData = (unsigned)sqlite3_column_int64(stmt,0);
-		retVal = true;
-	}
-	sqlite3_finalize(stmt);
-	return retVal;
+	std::string query = std::string("SELECT ") + valueName + " FROM " + tableName + " WHERE " + keyName + " == ?1";
+	SQLiteQuery q(DB,query.c_str(),retries);
+	if (!q.valid()) return false;
+	if (q.bind(keyData).step() != SQLITE_ROW) return false;
+	valueData = (unsigned)sqlite3_column_int64(q.stmt(),0);
+	return true;
+}
+
+
+/** Read a text result into an allocated string. */
+static bool singleTextLookup(SQLiteQuery& q, char* &valueData)
+{
+	if (q.step() != SQLITE_ROW) return false;
+	const char* ptr = (const char*)sqlite3_column_text(q.stmt(),0);
+	if (ptr) valueData = strdup(ptr);
+	return true;
 }
 
 
@@ -101,22 +315,11 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		const char* valueName, char* &valueData, unsigned retries)
 {
 	valueData=NULL;
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + strlen(keyData);
-	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == \"%s\"",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return false;
-	// Read the result.
-	int src = sqlite3_run_query(DB,stmt,retries);
-	bool retVal = false;
-	if (src == SQLITE_ROW) {
-		const char* ptr = (const char*)sqlite3_column_text(stmt,0);
-		if (ptr) valueData = strdup(ptr);
-		retVal = true;
-	}
-	sqlite3_finalize(stmt);
-	return retVal;
+	std::string query = std::string("SELECT ") + valueName + " FROM " + tableName + " WHERE " + keyName + " == ?1";
+	SQLiteQuery q(DB,query.c_str(),retries);
+	if (!q.valid()) return false;
+	q.bind(keyData);
+	return singleTextLookup(q,valueData);
 }
 
 
@@ -126,22 +329,11 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		const char* valueName, char* &valueData, unsigned retries)
 {
 	valueData=NULL;
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + 20;
-	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == %u",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return false;
-	// Read the result.
-	int src = sqlite3_run_query(DB,stmt,retries);
-	bool retVal = false;
-	if (src == SQLITE_ROW) {
-		const char* ptr = (const char*)sqlite3_column_text(stmt,0);
-		if (ptr) valueData = strdup(ptr);
-		retVal = true;
-	}
-	sqlite3_finalize(stmt);
-	return retVal;
+	std::string query = std::string("SELECT ") + valueName + " FROM " + tableName + " WHERE " + keyName + " == ?1";
+	SQLiteQuery q(DB,query.c_str(),retries);
+	if (!q.valid()) return false;
+	q.bind(keyData);
+	return singleTextLookup(q,valueData);
 }
 
 
@@ -149,14 +341,9 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 
 bool sqlite3_command(sqlite3* DB, const char* query, unsigned retries)
 {
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query,retries)) return false;
+	SQLiteQuery q(DB,query,retries);
+	if (!q.valid()) return false;
 	// Run the query.
-	int src = sqlite3_run_query(DB,stmt,retries);
-	sqlite3_finalize(stmt);
+	int src = q.step();
 	return (src==SQLITE_DONE || src==SQLITE_OK || src==SQLITE_ROW);
 }
-
-
-
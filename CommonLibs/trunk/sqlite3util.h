@@ -2,6 +2,7 @@
 #define SQLITE3UTIL_H
 
 #include <sqlite3.h>
+#include <string>
 
 // (pat) Dont put statics in .h files - they generate a zillion g++ error messages.
 extern const char *enableWAL;
@@ -32,4 +33,106 @@ bool sqlite3_exists(sqlite3* DB, const char* tableName,
 /** Run a query, ignoring the result; return true on success. */
 bool sqlite3_command(sqlite3* DB, const char* query, unsigned retries = 5);
 
+
+/**
+	Get a prepared statement for a query from a per-connection cache of
+	recently used statements, preparing it if there is none.
+	The statement comes back reset, with no bindings.
+	Each statement is lent to one caller at a time, so a connection
+	shared between threads is safe.
+	Hand it back with sqlite3_release_statement; never finalize it.
+	Return NULL on failure.
+*/
+sqlite3_stmt* sqlite3_cached_statement(sqlite3* DB, const char* query, unsigned retries = 5);
+
+/** Return a statement from sqlite3_cached_statement to its cache. */
+void sqlite3_release_statement(sqlite3* DB, sqlite3_stmt* stmt);
+
+/** Finalize the cached statements of a connection and close it. */
+int sqlite3_close_cached(sqlite3* DB);
+
+
+/**
+	A cached statement with bound parameters, used instead of SQL text built
+	with sprintf.  Parameters are bound in order by bind(); values never
+	need quoting.  The statement goes back to the cache on destruction.
+*/
+class SQLiteQuery {
+
+	private:
+
+	sqlite3* mDB;
+	sqlite3_stmt* mStmt;		///< NULL if the prepare failed
+	unsigned mRetries;
+	int mParam;					///< index of the last parameter bound
+
+	SQLiteQuery(const SQLiteQuery&);
+	SQLiteQuery& operator=(const SQLiteQuery&);
+
+	public:
+
+	SQLiteQuery(sqlite3* DB, const char* query, unsigned retries = 5);
+
+	~SQLiteQuery();
+
+	/** True if the statement was prepared. */
+	bool valid() const { return mStmt!=NULL; }
+
+	/** Bind the next parameter; NULL binds SQL NULL.  Text is copied. */
+	SQLiteQuery& bind(const char* value);
+	SQLiteQuery& bind(const std::string& value);
+	SQLiteQuery& bind(sqlite3_int64 value);
+	SQLiteQuery& bind(int value) { return bind((sqlite3_int64)value); }
+	SQLiteQuery& bind(unsigned value) { return bind((sqlite3_int64)value); }
+	SQLiteQuery& bind(long value) { return bind((sqlite3_int64)value); }
+	SQLiteQuery& bind(unsigned long value) { return bind((sqlite3_int64)value); }
+	SQLiteQuery& bind(double value);
+
+	/** Step once, retrying while busy; return SQLITE_ROW, SQLITE_DONE or an error. */
+	int step();
+
+	/** Step to the end, ignoring any rows; return true on success. */
+	bool run();
+
+	/** Clear the bindings and rewind, to run again with new parameters. */
+	void reset();
+
+	/** The statement, for reading columns of the current row. */
+	sqlite3_stmt* stmt() { return mStmt; }
+};
+
+
+/**
+	A scoped transaction, for batching many writes into one commit.
+	Begins on construction and rolls back on destruction unless committed.
+	BEGIN IMMEDIATE takes the write lock up front, so a busy database is
+	met here, where it can be retried, rather than part way through.
+*/
+class SQLiteTransaction {
+
+	private:
+
+	sqlite3* mDB;
+	unsigned mRetries;
+	bool mOpen;
+
+	SQLiteTransaction(const SQLiteTransaction&);
+	SQLiteTransaction& operator=(const SQLiteTransaction&);
+
+	public:
+
+	SQLiteTransaction(sqlite3* DB, unsigned retries = 5);
+
+	~SQLiteTransaction() { if (mOpen) rollback(); }
+
+	/** True if the transaction began and is not yet finished. */
+	bool active() const { return mOpen; }
+
+	/** Commit; return true on success.  On failure the transaction stays open until rollback or destruction. */
+	bool commit();
+
+	/** Abandon the changes. */
+	void rollback();
+};
+
 #endif
@@ -1286,6 +1286,14 @@ int stats(int argc, char** argv, ostream& os)
 				os << "stats table (gReporting) cleared" << endl;
 				return SUCCESS;
 		}
+		if (strcmp(argv[1],"flush")==0) {
+				if (!gReports.commit()) {
+					os << "stats table (gReporting) flush failed" << endl;
+					return FAILURE;
+				}
+				os << "stats table (gReporting) flushed" << endl;
+				return SUCCESS;
+		}
 		sprintf(cmd,"sqlite3 %s 'select name||\": \"||value||\" events over \"||((%lu-clearedtime)/60)||\" minutes\" from reporting where name like \"%%%s%%\";'",
 			gConfig.getStr("Control.Reporting.StatsTable").c_str(), time(NULL), argv[1]);
 	}
@@ -1293,6 +1301,8 @@ int stats(int argc, char** argv, ostream& os)
 		sprintf(cmd,"sqlite3 %s 'select name||\": \"||value||\" events over \"||((%lu-clearedtime)/60)||\" minutes\" from reporting;'",
 			gConfig.getStr("Control.Reporting.StatsTable").c_str(), time(NULL));
 	else return BAD_NUM_ARGS;
+	// Counters are batched in memory; write them out so the query sees them.
+	gReports.commit();
 	FILE *result = popen(cmd,"r");
 	char *line = (char*)malloc(200);
 	while (!feof(result)) {
@@ -1346,7 +1356,7 @@ void Parser::addCommands()
 	addCommand("gprs", GPRS::gprsCLI,"GPRS mode sub-command.  Type: gprs help for more");
 	addCommand("sgsn", SGSN::sgsnCLI,"SGSN mode sub-command.  Type: sgsn help for more");
 	addCommand("crashme", crashme, "force crash of OpenBTS for testing purposes");
-	addCommand("stats", stats,"[patt] OR clear -- print all, or selected, performance counters, OR clear all counters");
+	addCommand("stats", stats,"[patt] OR clear OR flush -- print all, or selected, performance counters, OR clear all counters, OR write pending counters to the database now");
 }
 
 
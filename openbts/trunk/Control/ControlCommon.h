@@ -108,7 +108,12 @@ GSM::L3Message* getMessage(GSM::LogicalChannel* LCH, unsigned SAPI=0);
 //@{
 //void FACCHDispatcher(GSM::TCHFACCHLogicalChannel *TCHFACCH);
 //void SDCCHDispatcher(GSM::SDCCHLogicalChannel *SDCCH);
-void DCCHDispatcher(GSM::LogicalChannel *DCCH);
+/**
+	Hand a DCCH to the dispatcher pool; call before the channel is opened.
+	A pool thread runs each transaction as the channel establishes,
+	so an idle channel holds no thread.
+*/
+void DCCHDispatcherAdd(GSM::LogicalChannel *DCCH);
 //@}
 
 
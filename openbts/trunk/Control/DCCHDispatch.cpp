@@ -20,6 +20,9 @@
 
 
 
+#include <list>
+#include <map>
+
 #include "ControlCommon.h"
 #include "TransactionTable.h"
 #include "RadioResource.h"
@@ -115,89 +118,243 @@ void DCCHDispatchMessage(const L3Message* msg, LogicalChannel* DCCH)
 
 
 
-/** Example of a closed-loop, persistent-thread control function for the DCCH. */
-// (pat) DCCH is a TCHFACCHLogicalChannel or SDCCHLogicalChannel
-void Control::DCCHDispatcher(LogicalChannel *DCCH)
+/**
+	Run one transaction on a DCCH, from its establishing primitive to its end.
+	@param frame The ESTABLISH or HANDOVER_ACCESS primitive, deleted here.
+	@param DCCH A TCHFACCHLogicalChannel or SDCCHLogicalChannel.
+*/
+static void DCCHDispatchTransaction(L3Frame *frame, LogicalChannel *DCCH)
 {
-	while (1) {
-		try {
-			// Wait for a transaction to start.
-			LOG(DEBUG) << "waiting for " << *DCCH << " ESTABLISH or HANDOVER_ACCESS";
-			L3Frame *frame = DCCH->waitForEstablishOrHandover();
-			LOG(DEBUG) << *DCCH << " received " << *frame;
-			gResetWatchdog();
-			Primitive prim = frame->primitive();
-			delete frame;
-			LOG(DEBUG) << "received primtive " << prim;
-			switch (prim) {
-				case ESTABLISH: {
-					// Pull the first message and dispatch a new transaction.
-					gReports.incr("OpenBTS.GSM.RR.ChannelSiezed");
-					const L3Message *message = getMessage(DCCH);
-					LOG(INFO) << *DCCH << " received establishing messaage " << *message;
-					DCCHDispatchMessage(message,DCCH);
-					delete message;
-					break;
-				}
-				case HANDOVER_ACCESS: {
-					ProcessHandoverAccess(dynamic_cast<GSM::TCHFACCHLogicalChannel*>(DCCH));
-					break;
-				}
-				default: assert(0);
+	try {
+		LOG(DEBUG) << *DCCH << " received " << *frame;
+		gResetWatchdog();
+		Primitive prim = frame->primitive();
+		delete frame;
+		LOG(DEBUG) << "received primtive " << prim;
+		switch (prim) {
+			case ESTABLISH: {
+				// Pull the first message and dispatch a new transaction.
+				gReports.incr("OpenBTS.GSM.RR.ChannelSiezed");
+				const L3Message *message = getMessage(DCCH);
+				LOG(INFO) << *DCCH << " received establishing messaage " << *message;
+				DCCHDispatchMessage(message,DCCH);
+				delete message;
+				break;
 			}
+			case HANDOVER_ACCESS: {
+				ProcessHandoverAccess(dynamic_cast<GSM::TCHFACCHLogicalChannel*>(DCCH));
+				break;
+			}
+			default: assert(0);
 		}
+	}
 
-		// Catch the various error cases.
+	// Catch the various error cases.
 
-		catch (RemovedTransaction except) {
-			LOG(ERR) << "attempt to use removed transaciton " << except.transactionID();
-		}
-		catch (ChannelReadTimeout except) {
-			LOG(NOTICE) << "ChannelReadTimeout";
-			// Cause 0x03 means "abnormal release, timer expired".
-			DCCH->send(L3ChannelRelease(0x03));
-			gTransactionTable.remove(except.transactionID());
-		}
-		catch (UnexpectedPrimitive except) {
-			LOG(NOTICE) << "UnexpectedPrimitive";
-			// Cause 0x62 means "message type not not compatible with protocol state".
-			DCCH->send(L3ChannelRelease(0x62));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
-		catch (UnexpectedMessage except) {
-			LOG(NOTICE) << "UnexpectedMessage";
-			// Cause 0x62 means "message type not not compatible with protocol state".
-			DCCH->send(L3ChannelRelease(0x62));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
-		catch (UnsupportedMessage except) {
-			LOG(NOTICE) << "UnsupportedMessage";
-			// Cause 0x61 means "message type not implemented".
-			DCCH->send(L3ChannelRelease(0x61));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
-		catch (Q931TimerExpired except) {
-			LOG(NOTICE) << "Q.931 T3xx timer expired";
-			// Cause 0x03 means "abnormal release, timer expired".
-			// TODO -- Send diagnostics.
-			DCCH->send(L3ChannelRelease(0x03));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
-		catch (SIP::SIPTimeout except) {
-			// FIXME -- The transaction ID should be an argument here.
-			LOG(WARNING) << "Uncaught SIPTimeout, will leave a stray transcation";
-			// Cause 0x03 means "abnormal release, timer expired".
-			DCCH->send(L3ChannelRelease(0x03));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
-		catch (SIP::SIPError except) {
-			// FIXME -- The transaction ID should be an argument here.
-			LOG(WARNING) << "Uncaught SIPError, will leave a stray transcation";
-			// Cause 0x01 means "abnormal release, unspecified".
-			DCCH->send(L3ChannelRelease(0x01));
-			if (except.transactionID()) gTransactionTable.remove(except.transactionID());
-		}
+	catch (RemovedTransaction except) {
+		LOG(ERR) << "attempt to use removed transaciton " << except.transactionID();
+	}
+	catch (ChannelReadTimeout except) {
+		LOG(NOTICE) << "ChannelReadTimeout";
+		// Cause 0x03 means "abnormal release, timer expired".
+		DCCH->send(L3ChannelRelease(0x03));
+		gTransactionTable.remove(except.transactionID());
+	}
+	catch (UnexpectedPrimitive except) {
+		LOG(NOTICE) << "UnexpectedPrimitive";
+		// Cause 0x62 means "message type not not compatible with protocol state".
+		DCCH->send(L3ChannelRelease(0x62));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+	catch (UnexpectedMessage except) {
+		LOG(NOTICE) << "UnexpectedMessage";
+		// Cause 0x62 means "message type not not compatible with protocol state".
+		DCCH->send(L3ChannelRelease(0x62));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+	catch (UnsupportedMessage except) {
+		LOG(NOTICE) << "UnsupportedMessage";
+		// Cause 0x61 means "message type not implemented".
+		DCCH->send(L3ChannelRelease(0x61));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+	catch (Q931TimerExpired except) {
+		LOG(NOTICE) << "Q.931 T3xx timer expired";
+		// Cause 0x03 means "abnormal release, timer expired".
+		// TODO -- Send diagnostics.
+		DCCH->send(L3ChannelRelease(0x03));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+	catch (SIP::SIPTimeout except) {
+		// FIXME -- The transaction ID should be an argument here.
+		LOG(WARNING) << "Uncaught SIPTimeout, will leave a stray transcation";
+		// Cause 0x03 means "abnormal release, timer expired".
+		DCCH->send(L3ChannelRelease(0x03));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+	catch (SIP::SIPError except) {
+		// FIXME -- The transaction ID should be an argument here.
+		LOG(WARNING) << "Uncaught SIPError, will leave a stray transcation";
+		// Cause 0x01 means "abnormal release, unspecified".
+		DCCH->send(L3ChannelRelease(0x01));
+		if (except.transactionID()) gTransactionTable.remove(except.transactionID());
+	}
+}
+
+
+
+/**
+	The threads that run DCCH transactions.
+	L2 wakes the pool when a channel establishes, through the channel's
+	establish callback, and a pool thread runs transactions on that channel
+	until none are left queued.  Transactions block for their whole length,
+	calls included, so the pool grows when every thread is busy,
+	up to one thread per channel, and never shrinks.
+*/
+class DCCHDispatchPool {
+
+	private:
+
+	enum ChannelState {
+		Idle,			///< no thread, nothing queued
+		Queued,			///< in mReady, waiting for a thread
+		Running,		///< a thread is running its transactions
+		Rearmed			///< running, and more primitives arrived since the last check
+	};
+
+	typedef std::map<LogicalChannel*,ChannelState> ChannelStateMap;
+
+	ChannelStateMap mChannels;				///< every channel in the pool
+	std::list<LogicalChannel*> mReady;		///< channels waiting for a thread
+	unsigned mThreads;						///< threads started
+	unsigned mIdleThreads;					///< threads waiting for a channel
+	Mutex mLock;
+	Signal mReadySignal;
+
+	/** Start a thread; caller holds mLock. */
+	void startThread();
+
+	public:
+
+	DCCHDispatchPool()
+		:mThreads(0),mIdleThreads(0)
+	{}
+
+	/** Add a channel, starting the pool on first use. */
+	void add(LogicalChannel*);
+
+	/** A channel has an establishing primitive queued. */
+	void ready(LogicalChannel*);
+
+	/** Block until a channel is ready and claim it. */
+	LogicalChannel* take();
+
+	/**
+		Release a claimed channel, unless it was woken again since claimed.
+		@return true if the channel went idle.
+	*/
+	bool release(LogicalChannel*);
+};
+
+
+static DCCHDispatchPool gDCCHDispatchPool;
+
+
+/** The pool thread. */
+static void *DCCHDispatchPoolLoop(void*)
+{
+	while (true) {
+		LogicalChannel *DCCH = gDCCHDispatchPool.take();
+		do {
+			while (L3Frame *frame = DCCH->readEstablishOrHandover()) {
+				DCCHDispatchTransaction(frame,DCCH);
+			}
+		} while (!gDCCHDispatchPool.release(DCCH));
 	}
+	return NULL;
+}
+
+
+/** The establish callback, run in the L2 thread. */
+static void DCCHDispatchReady(void *DCCH)
+{
+	gDCCHDispatchPool.ready((LogicalChannel*)DCCH);
+}
+
+
+void DCCHDispatchPool::startThread()
+{
+	Thread *thread = new Thread;
+	thread->start(DCCHDispatchPoolLoop,NULL);
+	mThreads++;
+	LOG(INFO) << "DCCH dispatcher pool has " << mThreads << " thread(s) for " << mChannels.size() << " channel(s)";
+}
+
+
+void DCCHDispatchPool::add(LogicalChannel *DCCH)
+{
+	ScopedLock lock(mLock);
+	mChannels[DCCH] = Idle;
+	DCCH->establishCallback(DCCHDispatchReady,DCCH);
+	unsigned minThreads = gConfig.getNum("Control.DCCH.DispatcherThreads");
+	while (mThreads < minThreads && mThreads < mChannels.size()) startThread();
+}
+
+
+void DCCHDispatchPool::ready(LogicalChannel *DCCH)
+{
+	ScopedLock lock(mLock);
+	ChannelStateMap::iterator itr = mChannels.find(DCCH);
+	assert(itr!=mChannels.end());
+	switch (itr->second) {
+		case Idle:
+			itr->second = Queued;
+			mReady.push_back(DCCH);
+			// Grow if every thread is tied up.
+			if (mIdleThreads < mReady.size() && mThreads < mChannels.size()) startThread();
+			mReadySignal.signal();
+			break;
+		case Running:
+			itr->second = Rearmed;
+			break;
+		case Queued:
+		case Rearmed:
+			break;
+	}
+}
+
+
+LogicalChannel* DCCHDispatchPool::take()
+{
+	ScopedLock lock(mLock);
+	mIdleThreads++;
+	while (mReady.empty()) mReadySignal.wait(mLock);
+	mIdleThreads--;
+	LogicalChannel *DCCH = mReady.front();
+	mReady.pop_front();
+	mChannels[DCCH] = Running;
+	return DCCH;
+}
+
+
+bool DCCHDispatchPool::release(LogicalChannel *DCCH)
+{
+	ScopedLock lock(mLock);
+	ChannelStateMap::iterator itr = mChannels.find(DCCH);
+	assert(itr!=mChannels.end());
+	if (itr->second==Rearmed) {
+		itr->second = Running;
+		return false;
+	}
+	itr->second = Idle;
+	return true;
+}
+
+
+
+void Control::DCCHDispatcherAdd(LogicalChannel *DCCH)
+{
+	gDCCHDispatchPool.add(DCCH);
 }
 
 
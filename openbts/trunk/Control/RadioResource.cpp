@@ -669,109 +669,173 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 
 
 
+/**
+	Locate the paging group of a mobile, from its IMSI when we know it.
+	A mobile paged by TMSI with no IMSI in its transaction is filed
+	by its TMSI instead, which at least spreads the load.
+*/
+static PagingGroup pagingGroup(const L3MobileIdentity& ID, const TransactionEntry& transaction)
+{
+	const char *IMSI = NULL;
+	if (ID.type()==IMSIType) IMSI = ID.digits();
+	else if (transaction.subscriber().type()==IMSIType) IMSI = transaction.subscriber().digits();
+	unsigned imsiMod1000 = 0;
+	if (IMSI) {
+		size_t len = strlen(IMSI);
+		imsiMod1000 = atoi(len>3 ? IMSI+len-3 : IMSI);
+	} else if (ID.type()==TMSIType) {
+		imsiMod1000 = ID.TMSI() % 1000;
+	}
+	PagingGroup group;
+	gBTS.crackPagingFromImsi(imsiMod1000,group.second,group.first);
+	return group;
+}
+
+
 void Pager::addID(const L3MobileIdentity& newID, ChannelType chanType,
 		TransactionEntry& transaction, unsigned wLife)
 {
 	transaction.GSMState(GSM::Paging);
 	transaction.setTimer("3113",wLife);
+	PagingGroup group = pagingGroup(newID,transaction);
 	// Add a mobile ID to the paging list for a given lifetime.
 	ScopedLock lock(mLock);
 	// If this ID is already in the list, just reset its timer.
-	// Uhg, another linear time search.
-	// This would be faster if the paging list were ordered by ID.
-	// But the list should usually be short, so it may not be worth the effort.
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==newID) {
-			LOG(DEBUG) << newID << " already in table";
-			lp->renew(wLife);
-			mPageSignal.signal();
-			return;
-		}
+	PagingIDMap::iterator ip = mIDs.find(newID);
+	if (ip!=mIDs.end()) {
+		LOG(DEBUG) << newID << " already in table";
+		ip->second->renew(wLife);
+		mExpirations.push(PagingExpiration(ip->second->expiration(),newID));
+		mPageSignal.signal();
+		return;
 	}
-	// If this ID is new, put it in the list.
-	mPageIDs.push_back(PagingEntry(newID,chanType,transaction.ID(),wLife));
+	// If this ID is new, put it in the list for its paging group.
+	PagingEntryList& list = mGroups[group];
+	list.push_back(PagingEntry(newID,chanType,transaction.ID(),group,wLife));
+	PagingEntryList::iterator lp = --list.end();
+	mIDs[newID] = lp;
+	mExpirations.push(PagingExpiration(lp->expiration(),newID));
 	LOG(INFO) << newID << " added to table";
 	mPageSignal.signal();
 }
 
 
+void Pager::erase(PagingIDMap::iterator ip)
+{
+	PagingGroupMap::iterator gp = mGroups.find(ip->second->group());
+	assert(gp!=mGroups.end());
+	gp->second.erase(ip->second);
+	if (gp->second.empty()) mGroups.erase(gp);
+	mIDs.erase(ip);
+	// Nothing left to expire, so drop any stale heap records.
+	if (mIDs.empty()) mExpirations = PagingExpirationHeap();
+}
+
+
 unsigned Pager::removeID(const L3MobileIdentity& delID)
 {
 	// Return the associated transaction ID, or 0 if none found.
 	LOG(INFO) << delID;
 	ScopedLock lock(mLock);
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==delID) {
-			unsigned retVal = lp->transactionID();
-			mPageIDs.erase(lp);
-			return retVal;
-		}
-	}
-	return 0;
+	PagingIDMap::iterator ip = mIDs.find(delID);
+	if (ip==mIDs.end()) return 0;
+	unsigned retVal = ip->second->transactionID();
+	erase(ip);
+	return retVal;
 }
 
 
+void Pager::expire()
+{
+	while (!mExpirations.empty() && mExpirations.top().mWhen.passed()) {
+		PagingIDMap::iterator ip = mIDs.find(mExpirations.top().mID);
+		mExpirations.pop();
+		// Stale record?  The entry is gone or has been renewed.
+		if (ip==mIDs.end()) continue;
+		if (!ip->second->expired()) continue;
+		LOG(INFO) << "erasing " << ip->first;
+		// Non-responsive.
+		gTransactionTable.removePaging(ip->second->transactionID());
+		erase(ip);
+	}
+}
+
 
 unsigned Pager::pageAll()
 {
-	// Traverse the full list and page all IDs.
+	// Page all IDs, one paging group after another.
 	// Remove expired IDs.
 	// Return the number of IDs paged.
-	// This is a linear time operation.
+	// This is a linear time operation, but only in the number of live entries.
 
 	ScopedLock lock(mLock);
 
-	// Clear expired entries.
-	PagingEntryList::iterator lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		bool expired = lp->expired();
-		bool defunct = gTransactionTable.find(lp->transactionID()) == NULL;
-		if (!expired && !defunct) ++lp;
-		else {
-			LOG(INFO) << "erasing " << lp->ID();
-			// Non-responsive, dead transaction?
-			gTransactionTable.removePaging(lp->transactionID());
-			// remove from the list
-			lp=mPageIDs.erase(lp);
-		}
-	}
+	expire();
+	if (mGroups.empty()) return 0;
 
-	LOG(INFO) << "paging " << mPageIDs.size() << " mobile(s)";
+	// Start from where the last pass left off,
+	// so no group is always at the back of the PCH queue.
+	PagingGroupMap::iterator gp = mGroups.lower_bound(mNextGroup);
+	if (gp==mGroups.end()) gp = mGroups.begin();
+	PagingGroupMap::iterator next = gp;
+	++next;
+	mNextGroup = (next==mGroups.end()) ? mGroups.begin()->first : next->first;
+
+	LOG(INFO) << "paging " << mIDs.size() << " mobile(s) in " << mGroups.size() << " group(s)";
 
 	// Page remaining entries, two at a time if possible.
 	// These PCH send operations are non-blocking.
-	lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		// FIXME -- This completely ignores the paging groups.
-		// HACK -- So we send every page twice.
-		// That will probably mean a different Pager for each subchannel.
-		// See GSM 04.08 10.5.2.11 and GSM 05.02 6.5.2.
-		const L3MobileIdentity& id1 = lp->ID();
-		ChannelType type1 = lp->type();
-		++lp;
-		if (lp==mPageIDs.end()) {
-			// Just one ID left?
-			LOG(DEBUG) << "paging " << id1;
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			break;
+	// FIXME -- The pages still all go out on the same PCH, whatever their paging group.
+	// HACK -- So we send every page twice.
+	// That will probably mean a different Pager for each subchannel.
+	// See GSM 04.08 10.5.2.11 and GSM 05.02 6.5.2.
+	vector<L3MobileIdentity> defunct;
+	vector<const PagingEntry*> live;
+	for (size_t n=mGroups.size(); n>0; n--) {
+		if (gp==mGroups.end()) gp = mGroups.begin();
+		const PagingEntryList& list = gp->second;
+		++gp;
+		// Skip dead transactions; they are cleared below.
+		live.clear();
+		for (PagingEntryList::const_iterator lp = list.begin(); lp != list.end(); ++lp) {
+			if (gTransactionTable.find(lp->transactionID()) == NULL) defunct.push_back(lp->ID());
+			else live.push_back(&*lp);
+		}
+		// Page by pairs when possible, keeping the pairs within the group.
+		for (size_t i=0; i<live.size(); i+=2) {
+			const L3MobileIdentity& id1 = live[i]->ID();
+			ChannelType type1 = live[i]->type();
+			if (i+1==live.size()) {
+				// Just one ID left?
+				LOG(DEBUG) << "paging " << id1;
+				gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
+				gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
+				break;
+			}
+			const L3MobileIdentity& id2 = live[i+1]->ID();
+			ChannelType type2 = live[i+1]->type();
+			LOG(DEBUG) << "paging " << id1 << " and " << id2;
+			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
+			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
 		}
-		// Page by pairs when possible.
-		const L3MobileIdentity& id2 = lp->ID();
-		ChannelType type2 = lp->type();
-		++lp;
-		LOG(DEBUG) << "paging " << id1 << " and " << id2;
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
 	}
 
-	return mPageIDs.size();
+	// Clear entries for dead transactions.
+	for (size_t i=0; i<defunct.size(); i++) {
+		PagingIDMap::iterator ip = mIDs.find(defunct[i]);
+		if (ip==mIDs.end()) continue;
+		LOG(INFO) << "erasing " << ip->first;
+		gTransactionTable.removePaging(ip->second->transactionID());
+		erase(ip);
+	}
+
+	return mIDs.size();
 }
 
 size_t Pager::pagingEntryListSize()
 {
 	ScopedLock lock(mLock);
-	return mPageIDs.size();
+	return mIDs.size();
 }
 
 void Pager::start()
@@ -795,7 +859,7 @@ void Pager::serviceLoop()
 
 		LOG(DEBUG) << "Pager blocking for signal";
 		mLock.lock();
-		while (mPageIDs.size()==0) mPageSignal.wait(mLock);
+		while (mIDs.size()==0) mPageSignal.wait(mLock);
 		mLock.unlock();
 
 		// page everything
@@ -814,10 +878,11 @@ void Pager::serviceLoop()
 void Pager::dump(ostream& os) const
 {
 	ScopedLock lock(mLock);
-	PagingEntryList::const_iterator lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		os << lp->ID() << " " << lp->type() << " " << lp->expired() << endl;
-		++lp;
+	for (PagingGroupMap::const_iterator gp = mGroups.begin(); gp != mGroups.end(); ++gp) {
+		const PagingEntryList& list = gp->second;
+		for (PagingEntryList::const_iterator lp = list.begin(); lp != list.end(); ++lp) {
+			os << lp->ID() << " " << lp->type() << " " << lp->expired() << endl;
+		}
 	}
 }
 
@@ -21,6 +21,8 @@
 #define RADIORESOURCE_H
 
 #include <list>
+#include <map>
+#include <queue>
 #include <GSML3CommonElements.h>
 #include <Interthread.h>
 
@@ -108,6 +110,12 @@ void* AccessGrantServiceLoop(void*);
 /**@ Paging mechanisms */
 //@{
 
+/**
+	A paging group, as located by GSMConfig::crackPagingFromImsi:
+	the 51-multiframe index and the paging block index within it.
+*/
+typedef std::pair<unsigned,unsigned> PagingGroup;
+
 /** An entry in the paging list. */
 class PagingEntry {
 
@@ -116,6 +124,7 @@ class PagingEntry {
 	GSM::L3MobileIdentity mID;		///< The mobile ID.
 	GSM::ChannelType mType;			///< The needed channel type.
 	unsigned mTransactionID;		///< The associated transaction ID.
+	PagingGroup mGroup;				///< The paging group of the mobile.
 	Timeval mExpiration;			///< The expiration time for this entry.
 
 	public:
@@ -126,8 +135,8 @@ class PagingEntry {
 		@param wLife The number of milliseconds to keep paging.
 	*/
 	PagingEntry(const GSM::L3MobileIdentity& wID, GSM::ChannelType wType,
-			unsigned wTransactionID, unsigned wLife)
-		:mID(wID),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
+			unsigned wTransactionID, const PagingGroup& wGroup, unsigned wLife)
+		:mID(wID),mType(wType),mTransactionID(wTransactionID),mGroup(wGroup),mExpiration(wLife)
 	{}
 
 	/** Access the ID. */
@@ -138,6 +147,10 @@ class PagingEntry {
 
 	unsigned transactionID() const { return mTransactionID; }
 
+	const PagingGroup& group() const { return mGroup; }
+
+	const Timeval& expiration() const { return mExpiration; }
+
 	/** Renew the timer. */
 	void renew(unsigned wLife) { mExpiration = Timeval(wLife); }
 
@@ -148,19 +161,53 @@ class PagingEntry {
 
 typedef std::list<PagingEntry> PagingEntryList;
 
+/** The paging list, one list per paging group. */
+typedef std::map<PagingGroup,PagingEntryList> PagingGroupMap;
+
+/** Index of the paging list by mobile ID. */
+typedef std::map<GSM::L3MobileIdentity,PagingEntryList::iterator> PagingIDMap;
+
+/**
+	An expiration time recorded in the pager's expiry heap.
+	Renewing an entry records a new time and leaves the old one in the heap,
+	so a record is stale if its entry has been removed or renewed since.
+*/
+struct PagingExpiration {
+	Timeval mWhen;
+	GSM::L3MobileIdentity mID;
+
+	PagingExpiration(const Timeval& wWhen, const GSM::L3MobileIdentity& wID)
+		:mWhen(wWhen),mID(wID)
+	{}
+
+	/** Ordered so that the earliest time is at the top of a std::priority_queue. */
+	bool operator<(const PagingExpiration& other) const
+	{
+		if (mWhen.sec()!=other.mWhen.sec()) return mWhen.sec() > other.mWhen.sec();
+		return mWhen.usec() > other.mWhen.usec();
+	}
+};
+
+typedef std::priority_queue<PagingExpiration> PagingExpirationHeap;
+
 
 /**
 	The pager is a global object that generates paging messages on the CCCH.
 	To page a mobile, add the mobile ID to the pager.
 	The entry will be deleted automatically when it expires.
-	All pager operations are linear time.
-	Not much point in optimizing since the main operation is inherently linear.
+	Entries are kept in per-paging-group lists, indexed by mobile ID,
+	so adding and removing an ID is log time in the number of entries.
+	Expired entries are found through a heap, without a scan of the lists.
+	Paging itself is still linear, since every live entry is paged each cycle.
 */
 class Pager {
 
 	private:
 
-	PagingEntryList mPageIDs;				///< List of ID's to be paged.
+	PagingGroupMap mGroups;					///< IDs to be paged, by paging group.
+	PagingIDMap mIDs;						///< Index of mGroups by mobile ID.
+	PagingExpirationHeap mExpirations;		///< Expiration times of the entries.
+	PagingGroup mNextGroup;					///< Round-robin starting point for pageAll.
 	mutable Mutex mLock;					///< Lock for thread-safe access.
 	Signal mPageSignal;						///< signal to wake the paging loop
 	Thread mPagingThread;					///< Thread for the paging loop.
@@ -198,8 +245,16 @@ class Pager {
 
 	private:
 
+	/** Remove an entry from the list and the index; caller holds mLock. */
+	void erase(PagingIDMap::iterator);
+
+	/** Remove expired entries, as found in the expiry heap; caller holds mLock. */
+	void expire();
+
 	/**
 		Traverse the paging list, paging all IDs.
+		Groups are visited round-robin, one after another, and IDs
+		are paired only with others in the same paging group.
 		@return Number of IDs paged.
 	*/
 	unsigned pageAll();
@@ -44,7 +44,7 @@ sqlite3* SMSCBConnectDatabase(const char* path, sqlite3 **DB)
 	int rc = sqlite3_open(path,DB);
 	if (rc) {
 		LOG(EMERG) << "Cannot open SMSCB database on path " << path << ": " << sqlite3_errmsg(*DB);
-		sqlite3_close(*DB);
+		sqlite3_close_cached(*DB);
 		*DB = NULL;
 		return NULL;
 	}
@@ -85,8 +85,8 @@ void SMSCBSendMessage(sqlite3* DB, sqlite3_stmt* stmt, GSM::CBCHLogicalChannel*
 	unsigned sendCount = (unsigned)sqlite3_column_int(stmt,6);
 	unsigned rowid = (unsigned)sqlite3_column_int(stmt,7);
 	// Done with the database entry.
-	// Finalize ASAP to unlock the database.
-	sqlite3_finalize(stmt);
+	// Reset ASAP to unlock the database.
+	sqlite3_reset(stmt);
 
 	// Figure out how many pages to send.
 	const unsigned maxLen = 40*15;
@@ -148,10 +148,8 @@ void SMSCBSendMessage(sqlite3* DB, sqlite3_stmt* stmt, GSM::CBCHLogicalChannel*
 	free(messageText);
 
 	// Update send count and send time in the database.
-	char query[100];
-	sprintf(query,"UPDATE SMSCB SET SEND_TIME = %u, SEND_COUNT = %u WHERE ROWID == %u",
-		(unsigned)time(NULL), sendCount+1, rowid);
-	if (!sqlite3_command(DB,query)) LOG(ALERT) << "timestamp update failed: " << sqlite3_errmsg(DB);
+	SQLiteQuery q(DB,"UPDATE SMSCB SET SEND_TIME = ?1, SEND_COUNT = ?2 WHERE ROWID == ?3");
+	if (!q.bind((unsigned)time(NULL)).bind(sendCount+1).bind(rowid).run()) LOG(ALERT) << "timestamp update failed: " << sqlite3_errmsg(DB);
 }
 
 
@@ -177,15 +175,15 @@ void* Control::SMSCBSender(void*)
 			" GS,MESSAGE_CODE,UPDATE_NUMBER,MSGID,MESSAGE,LANGUAGE_CODE,SEND_COUNT,ROWID"
 			" FROM SMSCB"
 			" WHERE SEND_TIME==(SELECT min(SEND_TIME) FROM SMSCB)";
-		sqlite3_stmt *stmt;
-		if (sqlite3_prepare_statement(DB,&stmt,query)) {
+		SQLiteQuery q(DB,query);
+		if (!q.valid()) {
 			LOG(ALERT) << "Cannot access SMSCB database: " << sqlite3_errmsg(DB);
 			sleep(1);
 			continue;
 		}
 		// Send the message or sleep briefly.
-		int result = sqlite3_run_query(DB,stmt);
-		if (result==SQLITE_ROW) SMSCBSendMessage(DB,stmt,CBCH);
+		int result = q.step();
+		if (result==SQLITE_ROW) SMSCBSendMessage(DB,q.stmt(),CBCH);
 		else sleep(1);
 		// Log errors.
 		if ((result!=SQLITE_ROW) && (result!=SQLITE_DONE))
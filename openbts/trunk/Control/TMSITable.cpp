@@ -36,6 +36,21 @@ using namespace std;
 using namespace Control;
 
 
+namespace Control {
+
+/** A TMSIRecord in memory. */
+class TMSIEntry {
+
+	public:
+
+	TMSIRecord record;
+	bool dirty;							///< changed since last written
+	TMSIEntryList::iterator position;	///< in TMSITable::mLRU
+};
+
+}
+
+
 static const char* createTMSITable = {
 	"CREATE TABLE IF NOT EXISTS TMSI_TABLE ("
 		"TMSI INTEGER PRIMARY KEY AUTOINCREMENT, "
@@ -60,6 +75,13 @@ static const char* createTMSITable = {
 	")"
 };
 
+/** Everything a TMSIRecord holds, in readRecord order. */
+static const char* selectTMSIRecords = {
+	"SELECT TMSI,IMSI,IMEI,CREATED,ACCESSED,L3TI,A5_SUPPORT,POWER_CLASS,"
+		"RANDUPPER,RANDLOWER,SRES,kc,PREV_MCC,PREV_MNC,PREV_LAC,OLD_TMSI "
+	"FROM TMSI_TABLE "
+};
+
 
 
 
@@ -83,7 +105,7 @@ int TMSITable::open(const char* wPath)
 	}
 	if (rc) {
 		LOG(EMERG) << "Cannot open TMSITable database at " << wPath << ": " << sqlite3_errmsg(mDB);
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return 1;
 	}
@@ -95,6 +117,8 @@ int TMSITable::open(const char* wPath)
 	if (!sqlite3_command(mDB,enableWAL)) {
 		LOG(EMERG) << "Cannot enable WAL mode on database at " << wPath << ", error message: " << sqlite3_errmsg(mDB);
 	}
+	load();
+	mWriter.start((void*(*)(void*))TMSITableWriter,this);
     return 0;
 }
 
@@ -102,7 +126,168 @@ int TMSITable::open(const char* wPath)
 
 TMSITable::~TMSITable()
 {
-	if (mDB) sqlite3_close(mDB);
+	// Don't bother disposing of the entries,
+	// since this is only invoked when the application exits.
+	// But do keep the TMSIs that were assigned since the last write.
+	ScopedLock lock(mDBLock);
+	writeChanges();
+	if (mDB) sqlite3_close_cached(mDB);
+	mDB = NULL;
+}
+
+
+
+/** Read a row selected with selectTMSIRecords. */
+static void readRecord(sqlite3_stmt* stmt, TMSIRecord& record)
+{
+	record.TMSI = (unsigned)sqlite3_column_int64(stmt,0);
+	const char* IMSI = (const char*)sqlite3_column_text(stmt,1);
+	if (IMSI) record.IMSI = IMSI;
+	const char* IMEI = (const char*)sqlite3_column_text(stmt,2);
+	if (IMEI) record.IMEI = IMEI;
+	record.created = (unsigned)sqlite3_column_int64(stmt,3);
+	record.accessed = (unsigned)sqlite3_column_int64(stmt,4);
+	record.L3TI = (unsigned)sqlite3_column_int(stmt,5);
+	if (sqlite3_column_type(stmt,6)!=SQLITE_NULL) record.A5Support = sqlite3_column_int(stmt,6);
+	if (sqlite3_column_type(stmt,7)!=SQLITE_NULL) record.powerClass = sqlite3_column_int(stmt,7);
+	record.hasAuthTokens = sqlite3_column_type(stmt,8)!=SQLITE_NULL;
+	record.upperRAND = (uint64_t)sqlite3_column_int64(stmt,8);
+	record.lowerRAND = (uint64_t)sqlite3_column_int64(stmt,9);
+	record.SRES = (uint32_t)sqlite3_column_int64(stmt,10);
+	const char* Kc = (const char*)sqlite3_column_text(stmt,11);
+	if (Kc) record.Kc = Kc;
+	if (sqlite3_column_type(stmt,12)!=SQLITE_NULL) record.prevMCC = sqlite3_column_int(stmt,12);
+	if (sqlite3_column_type(stmt,13)!=SQLITE_NULL) record.prevMNC = sqlite3_column_int(stmt,13);
+	if (sqlite3_column_type(stmt,14)!=SQLITE_NULL) record.prevLAC = sqlite3_column_int(stmt,14);
+	record.hasOldTMSI = sqlite3_column_type(stmt,15)!=SQLITE_NULL;
+	record.oldTMSI = (unsigned)sqlite3_column_int64(stmt,15);
+}
+
+
+
+void TMSITable::load()
+{
+	// Take the most recently seen subscribers in one pass over the table.
+	Timeval timer;
+	unsigned maxEntries = gConfig.getNum("Control.Reporting.TMSITableMaxEntries");
+	string query = string(selectTMSIRecords) + "ORDER BY ACCESSED DESC LIMIT ?1";
+	ScopedLock dbLock(mDBLock);
+	ScopedLock lock(mLock);
+	SQLiteQuery q(mDB,query.c_str());
+	q.bind(maxEntries+1);
+	while (q.step()==SQLITE_ROW) {
+		if (mByTMSI.size()==maxEntries) {
+			mComplete = false;
+			break;
+		}
+		TMSIRecord record;
+		readRecord(q.stmt(),record);
+		insert(record,false);
+	}
+	// Inserted newest first, each at the front.
+	mLRU.reverse();
+
+	// Never reuse a TMSI, as AUTOINCREMENT would not.
+	SQLiteQuery maxQuery(mDB,"SELECT MAX(TMSI) FROM TMSI_TABLE");
+	if (maxQuery.step()==SQLITE_ROW) {
+		unsigned next = (unsigned)sqlite3_column_int64(maxQuery.stmt(),0) + 1;
+		if (next > mNextTMSI) mNextTMSI = next;
+	}
+	SQLiteQuery seqQuery(mDB,"SELECT seq FROM sqlite_sequence WHERE name=='TMSI_TABLE'");
+	if (seqQuery.step()==SQLITE_ROW) {
+		unsigned next = (unsigned)sqlite3_column_int64(seqQuery.stmt(),0) + 1;
+		if (next > mNextTMSI) mNextTMSI = next;
+	}
+
+	LOG(INFO) << "loaded " << mByTMSI.size() << (mComplete ? " " : " most recent ")
+		<< "TMSI table entries in " << timer.elapsed() << " ms";
+}
+
+
+
+TMSIEntry* TMSITable::insert(const TMSIRecord& record, bool dirty)
+{
+	TMSIEntry* entry = new TMSIEntry;
+	entry->record = record;
+	entry->dirty = false;
+	entry->position = mLRU.insert(mLRU.begin(),entry);
+	mByTMSI[record.TMSI] = entry;
+	mByIMSI[record.IMSI] = entry;
+	if (dirty) changed(entry);
+	return entry;
+}
+
+
+
+void TMSITable::changed(TMSIEntry* entry)
+{
+	if (entry->dirty) return;
+	entry->dirty = true;
+	mChanged.push_back(entry);
+}
+
+
+
+void TMSITable::touch(TMSIEntry* entry)
+{
+	entry->record.accessed = (unsigned)time(NULL);
+	mLRU.splice(mLRU.begin(),mLRU,entry->position);
+	changed(entry);
+}
+
+
+
+TMSIEntry* TMSITable::readThrough(const char* IMSI, unsigned TMSI)
+{
+	// Every row is already here, so there is nothing to read.
+	if (mComplete) return NULL;
+
+	// Don't hold up the other lookups while reading.
+	TMSIRecord record;
+	bool found = false;
+	mLock.unlock();
+	mDBLock.lock();
+	if (mDB) {
+		string query = string(selectTMSIRecords) + (IMSI ? "WHERE IMSI==?1" : "WHERE TMSI==?1");
+		SQLiteQuery q(mDB,query.c_str());
+		if (IMSI) q.bind(IMSI);
+		else q.bind(TMSI);
+		found = q.step()==SQLITE_ROW;
+		if (found) readRecord(q.stmt(),record);
+	}
+	mDBLock.unlock();
+	mLock.lock();
+
+	// It may have been read or created meanwhile.
+	if (IMSI) {
+		IMSIIndex::iterator itr = mByIMSI.find(IMSI);
+		if (itr!=mByIMSI.end()) return itr->second;
+	} else {
+		TMSIIndex::iterator itr = mByTMSI.find(TMSI);
+		if (itr!=mByTMSI.end()) return itr->second;
+	}
+	if (!found) return NULL;
+	return insert(record,false);
+}
+
+
+
+TMSIEntry* TMSITable::findIMSI(const char* IMSI, bool access)
+{
+	IMSIIndex::iterator itr = mByIMSI.find(IMSI);
+	TMSIEntry* entry = (itr!=mByIMSI.end()) ? itr->second : readThrough(IMSI,0);
+	if (entry && access) touch(entry);
+	return entry;
+}
+
+
+
+TMSIEntry* TMSITable::findTMSI(unsigned TMSI, bool access)
+{
+	TMSIIndex::iterator itr = mByTMSI.find(TMSI);
+	TMSIEntry* entry = (itr!=mByTMSI.end()) ? itr->second : readThrough(NULL,TMSI);
+	if (entry && access) touch(entry);
+	return entry;
 }
 
 
@@ -117,75 +302,52 @@ unsigned TMSITable::assign(const char* IMSI, const GSM::L3LocationUpdatingReques
 	gReports.incr("OpenBTS.GSM.MM.TMSI.Assigned");
 
 	LOG(DEBUG) << "IMSI=" << IMSI;
+	ScopedLock lock(mLock);
 	// Is there already a record?
-	unsigned TMSI;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) {
-		LOG(DEBUG) << "found TMSI " << TMSI;
-		touch(TMSI);
-		return TMSI;
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (entry) {
+		LOG(DEBUG) << "found TMSI " << entry->record.TMSI;
+		return entry->record.TMSI;
 	}
 
 	// Create a new record.
 	LOG(NOTICE) << "new entry for IMSI " << IMSI;
-	char query[1000];
-	unsigned now = (unsigned)time(NULL);
-	if (!lur) {
-		sprintf(query,
-				"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED) "
-				"VALUES ('%s',%u,%u)",
-				IMSI,now,now);
-	} else {
+	TMSIRecord record;
+	record.TMSI = mNextTMSI++;
+	record.IMSI = IMSI;
+	record.created = (unsigned)time(NULL);
+	record.accessed = record.created;
+	if (lur) {
 		const GSM::L3LocationAreaIdentity &lai = lur->LAI();
 		const GSM::L3MobileIdentity &mid = lur->mobileID();
+		record.prevMCC = lai.MCC();
+		record.prevMNC = lai.MNC();
+		record.prevLAC = lai.LAC();
 		if (mid.type()==GSM::TMSIType) {
-			sprintf(query,
-					"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC,OLD_TMSI) "
-					"VALUES ('%s',%u,%u,%u,%u,%u,%u)",
-					IMSI,now,now,lai.MCC(),lai.MNC(),lai.LAC(),mid.TMSI());
-		} else {
-			sprintf(query,
-					"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC) "
-					"VALUES ('%s',%u,%u,%u,%u,%u)",
-					IMSI,now,now,lai.MCC(),lai.MNC(),lai.LAC());
+			record.hasOldTMSI = true;
+			record.oldTMSI = mid.TMSI();
 		}
 	}
-	if (!sqlite3_command(mDB,query)) {
-		LOG(ALERT) << "TMSI creation failed";
-		return 0;
-	}
-	if (!sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) {
-		LOG(ERR) << "TMSI database inconsistancy";
-		return 0;
-	}
-	return TMSI;
-}
-	
-
-
-void TMSITable::touch(unsigned TMSI) const
-{
-	// Update timestamp.
-	char query[100];
-	sprintf(query,"UPDATE TMSI_TABLE SET ACCESSED = %u WHERE TMSI == %u",
-		(unsigned)time(NULL),TMSI);
-	sqlite3_command(mDB,query);
+	return insert(record,true)->record.TMSI;
 }
 
 
 
 // Returned string must be free'd by the caller.
-char* TMSITable::IMSI(unsigned TMSI) const
+char* TMSITable::IMSI(unsigned TMSI)
 {
-	char* IMSI = NULL;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","TMSI",TMSI,"IMSI",IMSI)) touch(TMSI);
-	return IMSI;
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findTMSI(TMSI);
+	if (!entry) return NULL;
+	return strdup(entry->record.IMSI.c_str());
 }
 
-unsigned TMSITable::TMSI(const char* IMSI) const
+unsigned TMSITable::TMSI(const char* IMSI)
 {
-	unsigned TMSI=0;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) touch(TMSI);
-	return TMSI;
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (!entry) return 0;
+	return entry->record.TMSI;
 }
 
 
@@ -212,39 +374,51 @@ void printAge(unsigned seconds, ostream& os)
 }
 
 
-void TMSITable::dump(ostream& os) const
+void TMSITable::dump(ostream& os)
 {
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(mDB,&stmt,"SELECT TMSI,IMSI,CREATED,ACCESSED FROM TMSI_TABLE ORDER BY ACCESSED DESC")) {
+	// The database has every entry, not just the ones in memory.
+	flush();
+	ScopedLock lock(mDBLock);
+	if (!mDB) return;
+	SQLiteQuery q(mDB,"SELECT TMSI,IMSI,CREATED,ACCESSED FROM TMSI_TABLE ORDER BY ACCESSED DESC");
+	if (!q.valid()) {
 		LOG(ERR) << "sqlite3_prepare_statement failed";
 		return;
 	}
+	sqlite3_stmt *stmt = q.stmt();
 	time_t now = time(NULL);
-	while (sqlite3_run_query(mDB,stmt)==SQLITE_ROW) {
+	while (q.step()==SQLITE_ROW) {
 		os << hex << setw(8) << sqlite3_column_int64(stmt,0) << ' ' << dec;
 		os << sqlite3_column_text(stmt,1) << ' ';
 		printAge(now-sqlite3_column_int(stmt,2),os); os << ' ';
 		printAge(now-sqlite3_column_int(stmt,3),os); os << ' ';
 		os << endl;
 	}
-	sqlite3_finalize(stmt);
 }
 
 
 
 void TMSITable::clear()
 {
-	sqlite3_command(mDB,"DELETE FROM TMSI_TABLE WHERE 1");
+	ScopedLock dbLock(mDBLock);
+	ScopedLock lock(mLock);
+	for (TMSIEntryList::iterator itr = mLRU.begin(); itr != mLRU.end(); ++itr) delete *itr;
+	mLRU.clear();
+	mByTMSI.clear();
+	mByIMSI.clear();
+	mChanged.clear();
+	mComplete = true;
+	if (mDB) sqlite3_command(mDB,"DELETE FROM TMSI_TABLE WHERE 1");
 }
 
 
 
 bool TMSITable::IMEI(const char* IMSI, const char *IMEI)
 {
-	char query[100];
-	sprintf(query,"UPDATE TMSI_TABLE SET IMEI=\"%s\",ACCESSED=%u WHERE IMSI=\"%s\"",
-		IMEI,(unsigned)time(NULL),IMSI);
-	return sqlite3_command(mDB,query);
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (entry) entry->record.IMEI = IMEI;
+	return true;
 }
 
 
@@ -252,32 +426,24 @@ bool TMSITable::IMEI(const char* IMSI, const char *IMEI)
 bool TMSITable::classmark(const char* IMSI, const GSM::L3MobileStationClassmark2& classmark)
 {
 	int A5Bits = (classmark.A5_1()<<2) + (classmark.A5_2()<<1) + classmark.A5_3();
-	char query[100];
-	sprintf(query,
-		"UPDATE TMSI_TABLE SET A5_SUPPORT=%u,ACCESSED=%u,POWER_CLASS=%u "
-		" WHERE IMSI=\"%s\"",
-		A5Bits,(unsigned)time(NULL),classmark.powerClass(),IMSI);
-	return sqlite3_command(mDB,query);
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (entry) {
+		entry->record.A5Support = A5Bits;
+		entry->record.powerClass = classmark.powerClass();
+	}
+	return true;
 }
 
 
 
 int TMSITable::getPreferredA5Algorithm(const char* IMSI)
 {
-	char query[200];
-	sprintf(query, "SELECT A5_SUPPORT from TMSI_TABLE WHERE IMSI=\"%s\"", IMSI);
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(mDB,&stmt,query)) {
-		LOG(ERR) << "sqlite3_prepare_statement failed for " << query;
-		return 0;
-	}
-	if (sqlite3_run_query(mDB,stmt)!=SQLITE_ROW) {
-		// Returning false here just means the IMSI is not there yet.
-		sqlite3_finalize(stmt);
-		return 0;
-	}
-	int cm = sqlite3_column_int(stmt,0);
-	sqlite3_finalize(stmt);
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI,false);
+	// Returning 0 here just means the IMSI is not there yet.
+	if (!entry || entry->record.A5Support<0) return 0;
+	int cm = entry->record.A5Support;
 	if (cm&1) return 3;
 	// if (cm&2) return 2; not supported
 	if (cm&4) return 1;
@@ -288,34 +454,26 @@ int TMSITable::getPreferredA5Algorithm(const char* IMSI)
 
 void TMSITable::putAuthTokens(const char* IMSI, uint64_t upperRAND, uint64_t lowerRAND, uint32_t SRES)
 {
-	char query[300];
-	sprintf(query,"UPDATE TMSI_TABLE SET RANDUPPER=%llu,RANDLOWER=%llu,SRES=%u,ACCESSED=%u WHERE IMSI=\"%s\"",
-		upperRAND,lowerRAND,SRES,(unsigned)time(NULL),IMSI);
-	if (!sqlite3_command(mDB,query)) {
-		LOG(ALERT) << "cannot write to TMSI table";
-	}
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (!entry) return;
+	entry->record.hasAuthTokens = true;
+	entry->record.upperRAND = upperRAND;
+	entry->record.lowerRAND = lowerRAND;
+	entry->record.SRES = SRES;
 }
 
 
 
 bool TMSITable::getAuthTokens(const char* IMSI, uint64_t& upperRAND, uint64_t& lowerRAND, uint32_t& SRES)
 {
-	char query[200];
-	sprintf(query,"SELECT RANDUPPER,RANDLOWER,SRES FROM TMSI_TABLE WHERE IMSI=\"%s\"",IMSI);
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(mDB,&stmt,query)) {
-		LOG(ERR) << "sqlite3_prepare_statement failed for " << query;
-		return false;
-	}
-	if (sqlite3_run_query(mDB,stmt)!=SQLITE_ROW) {
-		// Returning false here just means the IMSI is not there yet.
-		sqlite3_finalize(stmt);
-		return false;
-	}
-	upperRAND = sqlite3_column_int64(stmt,0);
-	lowerRAND = sqlite3_column_int64(stmt,1);
-	SRES = sqlite3_column_int(stmt,2);
-	sqlite3_finalize(stmt);
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI,false);
+	// Returning false here just means the IMSI is not there yet.
+	if (!entry) return false;
+	upperRAND = entry->record.upperRAND;
+	lowerRAND = entry->record.lowerRAND;
+	SRES = entry->record.SRES;
 	return true;
 }
 
@@ -323,46 +481,162 @@ bool TMSITable::getAuthTokens(const char* IMSI, uint64_t& upperRAND, uint64_t& l
 
 void TMSITable::putKc(const char* IMSI, string Kc)
 {
-	char query[300];
-	sprintf(query,"UPDATE TMSI_TABLE SET kc=\"%s\" WHERE IMSI=\"%s\"", Kc.c_str(), IMSI);
-	if (!sqlite3_command(mDB,query)) {
-		LOG(ALERT) << "cannot write Kc to TMSI table";
-	}
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI,false);
+	if (!entry) return;
+	entry->record.Kc = Kc;
+	changed(entry);
 }
 
 
 
 string TMSITable::getKc(const char* IMSI)
 {
-	char *Kc;
-	if (!sqlite3_single_lookup(mDB, "TMSI_TABLE", "IMSI", IMSI, "kc", Kc)) {
-		LOG(ERR) << "sqlite3_single_lookup failed to find kc for " << IMSI;
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI,false);
+	if (!entry) {
+		LOG(ERR) << "failed to find kc for " << IMSI;
 		return "";
 	}
-	string Kcs = string(Kc);
-	free(Kc);
-	return Kcs;
+	return entry->record.Kc;
 }
 
 
 
 unsigned TMSITable::nextL3TI(const char* IMSI)
 {
-	// FIXME -- This should be a single atomic operation.
-	unsigned l3ti;
-	if (!sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"L3TI",l3ti)) {
+	ScopedLock lock(mLock);
+	TMSIEntry* entry = findIMSI(IMSI);
+	if (!entry) {
 		LOG(ERR) << "cannot read L3TI from TMSI_TABLE, using random L3TI";
 		return random() % 7;
 	}
 	// Note that TI=7 is a reserved value, so value values are 0-6.  See GSM 04.07 11.2.3.1.3.
-	unsigned next = (l3ti+1) % 7;
-	char query[200];
-	sprintf(query,"UPDATE TMSI_TABLE SET L3TI=%u,ACCESSED=%u WHERE IMSI='%s'",
-		next, (unsigned)time(NULL),IMSI);
-	if (!sqlite3_command(mDB,query)) {
-		LOG(ALERT) << "cannot write L3TI to TMSI_TABLE";
+	entry->record.L3TI = (entry->record.L3TI+1) % 7;
+	return entry->record.L3TI;
+}
+
+
+
+/** Bind an integer, or NULL if it is not present. */
+static void bindOptional(SQLiteQuery& q, bool present, sqlite3_int64 value)
+{
+	if (present) q.bind(value);
+	else q.bind((const char*)NULL);
+}
+
+
+bool TMSITable::writeRecords(const vector<TMSIRecord>& records)
+{
+	SQLiteTransaction transaction(mDB);
+	// The insert only creates the row; columns set once stay as written.
+	SQLiteQuery insert(mDB,
+		"INSERT OR IGNORE INTO TMSI_TABLE (TMSI,IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC,OLD_TMSI) "
+		"VALUES (?1,?2,?3,?4,?5,?6,?7,?8)");
+	SQLiteQuery update(mDB,
+		"UPDATE TMSI_TABLE SET ACCESSED=?1,IMEI=?2,L3TI=?3,A5_SUPPORT=?4,POWER_CLASS=?5,"
+		"RANDUPPER=?6,RANDLOWER=?7,SRES=?8,kc=?9 WHERE TMSI==?10");
+	bool ok = transaction.active() && insert.valid() && update.valid();
+	for (unsigned i = 0; ok && i < records.size(); i++) {
+		const TMSIRecord& r = records[i];
+		insert.reset();
+		insert.bind(r.TMSI).bind(r.IMSI).bind(r.created).bind(r.accessed);
+		bindOptional(insert,r.prevMCC>=0,r.prevMCC);
+		bindOptional(insert,r.prevMNC>=0,r.prevMNC);
+		bindOptional(insert,r.prevLAC>=0,r.prevLAC);
+		bindOptional(insert,r.hasOldTMSI,r.oldTMSI);
+		ok = insert.run();
+		if (!ok) break;
+		update.reset();
+		update.bind(r.accessed);
+		if (r.IMEI.size()) update.bind(r.IMEI);
+		else update.bind((const char*)NULL);
+		update.bind(r.L3TI);
+		bindOptional(update,r.A5Support>=0,r.A5Support);
+		bindOptional(update,r.powerClass>=0,r.powerClass);
+		bindOptional(update,r.hasAuthTokens,(sqlite3_int64)r.upperRAND);
+		bindOptional(update,r.hasAuthTokens,(sqlite3_int64)r.lowerRAND);
+		bindOptional(update,r.hasAuthTokens,r.SRES);
+		update.bind(r.Kc).bind(r.TMSI);
+		ok = update.run();
+	}
+	ok = ok && transaction.commit();
+	// The transaction rolls back as it goes out of scope.
+	if (!ok) LOG(ERR) << "cannot write " << records.size() << " TMSI table entries: " << sqlite3_errmsg(mDB);
+	return ok;
+}
+
+
+
+bool TMSITable::flush()
+{
+	ScopedLock dbLock(mDBLock);
+	if (!writeChanges()) return false;
+	ScopedLock lock(mLock);
+	trim();
+	return true;
+}
+
+
+
+bool TMSITable::writeChanges()
+{
+	if (!mDB) return false;
+
+	// Copy out the changes, so lookups are blocked only for the copy.
+	vector<TMSIEntry*> changedEntries;
+	vector<TMSIRecord> records;
+	mLock.lock();
+	changedEntries.swap(mChanged);
+	records.reserve(changedEntries.size());
+	for (unsigned i = 0; i < changedEntries.size(); i++) {
+		records.push_back(changedEntries[i]->record);
+		changedEntries[i]->dirty = false;
+	}
+	mLock.unlock();
+
+	Timeval timer;
+	bool ok = records.empty() || writeRecords(records);
+
+	// Entries are only deleted under mDBLock, which we hold, so these are still valid.
+	ScopedLock lock(mLock);
+	if (!ok) {
+		for (unsigned i = 0; i < changedEntries.size(); i++) changed(changedEntries[i]);
+		return false;
+	}
+	if (records.size()) LOG(DEBUG) << "wrote " << records.size() << " TMSI table entries in " << timer.elapsed() << " ms";
+	return true;
+}
+
+
+
+void TMSITable::trim()
+{
+	size_t maxEntries = gConfig.getNum("Control.Reporting.TMSITableMaxEntries");
+	// Oldest first, skipping entries still to be written.
+	TMSIEntryList::iterator itr = mLRU.end();
+	while (mByTMSI.size() > maxEntries && itr != mLRU.begin()) {
+		--itr;
+		TMSIEntry* entry = *itr;
+		if (entry->dirty) continue;
+		mByTMSI.erase(entry->record.TMSI);
+		mByIMSI.erase(entry->record.IMSI);
+		itr = mLRU.erase(itr);
+		delete entry;
+		mComplete = false;
+	}
+}
+
+
+
+void* Control::TMSITableWriter(void* arg)
+{
+	TMSITable* table = (TMSITable*)arg;
+	while (true) {
+		msleep(gConfig.getNum("Control.Reporting.TMSITableWritePeriod"));
+		table->flush();
 	}
-	return next;
+	return NULL;
 }
 
 
@@ -20,13 +20,17 @@
 #ifndef TMSITABLE_H
 #define TMSITABLE_H
 
+#include <list>
 #include <map>
+#include <string>
+#include <vector>
 
 #include <Timeval.h>
 #include <Threads.h>
 
 
 struct sqlite3;
+class SQLiteQuery;
 
 namespace GSM {
 class L3LocationUpdatingRequest;
@@ -37,15 +41,76 @@ class L3MobileIdentity;
 
 namespace Control {
 
+
+/** One subscriber, as kept in memory and written to TMSI_TABLE. */
+struct TMSIRecord {
+	unsigned TMSI;
+	std::string IMSI;
+	std::string IMEI;			///< empty if unknown
+	unsigned created;			///< Unix time of record creation
+	unsigned accessed;			///< Unix time of last encounter
+	unsigned L3TI;				///< last L3 transaction identifier used
+	int A5Support;				///< A5 bits from the classmark, -1 if unknown
+	int powerClass;				///< -1 if unknown
+	bool hasAuthTokens;			///< true if the RAND/SRES fields are set
+	uint64_t upperRAND;
+	uint64_t lowerRAND;
+	uint32_t SRES;
+	std::string Kc;
+	// Previous network, from the LUR that created the record; written once.
+	int prevMCC;				///< -1 if unknown
+	int prevMNC;
+	int prevLAC;
+	bool hasOldTMSI;
+	unsigned oldTMSI;
+
+	TMSIRecord()
+		:TMSI(0),created(0),accessed(0),L3TI(0),A5Support(-1),powerClass(-1),
+		hasAuthTokens(false),upperRAND(0),lowerRAND(0),SRES(0),
+		prevMCC(-1),prevMNC(-1),prevLAC(-1),hasOldTMSI(false),oldTMSI(0)
+	{ }
+};
+
+class TMSIEntry;
+
+typedef std::map<unsigned, TMSIEntry*> TMSIIndex;
+typedef std::map<std::string, TMSIEntry*> IMSIIndex;
+typedef std::list<TMSIEntry*> TMSIEntryList;
+
+
+/**
+	The TMSI table.
+
+	Subscribers are kept in memory, indexed both by TMSI and by IMSI, so
+	location updating and paging never wait on SQLite.  The most recently
+	seen Control.Reporting.TMSITableMaxEntries subscribers are loaded when
+	the table is opened.  Changes are written behind to the database by a
+	writer thread every Control.Reporting.TMSITableWritePeriod milliseconds,
+	in one transaction.  Past the size limit, the least recently seen
+	subscribers that have been written are dropped from memory; looking
+	one of them up reads it back from the database.
+*/
 class TMSITable {
 
 	private:
 
-	sqlite3 *mDB;			///< database connection
+	Mutex mLock;				///< protects the entries and indexes; take mDBLock first if both
+	TMSIIndex mByTMSI;
+	IMSIIndex mByIMSI;
+	TMSIEntryList mLRU;			///< most recently seen first
+	std::vector<TMSIEntry*> mChanged;	///< entries with unwritten changes
+	unsigned mNextTMSI;			///< next TMSI to assign
+	bool mComplete;				///< true if every database row is in memory
+
+	Mutex mDBLock;				///< serializes use of mDB
+	sqlite3 *mDB;				///< database connection
+	Thread mWriter;				///< thread running TMSITableWriter
 
 
 	public:
 
+	TMSITable():mNextTMSI(1),mComplete(true),mDB(NULL) {}
+
 	/**
 			Open the database connection.  
 			@param wPath Path to sqlite3 database file.
@@ -65,22 +130,22 @@ class TMSITable {
 
 	/**
 		Find an IMSI in the table.
-		This is a log-time operation.
+		This is a log-time operation on the in-memory index.
 		@param TMSI The TMSI to find.
 		@return Pointer to IMSI to be freed by the caller, or NULL.
 	*/
-	char* IMSI(unsigned TMSI) const;
+	char* IMSI(unsigned TMSI);
 
 	/**
 		Find a TMSI in the table.
-		This is a linear-time operation.
+		This is a log-time operation on the in-memory index.
 		@param IMSI The IMSI to mach.
 		@return A TMSI value or zero on failure.
 	*/
-	unsigned TMSI(const char* IMSI) const;
+	unsigned TMSI(const char* IMSI);
 
-	/** Write entries as text to a stream. */
-	void dump(std::ostream&) const;
+	/** Write entries as text to a stream, flushing changes first. */
+	void dump(std::ostream&);
 	
 	/** Clear the table completely. */
 	void clear();
@@ -109,13 +174,58 @@ class TMSITable {
 	/** Get the next TI value to use for this IMSI or TMSI. */
 	unsigned nextL3TI(const char* IMSI);
 
+	/**
+		Write changed entries to the database in one transaction,
+		then drop old entries from memory if over the size limit.
+		@return true on success or if there was nothing to write.
+	*/
+	bool flush();
+
 	private:
 
-	/** Update the "accessed" time on a record. */
-	void touch(unsigned TMSI) const;
+	/** Read the most recently seen subscribers from the database. */
+	void load();
+
+	/**
+		Find an entry by IMSI, reading it from the database if it is not in memory.
+		Caller holds mLock.
+		@param access If true, update the accessed time of the entry.
+	*/
+	TMSIEntry* findIMSI(const char* IMSI, bool access=true);
+
+	/** Same as findIMSI, by TMSI. */
+	TMSIEntry* findTMSI(unsigned TMSI, bool access=true);
+
+	/**
+		Read one row into memory, by IMSI if given, else by TMSI.
+		Caller holds mLock, which is released around the query.
+	*/
+	TMSIEntry* readThrough(const char* IMSI, unsigned TMSI);
+
+	/** Add a record to memory and the indexes; caller holds mLock. */
+	TMSIEntry* insert(const TMSIRecord& record, bool dirty);
+
+	/** Move an entry to the front of the LRU list and update its accessed time; caller holds mLock. */
+	void touch(TMSIEntry* entry);
+
+	/** Flag an entry for the writer; caller holds mLock. */
+	void changed(TMSIEntry* entry);
+
+	/** Write the changed entries; caller holds mDBLock. */
+	bool writeChanges();
+
+	/** Drop written entries past the size limit; caller holds mLock. */
+	void trim();
+
+	/** Write records to the database in one transaction; caller holds mDBLock. */
+	bool writeRecords(const std::vector<TMSIRecord>& records);
 };
 
 
+/** Periodically calls TMSITable::flush() on the object passed as the argument. */
+void* TMSITableWriter(void*);
+
+
 }
 
 #endif
@@ -0,0 +1,75 @@
+/**@file Secondary index for TransactionTable. */
+/*
+* Copyright 2013 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+
+#ifndef TRANSACTIONINDEX_H
+#define TRANSACTIONINDEX_H
+
+#include <map>
+#include <set>
+#include <vector>
+
+
+namespace Control {
+
+/**
+	Maps a key to the IDs of the transactions filed under it.
+	Lookups are log-time in the number of keys and return IDs in
+	increasing order, the same order as a scan of the TransactionMap.
+	Not thread safe.
+*/
+template <class Key>
+class TransactionIndex {
+
+	private:
+
+	typedef std::set<unsigned> IDSet;
+	typedef std::map<Key,IDSet> IndexMap;
+
+	IndexMap mMap;
+
+	public:
+
+	/** File an ID under a key. */
+	void add(const Key& key, unsigned ID) { mMap[key].insert(ID); }
+
+	/** Remove an ID from a key, dropping the key when it is empty. */
+	void remove(const Key& key, unsigned ID)
+	{
+		typename IndexMap::iterator itr = mMap.find(key);
+		if (itr==mMap.end()) return;
+		itr->second.erase(ID);
+		if (itr->second.empty()) mMap.erase(itr);
+	}
+
+	/** Append the IDs filed under a key to a vector. */
+	void get(const Key& key, std::vector<unsigned>& IDs) const
+	{
+		typename IndexMap::const_iterator itr = mMap.find(key);
+		if (itr==mMap.end()) return;
+		IDs.insert(IDs.end(),itr->second.begin(),itr->second.end());
+	}
+
+	/** Number of distinct keys. */
+	size_t size() const { return mMap.size(); }
+};
+
+}	// Control
+
+#endif
+
+// vim: ts=4 sw=4
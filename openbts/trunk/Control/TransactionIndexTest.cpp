@@ -0,0 +1,166 @@
+/*
+* Copyright 2013 Range Networks, Inc.
+*
+* This software is distributed under multiple licenses;
+* see the COPYING file in the main directory for licensing
+* information for this specific distribuion.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+*/
+
+/*
+	Stress benchmark for the TransactionTable secondary indexes.
+	Fills a table of synthetic transactions, keyed the way TransactionTable
+	keys its entries, and compares indexed lookups against the brute force
+	scans they replaced as the table grows.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Timeval.h>
+
+#include "TransactionIndex.h"
+
+using namespace std;
+using namespace Control;
+
+
+struct SyntheticTransaction {
+	unsigned ID;
+	const void* channel;
+	string subscriber;
+	string callID;
+};
+
+typedef map<unsigned,SyntheticTransaction*> SyntheticMap;
+
+
+static const unsigned numChannels = 10000;
+static char channels[numChannels];	// stand-ins for LogicalChannel objects, about one per transaction
+static const unsigned numLookups = 20000;
+
+
+static string subscriberKey(unsigned n)
+{
+	char buf[25];
+	sprintf(buf,"IMSI0010100000%05u",n);
+	return string(buf);
+}
+
+static string callIDKey(unsigned n)
+{
+	char buf[25];
+	sprintf(buf,"%u",n*2654435761U);
+	return string(buf);
+}
+
+
+static void runCase(unsigned numTransactions)
+{
+	SyntheticMap table;
+	TransactionIndex<const void*> channelIndex;
+	TransactionIndex<string> mobileIndex;
+	TransactionIndex<string> callIDIndex;
+
+	// Several transactions per subscriber, as with a call plus an SMS.
+	unsigned numSubscribers = numTransactions/3 + 1;
+	for (unsigned i=1; i<=numTransactions; i++) {
+		SyntheticTransaction *t = new SyntheticTransaction;
+		t->ID = i;
+		t->channel = &channels[i % numChannels];
+		t->subscriber = subscriberKey(i % numSubscribers);
+		t->callID = callIDKey(i);
+		table[i] = t;
+		channelIndex.add(t->channel,i);
+		mobileIndex.add(t->subscriber,i);
+		callIDIndex.add(t->callID,i);
+	}
+
+	// The same pseudo-random targets for both methods.
+	vector<unsigned> targets(numLookups);
+	for (unsigned i=0; i<numLookups; i++) targets[i] = 1 + random() % numTransactions;
+
+	// Brute force: by subscriber and call ID, as find(mobileID,callID) did.
+	unsigned scanHits = 0;
+	Timeval start;
+	for (unsigned i=0; i<numLookups; i++) {
+		const SyntheticTransaction *target = table[targets[i]];
+		for (SyntheticMap::const_iterator itr = table.begin(); itr!=table.end(); ++itr) {
+			if (itr->second->callID != target->callID) continue;
+			if (itr->second->subscriber != target->subscriber) continue;
+			scanHits++;
+			break;
+		}
+	}
+	long scanMs = start.elapsed();
+
+	// Indexed: candidates from the call ID index, then the same checks.
+	unsigned indexHits = 0;
+	vector<unsigned> IDs;
+	start.now();
+	for (unsigned i=0; i<numLookups; i++) {
+		const SyntheticTransaction *target = table[targets[i]];
+		IDs.clear();
+		callIDIndex.get(target->callID,IDs);
+		for (unsigned j=0; j<IDs.size(); j++) {
+			const SyntheticTransaction *t = table[IDs[j]];
+			if (t->callID != target->callID) continue;
+			if (t->subscriber != target->subscriber) continue;
+			indexHits++;
+			break;
+		}
+	}
+	long indexMs = start.elapsed();
+
+	// The subscriber index must file exactly the entries a scan finds.
+	bool consistent = (scanHits==numLookups) && (indexHits==numLookups);
+	for (unsigned i=0; i<100; i++) {
+		const SyntheticTransaction *target = table[targets[i]];
+		IDs.clear();
+		mobileIndex.get(target->subscriber,IDs);
+		unsigned count = 0;
+		for (SyntheticMap::const_iterator itr = table.begin(); itr!=table.end(); ++itr) {
+			if (itr->second->subscriber == target->subscriber) count++;
+		}
+		if (count!=IDs.size()) consistent = false;
+	}
+
+	start.now();
+	unsigned channelHits = 0;
+	for (unsigned i=0; i<numLookups; i++) {
+		IDs.clear();
+		channelIndex.get(&channels[targets[i] % numChannels],IDs);
+		channelHits += IDs.size() ? 1 : 0;
+	}
+	long channelMs = start.elapsed();
+
+	cout << numTransactions << " transactions: "
+		<< "scan " << (double)scanMs*1000.0/numLookups << " us/lookup, "
+		<< "call ID index " << (double)indexMs*1000.0/numLookups << " us/lookup, "
+		<< "channel index " << (double)channelMs*1000.0/numLookups << " us/lookup"
+		<< (consistent && channelHits==numLookups ? "" : " MISMATCH") << endl;
+
+	for (SyntheticMap::iterator itr = table.begin(); itr!=table.end(); ++itr) delete itr->second;
+}
+
+
+int main(int argc, char *argv[])
+{
+	srandom(1);
+	unsigned sizes[] = { 10, 100, 1000, 5000, 10000 };
+	for (unsigned i=0; i<sizeof(sizes)/sizeof(sizes[0]); i++) runCase(sizes[i]);
+	return 0;
+}
+
+// vim: ts=4 sw=4
@@ -109,7 +109,8 @@ TransactionEntry::TransactionEntry(
 	mCalling(wCalling),
 	mSIP(proxy,mSubscriber.digits()),
 	mGSMState(wState),
-	mNumSQLTries(gConfig.getNum("Control.NumSQLTries")),
+	mCreated(0),mChanged(0),
+	mIndexed(false),mIndexedChannel(NULL),
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mHandoverOtherBSTransactionID(0),
@@ -134,7 +135,8 @@ TransactionEntry::TransactionEntry(
 	mCalled(wCalled),
 	mSIP(proxy,mSubscriber.digits()),
 	mGSMState(GSM::MOCInitiated),
-	mNumSQLTries(gConfig.getNum("Control.NumSQLTries")),
+	mCreated(0),mChanged(0),
+	mIndexed(false),mIndexedChannel(NULL),
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mHandoverOtherBSTransactionID(0),
@@ -159,7 +161,8 @@ TransactionEntry::TransactionEntry(
 	mL3TI(7),mCalled(wCalled),
 	mSIP(proxy,mSubscriber.digits()),
 	mGSMState(GSM::SMSSubmitting),
-	mNumSQLTries(gConfig.getNum("Control.NumSQLTries")),
+	mCreated(0),mChanged(0),
+	mIndexed(false),mIndexedChannel(NULL),
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mHandoverOtherBSTransactionID(0),
@@ -182,7 +185,8 @@ TransactionEntry::TransactionEntry(
 	mL3TI(7),
 	mSIP(proxy,mSubscriber.digits()),
 	mGSMState(GSM::SMSSubmitting),
-	mNumSQLTries(gConfig.getNum("Control.NumSQLTries")),
+	mCreated(0),mChanged(0),
+	mIndexed(false),mIndexedChannel(NULL),
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mHandoverOtherBSTransactionID(0),
@@ -207,7 +211,8 @@ TransactionEntry::TransactionEntry(const struct sockaddr_in* peer,
 	mSIP(proxy),
 	mGSMState(GSM::HandoverInbound),
 	mInboundReference(wHandoverReference),
-	mNumSQLTries(gConfig.getNum("Control.NumSQLTries")),
+	mCreated(0),mChanged(0),
+	mIndexed(false),mIndexedChannel(NULL),
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mHandoverOtherBSTransactionID(wHandoverOtherBSTransactionID),
@@ -334,9 +339,10 @@ TransactionEntry::~TransactionEntry()
 	gSIPInterface.removeCall(mSIP.callID());
 
 	// Delete the SQL table entry.
-	char query[100];
-	sprintf(query,"DELETE FROM TRANSACTION_TABLE WHERE ID=%u",mID);
-	runQuery(query);
+	TransactionRow row;
+	row.ID = mID;
+	row.remove = true;
+	gTransactionTable.post(row);
 
 }
 
@@ -518,65 +524,62 @@ void TransactionEntry::messageType(const char *wContentType)
 
 
 
-void TransactionEntry::runQuery(const char* query) const
+static string subscriberString(const L3MobileIdentity& subscriber)
 {
-	// Caller should hold mLock and should have already checked mRemoved..
-	if (sqlite3_command(gTransactionTable.DB(),query,mNumSQLTries)) return;
-	LOG(ALERT) << "transaction table access failed after " << mNumSQLTries << "attempts. query:" << query << " error: " << sqlite3_errmsg(gTransactionTable.DB());
+	char buf[25];
+	switch (subscriber.type()) {
+		case IMSIType: sprintf(buf,"IMSI%s",subscriber.digits()); break;
+		case IMEIType: sprintf(buf,"IMEI%s",subscriber.digits()); break;
+		case TMSIType: sprintf(buf,"TMSI%x",subscriber.TMSI()); break;
+		default: sprintf(buf,"invalid");
+	}
+	return string(buf);
 }
 
 
 
-void TransactionEntry::insertIntoDatabase()
+void TransactionEntry::writeToDatabase() const
 {
-	// This should be called only from gTransactionTable::add.
 	// Caller should hold mLock.
-
+	TransactionRow row;
+	row.ID = mID;
+	row.remove = false;
+	if (mChannel) row.channel = mChannel->descriptiveString();
+	row.created = mCreated;
+	row.changed = mChanged;
 	ostringstream serviceTypeSS;
 	serviceTypeSS << mService;
-
-	ostringstream sipStateSS;
-	sipStateSS << mSIP.state();
-	mPrevSIPState = mSIP.state();
-
-	char subscriber[25];
-	switch (mSubscriber.type()) {
-		case IMSIType: sprintf(subscriber,"IMSI%s",mSubscriber.digits()); break;
-		case IMEIType: sprintf(subscriber,"IMEI%s",mSubscriber.digits()); break;
-		case TMSIType: sprintf(subscriber,"TMSI%x",mSubscriber.TMSI()); break;
-		default:
-			sprintf(subscriber,"invalid");
-			LOG(ERR) << "non-valid subscriber ID in transaction table: " << mSubscriber;
-	}
-
+	row.type = serviceTypeSS.str();
+	row.subscriber = subscriberString(mSubscriber);
+	row.L3TI = mL3TI;
+	row.SIPCallID = mSIP.callID();
+	row.SIPProxy = mSIP.proxyIP();
+	row.called = mCalled.digits();
+	row.calling = mCalling.digits();
 	const char* stateString = GSM::CallStateString(mGSMState);
 	assert(stateString);
+	row.GSMState = stateString;
+	const char* sipStateString = SIP::SIPStateString(mPrevSIPState);
+	assert(sipStateString);
+	row.SIPState = sipStateString;
+	gTransactionTable.post(row);
+}
 
-	// FIXME -- This should be done in a single SQL transaction.
 
-	char query[500];
-	unsigned now = (unsigned)time(NULL);
-	sprintf(query,"INSERT INTO TRANSACTION_TABLE "
-		        "(ID,CREATED,CHANGED,TYPE,SUBSCRIBER,L3TI,CALLED,CALLING,GSMSTATE,SIPSTATE,SIP_CALLID,SIP_PROXY) "
-		"VALUES  (%u,%u,     %u,     '%s','%s',      %u,'%s',  '%s',   '%s',    '%s',      '%s',      '%s')",
-		mID,now,now,
-		serviceTypeSS.str().c_str(),
-		subscriber,
-		mL3TI,
-		mCalled.digits(),
-		mCalling.digits(),
-		stateString,
-		sipStateSS.str().c_str(),
-		mSIP.callID().c_str(),
-		mSIP.proxyIP().c_str()
-	);
 
-	runQuery(query);
+void TransactionEntry::insertIntoDatabase()
+{
+	// This should be called only from gTransactionTable::add.
+	// Caller should hold mLock.
 
-	if (!mChannel) return;
-	sprintf(query,"UPDATE TRANSACTION_TABLE SET CHANNEL='%s' WHERE ID=%u",
-			mChannel->descriptiveString(), mID);
-	runQuery(query);
+	switch (mSubscriber.type()) {
+		case IMSIType: case IMEIType: case TMSIType: break;
+		default: LOG(ERR) << "non-valid subscriber ID in transaction table: " << mSubscriber;
+	}
+
+	mPrevSIPState = mSIP.state();
+	mCreated = mChanged = (unsigned)time(NULL);
+	writeToDatabase();
 }
 
 
@@ -586,17 +589,9 @@ void TransactionEntry::channel(GSM::LogicalChannel* wChannel)
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
 	mChannel = wChannel;
-
-	char query[500];
-	if (mChannel) {
-		sprintf(query,"UPDATE TRANSACTION_TABLE SET CHANGED=%u,CHANNEL='%s' WHERE ID=%u",
-				(unsigned)time(NULL), mChannel->descriptiveString(), mID);
-	} else {
-		sprintf(query,"UPDATE TRANSACTION_TABLE SET CHANGED=%u,CHANNEL=NULL WHERE ID=%u",
-				(unsigned)time(NULL), mID);
-	}
-
-	runQuery(query);
+	mChanged = (unsigned)time(NULL);
+	writeToDatabase();
+	gTransactionTable.reindex(this);
 }
 
 
@@ -636,14 +631,8 @@ void TransactionEntry::GSMState(GSM::CallState wState)
 	unsigned now = mStateTimer.sec();
 
 	mGSMState = wState;
-	const char* stateString = GSM::CallStateString(wState);
-	assert(stateString);
-
-	char query[150];
-	sprintf(query,
-		"UPDATE TRANSACTION_TABLE SET GSMSTATE='%s',CHANGED=%u WHERE ID=%u",
-		stateString,now, mID);
-	runQuery(query);
+	mChanged = now;
+	writeToDatabase();
 }
 
 
@@ -652,17 +641,8 @@ SIP::SIPState TransactionEntry::echoSIPState(SIP::SIPState state) const
 	// Caller should hold mLock.
 	if (mPrevSIPState==state) return state;
 	mPrevSIPState = state;
-
-	const char* stateString = SIP::SIPStateString(state);
-	assert(stateString);
-
-	unsigned now = time(NULL);
-
-	char query[150];
-	sprintf(query,
-		"UPDATE TRANSACTION_TABLE SET SIPSTATE='%s',CHANGED=%u WHERE ID=%u",
-		stateString,now,mID);
-	runQuery(query);
+	mChanged = (unsigned)time(NULL);
+	writeToDatabase();
 
 	return state;
 }
@@ -917,6 +897,7 @@ void TransactionEntry::SIPUser(const char* IMSI)
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
 	mSIP.user(IMSI);
+	gTransactionTable.reindex(this);
 }
 
 void TransactionEntry::SIPUser(const char* callID, const char *IMSI , const char *origID, const char *origHost)
@@ -924,6 +905,15 @@ void TransactionEntry::SIPUser(const char* callID, const char *IMSI , const char
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
 	mSIP.user(callID,IMSI,origID,origHost);
+	gTransactionTable.reindex(this);
+}
+
+SIP::SIPState TransactionEntry::inboundHandoverSendINVITE(unsigned RTPPort)
+{
+	ScopedLock lock(mLock);
+	SIP::SIPState state = mSIP.inboundHandoverSendINVITE(this, RTPPort);
+	gTransactionTable.reindex(this);
+	return state;
 }
 
 void TransactionEntry::called(const L3CalledPartyBCDNumber& wCalled)
@@ -931,12 +921,7 @@ void TransactionEntry::called(const L3CalledPartyBCDNumber& wCalled)
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
 	mCalled = wCalled;
-
-	char query[151];
-	snprintf(query,150,
-		"UPDATE TRANSACTION_TABLE SET CALLED='%s' WHERE ID=%u",
-		mCalled.digits(), mID);
-	runQuery(query);
+	writeToDatabase();
 }
 
 
@@ -945,12 +930,7 @@ void TransactionEntry::L3TI(unsigned wL3TI)
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
 	mL3TI = wL3TI;
-
-	char query[151];
-	snprintf(query,150,
-		"UPDATE TRANSACTION_TABLE SET L3TI=%u WHERE ID=%u",
-		mL3TI, mID);
-	runQuery(query);
+	writeToDatabase();
 }
 
 
@@ -1085,7 +1065,7 @@ void TransactionTable::init(const char* path)
 	int rc = sqlite3_open(path,&mDB);
 	if (rc) {
 		LOG(ALERT) << "Cannot open Transaction Table database at " << path << ": " << sqlite3_errmsg(mDB);
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return;
 	}
@@ -1098,8 +1078,21 @@ void TransactionTable::init(const char* path)
 		LOG(ALERT) << "Cannot enable WAL mode on database at " << path << ", error message: " << sqlite3_errmsg(mDB);
 	}
 	// Clear any previous entires.
-	if (!sqlite3_command(gTransactionTable.DB(),"DELETE FROM TRANSACTION_TABLE"))
+	if (!sqlite3_command(mDB,"DELETE FROM TRANSACTION_TABLE"))
 		LOG(WARNING) << "cannot clear previous transaction table";
+	// Prepare the writer's statements and start it.
+	if (sqlite3_prepare_statement(mDB,&mWriteStmt,
+			"INSERT OR REPLACE INTO TRANSACTION_TABLE "
+			"(ID,CHANNEL,CREATED,CHANGED,TYPE,SUBSCRIBER,L3TI,CALLED,CALLING,GSMSTATE,SIPSTATE,SIP_CALLID,SIP_PROXY) "
+			"VALUES (?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13)")) {
+		LOG(ALERT) << "Cannot prepare Transaction Table write statement";
+		mWriteStmt = NULL;
+	}
+	if (sqlite3_prepare_statement(mDB,&mDeleteStmt,"DELETE FROM TRANSACTION_TABLE WHERE ID=?1")) {
+		LOG(ALERT) << "Cannot prepare Transaction Table delete statement";
+		mDeleteStmt = NULL;
+	}
+	mWriter.start((void*(*)(void*))TransactionTableWriter,this);
 }
 
 
@@ -1142,7 +1135,99 @@ TransactionTable::~TransactionTable()
 {
 	// Don't bother disposing of the memory,
 	// since this is only invoked when the application exits.
-	if (mDB) sqlite3_close(mDB);
+	ScopedLock lock(mDBLock);
+	if (mWriteStmt) sqlite3_finalize(mWriteStmt);
+	if (mDeleteStmt) sqlite3_finalize(mDeleteStmt);
+	if (mDB) sqlite3_close_cached(mDB);
+	mDB = NULL;
+}
+
+
+
+void TransactionTable::post(const TransactionRow& row)
+{
+	if (!mDB) return;
+	ScopedLock lock(mJournalLock);
+	if (mJournal.empty()) mJournalSignal.signal();
+	mJournal[row.ID] = row;
+}
+
+
+
+static void bindText(sqlite3_stmt* stmt, int index, const string& text)
+{
+	sqlite3_bind_text(stmt,index,text.c_str(),text.size(),SQLITE_STATIC);
+}
+
+
+
+bool TransactionTable::writeRows(const TransactionRowMap& rows)
+{
+	ScopedLock lock(mDBLock);
+	if (!mDB || !mWriteStmt || !mDeleteStmt) return false;
+
+	unsigned retries = gConfig.getNum("Control.NumSQLTries");
+	SQLiteTransaction transaction(mDB,retries);
+	bool ok = transaction.active();
+	for (TransactionRowMap::const_iterator itr = rows.begin(); ok && itr!=rows.end(); ++itr) {
+		const TransactionRow& row = itr->second;
+		sqlite3_stmt* stmt = row.remove ? mDeleteStmt : mWriteStmt;
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		sqlite3_bind_int64(stmt,1,row.ID);
+		if (!row.remove) {
+			if (row.channel.size()) bindText(stmt,2,row.channel);
+			sqlite3_bind_int64(stmt,3,row.created);
+			sqlite3_bind_int64(stmt,4,row.changed);
+			bindText(stmt,5,row.type);
+			bindText(stmt,6,row.subscriber);
+			sqlite3_bind_int64(stmt,7,row.L3TI);
+			bindText(stmt,8,row.called);
+			bindText(stmt,9,row.calling);
+			bindText(stmt,10,row.GSMState);
+			bindText(stmt,11,row.SIPState);
+			bindText(stmt,12,row.SIPCallID);
+			bindText(stmt,13,row.SIPProxy);
+		}
+		ok = sqlite3_run_query(mDB,stmt,retries)==SQLITE_DONE;
+	}
+	if (ok && transaction.commit()) return true;
+
+	// The transaction rolls back as it goes out of scope.
+	LOG(ALERT) << "transaction table write of " << rows.size() << " rows failed after " << retries << " attempts, error: " << sqlite3_errmsg(mDB);
+	return false;
+}
+
+
+
+void TransactionTable::writeJournal()
+{
+	while (true) {
+		TransactionRowMap rows;
+		mJournalLock.lock();
+		while (mJournal.empty()) mJournalSignal.wait(mJournalLock);
+		rows.swap(mJournal);
+		mJournalLock.unlock();
+
+		if (writeRows(rows)) continue;
+
+		// Requeue the failed batch behind anything newer and back off.
+		mJournalLock.lock();
+		for (TransactionRowMap::const_iterator itr = rows.begin(); itr!=rows.end(); ++itr) {
+			mJournal.insert(*itr);
+		}
+		mJournalLock.unlock();
+		sleep(1);
+	}
+}
+
+
+
+void* Control::TransactionTableWriter(void* arg)
+{
+	TransactionTable* table = (TransactionTable*)arg;
+	table->writeJournal();
+	return NULL;
 }
 
 
@@ -1161,6 +1246,75 @@ void TransactionTable::add(TransactionEntry* value)
 	ScopedLock lock(mLock);
 	mTable[value->ID()]=value;
 	value->insertIntoDatabase();
+	mIndexLock.lock();
+	value->mIndexed = true;
+	mMobileIndex.add(subscriberString(value->subscriber()),value->ID());
+	mIndexLock.unlock();
+	reindex(value);
+}
+
+
+
+void TransactionTable::reindex(TransactionEntry* entry)
+{
+	ScopedLock lock(mIndexLock);
+	if (!entry->mIndexed) return;
+	unsigned ID = entry->ID();
+
+	const GSM::LogicalChannel* chan = entry->mChannel;
+	if (chan != entry->mIndexedChannel) {
+		const GSM::LogicalChannel* old = entry->mIndexedChannel;
+		if (old) {
+			mChannelIndex.remove(old,ID);
+			mSACCHIndex.remove(old->SACCH(),ID);
+		}
+		if (chan) {
+			mChannelIndex.add(chan,ID);
+			mSACCHIndex.add(chan->SACCH(),ID);
+		}
+		entry->mIndexedChannel = chan;
+	}
+
+	const string& callID = entry->mSIP.callID();
+	if (callID != entry->mIndexedCallID) {
+		if (entry->mIndexedCallID.size()) mCallIDIndex.remove(entry->mIndexedCallID,ID);
+		if (callID.size()) mCallIDIndex.add(callID,ID);
+		entry->mIndexedCallID = callID;
+	}
+}
+
+
+
+void TransactionTable::unindex(TransactionEntry* entry)
+{
+	ScopedLock lock(mIndexLock);
+	if (!entry->mIndexed) return;
+	unsigned ID = entry->ID();
+	mMobileIndex.remove(subscriberString(entry->subscriber()),ID);
+	if (entry->mIndexedChannel) {
+		mChannelIndex.remove(entry->mIndexedChannel,ID);
+		mSACCHIndex.remove(entry->mIndexedChannel->SACCH(),ID);
+	}
+	if (entry->mIndexedCallID.size()) mCallIDIndex.remove(entry->mIndexedCallID,ID);
+	entry->mIndexed = false;
+}
+
+
+
+template <class Key>
+void TransactionTable::lookup(const TransactionIndex<Key>& index, const Key& key, vector<TransactionEntry*>& entries) const
+{
+	// Caller should hold mLock.
+	vector<unsigned> IDs;
+	mIndexLock.lock();
+	index.get(key,IDs);
+	mIndexLock.unlock();
+	for (unsigned i=0; i<IDs.size(); i++) {
+		TransactionMap::const_iterator itr = mTable.find(IDs[i]);
+		if (itr==mTable.end()) continue;
+		if (itr->second->deadOrRemoved()) continue;
+		entries.push_back(itr->second);
+	}
 }
 
 
@@ -1186,6 +1340,7 @@ void TransactionTable::innerRemove(TransactionMap::iterator itr)
 	LOG(DEBUG) << "removing transaction: " << *(itr->second);
 	TransactionEntry *t = itr->second;
 	mTable.erase(itr);
+	unindex(t);
 	delete t;
 }
 
@@ -1225,6 +1380,10 @@ bool TransactionTable::removePaging(unsigned key)
 void TransactionTable::clearDeadEntries()
 {
 	// Caller should hold mLock.
+	// Entries take many seconds to die and lookups skip dead ones anyway,
+	// so a sweep per lookup would only make every lookup linear time.
+	if (mLastSweep.elapsed() < 1000) return;
+	mLastSweep.now();
 	TransactionMap::iterator itr = mTable.begin();
 	while (itr!=mTable.end()) {
 		if (!itr->second->dead()) ++itr;
@@ -1245,19 +1404,16 @@ TransactionEntry* TransactionTable::find(const GSM::LogicalChannel *chan)
 	LOG(DEBUG) << "by channel: " << *chan << " (" << chan << ")";
 
 	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	// This search assumes in order by transaction ID.
+	// Candidates come in order by transaction ID; take the newest.
+	vector<TransactionEntry*> entries;
+	lookup(mChannelIndex,(const void*)chan,entries);
 	TransactionEntry *retVal = NULL;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		const GSM::LogicalChannel* thisChan = itr->second->channel();
+	for (unsigned i=0; i<entries.size(); i++) {
+		const GSM::LogicalChannel* thisChan = entries[i]->channel();
 		if ((void*)thisChan != (void*)chan) continue;
-		retVal = itr->second;
+		retVal = entries[i];
 	}
 	//LOG(DEBUG) << "no match for " << *chan << " (" << chan << ")";
 	return retVal;
@@ -1269,18 +1425,15 @@ TransactionEntry* TransactionTable::findBySACCH(const GSM::SACCHLogicalChannel *
 	LOG(DEBUG) << "by SACCH: " << *chan << " (" << chan << ")";
 
 	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
+	vector<TransactionEntry*> entries;
+	lookup(mSACCHIndex,(const void*)chan,entries);
 	TransactionEntry *retVal = NULL;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		const GSM::LogicalChannel* thisChan = itr->second->channel();
-		if (thisChan->SACCH() != chan) continue;
-		retVal = itr->second;
+	for (unsigned i=0; i<entries.size(); i++) {
+		const GSM::LogicalChannel* thisChan = entries[i]->channel();
+		if (!thisChan || thisChan->SACCH() != chan) continue;
+		retVal = entries[i];
 	}
 	return retVal;
 }
@@ -1313,17 +1466,14 @@ TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, GSM::
 	LOG(DEBUG) << "by ID and state: " << mobileID << " in " << state;
 
 	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->GSMState() != state) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->GSMState() != state) continue;
+		if (entries[i]->subscriber() != mobileID) continue;
+		return entries[i];
 	}
 	return NULL;
 }
@@ -1333,34 +1483,32 @@ bool TransactionTable::isBusy(const L3MobileIdentity& mobileID)
 	LOG(DEBUG) << "id: " << mobileID << "?";
 
 	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		GSM::L3CMServiceType service = itr->second->service();
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		TransactionEntry* entry = entries[i];
+		if (entry->subscriber() != mobileID) continue;
+		GSM::L3CMServiceType service = entry->service();
 		bool speech =
 			service==GSM::L3CMServiceType::MobileOriginatedCall ||
 			service==GSM::L3CMServiceType::MobileTerminatedCall;
 		if (!speech) continue;
 		// OK, so we found a transaction for this call.
 		bool inCall =
-			itr->second->GSMState() == GSM::Paging ||
-			itr->second->GSMState() == GSM::AnsweredPaging ||
-			itr->second->GSMState() == GSM::MOCInitiated ||
-			itr->second->GSMState() == GSM::MOCProceeding ||
-			itr->second->GSMState() == GSM::MTCConfirmed ||
-			itr->second->GSMState() == GSM::CallReceived ||
-			itr->second->GSMState() == GSM::CallPresent ||
-			itr->second->GSMState() == GSM::ConnectIndication ||
-			itr->second->GSMState() == GSM::HandoverInbound ||
-			itr->second->GSMState() == GSM::HandoverProgress ||
-			itr->second->GSMState() == GSM::HandoverOutbound ||
-			itr->second->GSMState() == GSM::Active;
+			entry->GSMState() == GSM::Paging ||
+			entry->GSMState() == GSM::AnsweredPaging ||
+			entry->GSMState() == GSM::MOCInitiated ||
+			entry->GSMState() == GSM::MOCProceeding ||
+			entry->GSMState() == GSM::MTCConfirmed ||
+			entry->GSMState() == GSM::CallReceived ||
+			entry->GSMState() == GSM::CallPresent ||
+			entry->GSMState() == GSM::ConnectIndication ||
+			entry->GSMState() == GSM::HandoverInbound ||
+			entry->GSMState() == GSM::HandoverProgress ||
+			entry->GSMState() == GSM::HandoverOutbound ||
+			entry->GSMState() == GSM::Active;
 		if (inCall) return true;
 	}
 	return false;
@@ -1375,17 +1523,15 @@ TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, const
 	LOG(DEBUG) << "by ID and call-ID: " << mobileID << ", call " << callID;
 
 	string callIDString = string(callID);
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
+	ScopedLock lock(mLock);
 	clearDeadEntries();
 
-	// Brute force search.
-	ScopedLock lock(mLock);
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->mSIP.callID() != callIDString) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	vector<TransactionEntry*> entries;
+	lookup(mCallIDIndex,callIDString,entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->mSIP.callID() != callIDString) continue;
+		if (entries[i]->subscriber() != mobileID) continue;
+		return entries[i];
 	}
 	return NULL;
 }
@@ -1395,17 +1541,15 @@ TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, unsig
 {
 	LOG(DEBUG) << "by ID and transaction-ID: " << mobileID << ", transaction " << transactionID;
 
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
+	ScopedLock lock(mLock);
 	clearDeadEntries();
 
-	// Brute force search.
-	ScopedLock lock(mLock);
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->HandoverOtherBSTransactionID() != transactionID) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->HandoverOtherBSTransactionID() != transactionID) continue;
+		if (entries[i]->subscriber() != mobileID) continue;
+		return entries[i];
 	}
 	return NULL;
 }
@@ -1413,23 +1557,18 @@ TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, unsig
 
 TransactionEntry* TransactionTable::answeredPaging(const L3MobileIdentity& mobileID)
 {
-	// Yes, it's linear time.
-	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
-
 	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->GSMState() != GSM::Paging) continue;
-		if (itr->second->subscriber() == mobileID) {
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->GSMState() != GSM::Paging) continue;
+		if (entries[i]->subscriber() == mobileID) {
 			// Stop T3113 and change the state.
-			itr->second->GSMState(AnsweredPaging);
-			itr->second->resetTimer("3113");
-			return itr->second;
+			entries[i]->GSMState(AnsweredPaging);
+			entries[i]->resetTimer("3113");
+			return entries[i];
 		}
 	}
 	return NULL;
@@ -1438,19 +1577,14 @@ TransactionEntry* TransactionTable::answeredPaging(const L3MobileIdentity& mobil
 
 GSM::LogicalChannel* TransactionTable::findChannel(const L3MobileIdentity& mobileID)
 {
-	// Yes, it's linear time.
-	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
-
 	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		GSM::LogicalChannel* chan = itr->second->channel();
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->subscriber() != mobileID) continue;
+		GSM::LogicalChannel* chan = entries[i]->channel();
 		if (!chan) continue;
 		if (chan->type() == FACCHType) return chan;
 		if (chan->type() == SDCCHType) return chan;
@@ -1463,10 +1597,11 @@ unsigned TransactionTable::countChan(const GSM::LogicalChannel* chan)
 {
 	ScopedLock lock(mLock);
 	clearDeadEntries();
+	vector<TransactionEntry*> entries;
+	lookup(mChannelIndex,(const void*)chan,entries);
 	unsigned count = 0;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->channel() == chan) count++;
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->channel() == chan) count++;
 	}
 	return count;
 }
@@ -1545,19 +1680,14 @@ TransactionEntry* TransactionTable::inboundHandover(unsigned ref)
 
 TransactionEntry* TransactionTable::inboundHandover(const GSM::LogicalChannel* chan)
 {
-	// Yes, it's linear time.
-	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
-
 	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->GSMState() != GSM::HandoverInbound) continue;
-		if (itr->second->channel() == chan) return itr->second;
+	vector<TransactionEntry*> entries;
+	lookup(mChannelIndex,(const void*)chan,entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->GSMState() != GSM::HandoverInbound) continue;
+		if (entries[i]->channel() == chan) return entries[i];
 	}
 	return NULL;
 }
@@ -1565,20 +1695,16 @@ TransactionEntry* TransactionTable::inboundHandover(const GSM::LogicalChannel* c
 
 bool TransactionTable::duplicateMessage(const GSM::L3MobileIdentity& mobileID, const std::string& wMessage)
 {
-
 	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
-	// Brute force search.
-	for (TransactionMap::const_iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		if (itr->second->message() == wMessage) return true;
+	vector<TransactionEntry*> entries;
+	lookup(mMobileIndex,subscriberString(mobileID),entries);
+	for (unsigned i=0; i<entries.size(); i++) {
+		if (entries[i]->subscriber() != mobileID) continue;
+		if (entries[i]->message() == wMessage) return true;
 	}
 	return false;
-
 }
 
 
@@ -38,6 +38,8 @@
 #include <GSML3RRElements.h>
 #include <SIPEngine.h>
 
+#include "TransactionIndex.h"
+
 namespace GSM {
 class LogicalChnanel;
 class SACCHLogicalChannel;
@@ -46,6 +48,7 @@ class SACCHLogicalChannel;
 
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 
 /**@namespace Control This namepace is for use by the control layer. */
@@ -54,6 +57,28 @@ namespace Control {
 typedef std::map<std::string, GSM::Z100Timer> TimerTable;
 
 
+/** An image of one TRANSACTION_TABLE row, queued for the database writer. */
+struct TransactionRow {
+	unsigned ID;
+	bool remove;					///< delete the row instead of writing it
+	std::string channel;			///< empty for NULL
+	unsigned created;
+	unsigned changed;
+	std::string type;
+	std::string subscriber;
+	unsigned L3TI;
+	std::string SIPCallID;
+	std::string SIPProxy;
+	std::string called;
+	std::string calling;
+	std::string GSMState;
+	std::string SIPState;
+};
+
+/** Pending rows keyed by transaction ID; a later image replaces an earlier one. */
+typedef std::map<unsigned,TransactionRow> TransactionRowMap;
+
+
 
 
 /**
@@ -134,7 +159,15 @@ class TransactionEntry {
 	//@}
 	//@}
 
-	unsigned mNumSQLTries;					///< number of SQL tries for DB operations
+	unsigned mCreated;						///< CREATED time of the database row
+	mutable unsigned mChanged;				///< CHANGED time of the database row
+
+	/**@name Secondary index keys, owned by gTransactionTable under its mIndexLock. */
+	//@{
+	bool mIndexed;							///< true while filed in the indexes
+	const GSM::LogicalChannel *mIndexedChannel;	///< channel the entry is filed under
+	std::string mIndexedCallID;				///< SIP call ID the entry is filed under
+	//@}
 
 	GSM::LogicalChannel *mChannel;			///< current channel of the transaction
 
@@ -323,8 +356,7 @@ class TransactionEntry {
 
 	SIP::SIPState MTSMSSendOK();
 
-	SIP::SIPState inboundHandoverSendINVITE(unsigned RTPPort)
-		{ ScopedLock lock(mLock); return mSIP.inboundHandoverSendINVITE(this, RTPPort); }
+	SIP::SIPState inboundHandoverSendINVITE(unsigned RTPPort);
 	SIP::SIPState inboundHandoverCheckForOK()
 		{ ScopedLock lock(mLock); return mSIP.inboundHandoverCheckForOK(&mLock); }
 	SIP::SIPState inboundHandoverSendACK()
@@ -400,8 +432,8 @@ class TransactionEntry {
 	/** Set up a new entry in gTransactionTable's sqlite3 database. */
 	void insertIntoDatabase();
 
-	/** Run a database query. */
-	void runQuery(const char* query) const;
+	/** Queue the current state as the entry's database row; caller should hold mLock. */
+	void writeToDatabase() const;
 
 	/** Echo latest SIPSTATE to the database. */
 	SIP::SIPState echoSIPState(SIP::SIPState state) const;
@@ -422,6 +454,12 @@ class TransactionMap : public std::map<unsigned,TransactionEntry*> {};
 
 /**
 	A table for tracking the states of active transactions.
+
+	The table is mirrored into an sqlite3 database for external tools.
+	Entries never touch the database themselves: each change queues an
+	image of the entry's row, replacing any image of the same transaction
+	still in the queue, and a writer thread applies the queue in a single
+	transaction with prepared statements.
 */
 class TransactionTable {
 
@@ -433,8 +471,37 @@ class TransactionTable {
 	mutable Mutex mLock;
 	unsigned mIDCounter;
 
+	/**@name Database writer */
+	//@{
+	Mutex mJournalLock;				///< protects mJournal
+	Signal mJournalSignal;			///< signaled when mJournal becomes non-empty
+	TransactionRowMap mJournal;		///< row images not yet written
+	Mutex mDBLock;					///< held while using mDB and the statements
+	sqlite3_stmt *mWriteStmt;		///< INSERT OR REPLACE of a whole row
+	sqlite3_stmt *mDeleteStmt;		///< DELETE of a row
+	Thread mWriter;					///< thread running TransactionTableWriter
+	//@}
+
+	/**@name Secondary indexes
+		Each maps a key to the IDs of the entries filed under it.
+		Lookups still check each candidate entry, so the indexes only
+		narrow the search.  mIndexLock is always the last lock taken,
+		so entries can refile themselves while holding their own locks.
+	*/
+	//@{
+	mutable Mutex mIndexLock;
+	TransactionIndex<const void*> mChannelIndex;	///< by LogicalChannel
+	TransactionIndex<const void*> mSACCHIndex;		///< by the SACCH of the channel
+	TransactionIndex<std::string> mMobileIndex;		///< by subscriber identity
+	TransactionIndex<std::string> mCallIDIndex;		///< by SIP call ID
+	//@}
+
+	Timeval mLastSweep;				///< time of the last clearDeadEntries pass
+
 	public:
 
+	TransactionTable():mDB(NULL),mWriteStmt(NULL),mDeleteStmt(NULL) {}
+
 	/**
 		Initialize a transaction table.
 		@param path Path fto sqlite3 database file.
@@ -574,16 +641,42 @@ class TransactionTable {
 	/** Generate a unique handover reference. */
 	//unsigned generateInboundHandoverReference(TransactionEntry* transaction);
 
+	/**
+		Wait for queued row images and write them to the database, forever.
+		Run by the writer thread.
+	*/
+	void writeJournal();
+
 	private:
 
 	friend class TransactionEntry;
 
-	/** Accessor to database connection. */
-	sqlite3* DB() { return mDB; }
+	/** File an entry under its current channel and SIP call ID; caller should hold the entry's mLock. */
+	void reindex(TransactionEntry* entry);
+
+	/** Remove an entry from all indexes. */
+	void unindex(TransactionEntry* entry);
+
+	/**
+		Collect the live entries filed under a key, in ID order.
+		The caller should hold mLock.
+	*/
+	template <class Key>
+	void lookup(const TransactionIndex<Key>& index, const Key& key, std::vector<TransactionEntry*>& entries) const;
+
+	/** Queue a row image for the writer thread. */
+	void post(const TransactionRow& row);
+
+	/**
+		Apply a batch of row images in one database transaction.
+		@return true on success.
+	*/
+	bool writeRows(const TransactionRowMap& rows);
 
 	/**
 		Remove "dead" entries from the table.
 		A "dead" entry is a transaction that is no longer active.
+		This sweeps the whole table, so it runs at most once a second.
 		The caller should hold mLock.
 	*/
 	void clearDeadEntries();
@@ -603,6 +696,10 @@ class TransactionTable {
 
 
 
+/** Runs TransactionTable::writeJournal() on the table passed as the argument. */
+void* TransactionTableWriter(void*);
+
+
 }	//Control
 
 
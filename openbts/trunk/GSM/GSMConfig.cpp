@@ -529,8 +529,7 @@ void GSMConfig::createCombinationI(TransceiverManager& TRX, unsigned CN, unsigne
 	radio->setSlot(TN,1);	// (pat) 1 => Transciever.h enum ChannelCombination = I
 	TCHFACCHLogicalChannel* chan = new TCHFACCHLogicalChannel(CN,TN,gTCHF_T[TN]);
 	chan->downstream(radio);
-	Thread* thread = new Thread;
-	thread->start((void*(*)(void*))Control::DCCHDispatcher,chan);
+	Control::DCCHDispatcherAdd(chan);
 	chan->open();
 	gBTS.addTCH(chan);
 }
@@ -545,8 +544,7 @@ void GSMConfig::createCombinationVII(TransceiverManager& TRX, unsigned CN, unsig
 	for (int i=0; i<8; i++) {
 		SDCCHLogicalChannel* chan = new SDCCHLogicalChannel(CN,TN,gSDCCH8[i]);
 		chan->downstream(radio);
-		Thread* thread = new Thread;
-		thread->start((void*(*)(void*))Control::DCCHDispatcher,chan);
+		Control::DCCHDispatcherAdd(chan);
 		chan->open();
 		gBTS.addSDCCH(chan);
 	}
@@ -567,8 +565,6 @@ bool GSMConfig::hold() const
 
 
 
-#if ENABLE_PAGING_CHANNELS
-
 // 5-27-2012 pat added:
 // Routines for CCCH messages to add real paging channels.
 // Added in the simplest possible way to avoid destabilizing anything.
@@ -577,26 +573,29 @@ bool GSMConfig::hold() const
 // In DRX [Discontinuous Reception] mode the MS listens only to a subset of CCCH based on its IMSI.
 // This is a GPRS thing but dependent on the configuration of CCCH in our system.
 // See: GSM 05.02 6.5.2: Determination of CCCH_GROUP and PAGING_GROUP for MS in idle mode.
+// The Pager also uses this to sort its entries by paging group.
 void GSMConfig::crackPagingFromImsi(	
-	unsigned imsiMod1000	// The phones imsi mod 1000, so just atoi the last 3 digits.
+	unsigned imsiMod1000,	// The phones imsi mod 1000, so just atoi the last 3 digits.
 	unsigned &paging_block_index,	// Returns which of the paging ccchs to use.
 	unsigned &multiframe_index	// Returns which 51-multiframe to use.
 	)
 {
 	L3ControlChannelDescription mCC;
+	paging_block_index = 0;
+	multiframe_index = 0;
 
 	// BS_CCCH_SDCCH_COMB is defined in GSM 05.02 3.3.2.3;
 	int bs_cc_chans;			// The number of ccch timeslots per 51-multiframe.
 	bool bs_ccch_sdcch_comb;	// temp var indicates if sdcch is on same TS as ccch.
-	switch (mCC.mCCCH_CONF) {
+	switch (mCC.CCCH_CONF()) {
 	case 0: bs_cc_chans=1; bs_ccch_sdcch_comb=false; break;
 	case 1: bs_cc_chans=1; bs_ccch_sdcch_comb=true; break;
 	case 2: bs_cc_chans=2; bs_ccch_sdcch_comb=false; break;
 	case 4: bs_cc_chans=3; bs_ccch_sdcch_comb=false; break;
 	case 6: bs_cc_chans=4; bs_ccch_sdcch_comb=false; break;
 	default:
-		LOG(ERR) << "Invalid GSM.CCCH.CCCH-CONF value:"<<mCC.mCCCH_CONF <<" GPRS will fail until fixed";
-		return NULL;	// There will be no reliable GPRS service until you fix this.
+		LOG(ERR) << "Invalid GSM.CCCH.CCCH-CONF value:"<<mCC.CCCH_CONF() <<" GPRS will fail until fixed";
+		return;	// There will be no reliable GPRS service until you fix this.
 	}
 
 	// BS_PA_MFRMS is the number of 51-multiframes used for paging.
@@ -613,7 +612,7 @@ void GSMConfig::crackPagingFromImsi(
 	//	N=6; tmp = imsi % 6; PAGING_GROUP = imsi % 6;
 	// For BS_PA_MFRMS=3, BS_AG_BLKS_RES=0:
 	//	N=9; tmp = imsi % 9; PAGING_GROUP = imsi % 9;
-	// Paging block index = PAGING_GROUP % BS_PA_MFRMS
+	// Paging block index = PAGING_GROUP % pch_avail
 	// Multiframe index = PAGING_GROUP / pch_avail;
 	// correct multiframe when: multiframe_index == (FN div 51) % BA_PA_MFRMS
 
@@ -621,21 +620,23 @@ void GSMConfig::crackPagingFromImsi(
 	unsigned agch_avail = bs_ccch_sdcch_comb ? 3 : 8;
 	// If you hit this assertion, go fix L3ControlChannelDescription
 	// to make sure you leave some paging channels available.
-	assert(agch_avail > mPCC.mBS_AG_BLKS_RES);
+	assert(agch_avail > mCC.BS_AG_BLKS_RES());
 
 	// GSM 05.02 6.5.2: N is number of paging blocks "available" on one CCCH.
 	// The "available" is in quotes and not specifically defined, but I believe
 	// they mean after subtracting out BS_AG_BLKS_RES, as per 6.5.1 paragraph v).
-	unsigned pch_avail = agch_avail - mPCC.mBS_AG_BLKS_RES;
+	unsigned pch_avail = agch_avail - mCC.BS_AG_BLKS_RES();
 	unsigned Ntotal = pch_avail * bs_pa_mfrms;
-	unsigned tmp = (imsiMod1000 % (bs_cc_chans * Ntotal)) % Ntotal;
-	unsigned paging_group = tmp % Ntotal;
-	paging_block_index = paging_group / (Ntotal / bs_pa_mfrms);
+	unsigned paging_group = (imsiMod1000 % (bs_cc_chans * Ntotal)) % Ntotal;
+	paging_block_index = paging_group % pch_avail;
 	// And I quote: The required 51-multiframe occurs when:
 	// PAGING_GROUP div (N div BS_PA_MFRMS) = (FN div 51) mod (BS_PA_MFRMS)
-	multiframe_index = paging_group / (Ntotal % bs_pa_mfrms); 
+	multiframe_index = paging_group / (Ntotal / bs_pa_mfrms);
 }
 
+
+#if ENABLE_PAGING_CHANNELS
+
 void GSMConfig::sendPCH(const L3RRMessage& msg,unsigned imsiMod1000)
 {
 	unsigned paging_block_index;	// which of the paging ccchs to use.
@@ -129,9 +129,6 @@ class GSMConfig {
 	unsigned mChangemark;
 
 
-
-	void crackPagingFromImsi(unsigned imsiMod1000,unsigned &ccch_group,unsigned &paging_Index);;
-
 	public:
 	
 	
@@ -252,6 +249,14 @@ class GSMConfig {
 	void sendAGCH(const L3RRMessage& msg);
 #endif
 
+	/**
+		Locate the paging group of a mobile, GSM 05.02 6.5.2.
+		@param imsiMod1000 The IMSI mod 1000, the atoi of its last 3 digits.
+		@param paging_block_index Returns which of the paging blocks to use.
+		@param multiframe_index Returns which 51-multiframe to use, 0..BS_PA_MFRMS-1.
+	*/
+	void crackPagingFromImsi(unsigned imsiMod1000,unsigned &paging_block_index,unsigned &multiframe_index);
+
 	/** Return a minimum-load PCH. */
 	CCCHLogicalChannel* getPCH() { return minimumLoad(mPCHPool); }
 
@@ -811,7 +811,8 @@ bool SharedL1Decoder::decode()
 	unsigned syndrome = mBlockCoder.syndrome(mDP);
 	OBJLOG(DEBUG) <<"XCCHL1Decoder syndrome=" << hex << syndrome << dec;
 	// Simulate high FER for testing?
-	if (random()%100 < gConfig.getNum("Test.GSM.SimulatedFER.Uplink")) {
+	static const ConfigurationHandle& simulatedFER = gConfig.handle("Test.GSM.SimulatedFER.Uplink");
+	if (random()%100 < simulatedFER.getNum()) {
 		LOG(NOTICE) << "simulating dropped uplink frame at " << mReadTime;
 		return false;
 	}
@@ -842,13 +843,15 @@ void XCCHL1Decoder::handleGoodFrame()
 
 	if (mUpstream) {
 		// Are we fuzzing ourselves?
-		if (random()%100 < gConfig.getNum("Test.GSM.UplinkFuzzingRate")) {
+		static const ConfigurationHandle& fuzzingRate = gConfig.handle("Test.GSM.UplinkFuzzingRate");
+		if (random()%100 < fuzzingRate.getNum()) {
 			size_t i = random() % mD.size();
 			mD[i] = 1 - mD[i];
 			LOG(NOTICE) << "fuzzing input frame, flipped bit " << i;
 		}
 		// Send all bits to GSMTAP
-		if (gConfig.getBool("Control.GSMTAP.GSM")) {
+		static const ConfigurationHandle& gsmtap = gConfig.handle("Control.GSMTAP.GSM");
+		if (gsmtap.getBool()) {
 			// FIXME -- This repeatLengh>51 is a bit of a hack.
 			gWriteGSMTAP(ARFCN(),TN(),mReadTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,true,mD);
 		}
@@ -1022,7 +1025,8 @@ void XCCHL1Encoder::sendFrame(const L2Frame& frame)
 
 	// Send to GSMTAP
 	frame.copyToSegment(mU,headerOffset());
-	if (gConfig.getBool("Control.GSMTAP.GSM")) {
+	static const ConfigurationHandle& gsmtap = gConfig.handle("Control.GSMTAP.GSM");
+	if (gsmtap.getBool()) {
 		gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,false,mU);
 	}
 
@@ -1088,7 +1092,8 @@ void L1Encoder::transmit(BitVector *mI, BitVector *mE, const int *qbits)
 
 	// add noise
 	// the noise insertion happens below, merged in with the ciphering
-	int p = gConfig.getFloat("GSM.Cipher.CCHBER") * (float)0xFFFFFF;
+	static const ConfigurationHandle& cchBER = gConfig.handle("GSM.Cipher.CCHBER");
+	int p = cchBER.getFloat() * (float)0xFFFFFF;
 
 	for (int qi=0,B=0; B<4; B++) {
 		mBurst.time(mNextWriteTime);
@@ -1538,7 +1543,8 @@ bool TCHFACCHL1Decoder::decodeTCH(bool stolen)
 	// GSM 05.02 3.1.2, but backwards
 
 	// Simulate high FER for testing?
-	if (random()%100 < gConfig.getNum("Test.GSM.SimulatedFER.Uplink")) {
+	static const ConfigurationHandle& simulatedFER = gConfig.handle("Test.GSM.SimulatedFER.Uplink");
+	if (random()%100 < simulatedFER.getNum()) {
 		LOG(DEBUG) << "simulating dropped uplink vocoder frame at " << mReadTime;
 		stolen = true;
 	}
@@ -1619,7 +1625,8 @@ bool TCHFACCHL1Decoder::decodeTCH(bool stolen)
 	}
 
 	// Good or bad, we must feed the speech channel.
-	mSpeechQ.write(newFrame);
+	// If the call thread has stopped reading, drop the frame instead of blocking the rx thread.
+	if (!mSpeechQ.writeNoBlock(newFrame)) delete[] newFrame;
 
 	return good;
 }
@@ -1724,7 +1731,8 @@ void TCHFACCHL1Encoder::sendFrame( const L2Frame& frame )
 {
 	OBJLOG(DEBUG) << "TCHFACCHL1Encoder " << frame;
 	// Simulate high FER for testing.
-	if (random()%100 < gConfig.getNum("Test.GSM.SimulatedFER.Downlink")) {
+	static const ConfigurationHandle& simulatedFER = gConfig.handle("Test.GSM.SimulatedFER.Downlink");
+	if (random()%100 < simulatedFER.getNum()) {
 		LOG(NOTICE) << "simulating dropped downlink frame at " << mNextWriteTime;
 		return;
 	}
@@ -1761,7 +1769,8 @@ void TCHFACCHL1Encoder::dispatch()
 	// Speech latency control.
 	// Since Asterisk is local, latency should be small.
 	OBJLOG(DEBUG) <<"TCHFACCHL1Encoder speechQ.size=" << mSpeechQ.size();
-	int maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
+	static const ConfigurationHandle& maxSpeechLatency = gConfig.handle("GSM.MaxSpeechLatency");
+	int maxQ = maxSpeechLatency.getNum();
 	while ((int)mSpeechQ.size() > maxQ) delete mSpeechQ.read();
 
 	// Send, by priority: (1) FACCH, (2) TCH, (3) filler.
@@ -1769,7 +1778,8 @@ void TCHFACCHL1Encoder::dispatch()
 		OBJLOG(DEBUG) <<"TCHFACCHL1Encoder FACCH " << *fFrame;
 		currentFACCH = true;
 		// Send to GSMTAP
-		if (gConfig.getBool("Control.GSMTAP.GSM")) {
+		static const ConfigurationHandle& gsmtap = gConfig.handle("Control.GSMTAP.GSM");
+		if (gsmtap.getBool()) {
 			gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),typeAndOffset(),mMapping.repeatLength()>51,false,*fFrame);
 		}
 		// Copy the L2 frame into u[] for processing.
@@ -1810,7 +1820,8 @@ void TCHFACCHL1Encoder::dispatch()
 
 	// randomly toggle bits in control channel bursts
 	// the toggle happens below, merged in with the ciphering
-	int p = currentFACCH ? gConfig.getFloat("GSM.Cipher.CCHBER") * (float)0xFFFFFF : 0;
+	static const ConfigurationHandle& cchBER = gConfig.handle("GSM.Cipher.CCHBER");
+	int p = currentFACCH ? cchBER.getFloat() * (float)0xFFFFFF : 0;
 
 	// "mapping on a burst"
 	// Map c[] into outgoing normal bursts, marking stealing flags as needed.
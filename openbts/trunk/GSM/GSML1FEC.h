@@ -1032,7 +1032,11 @@ public:
 
 	/** Enqueue a traffic frame for transmission. */
 	void sendTCH(const unsigned char *frame)
-		{ mSpeechQ.write(new VocoderFrame(frame)); }
+	{
+		// Drop rather than block the caller if the encoder has stalled.
+		VocoderFrame *vFrame = new VocoderFrame(frame);
+		if (!mSpeechQ.writeNoBlock(vFrame)) delete vFrame;
+	}
 
 	/** Extend open() to set up semaphores. */
 	void open();
@@ -1086,7 +1090,7 @@ class TCHFACCHL1Decoder : public XCCHL1Decoder {
 
 	Parity mTCHParity;
 
-	InterthreadQueue<unsigned char> mSpeechQ;					///< output queue for speech frames
+	InterthreadRing<unsigned char> mSpeechQ;					///< output queue for speech frames, from the rx thread to the call thread
 
 
 	public:
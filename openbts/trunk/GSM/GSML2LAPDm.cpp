@@ -75,7 +75,8 @@ L2LAPDm::L2LAPDm(unsigned wC, unsigned wSAPI)
 	mC(wC),mR(1-wC),mSAPI(wSAPI),
 	mMaster(NULL),
 	mT200(T200ms),
-	mIdleFrame(DATA)
+	mIdleFrame(DATA),
+	mEstablishCallback(NULL),mEstablishArg(NULL)
 {
 	// sanity checks
 	assert(mC<2);
@@ -279,6 +280,14 @@ void L2LAPDm::retransmissionProcedure()
 
 
 
+void L2LAPDm::writeL3Establish(Primitive prim)
+{
+	mL3Out.write(new L3Frame(prim));
+	if (mEstablishCallback) mEstablishCallback(mEstablishArg);
+}
+
+
+
 void L2LAPDm::open()
 {
 	OBJLOG(DEBUG);
@@ -486,7 +495,7 @@ void L2LAPDm::receiveFrame(const GSM::L2Frame& frame)
 			}
 			break;
 		case HANDOVER_ACCESS:
-			mL3Out.write(new L3Frame(HANDOVER_ACCESS));
+			writeL3Establish(HANDOVER_ACCESS);
 			break;                  
 		default:
 			OBJLOG(ERR) << "unhandled primitive in L1->L2 " << frame;
@@ -534,7 +543,7 @@ void L2LAPDm::receiveUFrameSABM(const L2Frame& frame)
 			clearCounters();
 			mEstablishmentInProgress = true;
 			// Tell L3 what happened.
-			mL3Out.write(new L3Frame(ESTABLISH));
+			writeL3Establish(ESTABLISH);
 			if (frame.L()) {
 				// Presence of an L3 payload indicates contention resolution.
 				// GSM 04.06 5.4.1.4.
@@ -644,7 +653,7 @@ void L2LAPDm::receiveUFrameUA(const L2Frame& frame)
 			clearCounters();
 			mState = LinkEstablished;
 			mAckSignal.signal();
-			mL3Out.write(new L3Frame(ESTABLISH));
+			writeL3Establish(ESTABLISH);
 			break;
 		case AwaitingRelease:
 			// We sent DISC and the peer responded.
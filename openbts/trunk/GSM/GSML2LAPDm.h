@@ -253,6 +253,15 @@ class L2LAPDm : public L2DL {
 	/** HACK -- Return maximum allowed idle count. */
 	virtual unsigned maxIdle() const =0;
 
+	/**@name Optional callback run after ESTABLISH or HANDOVER_ACCESS is sent up to L3. */
+	//@{
+	void (*mEstablishCallback)(void*);
+	void *mEstablishArg;
+	//@}
+
+	/** Send ESTABLISH or HANDOVER_ACCESS up to L3 and run the callback. */
+	void writeL3Establish(Primitive);
+
 	public:
 
 	/**
@@ -290,6 +299,15 @@ class L2LAPDm : public L2DL {
 	/** Prepare the channel for a new transaction. */
 	virtual void open();
 
+	/**
+		Install a callback for uplink ESTABLISH and HANDOVER_ACCESS.
+		It runs in the L2 thread after the primitive is queued for readHighSide,
+		so an idle L3 controller can wait for it without blocking a thread.
+		Install it before the channel is opened.
+	*/
+	void establishCallback(void (*wCallback)(void*), void *wArg)
+		{ mEstablishCallback=wCallback; mEstablishArg=wArg; }
+
 	/** Set the "master" SAP, SAP0; should be called no more than once. */
 	void master(L2LAPDm* wMaster)
 		{ assert(!mMaster); mMaster=wMaster; }
@@ -167,6 +167,9 @@ class L3ControlChannelDescription : public L3ProtocolElement {
 	// BS_PA_MFRMS is the number of 51-multiframes used for paging in the range 2..9.
 	unsigned getBS_PA_MFRMS();
 
+	unsigned CCCH_CONF() const { return mCCCH_CONF; }
+	unsigned BS_AG_BLKS_RES() const { return mBS_AG_BLKS_RES; }
+
 	size_t lengthV() const { return 3; }
 	void writeV(L3Frame& dest, size_t &wp) const;
 	void parseV(const L3Frame&, size_t&) { assert(0); }
@@ -550,17 +550,23 @@ void LogicalChannel::waitForPrimitive(Primitive primitive)
 	}
 }
 
-L3Frame* LogicalChannel::waitForEstablishOrHandover()
+L3Frame* LogicalChannel::readEstablishOrHandover()
 {
-	while (true) {
-		L3Frame *req = recv();
-		if (req==NULL) continue;
+	while (L3Frame *req = recv(0)) {
 		if (req->primitive()==ESTABLISH) return req;
 		if (req->primitive()==HANDOVER_ACCESS) return req;
 		LOG(INFO) << "LogicalChannel: Ignored primitive:"<<req->primitive();
 		delete req;
 	}
-	return NULL;	// to keep the compiler happy
+	return NULL;
+}
+
+
+void LogicalChannel::establishCallback(void (*wCallback)(void*), void *wArg)
+{
+	L2LAPDm *SAP0 = dynamic_cast<L2LAPDm*>(mL2[0]);
+	assert(SAP0);
+	SAP0->establishCallback(wCallback,wArg);
 }
 
 
@@ -222,8 +222,17 @@ public:
 	*/
 	void waitForPrimitive(GSM::Primitive primitive);
 
-	/** Block until a HANDOVER_ACCESS or ESTABLISH arrives. */
-	L3Frame* waitForEstablishOrHandover();
+	/**
+		Return the next HANDOVER_ACCESS or ESTABLISH already queued on SAP0,
+		discarding anything ahead of it, or NULL if there is none.  Does not block.
+	*/
+	L3Frame* readEstablishOrHandover();
+
+	/**
+		Install a callback for HANDOVER_ACCESS and ESTABLISH on SAP0.
+		See L2LAPDm::establishCallback.
+	*/
+	void establishCallback(void (*wCallback)(void*), void *wArg);
 
 	/**
 		Block on a channel until a given primitive arrives.
@@ -686,7 +686,8 @@ class VocoderFrame : public BitVector {
 };
 
 
-typedef InterthreadQueue<VocoderFrame> VocoderFrameFIFO;
+/** Speech frames pass from one call thread to one encoder thread. */
+typedef InterthreadRing<VocoderFrame> VocoderFrameFIFO;
 
 };	// namespace GSM
 
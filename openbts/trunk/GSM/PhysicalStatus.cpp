@@ -67,7 +67,7 @@ int PhysicalStatus::open(const char* wPath)
 	int rc = sqlite3_open(wPath, &mDB);
 	if (rc) {
 		LOG(EMERG) << "Cannot open PhysicalStatus database at " << wPath << ": " << sqlite3_errmsg(mDB);
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return 1;
 	}
@@ -79,35 +79,15 @@ int PhysicalStatus::open(const char* wPath)
 	if (!sqlite3_command(mDB,enableWAL)) {
 		LOG(EMERG) << "Cannot enable WAL mode on database at " << wPath << ", error message: " << sqlite3_errmsg(mDB);
 	}
+	mWriter.start((void*(*)(void*))PhysicalStatusWriter,this);
 	return 0;
 }
 
 PhysicalStatus::~PhysicalStatus()
 {
-	if (mDB) sqlite3_close(mDB);
-}
-
-bool PhysicalStatus::createEntry(const LogicalChannel* chan)
-{
-	assert(mDB);
-	assert(chan);
-
-	ScopedLock lock(mLock);
-
-	const char* chanString = chan->descriptiveString();
-	LOG(DEBUG) << chan->descriptiveString();
-
-	/* Check to see if the key exists. */
-	if (!sqlite3_exists(mDB, "PHYSTATUS", "CN_TN_TYPE_AND_OFFSET", chanString)) {
-		/* No? Ok, it should now. */
-		char query[500];
-		sprintf(query, "INSERT INTO PHYSTATUS (CN_TN_TYPE_AND_OFFSET, ACCESSED) VALUES "
-					   "(\"%s\", %u)",
-				chanString, (unsigned)time(NULL));
-		return sqlite3_command(mDB, query);
-	}
-
-	return false;
+	ScopedLock lock(mDBLock);
+	if (mDB) sqlite3_close_cached(mDB);
+	mDB = NULL;
 }
 
 bool PhysicalStatus::setPhysical(const LogicalChannel* chan,
@@ -123,10 +103,6 @@ bool PhysicalStatus::setPhysical(const LogicalChannel* chan,
 	// Really.  See GSM 04.08 10.5.2.20.
 	if (measResults.MEAS_VALID()) return true; 
 
-	ScopedLock lock(mLock);
-
-	createEntry(chan);
-
 	int CN = -1;
 	if (measResults.NO_NCELL()>0) CN = measResults.BCCH_FREQ_NCELL(0);
 	int ARFCN = -1;
@@ -141,68 +117,106 @@ bool PhysicalStatus::setPhysical(const LogicalChannel* chan,
 		}
 	}
 
-	char query[500];
-
-	if (ARFCN<0) {
-		sprintf(query,
-			"UPDATE PHYSTATUS SET "
-			"RXLEV_FULL_SERVING_CELL=%d, "
-			"RXLEV_SUB_SERVING_CELL=%d, "
-			"RXQUAL_FULL_SERVING_CELL_BER=%f, "
-			"RXQUAL_SUB_SERVING_CELL_BER=%f, "
-			"RSSI=%f, "
-			"TIME_ERR=%f, "
-			"TRANS_PWR=%u, "
-			"TIME_ADVC=%u, "
-			"FER=%f, "
-			"ACCESSED=%u, "
-			"ARFCN=%u "
-			"WHERE CN_TN_TYPE_AND_OFFSET==\"%s\"",
-			measResults.RXLEV_FULL_SERVING_CELL_dBm(),
-			measResults.RXLEV_SUB_SERVING_CELL_dBm(),
-			measResults.RXQUAL_FULL_SERVING_CELL_BER(),
-			measResults.RXQUAL_SUB_SERVING_CELL_BER(),
-			chan->RSSI(), chan->timingError(),
-			chan->actualMSPower(), chan->actualMSTiming(),
-			chan->FER(),
-			(unsigned)time(NULL),
-			chan->ARFCN(),
-			chan->descriptiveString());
+	PhysicalSample sample;
+	sample.rxlevFull = measResults.RXLEV_FULL_SERVING_CELL_dBm();
+	sample.rxlevSub = measResults.RXLEV_SUB_SERVING_CELL_dBm();
+	sample.berFull = measResults.RXQUAL_FULL_SERVING_CELL_BER();
+	sample.berSub = measResults.RXQUAL_SUB_SERVING_CELL_BER();
+	sample.RSSI = chan->RSSI();
+	sample.timingError = chan->timingError();
+	sample.power = chan->actualMSPower();
+	sample.timing = chan->actualMSTiming();
+	sample.FER = chan->FER();
+	sample.accessed = (unsigned)time(NULL);
+	sample.ARFCN = chan->ARFCN();
+	sample.ncellARFCN = ARFCN;
+	sample.ncellRSSI = (ARFCN<0) ? 0 : measResults.RXLEV_NCELL_dBm(0);
+
+	// Only the latest report per channel is kept until the next flush.
+	string key = chan->descriptiveString();
+	ScopedLock lock(mLock);
+	mPending[key] = sample;
+	return true;
+}
+
+bool PhysicalStatus::writeSample(SQLiteQuery& insert, SQLiteQuery& update,
+	const std::string& chanString, const PhysicalSample& sample)
+{
+	insert.reset();
+	if (!insert.bind(chanString).bind(sample.accessed).run()) return false;
+
+	update.reset();
+	update.bind(sample.rxlevFull).bind(sample.rxlevSub);
+	update.bind((double)sample.berFull).bind((double)sample.berSub);
+	update.bind((double)sample.RSSI).bind((double)sample.timingError);
+	update.bind(sample.power).bind(sample.timing).bind((double)sample.FER);
+	update.bind(sample.accessed).bind(sample.ARFCN);
+	// A report without a neighbor leaves the previous neighbor columns alone.
+	if (sample.ncellARFCN < 0) {
+		update.bind((const char*)NULL).bind((const char*)NULL);
 	} else {
-		sprintf(query,
-			"UPDATE PHYSTATUS SET "
-			"RXLEV_FULL_SERVING_CELL=%d, "
-			"RXLEV_SUB_SERVING_CELL=%d, "
-			"RXQUAL_FULL_SERVING_CELL_BER=%f, "
-			"RXQUAL_SUB_SERVING_CELL_BER=%f, "
-			"RSSI=%f, "
-			"TIME_ERR=%f, "
-			"TRANS_PWR=%u, "
-			"TIME_ADVC=%u, "
-			"FER=%f, "
-			"ACCESSED=%u, "
-			"ARFCN=%u ,"
-			"NCELL_ARFCN=%u, "
-			"NCELL_RSSI=%d "
-			"WHERE CN_TN_TYPE_AND_OFFSET==\"%s\"",
-			measResults.RXLEV_FULL_SERVING_CELL_dBm(),
-			measResults.RXLEV_SUB_SERVING_CELL_dBm(),
-			measResults.RXQUAL_FULL_SERVING_CELL_BER(),
-			measResults.RXQUAL_SUB_SERVING_CELL_BER(),
-			chan->RSSI(), chan->timingError(),
-			chan->actualMSPower(), chan->actualMSTiming(),
-			chan->FER(),
-			(unsigned)time(NULL),
-			chan->ARFCN(),
-			(unsigned)ARFCN,
-			measResults.RXLEV_NCELL_dBm(0),
-			chan->descriptiveString()
-			);
+		update.bind(sample.ncellARFCN).bind(sample.ncellRSSI);
 	}
+	return update.bind(chanString).run();
+}
 
-	LOG(DEBUG) << "Query: " << query;
+bool PhysicalStatus::flush()
+{
+	// Take the pending samples, so setPhysical is blocked only for the swap.
+	PhysicalSampleMap samples;
+	mLock.lock();
+	samples.swap(mPending);
+	mLock.unlock();
+	if (samples.empty()) return true;
+
+	ScopedLock lock(mDBLock);
+	if (!mDB) return false;
+
+	Timeval timer;
+	SQLiteTransaction transaction(mDB);
+	SQLiteQuery insert(mDB,
+		"INSERT OR IGNORE INTO PHYSTATUS (CN_TN_TYPE_AND_OFFSET, ACCESSED) VALUES (?1, ?2)");
+	SQLiteQuery update(mDB,
+		"UPDATE PHYSTATUS SET "
+		"RXLEV_FULL_SERVING_CELL=?1, "
+		"RXLEV_SUB_SERVING_CELL=?2, "
+		"RXQUAL_FULL_SERVING_CELL_BER=?3, "
+		"RXQUAL_SUB_SERVING_CELL_BER=?4, "
+		"RSSI=?5, "
+		"TIME_ERR=?6, "
+		"TRANS_PWR=?7, "
+		"TIME_ADVC=?8, "
+		"FER=?9, "
+		"ACCESSED=?10, "
+		"ARFCN=?11, "
+		"NCELL_ARFCN=COALESCE(?12,NCELL_ARFCN), "
+		"NCELL_RSSI=COALESCE(?13,NCELL_RSSI) "
+		"WHERE CN_TN_TYPE_AND_OFFSET==?14");
+	bool ok = transaction.active() && insert.valid() && update.valid();
+	for (PhysicalSampleMap::const_iterator it = samples.begin(); ok && it != samples.end(); ++it) {
+		ok = writeSample(insert, update, it->first, it->second);
+	}
+	ok = ok && transaction.commit();
 
-	return sqlite3_command(mDB, query);
+	if (!ok) {
+		// These are snapshots; the next reports replace them anyway.
+		// The transaction rolls back as it goes out of scope.
+		LOG(ERR) << "cannot write " << samples.size() << " channel status entries: " << sqlite3_errmsg(mDB);
+		return false;
+	}
+
+	LOG(DEBUG) << "wrote " << samples.size() << " channel status entries in " << timer.elapsed() << " ms";
+	return true;
+}
+
+void* GSM::PhysicalStatusWriter(void* arg)
+{
+	PhysicalStatus* status = (PhysicalStatus*)arg;
+	while (true) {
+		msleep(gConfig.getNum("Control.Reporting.PhysStatusWritePeriod"));
+		status->flush();
+	}
+	return NULL;
 }
 
 #if 0
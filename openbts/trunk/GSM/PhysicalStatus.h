@@ -22,12 +22,14 @@
 #define PHYSICALSTATUS_H
 
 #include <map>
+#include <string>
 
 #include <Timeval.h>
 #include <Threads.h>
 
 
 struct sqlite3;
+class SQLiteQuery;
 
 
 namespace GSM {
@@ -35,18 +37,48 @@ namespace GSM {
 class L3MeasurementResults;
 class LogicalChannel;
 
+/** The most recent measurements for one channel, as written to the PHYSTATUS table. */
+struct PhysicalSample {
+	int rxlevFull;			///< RXLEV_FULL_SERVING_CELL, dBm
+	int rxlevSub;			///< RXLEV_SUB_SERVING_CELL, dBm
+	float berFull;			///< RXQUAL_FULL_SERVING_CELL_BER
+	float berSub;			///< RXQUAL_SUB_SERVING_CELL_BER
+	float RSSI;
+	float timingError;
+	int power;				///< MS tx power, dBm
+	int timing;				///< MS timing advance
+	float FER;
+	unsigned accessed;		///< Unix time of the report
+	unsigned ARFCN;
+	int ncellARFCN;			///< strongest neighbor ARFCN, or -1 if none reported
+	int ncellRSSI;
+};
+
+/** Channel descriptive string to its latest unwritten sample. */
+typedef std::map<std::string, PhysicalSample> PhysicalSampleMap;
+
 /**
 	A table for tracking the state of channels.
+
+	Measurement reports are kept in memory, latest per channel, and a
+	writer thread stores them in the database in a single transaction
+	every Control.Reporting.PhysStatusWritePeriod milliseconds, so the
+	SACCH service threads never wait on SQLite.
 */
 class PhysicalStatus {
 
 private:
 
-	Mutex mLock;		///< to reduce the load on the filesystem locking
+	Mutex mLock;		///< protects mPending
+	PhysicalSampleMap mPending;	///< samples not yet written to the database
+	Mutex mDBLock;		///< serializes use of mDB
 	sqlite3 *mDB;		///< database connection
+	Thread mWriter;		///< thread running PhysicalStatusWriter
 
 public:
 
+	PhysicalStatus():mDB(NULL) {}
+
 	/**
 		Initialize a physical status reporting table.
 		@param path Path fto sqlite3 database file.
@@ -64,6 +96,12 @@ public:
 	*/
 	bool setPhysical(const LogicalChannel* chan, const L3MeasurementResults& measResults);
 
+	/**
+		Write the pending samples to the database in one transaction.
+		@return true on success or if there was nothing to write.
+	*/
+	bool flush();
+
 	/**
 		Dump the physical status table to the output stream.
 		@param os The output stream to dump the channel information to.
@@ -72,17 +110,20 @@ public:
 
 	private:
 
-	/** 
-		Create entry in table. This is for the initial creation.
-		@param chan The channel to create an entry for.
-		@return The result of the SQLite query: true for the query being executed successfully, false otherwise.
+	/**
+		Write one sample, creating the channel's row if needed; mDBLock must be held.
+		@return true if both statements succeeded.
 	*/
-	bool createEntry(const LogicalChannel* chan);
+	bool writeSample(SQLiteQuery& insert, SQLiteQuery& update,
+		const std::string& chanString, const PhysicalSample& sample);
 
 
 };
 
 
+/** Periodically calls PhysicalStatus::flush() on the object passed as the argument. */
+void* PhysicalStatusWriter(void*);
+
 }
 
 #endif
@@ -44,7 +44,7 @@ void NeighborTable::NeighborTableInit(const char* wPath)
 	int rc = sqlite3_open(wPath,&mDB);
 	if (rc) {
 		LOG(ALERT) << "Cannot open NeighborTable database: " << sqlite3_errmsg(mDB);
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return;
 	}
@@ -107,11 +107,14 @@ void NeighborTable::fill()
 	}
 	sqlite3_finalize(stmt);
 	// remove entries in neighbor table that aren't configured
-	char query2[400];
+	if (toBeDeleted.empty()) return;
+	SQLiteTransaction transaction(mDB);
+	SQLiteQuery remove(mDB,"DELETE FROM NEIGHBOR_TABLE WHERE IPADDRESS = ?1");
 	for (unsigned int i = 0; i < toBeDeleted.size(); i++) {
-		sprintf(query2, "delete from NEIGHBOR_TABLE where IPADDRESS = '%s'", toBeDeleted[i].c_str());
-		sqlite3_command(mDB, query2);
+		remove.reset();
+		remove.bind(toBeDeleted[i]).run();
 	}
+	transaction.commit();
 }
 
 
@@ -127,17 +130,12 @@ void NeighborTable::addNeighbor(const struct ::sockaddr_in* address)
 	}
 	LOG(DEBUG) << "adding " << addrString << ":" << ntohs(address->sin_port) << " to neighbor table";
 
-	char query[200];
-	sprintf(query,
-		"INSERT OR IGNORE INTO NEIGHBOR_TABLE (IPADDRESS) "
-		"VALUES ('%s:%d')",
-		addrString,(int)ntohs(address->sin_port));
-	sqlite3_command(mDB,query);
+	char ipaddress[300];
+	sprintf(ipaddress,"%s:%d",addrString,(int)ntohs(address->sin_port));
+	SQLiteQuery q(mDB,"INSERT OR IGNORE INTO NEIGHBOR_TABLE (IPADDRESS) VALUES (?1)");
+	q.bind(ipaddress).run();
 	// flag the entry as configured
-	char *p = 1+index(query, '\'');
-	char *q = index(p, '\'');
-	*q = 0;
-	mConfigured.insert(p);
+	mConfigured.insert(ipaddress);
 
 	// update mBCCSet
 	mBCCSet = getBCCSet();
@@ -162,19 +160,18 @@ bool NeighborTable::addInfo(const struct ::sockaddr_in* address, unsigned update
 	}
 	LOG(DEBUG) << "updating " << addrString << ":" << ntohs(address->sin_port) << " in neighbor table";
 
-	char query[200];
+	char ipaddress[300];
 	unsigned int dummy;  // C0 is arbitrary integer column.  just want to know if ipaddress is in table.
-	sprintf(query, "%s:%d", addrString,(int)ntohs(address->sin_port));
-	if (!sqlite3_single_lookup(mDB, "NEIGHBOR_TABLE", "IPADDRESS", query, "C0", dummy)) {
-		LOG(NOTICE) << "Ignoring unsolicited 'RSP NEIGHBOR_PARAMS' from " << query;
+	sprintf(ipaddress, "%s:%d", addrString,(int)ntohs(address->sin_port));
+	if (!sqlite3_single_lookup(mDB, "NEIGHBOR_TABLE", "IPADDRESS", ipaddress, "C0", dummy)) {
+		LOG(NOTICE) << "Ignoring unsolicited 'RSP NEIGHBOR_PARAMS' from " << ipaddress;
 		return false;
 	}
-	sprintf(query,
+	SQLiteQuery q(mDB,
 		"REPLACE INTO NEIGHBOR_TABLE (IPADDRESS,UPDATED,C0,BSIC,HOLDOFF) "
-		"VALUES ('%s:%d',%u,%u,%u,0) ",
-		addrString,(int)ntohs(address->sin_port),updated,C0,BSIC);
-	if (!sqlite3_command(mDB,query)) {
-		LOG(ALERT) << "write to neighbor table failed: " << query;
+		"VALUES (?1,?2,?3,?4,0)");
+	if (!q.bind(ipaddress).bind(updated).bind(C0).bind(BSIC).run()) {
+		LOG(ALERT) << "write to neighbor table failed for " << ipaddress;
 		return false;
 	}
 
@@ -195,14 +192,13 @@ void NeighborTable::refresh()
 	fill();
 	time_t now = time(NULL);
 	time_t then = now - gConfig.getNum("Peering.Neighbor.RefreshAge");
-	char query[400];
-	sprintf(query,"SELECT IPADDRESS FROM NEIGHBOR_TABLE WHERE UPDATED < %u",(unsigned)then);
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(mDB,&stmt,query)) {
-		LOG(ALERT) << "read of neighbor table failed: " << query;
+	SQLiteQuery q(mDB,"SELECT IPADDRESS FROM NEIGHBOR_TABLE WHERE UPDATED < ?1");
+	if (!q.valid()) {
+		LOG(ALERT) << "read of neighbor table failed";
 		return;
 	}
-	int src = sqlite3_step(stmt);
+	sqlite3_stmt *stmt = q.stmt();
+	int src = q.bind((unsigned)then).step();
 	while (src==SQLITE_ROW) {
 		const char* addrString = (const char*)sqlite3_column_text(stmt,0);
 		if (!addrString) {
@@ -220,7 +216,6 @@ void NeighborTable::refresh()
 		gPeerInterface.sendNeighborParamsRequest(&address);
 		src = sqlite3_step(stmt);
 	}
-	sqlite3_finalize(stmt);
 }
 
 
@@ -233,23 +228,18 @@ char* NeighborTable::getAddress(unsigned BCCH_FREQ_NCELL, unsigned BSIC)
 
 	LOG(DEBUG) << "BCCH_FREQ_NCELL=" << BCCH_FREQ_NCELL << " BSIC=" << BSIC;
 	char *retVal = NULL;
-	char query[500];
 	int C0 = getARFCN(BCCH_FREQ_NCELL);
 	if (C0 < 0) return NULL;
-	sprintf(query,"SELECT IPADDRESS FROM NEIGHBOR_TABLE WHERE BSIC=%d AND C0=%d",BSIC,C0);
-	LOG(DEBUG) << query;
-	sqlite3_stmt *stmt;
-	int prc = sqlite3_prepare_statement(mDB,&stmt,query);
-	if (prc) {
-		LOG(ALERT) << "cannot prepare statement for " << query;
+	SQLiteQuery q(mDB,"SELECT IPADDRESS FROM NEIGHBOR_TABLE WHERE BSIC=?1 AND C0=?2");
+	if (!q.valid()) {
+		LOG(ALERT) << "cannot prepare neighbor address lookup";
 		return NULL;
 	}
-	int src = sqlite3_run_query(mDB,stmt);
+	int src = q.bind(BSIC).bind(C0).step();
 	if (src==SQLITE_ROW) {
-		const char* ptr = (const char*)sqlite3_column_text(stmt,0);
-		retVal = strdup(ptr);
+		const char* ptr = (const char*)sqlite3_column_text(q.stmt(),0);
+		if (ptr) retVal = strdup(ptr);
 	}
-	sqlite3_finalize(stmt);
 	return retVal;
 }
 
@@ -279,10 +269,8 @@ void NeighborTable::holdOff(const char* address, unsigned seconds)
 	if (!seconds) return;
 
 	time_t holdoffTime = time(NULL) + seconds;
-	char query[200];
-	sprintf(query,"UPDATE NEIGHBOR_TABLE SET HOLDOFF=%u WHERE IPADDRESS='%s'",
-		holdoffTime, address);
-	if (!sqlite3_command(mDB,query)) {
+	SQLiteQuery q(mDB,"UPDATE NEIGHBOR_TABLE SET HOLDOFF=?1 WHERE IPADDRESS=?2");
+	if (!q.bind(holdoffTime).bind(address).run()) {
 		LOG(ALERT) << "cannot access neighbor table";
 	}
 }
@@ -315,22 +303,18 @@ bool NeighborTable::holdingOff(const char* address)
 
 std::vector<unsigned> NeighborTable::getARFCNs() const
 {
-	char query[500];
 	vector<unsigned> bcchChannelList;
-	sprintf(query,"SELECT C0 FROM NEIGHBOR_TABLE WHERE BSIC > -1 ORDER BY UPDATED DESC LIMIT %u", gConfig.getNum("GSM.Neighbors.NumToSend"));
-	sqlite3_stmt *stmt;
-	int prc = sqlite3_prepare_statement(mDB,&stmt,query);
-	if (prc) {
-		LOG(ALERT) << "cannot prepare statement for " << query;
+	SQLiteQuery q(mDB,"SELECT C0 FROM NEIGHBOR_TABLE WHERE BSIC > -1 ORDER BY UPDATED DESC LIMIT ?1");
+	if (!q.valid()) {
+		LOG(ALERT) << "cannot prepare neighbor ARFCN query";
 		return bcchChannelList;
 	}
-	int src = sqlite3_run_query(mDB,stmt);
+	int src = q.bind(gConfig.getNum("GSM.Neighbors.NumToSend")).step();
 	while (src==SQLITE_ROW) {
-		unsigned ARFCN = sqlite3_column_int(stmt,0);
+		unsigned ARFCN = sqlite3_column_int(q.stmt(),0);
 		bcchChannelList.push_back(ARFCN);
-		src = sqlite3_step(stmt);
+		src = q.step();
 	}
-	sqlite3_finalize(stmt);
 	return bcchChannelList;
 }
 
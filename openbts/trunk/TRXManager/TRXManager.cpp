@@ -95,7 +95,8 @@ void* ClockLoopAdapter(TransceiverManager *transceiver)
 void TransceiverManager::clockHandler()
 {
 	char buffer[MAX_UDP_LENGTH];
-	int msgLen = mClockSocket.read(buffer,gConfig.getNum("TRX.Timeout.Clock")*1000);
+	static const ConfigurationHandle& clockTimeout = gConfig.handle("TRX.Timeout.Clock");
+	int msgLen = mClockSocket.read(buffer,clockTimeout.getNum()*1000);
 
 	// Did the transceiver die??
 	if (msgLen<0) {
@@ -145,7 +146,9 @@ unsigned TransceiverManager::C0() const
 ::ARFCNManager::ARFCNManager(const char* wTRXAddress, int wBasePort, TransceiverManager &wTransceiver)
 	:mTransceiver(wTransceiver),
 	mDataSocket(wBasePort+100+1,wTRXAddress,wBasePort+1),
-	mControlSocket(wBasePort+100,wTRXAddress,wBasePort)
+	mControlSocket(wBasePort+100,wTRXAddress,wBasePort),
+	mBatchBursts(0),mTxBatchCount(0),mTxBatchFN(0),mTxBatchSeq(0),
+	mTxFlushStarted(false)
 {
 	// The default demux table is full of NULL pointers.
 	for (int i=0; i<8; i++) {
@@ -197,8 +200,7 @@ void ::ARFCNManager::writeHighSideTx(const GSM::TxBurst& burst,const char *culpr
 	LOG(DEBUG) << culprit << " transmit at time " << gBTS.clock().get() << ": " << burst 
 		<<" steal="<<(int)burst.peekField(60,1)<<(int)burst.peekField(87,1);
 	// format the transmission request message
-	static const int bufferSize = gSlotLen+1+4+1;
-	char buffer[bufferSize];
+	char buffer[txBurstLength];
 	unsigned char *wp = (unsigned char*)buffer;
 	// slot
 	*wp++ = burst.time().TN();
@@ -217,9 +219,56 @@ void ::ARFCNManager::writeHighSideTx(const GSM::TxBurst& burst,const char *culpr
 		*wp++ = (unsigned char)((*dp++) & 0x01);
 	}
 	// write to the socket
-	mDataSocketLock.lock();
-	mDataSocket.write(buffer,bufferSize);
-	mDataSocketLock.unlock();
+	ScopedLock lock(mDataSocketLock);
+	if (mBatchBursts<2) {
+		mDataSocket.write(buffer,txBurstLength);
+		return;
+	}
+	// Batched: the bursts of one TDMA frame share a datagram.
+	if (mTxBatchCount && (FN!=mTxBatchFN)) flushTx();
+	memcpy(mTxBatch+mTxBatchCount*txBurstLength,buffer,txBurstLength);
+	if (mTxBatchCount++==0) {
+		mTxBatchFN = FN;
+		mTxBatchSignal.signal();
+	}
+	if (mTxBatchCount==mBatchBursts) flushTx();
+}
+
+
+void ::ARFCNManager::flushTx()
+{
+	if (!mTxBatchCount) return;
+	mDataSocket.write(mTxBatch,mTxBatchCount*txBurstLength);
+	mTxBatchCount = 0;
+	mTxBatchSeq++;
+}
+
+
+void ::ARFCNManager::driveTxFlush()
+{
+	ScopedLock lock(mDataSocketLock);
+	while (!mTxBatchCount) mTxBatchSignal.wait(mDataSocketLock);
+	// Give the rest of the frame a moment to show up, but no longer,
+	// since the bursts are only a frame or two ahead of the radio.
+	unsigned seq = mTxBatchSeq;
+	Timeval deadline(maxTxHoldMs);
+	while (mTxBatchSeq==seq) {
+		long remaining = deadline.remaining();
+		if (remaining<=0) {
+			flushTx();
+			break;
+		}
+		mTxBatchSignal.wait(mDataSocketLock,remaining);
+	}
+}
+
+
+void* TxFlushLoopAdapter(::ARFCNManager* manager){
+	while (true) {
+		manager->driveTxFlush();
+		pthread_testcancel();
+	}
+	return NULL;
 }
 
 
@@ -227,33 +276,48 @@ void ::ARFCNManager::writeHighSideTx(const GSM::TxBurst& burst,const char *culpr
 
 void ::ARFCNManager::driveRx()
 {
-	// read the message
-	char buffer[MAX_UDP_LENGTH];
-	int msgLen = mDataSocket.read(buffer);
-	if (msgLen<=0) SOCKET_ERROR;
-	// decode
-	unsigned char *rp = (unsigned char*)buffer;
-	// timeslot number
-	unsigned TN = *rp++;
-	// frame number
-	int32_t FN = *rp++;
-	FN = (FN<<8) + (*rp++);
-	FN = (FN<<8) + (*rp++);
-	FN = (FN<<8) + (*rp++);
-	// physcial header data
-	signed char* srp = (signed char*)rp++;
-	// reported RSSI is negated dB wrt full scale
-	int RSSI = *srp;
-	srp = (signed char*)rp++;
-	// timing error comes in 1/256 symbol steps
-	// because that fits nicely in 2 bytes
-	int timingError = *srp;
-	timingError = (timingError<<8) | (*rp++);
-	// soft symbols
-	float data[gSlotLen];
-	for (unsigned i=0; i<gSlotLen; i++) data[i] = (*rp++) / 256.0F;
-	// demux
-	receiveBurst(RxBurst(data,GSM::Time(FN,TN),timingError/256.0F,-RSSI));
+	// read the messages, as many as are already queued
+	static const unsigned maxDatagrams = 8;
+	char buffers[maxDatagrams][MAX_UDP_LENGTH];
+	char *bufferPtrs[maxDatagrams];
+	for (unsigned i=0; i<maxDatagrams; i++) bufferPtrs[i] = buffers[i];
+	int msgLens[maxDatagrams];
+	int numMsgs = mDataSocket.readBatch(bufferPtrs,msgLens,maxDatagrams);
+	if (numMsgs<=0) SOCKET_ERROR;
+	for (int m=0; m<numMsgs; m++) {
+		if (msgLens[m]<=0) SOCKET_ERROR;
+		// A batched message carries several bursts back to back.
+		unsigned numBursts = msgLens[m] / rxBurstLength;
+		if (numBursts==0) numBursts = 1;
+		unsigned char *rp = (unsigned char*)buffers[m];
+		for (unsigned b=0; b<numBursts; b++) {
+			unsigned char *next = rp + rxBurstLength;
+			// decode
+			// timeslot number
+			unsigned TN = *rp++;
+			// frame number
+			int32_t FN = *rp++;
+			FN = (FN<<8) + (*rp++);
+			FN = (FN<<8) + (*rp++);
+			FN = (FN<<8) + (*rp++);
+			// physcial header data
+			signed char* srp = (signed char*)rp++;
+			// reported RSSI is negated dB wrt full scale
+			int RSSI = *srp;
+			srp = (signed char*)rp++;
+			// timing error comes in 1/256 symbol steps
+			// because that fits nicely in 2 bytes
+			int timingError = *srp;
+			timingError = (timingError<<8) | (*rp++);
+			// soft symbols
+			static const float softScale = 1.0F/256.0F;
+			float data[gSlotLen];
+			for (unsigned i=0; i<gSlotLen; i++) data[i] = (*rp++) * softScale;
+			// demux
+			receiveBurst(RxBurst(data,GSM::Time(FN,TN),timingError*softScale,-RSSI));
+			rp = next;
+		}
+	}
 }
 
 
@@ -507,6 +571,27 @@ bool ::ARFCNManager::setSlot(unsigned TN, unsigned combination)
 	return true;
 }
 
+bool ::ARFCNManager::setBatch(unsigned bursts)
+{
+	if (bursts>maxBatchBursts) bursts = maxBatchBursts;
+	int accepted = 0;
+	int status = sendCommand("SETBATCH",bursts,&accepted);
+	if (status!=0) {
+		LOG(NOTICE) << "SETBATCH failed with status " << status << ", sending one burst per datagram";
+		return false;
+	}
+	ScopedLock lock(mDataSocketLock);
+	if (accepted<0) accepted = 0;
+	mBatchBursts = ((unsigned)accepted<bursts) ? accepted : bursts;
+	if (mBatchBursts>1 && !mTxFlushStarted) {
+		mTxFlushThread.start((void*(*)(void*))TxFlushLoopAdapter,this);
+		mTxFlushStarted = true;
+	}
+	LOG(INFO) << "batching " << mBatchBursts << " bursts per datagram";
+	return true;
+}
+
+
 bool ::ARFCNManager::setMaxDelay(unsigned km)
 {
         int status = sendCommand("SETMAXDLY",km);
@@ -600,7 +685,8 @@ signed ::ARFCNManager::getFactoryCalibration(const char * param)
 
 void ::ARFCNManager::receiveBurst(const RxBurst& inBurst)
 {
-	if (inBurst.RSSI() < gConfig.getNum("TRX.MinimumRxRSSI")) {
+	static const ConfigurationHandle& minimumRxRSSI = gConfig.handle("TRX.MinimumRxRSSI");
+	if (inBurst.RSSI() < minimumRxRSSI.getNum()) {
 		LOG(DEBUG) << "ignoring " << inBurst;
 		return;
 	}
@@ -120,6 +120,22 @@ class ARFCNManager {
 
 	Thread mRxThread;				///< thread to receive data from rx
 
+	/**@name Batched downlink transport, negotiated with SETBATCH. */
+	//@{
+	static const unsigned maxBatchBursts = 8;		///< one TDMA frame
+	static const unsigned txBurstLength = GSM::gSlotLen+1+4+1;	///< downlink burst on the data socket
+	static const unsigned rxBurstLength = GSM::gSlotLen+10;		///< uplink burst on the data socket
+	static const unsigned maxTxHoldMs = 1;			///< longest a partial batch is held
+	unsigned mBatchBursts;			///< most bursts per downlink datagram, 0 or 1 for one each
+	char mTxBatch[maxBatchBursts*txBurstLength];	///< downlink bursts waiting to be sent
+	unsigned mTxBatchCount;			///< number of bursts in mTxBatch
+	uint32_t mTxBatchFN;			///< frame number of the bursts in mTxBatch
+	unsigned mTxBatchSeq;			///< count of batches sent, to tell them apart
+	Signal mTxBatchSignal;			///< wakes the flush thread when a batch starts
+	Thread mTxFlushThread;			///< thread to send batches held too long
+	bool mTxFlushStarted;			///< true once mTxFlushThread is running
+	//@}
+
 	/**@name The demux table. */
 	//@{
 	Mutex mTableLock;
@@ -244,6 +260,14 @@ class ARFCNManager {
 	*/
 	bool setSlot(unsigned TN, unsigned combo);
 
+	/**
+		Ask the transceiver to batch bursts on the data socket,
+		several per datagram.  Call before the radio is powered on.
+		@param bursts The most bursts per datagram, 0 or 1 for one each.
+		@return true on success; otherwise both ends keep one burst per datagram.
+	*/
+	bool setBatch(unsigned bursts);
+
 	/**
 		Set the given slot to run the handover burst correlator.
 		@param TN The timeslot number.
@@ -277,6 +301,15 @@ class ARFCNManager {
 	/** Receiver loop. */
 	friend void* ReceiveLoopAdapter(ARFCNManager*);
 
+	/** Send the batched downlink bursts; caller holds mDataSocketLock. */
+	void flushTx();
+
+	/** Send a partial batch once it has been held for maxTxHoldMs. */
+	void driveTxFlush();
+
+	/** Batch flush loop. */
+	friend void* TxFlushLoopAdapter(ARFCNManager*);
+
 	/**
 		Send a command packet and get the response packet.
 		@param command The NULL-terminated command string to send.
@@ -325,6 +358,7 @@ class ARFCNManager {
 
 /** C interface for ARFCNManager threads. */
 void* ReceiveLoopAdapter(ARFCNManager*);
+void* TxFlushLoopAdapter(ARFCNManager*);
 
 
 #endif
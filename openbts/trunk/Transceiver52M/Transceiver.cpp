@@ -30,6 +30,7 @@
 
 #include <stdio.h>
 #include "Transceiver.h"
+#include "signalPool.h"
 #include <Logger.h>
 
 #ifdef HAVE_CONFIG_H
@@ -77,6 +78,7 @@ Transceiver::Transceiver(int wBasePort,
   gsmPulse = generateGSMPulse(2,mSamplesPerSymbol);
   LOG(DEBUG) << "gsmPulse: " << *gsmPulse;
   sigProcLibSetup(mSamplesPerSymbol);
+  sigProcFixedSetup(mSamplesPerSymbol);
 
   txFullScale = mRadioInterface->fullScaleInputValue();
   rxFullScale = mRadioInterface->fullScaleOutputValue();
@@ -96,6 +98,7 @@ Transceiver::Transceiver(int wBasePort,
     channelResponse[i] = NULL;
     DFEForward[i] = NULL;
     DFEFeedback[i] = NULL;
+    correlationBuffer[i] = new signalVector((gSlotLen+9)*mSamplesPerSymbol);
     channelEstimateTime[i] = startTime;
   }
 
@@ -106,11 +109,34 @@ Transceiver::Transceiver(int wBasePort,
   mEnergyThreshold = INIT_ENERGY_THRSHD;
   prevFalseDetectionTime = startTime;
 
+  mFixedPoint = false;
+  mNumDemodThreads = 0;
+  mDemodThreads = NULL;
+  mDemodPending = 0;
+  mRxFrameSize = 0;
+  mBatchBursts = 0;
+  mDataBatchCount = 0;
 }
 
 Transceiver::~Transceiver()
 {
+  // stop the demod threads before the state they work on goes away
+  if (mDemodThreads) {
+    for (unsigned i = 0; i < mNumDemodThreads; i++)
+      mDemodQueue.write(&mDemodStop);
+    for (unsigned i = 0; i < mNumDemodThreads; i++) {
+      mDemodThreads[i]->join();
+      delete mDemodThreads[i];
+    }
+    delete[] mDemodThreads;
+    mDemodThreads = NULL;
+  }
+  // the queue holds pointers into mRxFrame, which it must not delete
+  mDemodQueue.flushNoDelete();
+
   delete gsmPulse;
+  for (int i = 0; i < 8; i++) delete correlationBuffer[i];
+  sigProcFixedDestroy();
   sigProcLibDestroy();
   mTransmitPriorityQueue.clear();
 }
@@ -322,46 +348,69 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				      int &RSSI,
 				      int &timingOffset)
 {
-  bool needDFE = (mMaxExpectedDelay > 1);
-
   radioVector *rxBurst = (radioVector *) mReceiveFIFO->get();
 
   if (!rxBurst) return NULL;
 
   LOG(DEBUG) << "receiveFIFO: read radio vector at time: " << rxBurst->getTime() << ", new size: " << mReceiveFIFO->size();
 
-  int timeslot = rxBurst->getTime().TN();
-
   CorrType corrType = expectedCorrType(rxBurst->getTime());
 
   if ((corrType==OFF) || (corrType==IDLE)) {
     delete rxBurst;
     return NULL;
   }
- 
+
+  RxBurst rx;
+  rx.burst = rxBurst;
+  rx.corrType = corrType;
+  rx.energyThreshold = mEnergyThreshold;
+  demodulate(rx);
+  updateEnergyThreshold(rx);
+
+  if (rx.bits) {
+    wTime = rxBurst->getTime();
+    RSSI = rx.RSSI;
+    timingOffset = rx.timingOffset;
+  }
+
+  delete rxBurst;
+
+  return rx.bits;
+}
+
+void Transceiver::demodulate(RxBurst &rx)
+{
+  bool needDFE = (mMaxExpectedDelay > 1);
+
+  radioVector *rxBurst = rx.burst;
+  int timeslot = rxBurst->getTime().TN();
+
+  rx.energyDetected = false;
+  rx.success = false;
+  rx.bits = NULL;
+
+  // the fixed-point path has no equalizer
+  if (mFixedPoint && ((rx.corrType==RACH) || !needDFE)) {
+    demodulateFixed(rx);
+    return;
+  }
+
   // check to see if received burst has sufficient 
   signalVector *vectorBurst = rxBurst;
   complex amplitude = 0.0;
   float TOA = 0.0;
   float avgPwr = 0.0;
-  if (!energyDetect(*vectorBurst,20*mSamplesPerSymbol,mEnergyThreshold,&avgPwr)) {
+  if (!energyDetect(*vectorBurst,20*mSamplesPerSymbol,rx.energyThreshold,&avgPwr)) {
      LOG(DEBUG) << "Estimated Energy: " << sqrt(avgPwr) << ", at time " << rxBurst->getTime();
-     double framesElapsed = rxBurst->getTime()-prevFalseDetectionTime;
-     if (framesElapsed > 50) {  // if we haven't had any false detections for a while, lower threshold
-	mEnergyThreshold -= 10.0/10.0;
-        if (mEnergyThreshold < 0.0)
-          mEnergyThreshold = 0.0;
-
-        prevFalseDetectionTime = rxBurst->getTime();
-     }
-     delete rxBurst;
-     return NULL;
+     return;
   }
   LOG(DEBUG) << "Estimated Energy: " << sqrt(avgPwr) << ", at time " << rxBurst->getTime();
+  rx.energyDetected = true;
 
   // run the proper correlator
   bool success = false;
-  if (corrType==TSC) {
+  if (rx.corrType==TSC) {
     LOG(DEBUG) << "looking for TSC at time: " << rxBurst->getTime();
     signalVector *channelResp;
     double framesElapsed = rxBurst->getTime()-channelEstimateTime[timeslot];
@@ -386,12 +435,14 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 				  mMaxExpectedDelay, 
 				  estimateChannel,
 				  &channelResp,
-				  &chanOffset);
+				  &chanOffset,
+				  correlationBuffer[timeslot]);
     if (success) {
       LOG(DEBUG) << "FOUND TSC!!!!!! " << amplitude << " " << TOA;
-      mEnergyThreshold -= 1.0F/10.0F;
-      if (mEnergyThreshold < 0.0) mEnergyThreshold = 0.0;
-      SNRestimate[timeslot] = amplitude.norm2()/(mEnergyThreshold*mEnergyThreshold+1.0); // this is not highly accurate
+      // threshold as lowered by updateEnergyThreshold() for this burst
+      double threshold = rx.energyThreshold - 1.0F/10.0F;
+      if (threshold < 0.0) threshold = 0.0;
+      SNRestimate[timeslot] = amplitude.norm2()/(threshold*threshold+1.0); // this is not highly accurate
       if (estimateChannel) {
          LOG(DEBUG) << "estimating channel...";
          channelResponse[timeslot] = channelResp;
@@ -404,10 +455,6 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
       }
     }
     else {
-      double framesElapsed = rxBurst->getTime()-prevFalseDetectionTime; 
-      LOG(DEBUG) << "wTime: " << rxBurst->getTime() << ", pTime: " << prevFalseDetectionTime << ", fElapsed: " << framesElapsed;
-      mEnergyThreshold += 10.0F/10.0F*exp(-framesElapsed);
-      prevFalseDetectionTime = rxBurst->getTime();
       channelResponse[timeslot] = NULL;
     }
   }
@@ -417,49 +464,170 @@ SoftVector *Transceiver::pullRadioVector(GSM::Time &wTime,
 			      5.0,  // detection threshold
 			      mSamplesPerSymbol,
 			      &amplitude,
-			      &TOA);
+			      &TOA,
+			      correlationBuffer[timeslot]);
     if (success) {
       LOG(DEBUG) << "FOUND RACH!!!!!! " << amplitude << " " << TOA;
-      mEnergyThreshold -= (1.0F/10.0F);
-      if (mEnergyThreshold < 0.0) mEnergyThreshold = 0.0;
       channelResponse[timeslot] = NULL; 
     }
-    else {
-      double framesElapsed = rxBurst->getTime()-prevFalseDetectionTime;
-      mEnergyThreshold += (1.0F/10.0F)*exp(-framesElapsed);
-      prevFalseDetectionTime = rxBurst->getTime();
-    }
   }
-  LOG(DEBUG) << "energy Threshold = " << mEnergyThreshold; 
+  rx.success = success;
 
   // demodulate burst
-  SoftVector *burst = NULL;
-  if ((rxBurst) && (success)) {
-    if ((corrType==RACH) || (!needDFE)) {
-      burst = demodulateBurst(*vectorBurst,
+  if (success) {
+    if ((rx.corrType==RACH) || (!needDFE)) {
+      rx.bits = demodulateBurst(*vectorBurst,
 			      *gsmPulse,
 			      mSamplesPerSymbol,
 			      amplitude,TOA);
     }
     else { // TSC
       scaleVector(*vectorBurst,complex(1.0,0.0)/amplitude);
-      burst = equalizeBurst(*vectorBurst,
+      rx.bits = equalizeBurst(*vectorBurst,
 			    TOA-chanRespOffset[timeslot],
 			    mSamplesPerSymbol,
 			    *DFEForward[timeslot],
 			    *DFEFeedback[timeslot]);
     }
-    wTime = rxBurst->getTime();
-    RSSI = (int) floor(20.0*log10(rxFullScale/amplitude.abs()));
-    LOG(DEBUG) << "RSSI: " << RSSI;
-    timingOffset = (int) round(TOA*256.0/mSamplesPerSymbol);
+    rx.RSSI = (int) floor(20.0*log10(rxFullScale/amplitude.abs()));
+    LOG(DEBUG) << "RSSI: " << rx.RSSI;
+    rx.timingOffset = (int) round(TOA*256.0/mSamplesPerSymbol);
   }
 
-  //if (burst) LOG(DEBUG) << "burst: " << *burst << '\n';
+  //if (rx.bits) LOG(DEBUG) << "burst: " << *rx.bits << '\n';
+}
 
-  delete rxBurst;
+void Transceiver::demodulateFixed(RxBurst &rx)
+{
+  radioVector *rxBurst = rx.burst;
+  int timeslot = rxBurst->getTime().TN();
+
+  // convert once, everything below is integer per sample
+  fixedVector &burst = mFixedBurst[timeslot];
+  quantizeBurst(*rxBurst,burst);
+
+  complex amplitude = 0.0;
+  float TOA = 0.0;
+  float avgPwr = 0.0;
+  if (!energyDetectFixed(burst,20*mSamplesPerSymbol,rx.energyThreshold,&avgPwr)) {
+     LOG(DEBUG) << "Estimated Energy: " << sqrt(avgPwr) << ", at time " << rxBurst->getTime();
+     return;
+  }
+  LOG(DEBUG) << "Estimated Energy: " << sqrt(avgPwr) << ", at time " << rxBurst->getTime();
+  rx.energyDetected = true;
+
+  if (rx.corrType==TSC)
+    rx.success = analyzeTrafficBurstFixed(burst,
+					  mTSC,
+					  3.0,
+					  mSamplesPerSymbol,
+					  &amplitude,
+					  &TOA,
+					  mMaxExpectedDelay);
+  else
+    rx.success = detectRACHBurstFixed(burst,
+				      5.0,  // detection threshold
+				      mSamplesPerSymbol,
+				      &amplitude,
+				      &TOA);
+
+  if (rx.success) {
+    LOG(DEBUG) << "FOUND " << ((rx.corrType==TSC) ? "TSC" : "RACH") << " " << amplitude << " " << TOA;
+    rx.bits = demodulateBurstFixed(burst,mSamplesPerSymbol,amplitude,TOA);
+    rx.RSSI = (int) floor(20.0*log10(rxFullScale/amplitude.abs()));
+    rx.timingOffset = (int) round(TOA*256.0/mSamplesPerSymbol);
+  }
+}
+
+void Transceiver::updateEnergyThreshold(const RxBurst &rx)
+{
+  GSM::Time burstTime = rx.burst->getTime();
+  double framesElapsed = burstTime-prevFalseDetectionTime;
+
+  if (!rx.energyDetected) {
+    if (framesElapsed > 50) {  // if we haven't had any false detections for a while, lower threshold
+      mEnergyThreshold -= 10.0/10.0;
+      if (mEnergyThreshold < 0.0)
+        mEnergyThreshold = 0.0;
+
+      prevFalseDetectionTime = burstTime;
+    }
+    return;
+  }
+
+  if (rx.success) {
+    mEnergyThreshold -= 1.0F/10.0F;
+    if (mEnergyThreshold < 0.0) mEnergyThreshold = 0.0;
+  }
+  else if (rx.corrType==TSC) {
+    LOG(DEBUG) << "wTime: " << burstTime << ", pTime: " << prevFalseDetectionTime << ", fElapsed: " << framesElapsed;
+    mEnergyThreshold += 10.0F/10.0F*exp(-framesElapsed);
+    prevFalseDetectionTime = burstTime;
+  }
+  else {
+    mEnergyThreshold += (1.0F/10.0F)*exp(-framesElapsed);
+    prevFalseDetectionTime = burstTime;
+  }
+  LOG(DEBUG) << "energy Threshold = " << mEnergyThreshold; 
+}
+
+void Transceiver::demodulateFrame()
+{
+  // Bursts of a frame are held until the frame is complete, i.e. until
+  // the last timeslot or a burst from a later frame shows up, so that
+  // all active timeslots of the frame are demodulated in parallel.
+  while (radioVector *rxBurst = mReceiveFIFO->get()) {
+    LOG(DEBUG) << "receiveFIFO: read radio vector at time: " << rxBurst->getTime() << ", new size: " << mReceiveFIFO->size();
+
+    if (mRxFrameSize && (rxBurst->getTime().FN() != mRxFrame[0].burst->getTime().FN()))
+      dispatchFrame();
+
+    GSM::Time burstTime = rxBurst->getTime();
+    CorrType corrType = expectedCorrType(burstTime);
+    if ((corrType==OFF) || (corrType==IDLE)) {
+      delete rxBurst;
+    }
+    else {
+      RxBurst &rx = mRxFrame[mRxFrameSize++];
+      rx.burst = rxBurst;
+      rx.corrType = corrType;
+    }
 
-  return burst;
+    if ((burstTime.TN() == 7) || (mRxFrameSize == 8))
+      dispatchFrame();
+  }
+}
+
+void Transceiver::dispatchFrame()
+{
+  if (!mRxFrameSize) return;
+
+  mDemodLock.lock();
+  mDemodPending = mRxFrameSize;
+  mDemodLock.unlock();
+
+  // all bursts of the frame see the same threshold,
+  // the updates are applied in timeslot order afterwards
+  for (unsigned i = 0; i < mRxFrameSize; i++) {
+    mRxFrame[i].energyThreshold = mEnergyThreshold;
+    mDemodQueue.write(&mRxFrame[i]);
+  }
+
+  mDemodLock.lock();
+  while (mDemodPending) mDemodDone.wait(mDemodLock);
+  mDemodLock.unlock();
+
+  for (unsigned i = 0; i < mRxFrameSize; i++) {
+    RxBurst &rx = mRxFrame[i];
+    updateEnergyThreshold(rx);
+    if (rx.bits) {
+      writeDataInterface(*rx.bits,rx.burst->getTime(),rx.RSSI,rx.timingOffset);
+      delete rx.bits;
+    }
+    delete rx.burst;
+  }
+  mRxFrameSize = 0;
+  flushDataInterface();
 }
 
 void Transceiver::start()
@@ -520,6 +688,17 @@ void Transceiver::driveControl()
         mPower = -20;
         mRadioInterface->start();
         generateRACHSequence(*gsmPulse,mSamplesPerSymbol);
+        generateRACHSequenceFixed(mSamplesPerSymbol);
+
+        // Start the demod thread pool, if any.
+        if (mNumDemodThreads) {
+          LOG(NOTICE) << "demodulating on " << mNumDemodThreads << " threads";
+          mDemodThreads = new Thread*[mNumDemodThreads];
+          for (unsigned i = 0; i < mNumDemodThreads; i++) {
+            mDemodThreads[i] = new Thread(65536);
+            mDemodThreads[i]->start((void * (*)(void*))DemodServiceLoopAdapter,(void*) this);
+          }
+        }
 
         // Start radio interface threads.
         mFIFOServiceLoopThread->start((void * (*)(void*))FIFOServiceLoopAdapter,(void*) this);
@@ -612,6 +791,7 @@ void Transceiver::driveControl()
     else {
       mTSC = TSC;
       generateMidamble(*gsmPulse,mSamplesPerSymbol,TSC);
+      generateMidambleFixed(mSamplesPerSymbol,TSC);
       sprintf(response,"RSP SETTSC 0 %d",TSC);
     }
   }
@@ -667,8 +847,29 @@ void Transceiver::driveControl()
     // READFACTORY FAILS
     sprintf(response,"RSP READFACTORY 1 %d", ret);
   }
+  else if (strcmp(command,"SETBATCH")==0) {
+    // bursts per uplink datagram, 0 or 1 for one each
+    int bursts;
+    sscanf(buffer,"%3s %s %d",cmdcheck,command,&bursts);
+    if (mOn)
+      snprintf(response,MAX_PACKET_LENGTH,"RSP SETBATCH 1 %d",mBatchBursts);
+    else {
+      if (bursts < 0) bursts = 0;
+      if (bursts > (int) maxBatchBursts) bursts = maxBatchBursts;
+      mBatchBursts = bursts;
+      snprintf(response,MAX_PACKET_LENGTH,"RSP SETBATCH 0 %d",bursts);
+    }
+  }
+  else if (strcmp(command,"POOLSTATS")==0) {
+    // signalVector storage pool counters
+    SignalPoolStats stats;
+    signalPoolStats(&stats);
+    snprintf(response,MAX_PACKET_LENGTH,"RSP POOLSTATS 0 %llu %llu %llu %lld %llu",
+	     stats.allocs,stats.recycled,stats.fresh,stats.outstanding,stats.depot);
+  }
   else {
     LOG(WARNING) << "bogus command " << command << " on control interface.";
+    snprintf(response,MAX_PACKET_LENGTH,"RSP %s 1",command);
   }
 
   mControlSocket.write(response,strlen(response)+1);
@@ -678,16 +879,34 @@ void Transceiver::driveControl()
 bool Transceiver::driveTransmitPriorityQueue() 
 {
 
-  char buffer[gSlotLen+50];
-
-  // check data socket
-  size_t msgLen = mDataSocket.read(buffer);
-
-  if (msgLen!=gSlotLen+1+4+1) {
-    LOG(ERR) << "badly formatted packet on GSM->TRX interface";
-    return false;
+  // check data socket, taking every datagram already queued
+  // (static, since this thread has a small stack)
+  static const unsigned maxDatagrams = 8;
+  static char buffers[maxDatagrams][MAX_UDP_LENGTH];
+  static char *bufferPtrs[maxDatagrams] = {
+    buffers[0], buffers[1], buffers[2], buffers[3],
+    buffers[4], buffers[5], buffers[6], buffers[7]
+  };
+  int lengths[maxDatagrams];
+  int count = mDataSocket.readBatch(bufferPtrs,lengths,maxDatagrams);
+
+  // a datagram carries one or more bursts
+  bool ok = (count > 0);
+  for (int i = 0; i < count; i++) {
+    if ((lengths[i] <= 0) || (lengths[i] % transmitBurstLength)) {
+      LOG(ERR) << "badly formatted packet on GSM->TRX interface";
+      ok = false;
+      continue;
+    }
+    for (int offset = 0; offset < lengths[i]; offset += transmitBurstLength)
+      pushTransmitBurst(buffers[i]+offset);
   }
 
+  return ok;
+}
+
+void Transceiver::pushTransmitBurst(const char *buffer)
+{
   int timeSlot = (int) buffer[0];
   int fillerFlag = timeSlot & SET_FILLER_FRAME;	// Magic flag says this is a filler burst.
   timeSlot = timeSlot & 0x7;
@@ -723,7 +942,7 @@ bool Transceiver::driveTransmitPriorityQueue()
   int RSSI = (int) buffer[5];
   static BitVector newBurst(gSlotLen);
   BitVector::iterator itr = newBurst.begin();
-  char *bufferItr = buffer+6;
+  const char *bufferItr = buffer+6;
   while (itr < newBurst.end()) 
     *itr++ = *bufferItr++;
   
@@ -738,10 +957,6 @@ bool Transceiver::driveTransmitPriorityQueue()
   }
   
   //LOG(DEBUG) "added burst - time: " << currTime << ", RSSI: " << RSSI; // << ", data: " << newBurst; 
-
-  return true;
-
-
 }
  
 void Transceiver::driveReceiveFIFO() 
@@ -754,34 +969,61 @@ void Transceiver::driveReceiveFIFO()
 
   mRadioInterface->driveReceiveRadio();
 
+  if (mNumDemodThreads) {
+    demodulateFrame();
+    return;
+  }
+
   rxBurst = pullRadioVector(burstTime,RSSI,TOA);
 
   if (rxBurst) { 
+    writeDataInterface(*rxBurst,burstTime,RSSI,TOA);
+    delete rxBurst;
+  }
 
+  // hold uplink bursts only while more are already waiting
+  if (!mReceiveFIFO->size()) flushDataInterface();
+
+}
+
+void Transceiver::writeDataInterface(const SoftVector &bits,
+				     const GSM::Time &burstTime,
+				     int RSSI,
+				     int TOA)
+{
     LOG(DEBUG) << "burst parameters: "
 	  << " time: " << burstTime
 	  << " RSSI: " << RSSI
 	  << " TOA: "  << TOA
-	  << " bits: " << *rxBurst;
+	  << " bits: " << bits;
     
-    char burstString[gSlotLen+10];
+    char oneBurst[dataBurstLength];
+    char *burstString = (mBatchBursts > 1) ? mDataBatch + mDataBatchCount*dataBurstLength : oneBurst;
     burstString[0] = burstTime.TN();
     for (int i = 0; i < 4; i++)
       burstString[1+i] = (burstTime.FN() >> ((3-i)*8)) & 0x0ff;
     burstString[5] = RSSI;
     burstString[6] = (TOA >> 8) & 0x0ff;
     burstString[7] = TOA & 0x0ff;
-    SoftVector::iterator burstItr = rxBurst->begin();
+    SoftVector::const_iterator burstItr = bits.begin();
 
     for (unsigned int i = 0; i < gSlotLen; i++) {
       burstString[8+i] =(char) round((*burstItr++)*255.0);
     }
     burstString[gSlotLen+9] = '\0';
-    delete rxBurst;
 
-    mDataSocket.write(burstString,gSlotLen+10);
-  }
+    if (mBatchBursts < 2) {
+      mDataSocket.write(burstString,dataBurstLength);
+      return;
+    }
+    if (++mDataBatchCount == mBatchBursts) flushDataInterface();
+}
 
+void Transceiver::flushDataInterface()
+{
+  if (!mDataBatchCount) return;
+  mDataSocket.write(mDataBatch,mDataBatchCount*dataBurstLength);
+  mDataBatchCount = 0;
 }
 
 void Transceiver::driveTransmitFIFO() 
@@ -878,6 +1120,23 @@ void *ControlServiceLoopAdapter(Transceiver *transceiver)
   return NULL;
 }
 
+void *DemodServiceLoopAdapter(Transceiver *transceiver)
+{
+  transceiver->setPriority();
+
+  while (1) {
+    Transceiver::RxBurst *rx = transceiver->mDemodQueue.read();
+    if (rx == &transceiver->mDemodStop) break;
+    transceiver->demodulate(*rx);
+    transceiver->mDemodLock.lock();
+    if (--transceiver->mDemodPending == 0)
+      transceiver->mDemodDone.signal();
+    transceiver->mDemodLock.unlock();
+    pthread_testcancel();
+  }
+  return NULL;
+}
+
 void *TransmitPriorityQueueServiceLoopAdapter(Transceiver *transceiver)
 {
   while (1) {
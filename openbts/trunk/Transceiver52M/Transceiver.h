@@ -30,6 +30,7 @@
 */
 
 #include "radioInterface.h"
+#include "sigProcFixed.h"
 #include "Interthread.h"
 #include "GSMCommon.h"
 #include "Sockets.h"
@@ -105,10 +106,59 @@ private:
   /** Push modulated burst into transmit FIFO corresponding to a particular timestamp */
   void pushRadioVector(GSM::Time &nowTime);
 
+  /** A received burst on its way through the demodulator */
+  struct RxBurst {
+    radioVector *burst;                ///< received samples, owned by the RxBurst
+    CorrType corrType;                 ///< expected burst type
+    double energyThreshold;            ///< energy detection threshold in effect
+    bool energyDetected;               ///< burst energy was above the threshold
+    bool success;                      ///< correlator found the burst
+    SoftVector *bits;                  ///< demodulated bits, NULL if not found
+    int RSSI;                          ///< received signal strength
+    int timingOffset;                  ///< TOA in 1/256 of a symbol
+  };
+
   /** Pull and demodulate a burst from the receive FIFO */ 
   SoftVector *pullRadioVector(GSM::Time &wTime,
 			   int &RSSI,
 			   int &timingOffset);
+
+  /**
+    Detect, correlate and demodulate one burst.
+    Touches only the per-timeslot state of the burst's timeslot,
+    so bursts of different timeslots may be demodulated concurrently.
+  */
+  void demodulate(RxBurst &rx);
+
+  /** demodulate a burst on the fixed-point path */
+  void demodulateFixed(RxBurst &rx);
+
+  /** Adapt the energy detection threshold to the outcome of a demodulated burst */
+  void updateEnergyThreshold(const RxBurst &rx);
+
+  /**
+    Send a demodulated burst to the GSM core over the data socket.
+    With batching on, the burst is held for flushDataInterface().
+  */
+  void writeDataInterface(const SoftVector &bits,
+			  const GSM::Time &burstTime,
+			  int RSSI,
+			  int TOA);
+
+  /** Send the held uplink bursts to the GSM core in one datagram */
+  void flushDataInterface();
+
+  /** Queue one downlink burst record from the data socket for transmission */
+  void pushTransmitBurst(const char *record);
+
+  /**
+    Collect the bursts of one TDMA frame and demodulate them on the
+    demod thread pool, forwarding results in timeslot order.
+  */
+  void demodulateFrame();
+
+  /** Run the current TDMA frame through the demod thread pool */
+  void dispatchFrame();
    
   /** Set modulus for specific timeslot */
   void setModulus(int timeslot);
@@ -142,6 +192,26 @@ private:
   signalVector *DFEFeedback[8];        ///< most recent DFE feedback filter of all timeslots
   float        chanRespOffset[8];      ///< most recent timing offset, e.g. TOA, of all timeslots
   complex      chanRespAmplitude[8];   ///< most recent channel amplitude of all timeslots
+  signalVector *correlationBuffer[8];  ///< correlator scratch space of all timeslots
+  bool mFixedPoint;                    ///< run detection and slicing in fixed point
+  fixedVector  mFixedBurst[8];         ///< fixed-point copy of the current burst of all timeslots
+
+  unsigned mNumDemodThreads;           ///< size of the demod thread pool, 0 to demodulate on the FIFO thread
+  Thread **mDemodThreads;              ///< threads demodulating bursts of the current TDMA frame
+  InterthreadQueue<RxBurst> mDemodQueue; ///< bursts waiting for a demod thread
+  Mutex mDemodLock;                    ///< protects mDemodPending
+  Signal mDemodDone;                   ///< signaled when the last burst of a frame is demodulated
+  unsigned mDemodPending;              ///< bursts of the current frame still being demodulated
+  RxBurst mDemodStop;                  ///< queued once per demod thread to make it exit
+  RxBurst mRxFrame[8];                 ///< bursts of the TDMA frame being collected
+  unsigned mRxFrameSize;               ///< number of bursts in mRxFrame
+
+  static const unsigned maxBatchBursts = 8;          ///< one TDMA frame
+  static const unsigned dataBurstLength = gSlotLen+10;     ///< uplink burst on the data socket
+  static const unsigned transmitBurstLength = gSlotLen+6;  ///< downlink burst on the data socket
+  unsigned mBatchBursts;               ///< most bursts per uplink datagram, set by SETBATCH, 0 or 1 for one each
+  char mDataBatch[maxBatchBursts*dataBurstLength];  ///< uplink bursts waiting to be sent
+  unsigned mDataBatchCount;            ///< number of bursts in mDataBatch
 
 public:
 
@@ -170,6 +240,16 @@ public:
   /** attach the radioInterface transmit FIFO */
   void transmitFIFO(VectorFIFO *wFIFO) { mTransmitFIFO = wFIFO;}
 
+  /**
+    Set the number of threads used to demodulate the timeslots of a
+    TDMA frame in parallel.  Takes effect at POWERON.
+    @param wNumThreads number of threads, 0 to demodulate on the FIFO thread
+  */
+  void setDemodThreads(unsigned wNumThreads) { if (!mOn) mNumDemodThreads = wNumThreads; }
+
+  /** select the fixed-point receive path, only while the transceiver is off */
+  void setFixedPoint(bool wFixedPoint) { if (!mOn) mFixedPoint = wFixedPoint; }
+
   // This magic flag is ORed with the TN TimeSlot in vectors passed to the transceiver
   // to indicate the radio block is a filler frame instead of a radio frame.
   // Must be higher than any possible TN.
@@ -200,6 +280,8 @@ protected:
 
   friend void *TransmitPriorityQueueServiceLoopAdapter(Transceiver *);
 
+  friend void *DemodServiceLoopAdapter(Transceiver *);
+
   void reset();
 
   /** set priority on current thread */
@@ -216,3 +298,6 @@ void *ControlServiceLoopAdapter(Transceiver *);
 /** transmit queueing thread loop */
 void *TransmitPriorityQueueServiceLoopAdapter(Transceiver *);
 
+/** burst demodulation thread loop */
+void *DemodServiceLoopAdapter(Transceiver *);
+
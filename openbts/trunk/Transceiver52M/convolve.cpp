@@ -0,0 +1,295 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "convolve.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Scalar reference kernels.  These are used for vector tails and on
+ * hosts without SIMD support.
+ */
+static void convolveComplexScalar(const float *x, const float *h,
+				  float *y, int hLen, int outLen)
+{
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		float re = 0.0f, im = 0.0f;
+		for (int k = 0; k < hLen; k++) {
+			re += xp[2*k] * h[2*k] - xp[2*k+1] * h[2*k+1];
+			im += xp[2*k] * h[2*k+1] + xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+static void convolveRealScalar(const float *x, const float *h,
+			       float *y, int hLen, int outLen)
+{
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		float re = 0.0f, im = 0.0f;
+		for (int k = 0; k < hLen; k++) {
+			re += xp[2*k] * h[2*k];
+			im += xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/*
+ * Complex by complex products are formed with two accumulators,
+ *
+ *     a = sum {xr*hr, xi*hr}
+ *     b = sum {xr*hi, xi*hi}
+ *
+ * which combine into re = a.re - b.im, im = a.im + b.re.  The taps are
+ * split into duplicated real {hr,hr} and imaginary {hi,hi} lanes by
+ * shuffles so the tap vector can be used as passed.
+ */
+__attribute__((target("sse3")))
+static void convolveComplexSSE(const float *x, const float *h,
+			       float *y, int hLen, int outLen)
+{
+	int vLen = hLen & ~1;
+
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		__m128 a = _mm_setzero_ps();
+		__m128 b = _mm_setzero_ps();
+
+		for (int k = 0; k < vLen; k += 2) {
+			__m128 xv = _mm_loadu_ps(xp + 2 * k);
+			__m128 hv = _mm_loadu_ps(h + 2 * k);
+			__m128 hr = _mm_moveldup_ps(hv);
+			__m128 hi = _mm_movehdup_ps(hv);
+			a = _mm_add_ps(a, _mm_mul_ps(xv, hr));
+			b = _mm_add_ps(b, _mm_mul_ps(xv, hi));
+		}
+
+		float av[4], bv[4];
+		_mm_storeu_ps(av, a);
+		_mm_storeu_ps(bv, b);
+		float re = (av[0] + av[2]) - (bv[1] + bv[3]);
+		float im = (av[1] + av[3]) + (bv[0] + bv[2]);
+
+		for (int k = vLen; k < hLen; k++) {
+			re += xp[2*k] * h[2*k] - xp[2*k+1] * h[2*k+1];
+			im += xp[2*k] * h[2*k+1] + xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+__attribute__((target("sse")))
+static void convolveRealSSE(const float *x, const float *h,
+			    float *y, int hLen, int outLen)
+{
+	int vLen = hLen & ~1;
+
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		__m128 a = _mm_setzero_ps();
+
+		for (int k = 0; k < vLen; k += 2) {
+			__m128 xv = _mm_loadu_ps(xp + 2 * k);
+			__m128 hv = _mm_loadu_ps(h + 2 * k);
+			a = _mm_add_ps(a, _mm_mul_ps(xv, hv));
+		}
+
+		float av[4];
+		_mm_storeu_ps(av, a);
+		float re = av[0] + av[2];
+		float im = av[1] + av[3];
+
+		for (int k = vLen; k < hLen; k++) {
+			re += xp[2*k] * h[2*k];
+			im += xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void convolveComplexAVX2(const float *x, const float *h,
+				float *y, int hLen, int outLen)
+{
+	int vLen = hLen & ~3;
+
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		__m256 a = _mm256_setzero_ps();
+		__m256 b = _mm256_setzero_ps();
+
+		for (int k = 0; k < vLen; k += 4) {
+			__m256 xv = _mm256_loadu_ps(xp + 2 * k);
+			__m256 hv = _mm256_loadu_ps(h + 2 * k);
+			a = _mm256_fmadd_ps(xv, _mm256_moveldup_ps(hv), a);
+			b = _mm256_fmadd_ps(xv, _mm256_movehdup_ps(hv), b);
+		}
+
+		float av[8], bv[8];
+		_mm256_storeu_ps(av, a);
+		_mm256_storeu_ps(bv, b);
+		float re = (av[0] + av[2] + av[4] + av[6]) -
+			   (bv[1] + bv[3] + bv[5] + bv[7]);
+		float im = (av[1] + av[3] + av[5] + av[7]) +
+			   (bv[0] + bv[2] + bv[4] + bv[6]);
+
+		for (int k = vLen; k < hLen; k++) {
+			re += xp[2*k] * h[2*k] - xp[2*k+1] * h[2*k+1];
+			im += xp[2*k] * h[2*k+1] + xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void convolveRealAVX2(const float *x, const float *h,
+			     float *y, int hLen, int outLen)
+{
+	int vLen = hLen & ~3;
+
+	for (int n = 0; n < outLen; n++) {
+		const float *xp = x + 2 * n;
+		__m256 a = _mm256_setzero_ps();
+
+		for (int k = 0; k < vLen; k += 4) {
+			__m256 xv = _mm256_loadu_ps(xp + 2 * k);
+			__m256 hv = _mm256_loadu_ps(h + 2 * k);
+			a = _mm256_fmadd_ps(xv, hv, a);
+		}
+
+		float av[8];
+		_mm256_storeu_ps(av, a);
+		float re = av[0] + av[2] + av[4] + av[6];
+		float im = av[1] + av[3] + av[5] + av[7];
+
+		for (int k = vLen; k < hLen; k++) {
+			re += xp[2*k] * h[2*k];
+			im += xp[2*k+1] * h[2*k];
+		}
+		y[2*n] = re;
+		y[2*n+1] = im;
+	}
+}
+
+#endif /* HAVE_X86_KERNELS */
+
+ConvolveKernelFunc gConvolveComplex = convolveComplexScalar;
+ConvolveKernelFunc gConvolveReal = convolveRealScalar;
+
+static ConvolveKernel gKernel = CONVOLVE_SCALAR;
+
+bool convolveKernelSupported(ConvolveKernel kernel)
+{
+	switch (kernel) {
+	case CONVOLVE_SCALAR:
+		return true;
+#ifdef HAVE_X86_KERNELS
+	case CONVOLVE_SSE:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse3");
+	case CONVOLVE_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") &&
+		       __builtin_cpu_supports("fma");
+#endif
+	default:
+		return false;
+	}
+}
+
+ConvolveKernel convolveSetKernel(ConvolveKernel kernel)
+{
+	if ((kernel == CONVOLVE_AUTO) || !convolveKernelSupported(kernel)) {
+		if (convolveKernelSupported(CONVOLVE_AVX2))
+			kernel = CONVOLVE_AVX2;
+		else if (convolveKernelSupported(CONVOLVE_SSE))
+			kernel = CONVOLVE_SSE;
+		else
+			kernel = CONVOLVE_SCALAR;
+	}
+
+	switch (kernel) {
+#ifdef HAVE_X86_KERNELS
+	case CONVOLVE_AVX2:
+		gConvolveComplex = convolveComplexAVX2;
+		gConvolveReal = convolveRealAVX2;
+		break;
+	case CONVOLVE_SSE:
+		gConvolveComplex = convolveComplexSSE;
+		gConvolveReal = convolveRealSSE;
+		break;
+#endif
+	default:
+		kernel = CONVOLVE_SCALAR;
+		gConvolveComplex = convolveComplexScalar;
+		gConvolveReal = convolveRealScalar;
+		break;
+	}
+
+	gKernel = kernel;
+	return kernel;
+}
+
+ConvolveKernel convolveSetKernel(const char *name)
+{
+	if (!name || !strcasecmp(name, "auto"))
+		return convolveSetKernel(CONVOLVE_AUTO);
+	if (!strcasecmp(name, "avx2"))
+		return convolveSetKernel(CONVOLVE_AVX2);
+	if (!strcasecmp(name, "sse"))
+		return convolveSetKernel(CONVOLVE_SSE);
+	if (!strcasecmp(name, "scalar"))
+		return convolveSetKernel(CONVOLVE_SCALAR);
+
+	return convolveSetKernel(CONVOLVE_AUTO);
+}
+
+ConvolveKernel convolveGetKernel()
+{
+	return gKernel;
+}
+
+const char *convolveKernelName(ConvolveKernel kernel)
+{
+	switch (kernel) {
+	case CONVOLVE_SCALAR:
+		return "scalar";
+	case CONVOLVE_SSE:
+		return "sse";
+	case CONVOLVE_AVX2:
+		return "avx2";
+	default:
+		return "auto";
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+/*
+ * Inner product kernels for the sliding dot products that make up
+ * convolve() and correlate() in sigProcLib.
+ *
+ * All buffers are interleaved complex floats (re,im,re,im,...).  The
+ * taps are passed already time-reversed so that each output is a plain
+ * dot product over a contiguous span of the input:
+ *
+ *     y[n] = sum(k = 0..hLen-1) x[n+k] * h[k],   n = 0..outLen-1
+ *
+ * The caller guarantees that x holds at least outLen+hLen-1 samples.
+ * Real-valued taps are passed with each value duplicated into both
+ * halves of the complex slot, i.e. h = {h0,h0,h1,h1,...}.
+ */
+
+enum ConvolveKernel {
+	CONVOLVE_SCALAR = 0,	///< original scalar loops in sigProcLib
+	CONVOLVE_SSE = 1,	///< 128-bit SSE kernels
+	CONVOLVE_AVX2 = 2,	///< 256-bit AVX2/FMA kernels
+	CONVOLVE_AUTO = 255	///< best kernel supported by this CPU
+};
+
+typedef void (*ConvolveKernelFunc)(const float *x, const float *h,
+				   float *y, int hLen, int outLen);
+
+/** Kernels selected by convolveSetKernel() */
+extern ConvolveKernelFunc gConvolveComplex;
+extern ConvolveKernelFunc gConvolveReal;
+
+/**
+	Select the convolution kernel.
+	Unsupported requests fall back to the best supported kernel.
+	@param kernel The requested kernel.
+	@return The kernel actually selected.
+*/
+ConvolveKernel convolveSetKernel(ConvolveKernel kernel);
+
+/** Select the convolution kernel by name ("auto", "avx2", "sse", "scalar") */
+ConvolveKernel convolveSetKernel(const char *name);
+
+/** Return the currently selected kernel */
+ConvolveKernel convolveGetKernel();
+
+/** Return true if the CPU and build can run the given kernel */
+bool convolveKernelSupported(ConvolveKernel kernel);
+
+/** Return a printable name for a kernel */
+const char *convolveKernelName(ConvolveKernel kernel);
+
+#endif /* CONVOLVE_H */
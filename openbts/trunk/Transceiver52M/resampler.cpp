@@ -0,0 +1,178 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "resampler.h"
+#include "convolve.h"
+
+static long long floorDiv(long long a, long long b)
+{
+	long long q = a / b;
+	if ((a % b) && ((a < 0) != (b < 0)))
+		q--;
+
+	return q;
+}
+
+/*
+ * Partition b holds taps h[b], h[b+P], h[b+2P], ... zero padded to a
+ * common length and stored newest-sample-last, so that each output is
+ * a plain inner product over a contiguous span of the input.
+ */
+Resampler::Resampler(int P, int Q, const signalVector &lpf)
+	: mP(P), mQ(Q), mBuf(NULL), mBufLen(0), mBufSize(0)
+{
+	assert((P > 0) && (Q > 0));
+	assert(lpf.isRealOnly());
+
+	int L = lpf.size();
+	mPartitionLen = (L + P - 1) / P;
+	mOffset = (L + 1) / 2 / Q;
+
+	mPartitions = new float[2 * P * mPartitionLen];
+	for (int b = 0; b < P; b++) {
+		float *part = mPartitions + 2 * b * mPartitionLen;
+		for (int k = 0; k < mPartitionLen; k++) {
+			int n = b + (mPartitionLen - 1 - k) * P;
+			float tap = (n < L) ? lpf[n].real() : 0.0f;
+			part[2 * k + 0] = tap;
+			part[2 * k + 1] = tap;
+		}
+	}
+
+	reset();
+}
+
+Resampler::~Resampler()
+{
+	delete[] mPartitions;
+	delete[] mBuf;
+}
+
+void Resampler::reset()
+{
+	/* Start from a zero history, as polyphaseResampleVector() does */
+	reserve(mPartitionLen - 1);
+	memset(mBuf, 0, 2 * (mPartitionLen - 1) * sizeof(float));
+	mBufLen = mPartitionLen - 1;
+	mBase = -(mPartitionLen - 1);
+	mNextOut = 0;
+}
+
+long long Resampler::inputIndex(long long outIx) const
+{
+	return (outIx + mOffset) * mQ / mP;
+}
+
+void Resampler::reserve(int inLen)
+{
+	if (mBufLen + inLen <= mBufSize)
+		return;
+
+	int size = 2 * (mBufLen + inLen);
+	float *buf = new float[2 * size];
+	if (mBuf)
+		memcpy(buf, mBuf, 2 * mBufLen * sizeof(float));
+	delete[] mBuf;
+
+	mBuf = buf;
+	mBufSize = size;
+}
+
+template <typename T>
+void Resampler::pushSamples(const T *in, int inLen)
+{
+	reserve(inLen);
+
+	float *buf = mBuf + 2 * mBufLen;
+	for (int i = 0; i < 2 * inLen; i++)
+		buf[i] = in[i];
+
+	mBufLen += inLen;
+}
+
+template <typename T>
+int Resampler::pullSamples(T *out, int maxOut)
+{
+	int num = 0;
+
+	while (num < maxOut) {
+		long long phase = (mNextOut + mOffset) * mQ;
+		long long pos = phase / mP - mBase;
+		if (pos >= mBufLen)
+			break;
+
+		const float *x = mBuf + 2 * (pos - mPartitionLen + 1);
+		const float *h = mPartitions + 2 * (phase % mP) * mPartitionLen;
+		float y[2];
+		gConvolveReal(x, h, y, mPartitionLen, 1);
+
+		out[2 * num + 0] = y[0];
+		out[2 * num + 1] = y[1];
+		num++;
+
+		/* Keep the indices small; P outputs consume exactly Q inputs */
+		if (++mNextOut >= mP) {
+			mNextOut -= mP;
+			mBase -= mQ;
+		}
+	}
+
+	/* Drop input that no later output reaches back to */
+	long long drop = inputIndex(mNextOut) - (mPartitionLen - 1) - mBase;
+	if (drop > mBufLen)
+		drop = mBufLen;
+	if (drop > 0) {
+		mBufLen -= drop;
+		memmove(mBuf, mBuf + 2 * drop, 2 * mBufLen * sizeof(float));
+		mBase += drop;
+	}
+
+	return num;
+}
+
+void Resampler::push(const float *in, int inLen)
+{
+	pushSamples(in, inLen);
+}
+
+void Resampler::push(const short *in, int inLen)
+{
+	pushSamples(in, inLen);
+}
+
+int Resampler::pull(float *out, int maxOut)
+{
+	return pullSamples(out, maxOut);
+}
+
+int Resampler::pull(short *out, int maxOut)
+{
+	return pullSamples(out, maxOut);
+}
+
+int Resampler::pending() const
+{
+	/* Outputs whose newest input index is below mBase + mBufLen */
+	long long last = floorDiv((mBase + mBufLen) * mP - 1, mQ) - mOffset;
+	long long num = last - mNextOut + 1;
+
+	return (num > 0) ? (int) num : 0;
+}
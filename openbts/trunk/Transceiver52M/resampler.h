@@ -0,0 +1,84 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include "sigProcLib.h"
+
+/*
+ * Streaming rational P/Q polyphase resampler.
+ *
+ * Produces the same output sequence as running polyphaseResampleVector()
+ * over the whole stream, with the filter split into P partitions once at
+ * construction and the input history carried between calls.  Samples are
+ * interleaved complex (re,im,re,im,...).  Each output is an inner product
+ * computed by the kernel selected through convolveSetKernel().
+ *
+ * An output is produced only once all of the input it depends on has been
+ * pushed, so the number of outputs per call varies by a sample or two
+ * around inLen * P / Q.
+ */
+class Resampler {
+public:
+	/**
+		@param P The interpolation factor.
+		@param Q The decimation factor.
+		@param lpf The real-valued prototype filter, e.g. from createLPF().
+	*/
+	Resampler(int P, int Q, const signalVector &lpf);
+	~Resampler();
+
+	/** Queue input samples */
+	void push(const float *in, int inLen);
+	void push(const short *in, int inLen);
+
+	/**
+		Produce as many outputs as the queued input allows.
+		@param out Output buffer.
+		@param maxOut Capacity of the output buffer in samples.
+		@return The number of samples written.
+	*/
+	int pull(float *out, int maxOut);
+	int pull(short *out, int maxOut);
+
+	/** Upper bound on the outputs of the next pull() */
+	int pending() const;
+
+	/** Discard queued input and history */
+	void reset();
+
+private:
+	int mP, mQ;
+	int mPartitionLen;	///< taps per partition
+	int mOffset;		///< output index of the first output sample
+	float *mPartitions;	///< P time reversed partitions of duplicated real taps
+
+	float *mBuf;		///< history followed by queued input
+	int mBufLen;		///< samples held in mBuf
+	int mBufSize;		///< capacity of mBuf in samples
+	long long mBase;	///< stream input index of mBuf[0]
+	long long mNextOut;	///< stream index of the next output
+
+	long long inputIndex(long long outIx) const;
+	void reserve(int inLen);
+	template <typename T> void pushSamples(const T *in, int inLen);
+	template <typename T> int pullSamples(T *out, int maxOut);
+};
+
+#endif /* RESAMPLER_H */
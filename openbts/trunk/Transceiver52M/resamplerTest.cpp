@@ -0,0 +1,160 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+/*
+ * Checks the streaming resampler against polyphaseResampleVector() and
+ * measures its throughput against the chunked conversion it replaced in
+ * radioIOResamp.cpp.
+ */
+
+#include <stdlib.h>
+#include <iostream>
+
+#include "sigProcLib.h"
+#include "convolve.h"
+#include "resampler.h"
+#include <Logger.h>
+#include <Configuration.h>
+#include <Timeval.h>
+
+using namespace std;
+
+ConfigurationTable gConfig;
+
+#define CHUNKS		9
+#define ITERATIONS	1000
+#define MAX_ERROR	1e-10	/* Relative to the reference, in power */
+
+/* The previous chunked path: prepend history, resample, keep a tail */
+static int chunkedResample(signalVector &hist, signalVector &chunk,
+			   signalVector *lpf, int P, int Q, int outHist,
+			   float *out)
+{
+	signalVector input(hist, chunk);
+	signalVector *resamp = polyphaseResampleVector(input, P, Q, lpf);
+	chunk.segmentCopyTo(hist, chunk.size() - hist.size(), hist.size());
+
+	int num = resamp->size() - outHist;
+	for (int i = 0; i < num; i++) {
+		out[2 * i + 0] = (*resamp)[outHist + i].real();
+		out[2 * i + 1] = (*resamp)[outHist + i].imag();
+	}
+	delete resamp;
+
+	return num;
+}
+
+/* Returns false if the streaming output is off the reference */
+static bool runCase(const char *name, int P, int Q, int taps)
+{
+	float cutoff = (P < Q) ? (1.0/(float) Q) : (1.0/(float) P);
+	signalVector *lpf = createLPF(cutoff, taps, P);
+
+	int inChunk = Q * CHUNKS;
+	int outChunk = P * CHUNKS;
+	int total = inChunk * ITERATIONS;
+
+	float *in = new float[2 * total];
+	for (int i = 0; i < 2 * total; i++)
+		in[i] = (float) (rand() % 2001 - 1000);
+	float *out = new float[2 * (outChunk + P) * ITERATIONS];
+
+	/* Accuracy against a single pass over the whole stream */
+	signalVector whole(total);
+	for (int i = 0; i < total; i++)
+		whole[i] = complex(in[2 * i], in[2 * i + 1]);
+	signalVector *ref = polyphaseResampleVector(whole, P, Q, lpf);
+
+	Resampler resampler(P, Q, *lpf);
+	int num = 0;
+	for (int n = 0; n < ITERATIONS; n++) {
+		resampler.push(in + 2 * n * inChunk, inChunk);
+		num += resampler.pull(out + 2 * num, resampler.pending());
+	}
+
+	/* The tail of the reference runs its filter off the end of the input */
+	double err = 0.0, pwr = 0.0;
+	for (int i = 0; i < num - P; i++) {
+		complex d = complex(out[2 * i], out[2 * i + 1]) - (*ref)[i];
+		err += d.norm2();
+		pwr += (*ref)[i].norm2();
+	}
+	delete ref;
+
+	/* Throughput of the streaming resampler */
+	Timeval start;
+	for (int n = 0; n < ITERATIONS; n++) {
+		resampler.push(in + 2 * n * inChunk, inChunk);
+		resampler.pull(out, resampler.pending());
+	}
+	long streamMs = start.elapsed();
+
+	/* Throughput of the chunked path */
+	int inHist = 2 * Q;
+	signalVector hist(inHist);
+	hist.fill(0);
+	signalVector chunk(inChunk);
+	start = Timeval();
+	for (int n = 0; n < ITERATIONS; n++) {
+		for (int i = 0; i < inChunk; i++)
+			chunk[i] = complex(in[2 * (n * inChunk + i)],
+					   in[2 * (n * inChunk + i) + 1]);
+		chunkedResample(hist, chunk, lpf, P, Q, 2 * P, out);
+	}
+	long chunkMs = start.elapsed();
+
+	cout << name << " " << P << "/" << Q << ": "
+	     << num << " samples, relative error " << err / pwr << endl;
+	cout << "  streaming " << (streamMs ? (double) total / streamMs / 1000.0 : 0.0)
+	     << " Msps, chunked " << (chunkMs ? (double) total / chunkMs / 1000.0 : 0.0)
+	     << " Msps (input rate)" << endl;
+
+	delete[] in;
+	delete[] out;
+	delete lpf;
+
+	/* Written so that a NaN fails too */
+	if (!(err / pwr <= MAX_ERROR)) {
+		cout << "  FAILED: relative error above " << MAX_ERROR << endl;
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	int status = 0;
+
+	gLogInit("resamplerTest", "NOTICE");
+
+	const ConvolveKernel kernels[] = { CONVOLVE_SCALAR, CONVOLVE_SSE, CONVOLVE_AVX2 };
+	for (unsigned k = 0; k < 3; k++) {
+		if (!convolveKernelSupported(kernels[k]))
+			continue;
+		convolveSetKernel(kernels[k]);
+		cout << "kernel " << convolveKernelName(kernels[k]) << endl;
+
+		srand(1);
+		if (!runCase("rx", 65, 96, 961))
+			status = 1;
+		if (!runCase("tx", 96, 65, 651))
+			status = 1;
+	}
+
+	return status;
+}
@@ -98,6 +98,12 @@ int main(int argc, char *argv[])
   RadioInterface* radio = new RadioInterface(usrp,3,SAMPSPERSYM,mOversamplingRate,false);
   Transceiver *trx = new Transceiver(gConfig.getNum("TRX.Port"),gConfig.getStr("TRX.IP").c_str(),SAMPSPERSYM,GSM::Time(3,0),radio);
   trx->receiveFIFO(radio->receiveFIFO());
+  if (gConfig.defines("TRX.DSP.Kernel"))
+    sigProcLibSetKernel(gConfig.getStr("TRX.DSP.Kernel").c_str());
+  if (gConfig.defines("TRX.DSP.DemodThreads"))
+    trx->setDemodThreads(gConfig.getNum("TRX.DSP.DemodThreads"));
+  if (gConfig.defines("TRX.DSP.FixedPoint"))
+    trx->setFixedPoint(gConfig.getBool("TRX.DSP.FixedPoint"));
 /*
   signalVector *gsmPulse = generateGSMPulse(2,1);
   BitVector normalBurstSeg = "0000101010100111110010101010010110101110011000111001101010000";
@@ -0,0 +1,482 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+
+#include "sigProcFixed.h"
+#include <F16.h>
+#include <Logger.h>
+
+#define MAX_SPS		8
+
+/* Templates and tables are Q14, so that a full scale tap fits in a short */
+#define TAP_ONE		(1 << 14)
+#define TAP_SHIFT	14
+
+/* Correlator outputs are shifted down to keep |c|^2 within 64 bits */
+#define CORR_SHIFT	15
+
+/* Fractional delays are quantized to 1/FRAC_STEPS of a sample */
+#define FRAC_STEPS	64
+#define SINC_LEN	21
+#define SINC_MID	10
+
+struct FixedSequence {
+	complex16 *taps;	///< conjugated template, Q14 scaled
+	int len;
+	float scale;		///< template units per Q14 unit
+	complex gain;
+	float TOA;
+	unsigned expectedTOAPeak;
+};
+
+static FixedSequence *gMidamblesFixed[8][MAX_SPS + 1];
+static FixedSequence *gRACHSequenceFixed[MAX_SPS + 1];
+
+static short gSincTable[FRAC_STEPS][SINC_LEN];
+static complex16 *gReverseRotation = NULL;
+static int gRotationLen = 0;
+
+static short saturate(int32_t x)
+{
+	if (x > 32767)
+		return 32767;
+	if (x < -32768)
+		return -32768;
+
+	return x;
+}
+
+static void deleteSequence(FixedSequence *seq)
+{
+	if (!seq)
+		return;
+
+	delete[] seq->taps;
+	delete seq;
+}
+
+void sigProcFixedSetup(int samplesPerSymbol)
+{
+	/* Fractional delay filters, as built per burst by delayVector() */
+	for (int f = 0; f < FRAC_STEPS; f++) {
+		float frac = (float) f / FRAC_STEPS;
+		for (int j = 0; j < SINC_LEN; j++) {
+			float tap = sinc(M_PI * (j - SINC_MID + frac));
+			gSincTable[f][j] = _f16_round(tap * TAP_ONE);
+		}
+	}
+
+	/* GMSK derotation, as GMSKReverseRotate() */
+	delete[] gReverseRotation;
+	gRotationLen = 157 * samplesPerSymbol;
+	gReverseRotation = new complex16[gRotationLen];
+	for (int n = 0; n < gRotationLen; n++) {
+		double phase = M_PI / 2.0 / samplesPerSymbol * n;
+		gReverseRotation[n].r = _f16_round(cos(phase) * TAP_ONE);
+		gReverseRotation[n].i = _f16_round(-sin(phase) * TAP_ONE);
+	}
+}
+
+void sigProcFixedDestroy()
+{
+	for (int sps = 0; sps <= MAX_SPS; sps++) {
+		for (int i = 0; i < 8; i++) {
+			deleteSequence(gMidamblesFixed[i][sps]);
+			gMidamblesFixed[i][sps] = NULL;
+		}
+		deleteSequence(gRACHSequenceFixed[sps]);
+		gRACHSequenceFixed[sps] = NULL;
+	}
+
+	delete[] gReverseRotation;
+	gReverseRotation = NULL;
+	gRotationLen = 0;
+}
+
+static FixedSequence *quantizeSequence(int TSC, int samplesPerSymbol)
+{
+	FixedSequence *seq = new FixedSequence;
+	const signalVector *sequence =
+		correlationTemplate(TSC, samplesPerSymbol, &seq->gain,
+				    &seq->TOA, &seq->expectedTOAPeak);
+	if (!sequence) {
+		delete seq;
+		return NULL;
+	}
+
+	float peak = 0.0;
+	for (unsigned k = 0; k < sequence->size(); k++) {
+		peak = fmax(peak, fabs((*sequence)[k].real()));
+		peak = fmax(peak, fabs((*sequence)[k].imag()));
+	}
+	if (peak <= 0.0)
+		peak = 1.0;
+
+	seq->len = sequence->size();
+	seq->scale = TAP_ONE / peak;
+	seq->taps = new complex16[seq->len];
+	for (int k = 0; k < seq->len; k++) {
+		seq->taps[k].r = _f16_round((*sequence)[k].real() * seq->scale);
+		seq->taps[k].i = -_f16_round((*sequence)[k].imag() * seq->scale);
+	}
+
+	return seq;
+}
+
+bool generateMidambleFixed(int samplesPerSymbol, int TSC)
+{
+	if ((TSC < 0) || (TSC > 7))
+		return false;
+	if ((samplesPerSymbol < 1) || (samplesPerSymbol > MAX_SPS))
+		return false;
+	if (gMidamblesFixed[TSC][samplesPerSymbol])
+		return true;
+
+	gMidamblesFixed[TSC][samplesPerSymbol] =
+		quantizeSequence(TSC, samplesPerSymbol);
+
+	return gMidamblesFixed[TSC][samplesPerSymbol] != NULL;
+}
+
+bool generateRACHSequenceFixed(int samplesPerSymbol)
+{
+	if ((samplesPerSymbol < 1) || (samplesPerSymbol > MAX_SPS))
+		return false;
+	if (gRACHSequenceFixed[samplesPerSymbol])
+		return true;
+
+	gRACHSequenceFixed[samplesPerSymbol] =
+		quantizeSequence(-1, samplesPerSymbol);
+
+	return gRACHSequenceFixed[samplesPerSymbol] != NULL;
+}
+
+void quantizeBurst(const signalVector &in, fixedVector &out)
+{
+	if (out.size() != in.size())
+		out.resize(in.size());
+
+	for (unsigned n = 0; n < in.size(); n++) {
+		out[n].r = saturate(_f16_round(in[n].real()));
+		out[n].i = saturate(_f16_round(in[n].imag()));
+	}
+}
+
+bool energyDetectFixed(const fixedVector &rxBurst,
+		       unsigned windowLength,
+		       float detectThreshold,
+		       float *avgPwr)
+{
+	if (windowLength > rxBurst.size())
+		windowLength = rxBurst.size();
+	if (!windowLength)
+		return false;
+
+	int64_t energy = 0;
+	for (unsigned i = 0; (i < windowLength) && (4 * i < rxBurst.size()); i++) {
+		const complex16 &x = rxBurst[4 * i];
+		energy += (int32_t) x.r * x.r + (int32_t) x.i * x.i;
+	}
+
+	if (avgPwr)
+		*avgPwr = (float) energy / windowLength;
+
+	double threshold = (double) detectThreshold * detectThreshold * windowLength;
+	return energy > threshold;
+}
+
+/*
+ * Correlate against a template over output indices
+ * [startIndex, startIndex + outLen), with the indexing of correlate().
+ */
+static void correlateFixed(const complex16 *x, int La,
+			   const FixedSequence *seq,
+			   int startIndex, int outLen,
+			   int32_t *re, int32_t *im)
+{
+	int Lb = seq->len;
+
+	for (int n = 0; n < outLen; n++) {
+		int base = startIndex + n - Lb + 1;
+		int kStart = (base < 0) ? -base : 0;
+		int kStop = (base + Lb > La) ? La - base : Lb;
+
+		int64_t accRe = 0, accIm = 0;
+		for (int k = kStart; k < kStop; k++) {
+			const complex16 &a = x[base + k];
+			const complex16 &h = seq->taps[k];
+			accRe += (int32_t) a.r * h.r - (int32_t) a.i * h.i;
+			accIm += (int32_t) a.r * h.i + (int32_t) a.i * h.r;
+		}
+		re[n] = accRe >> CORR_SHIFT;
+		im[n] = accIm >> CORR_SHIFT;
+	}
+}
+
+static int64_t norm2(int32_t re, int32_t im)
+{
+	return (int64_t) re * re + (int64_t) im * im;
+}
+
+/*
+ * Locate the correlation peak.  The fractional part comes from a
+ * parabola through the magnitudes around the peak, and the peak value
+ * is interpolated linearly towards it.
+ */
+static int peakDetectFixed(const int32_t *re, const int32_t *im, int len,
+			   float *peakIndex, complex *peak)
+{
+	int maxIx = 0;
+	int64_t maxPwr = -1;
+	for (int n = 0; n < len; n++) {
+		int64_t pwr = norm2(re[n], im[n]);
+		if (pwr > maxPwr) {
+			maxPwr = pwr;
+			maxIx = n;
+		}
+	}
+
+	float frac = 0.0;
+	if ((maxIx > 0) && (maxIx < len - 1)) {
+		float early = sqrtf(norm2(re[maxIx - 1], im[maxIx - 1]));
+		float mid = sqrtf(maxPwr);
+		float late = sqrtf(norm2(re[maxIx + 1], im[maxIx + 1]));
+		float curve = early - 2.0 * mid + late;
+		if (curve < 0.0)
+			frac = 0.5 * (early - late) / curve;
+		if (frac > 0.5)
+			frac = 0.5;
+		if (frac < -0.5)
+			frac = -0.5;
+	}
+
+	complex p(re[maxIx], im[maxIx]);
+	int nextIx = (frac < 0.0) ? maxIx - 1 : maxIx + 1;
+	if ((nextIx >= 0) && (nextIx < len)) {
+		complex q(re[nextIx], im[nextIx]);
+		p = p + (q - p) * fabs(frac);
+	}
+
+	*peakIndex = maxIx + frac;
+	*peak = p;
+
+	return maxIx;
+}
+
+/* Convert a correlator output back to the units of the float path */
+static complex correlatorUnits(const FixedSequence *seq, complex c)
+{
+	return c * (float) ((1 << CORR_SHIFT) / seq->scale);
+}
+
+bool detectRACHBurstFixed(const fixedVector &rxBurst,
+			  float detectThreshold,
+			  int samplesPerSymbol,
+			  complex *amplitude,
+			  float *TOA)
+{
+	assert((samplesPerSymbol > 0) && (samplesPerSymbol <= MAX_SPS));
+	const FixedSequence *seq = gRACHSequenceFixed[samplesPerSymbol];
+	assert(seq);
+
+	int La = rxBurst.size();
+	int startIndex = (seq->len % 2) ? seq->len / 2 : seq->len / 2 - 1;
+	int32_t re[La], im[La];
+	correlateFixed(rxBurst.begin(), La, seq, startIndex, La, re, im);
+
+	complex peak;
+	peakDetectFixed(re, im, La, TOA, &peak);
+
+	if ((*TOA < 0.0) || (*TOA > La)) {
+		*amplitude = 0.0;
+		return false;
+	}
+
+	int peakIx = (int) rint(*TOA);
+	int64_t valleyPower = 0;
+	int numSamples = 0;
+	for (int i = 57 * samplesPerSymbol; i <= 107 * samplesPerSymbol; i++) {
+		if (peakIx + i >= La)
+			break;
+		valleyPower += norm2(re[peakIx + i], im[peakIx + i]);
+		numSamples++;
+	}
+
+	if (numSamples < 2) {
+		*amplitude = 0.0;
+		return false;
+	}
+
+	float RMS = sqrtf((float) valleyPower / numSamples) + 0.00001;
+	float peakToMean = peak.abs() / RMS;
+
+	LOG(DEBUG) << "RACH peakAmpl=" << peak << " RMS=" << RMS << " peakToMean=" << peakToMean;
+	*amplitude = correlatorUnits(seq, peak) / seq->gain;
+	*TOA = (*TOA) - seq->TOA - 8 * samplesPerSymbol;
+
+	return (peakToMean > detectThreshold);
+}
+
+bool analyzeTrafficBurstFixed(const fixedVector &rxBurst,
+			      unsigned TSC,
+			      float detectThreshold,
+			      int samplesPerSymbol,
+			      complex *amplitude,
+			      float *TOA,
+			      unsigned maxTOA)
+{
+	assert(TSC < 8);
+	assert((samplesPerSymbol > 0) && (samplesPerSymbol <= MAX_SPS));
+	const FixedSequence *seq = gMidamblesFixed[TSC][samplesPerSymbol];
+	assert(seq);
+
+	if (maxTOA < 3 * (unsigned) samplesPerSymbol)
+		maxTOA = 3 * samplesPerSymbol;
+	unsigned spanTOA = maxTOA;
+	if (spanTOA < 5 * (unsigned) samplesPerSymbol)
+		spanTOA = 5 * samplesPerSymbol;
+
+	unsigned startIx = 66 * samplesPerSymbol - spanTOA;
+	unsigned endIx = (66 + 16) * samplesPerSymbol + spanTOA;
+	int windowLen = endIx - startIx;
+	int corrLen = 2 * maxTOA + 1;
+
+	int32_t re[corrLen], im[corrLen];
+	correlateFixed(rxBurst.begin() + startIx, windowLen, seq,
+		       seq->expectedTOAPeak - maxTOA, corrLen, re, im);
+
+	complex peak;
+	peakDetectFixed(re, im, corrLen, TOA, &peak);
+
+	if ((*TOA < 0.0) || (*TOA > corrLen)) {
+		*amplitude = 0.0;
+		return false;
+	}
+
+	int peakIx = (int) rint(*TOA);
+	int64_t valleyPower = 0;
+	int numRms = 0;
+	for (int i = 2 * samplesPerSymbol; i <= 5 * samplesPerSymbol; i++) {
+		if (peakIx - i >= 0) {
+			valleyPower += norm2(re[peakIx - i], im[peakIx - i]);
+			numRms++;
+		}
+		if (peakIx + i < corrLen) {
+			valleyPower += norm2(re[peakIx + i], im[peakIx + i]);
+			numRms++;
+		}
+	}
+
+	if (numRms < 2) {
+		*amplitude = 0.0;
+		return false;
+	}
+
+	float RMS = sqrtf((float) valleyPower / numRms) + 0.00001;
+	float peakToMean = peak.abs() / RMS;
+
+	*amplitude = correlatorUnits(seq, peak) / seq->gain;
+	*TOA = (*TOA) - maxTOA;
+
+	LOG(DEBUG) << "TCH peakAmpl=" << amplitude->abs() << " RMS=" << RMS << " peakToMean=" << peakToMean << " TOA=" << *TOA;
+
+	return (peakToMean > detectThreshold);
+}
+
+SoftVector *demodulateBurstFixed(const fixedVector &rxBurst,
+				 int samplesPerSymbol,
+				 complex channel,
+				 float TOA)
+{
+	int len = rxBurst.size();
+	assert(len <= gRotationLen);
+
+	/* Split the delay into whole samples and a table step */
+	float delay = -TOA;
+	int intOffset = (int) floor(delay);
+	int fracIx = (int) rint((delay - intOffset) * FRAC_STEPS);
+	if (fracIx == FRAC_STEPS) {
+		intOffset++;
+		fracIx = 0;
+	}
+
+	/* Fractional delay, as delayVector() */
+	int32_t re[len], im[len];
+	for (int n = 0; n < len; n++) {
+		if (!fracIx) {
+			re[n] = rxBurst[n].r;
+			im[n] = rxBurst[n].i;
+			continue;
+		}
+
+		const short *sinc = gSincTable[fracIx];
+		int64_t accRe = 0, accIm = 0;
+		for (int j = 0; j < SINC_LEN; j++) {
+			int ix = n + j - SINC_MID;
+			if ((ix < 0) || (ix >= len))
+				continue;
+			accRe += (int32_t) rxBurst[ix].r * sinc[j];
+			accIm += (int32_t) rxBurst[ix].i * sinc[j];
+		}
+		re[n] = accRe >> TAP_SHIFT;
+		im[n] = accIm >> TAP_SHIFT;
+	}
+
+	/* Projection onto the unit channel phase, scaled by 1/|channel| */
+	float chanAmpl = channel.abs();
+	if (chanAmpl <= 0.0)
+		chanAmpl = 1.0;
+	int32_t chanRe = _f16_round(channel.real() / chanAmpl * TAP_ONE);
+	int32_t chanIm = _f16_round(channel.imag() / chanAmpl * TAP_ONE);
+	F16 gain(32768.0F / chanAmpl);
+
+	int numBits = len / samplesPerSymbol;
+	SoftVector *burstBits = new SoftVector(numBits);
+	SoftVector::iterator burstItr = burstBits->begin();
+
+	for (int bit = 0; bit < numBits; bit++) {
+		/* Whole sample delay and decimation */
+		int n = bit * samplesPerSymbol;
+		int src = n - intOffset;
+		int32_t xRe = 0, xIm = 0;
+		if ((src >= 0) && (src < len)) {
+			xRe = re[src];
+			xIm = im[src];
+		}
+
+		/* Derotate, then take the real part after removing the channel phase */
+		const complex16 &rot = gReverseRotation[n];
+		int64_t yRe = (int64_t) xRe * rot.r - (int64_t) xIm * rot.i;
+		int64_t yIm = (int64_t) xRe * rot.i + (int64_t) xIm * rot.r;
+		int64_t z = (yRe * chanRe + yIm * chanIm) >> 20;
+
+		/* Q15 soft value, then the slicer of vectorSlicer() */
+		int64_t soft = (z * gain.raw()) >> 24;
+		int64_t level = (soft + 32768) >> 1;
+		if (level > 32768)
+			level = 32768;
+		if (level < 0)
+			level = 0;
+		*burstItr++ = level / 32768.0F;
+	}
+
+	return burstBits;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#ifndef SIGPROCFIXED_H
+#define SIGPROCFIXED_H
+
+#include "sigProcLib.h"
+
+/*
+ * Fixed-point receive path.
+ *
+ * Integer versions of the energy detector, the RACH and normal burst
+ * correlators and the slicer, for hosts without a fast FPU.  Bursts are
+ * held as Q15 complex samples, i.e. raw device units, and all per-sample
+ * work is done with 16x16 bit products and wide accumulators.  Floating
+ * point is only used for a handful of per-burst scalars (thresholds,
+ * amplitude and TOA reporting) and for setting up tables.
+ *
+ * The templates come from the float ones in sigProcLib, so
+ * generateMidamble() and generateRACHSequence() must be called before
+ * their fixed-point counterparts.  Channel estimation and equalization
+ * are not available on this path.
+ */
+
+typedef Vector<complex16> fixedVector;
+
+/** Build the sinc interpolation and rotation tables */
+void sigProcFixedSetup(int samplesPerSymbol);
+
+/** Free the tables and templates */
+void sigProcFixedDestroy();
+
+/** Quantize the float midamble template of a TSC */
+bool generateMidambleFixed(int samplesPerSymbol, int TSC);
+
+/** Quantize the float RACH template */
+bool generateRACHSequenceFixed(int samplesPerSymbol);
+
+/**
+	Convert a float burst to Q15, rounding and saturating.
+	@param in The burst in device units.
+	@param out The Q15 burst, resized to match.
+*/
+void quantizeBurst(const signalVector &in, fixedVector &out);
+
+/** Fixed-point energyDetect() */
+bool energyDetectFixed(const fixedVector &rxBurst,
+		       unsigned windowLength,
+		       float detectThreshold,
+		       float *avgPwr = NULL);
+
+/** Fixed-point detectRACHBurst() */
+bool detectRACHBurstFixed(const fixedVector &rxBurst,
+			  float detectThreshold,
+			  int samplesPerSymbol,
+			  complex *amplitude,
+			  float *TOA);
+
+/** Fixed-point analyzeTrafficBurst(), without channel estimation */
+bool analyzeTrafficBurstFixed(const fixedVector &rxBurst,
+			      unsigned TSC,
+			      float detectThreshold,
+			      int samplesPerSymbol,
+			      complex *amplitude,
+			      float *TOA,
+			      unsigned maxTOA);
+
+/**
+	Fixed-point demodulateBurst().
+	TOA is compensated to 1/64 of a sample.  The soft bits are the
+	only float output.
+*/
+SoftVector *demodulateBurstFixed(const fixedVector &rxBurst,
+				 int samplesPerSymbol,
+				 complex channel,
+				 float TOA);
+
+#endif /* SIGPROCFIXED_H */
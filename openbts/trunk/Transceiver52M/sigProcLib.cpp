@@ -28,6 +28,8 @@
 
 #include "sigProcLib.h"
 #include "GSMCommon.h"
+#include "convolve.h"
+#include "signalPool.h"
 #include "sendLPF_961.h"
 #include "rcvLPF_651.h"
 
@@ -48,16 +50,34 @@ static const float M_1_2PI_F = 1/M_2PI_F;
 signalVector *GMSKRotation = NULL;
 signalVector *GMSKReverseRotation = NULL;
 
-/** Static ideal RACH and midamble correlation waveforms */
+/**
+  Static ideal RACH and midamble correlation waveforms.
+  Templates are immutable once built and are cached per TSC and
+  samples-per-symbol for the life of the library, so the detectors
+  can read them from any thread without locking.
+*/
 typedef struct {
   signalVector *sequence;
   signalVector *sequenceReversedConjugated;
+  float        *kernelTaps;      ///< conjugated sequence laid out for the SIMD kernels
   float        TOA;
   complex      gain;
+  unsigned     expectedTOAPeak;  ///< correlator index of an ideally timed midamble
 } CorrelationSequence;
 
-CorrelationSequence *gMidambles[] = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
-CorrelationSequence *gRACHSequence = NULL;
+#define MAX_SAMPLES_PER_SYMBOL 8
+
+CorrelationSequence *gMidambles[8][MAX_SAMPLES_PER_SYMBOL+1];
+CorrelationSequence *gRACHSequence[MAX_SAMPLES_PER_SYMBOL+1];
+
+static void deleteCorrelationSequence(CorrelationSequence *seq)
+{
+  if (!seq) return;
+  delete seq->sequence;
+  delete seq->sequenceReversedConjugated;
+  delete[] seq->kernelTaps;
+  delete seq;
+}
 
 void sigProcLibDestroy(void) {
   if (GMSKRotation) {
@@ -68,23 +88,51 @@ void sigProcLibDestroy(void) {
     delete GMSKReverseRotation;
     GMSKReverseRotation = NULL;
   }
-  for (int i = 0; i < 8; i++) {
-    if (gMidambles[i]!=NULL) {
-      if (gMidambles[i]->sequence) delete gMidambles[i]->sequence;
-      if (gMidambles[i]->sequenceReversedConjugated) delete gMidambles[i]->sequenceReversedConjugated;
-      delete gMidambles[i];
-      gMidambles[i] = NULL;
+  for (int sps = 0; sps <= MAX_SAMPLES_PER_SYMBOL; sps++) {
+    for (int i = 0; i < 8; i++) {
+      deleteCorrelationSequence(gMidambles[i][sps]);
+      gMidambles[i][sps] = NULL;
     }
+    deleteCorrelationSequence(gRACHSequence[sps]);
+    gRACHSequence[sps] = NULL;
   }
-  if (gRACHSequence) {
-    if (gRACHSequence->sequence) delete gRACHSequence->sequence;
-    if (gRACHSequence->sequenceReversedConjugated) delete gRACHSequence->sequenceReversedConjugated;
-    delete gRACHSequence;
-    gRACHSequence = NULL;
+}
+
+
+
+void signalVector::allocate(size_t newSize)
+{
+  if (pooled && (mData == pooled))
+    signalPoolFree(pooled,pooledSize);
+  else if (mData)
+    delete[] mData;
+
+  pooled = NULL;
+  pooledSize = 0;
+  mData = NULL;
+  if (newSize) {
+    pooled = signalPoolAlloc(newSize);
+    pooledSize = newSize;
+    mData = pooled;
   }
+  mStart = mData;
+  mEnd = mStart + newSize;
 }
 
+void signalVector::clone(const Vector<complex> &other)
+{
+  if (&other == this) return;
+  allocate(other.size());
+  other.copyTo(*this);
+}
 
+signalVector& signalVector::operator=(const signalVector &other)
+{
+  clone(other);
+  symmetry = other.symmetry;
+  realOnly = other.realOnly;
+  return *this;
+}
 
 // dB relative to 1.0.
 // if > 1.0, then return 0 dB
@@ -230,6 +278,14 @@ void initGMSKRotationTables(int samplesPerSymbol) {
 void sigProcLibSetup(int samplesPerSymbol) {
   initTrigTables();
   initGMSKRotationTables(samplesPerSymbol);
+  sigProcLibSetKernel("auto");
+}
+
+const char *sigProcLibSetKernel(const char *name)
+{
+  ConvolveKernel kernel = convolveSetKernel(name);
+  LOG(NOTICE) << "using " << convolveKernelName(kernel) << " convolution kernels";
+  return convolveKernelName(kernel);
 }
 
 void GMSKRotate(signalVector &x) {
@@ -267,50 +323,130 @@ void GMSKReverseRotate(signalVector &x) {
 }
 
 
-signalVector* convolve(const signalVector *a,
-		       const signalVector *b,
-		       signalVector *c,
-		       ConvType spanType,
-		       unsigned startIx,
-		       unsigned len)
+/** Compute the output span of a convolution of lengths La and Lb */
+static bool convolveSpan(ConvType spanType,
+			 int La, int Lb,
+			 unsigned startIx, unsigned len,
+			 int *startIndex, unsigned *outSize)
 {
-  if ((a==NULL) || (b==NULL)) return NULL; 
-  int La = a->size();
-  int Lb = b->size();
-
-  int startIndex;
-  unsigned int outSize;
   switch (spanType) {
     case FULL_SPAN:
-      startIndex = 0;
-      outSize = La+Lb-1;
+      *startIndex = 0;
+      *outSize = La+Lb-1;
       break;
     case OVERLAP_ONLY:
-      startIndex = La;
-      outSize = abs(La-Lb)+1;
+      *startIndex = La;
+      *outSize = abs(La-Lb)+1;
       break;
     case START_ONLY:
-      startIndex = 0;
-      outSize = La;
+      *startIndex = 0;
+      *outSize = La;
       break;
     case WITH_TAIL:
-      startIndex = Lb;
-      outSize = La;
+      *startIndex = Lb;
+      *outSize = La;
       break;
     case NO_DELAY:
       if (Lb % 2) 
-	startIndex = Lb/2;
+	*startIndex = Lb/2;
       else
-	startIndex = Lb/2-1;
-      outSize = La;
+	*startIndex = Lb/2-1;
+      *outSize = La;
       break;
     case CUSTOM:
-      startIndex = startIx;
-      outSize = len;
+      *startIndex = startIx;
+      *outSize = len;
       break;
     default:
-      return NULL;
+      return false;
+  }
+  return true;
+}
+
+/**
+  Load the taps of b into an interleaved float buffer in the order the
+  SIMD kernels expect, i.e. time-reversed for a convolution.  Taps that
+  are already reversed (correlation) are loaded in order, conjugated.
+  Real-valued taps are duplicated into both halves of each slot.
+*/
+static void loadKernelTaps(const signalVector *b, bool correlation, float *h)
+{
+  int Lb = b->size();
+  for (int k = 0; k < Lb; k++) {
+    const complex &tap = correlation ? (*b)[k] : (*b)[Lb-1-k];
+    if (b->isRealOnly()) {
+      h[2*k] = tap.real();
+      h[2*k+1] = tap.real();
+    }
+    else {
+      h[2*k] = tap.real();
+      h[2*k+1] = correlation ? -tap.imag() : tap.imag();
+    }
+  }
+}
+
+/**
+  Convolve a complex vector with taps prepared by loadKernelTaps().
+  The span where the taps overlap the input completely goes through the
+  selected SIMD kernel; the partially overlapped edges are summed directly.
+*/
+static void convolveKernel(const signalVector *a,
+			   const float *h, bool realTaps, int Lb,
+			   signalVector *c,
+			   int startIndex, unsigned outSize)
+{
+  int La = a->size();
+  int stopIndex = startIndex + outSize;
+  int interiorStart = (startIndex > Lb-1) ? startIndex : Lb-1;
+  int interiorStop = (stopIndex < La) ? stopIndex : La;
+  if (interiorStop < interiorStart) interiorStop = interiorStart;
+
+  const float *x = (const float *) a->begin();
+  float *y = (float *) c->begin();
+
+  for (int t = startIndex; t < stopIndex; t++) {
+    if (t == interiorStart) {
+      int n = interiorStop - interiorStart;
+      if (n > 0) {
+	ConvolveKernelFunc kernel = realTaps ? gConvolveReal : gConvolveComplex;
+	kernel(x + 2*(interiorStart-Lb+1), h, y + 2*(interiorStart-startIndex), Lb, n);
+	t = interiorStop - 1;
+	continue;
+      }
+    }
+    float re = 0.0, im = 0.0;
+    for (int k = 0; k < Lb; k++) {
+      int ix = t - Lb + 1 + k;
+      if ((ix < 0) || (ix >= La)) continue;
+      if (realTaps) {
+	re += x[2*ix] * h[2*k];
+	im += x[2*ix+1] * h[2*k];
+      }
+      else {
+	re += x[2*ix] * h[2*k] - x[2*ix+1] * h[2*k+1];
+	im += x[2*ix] * h[2*k+1] + x[2*ix+1] * h[2*k];
+      }
+    }
+    y[2*(t-startIndex)] = re;
+    y[2*(t-startIndex)+1] = im;
   }
+}
+
+signalVector* convolve(const signalVector *a,
+		       const signalVector *b,
+		       signalVector *c,
+		       ConvType spanType,
+		       unsigned startIx,
+		       unsigned len)
+{
+  if ((a==NULL) || (b==NULL)) return NULL; 
+  int La = a->size();
+  int Lb = b->size();
+
+  int startIndex;
+  unsigned int outSize;
+  if (!convolveSpan(spanType,La,Lb,startIx,len,&startIndex,&outSize))
+    return NULL;
 
   
   if (c==NULL)
@@ -318,6 +454,14 @@ signalVector* convolve(const signalVector *a,
   else if (c->size()!=outSize)
     return NULL;
 
+  // vectorized path for complex input; the scalar kernel keeps the original loops
+  if ((convolveGetKernel() != CONVOLVE_SCALAR) && !a->isRealOnly()) {
+    float h[2*Lb];
+    loadKernelTaps(b,false,h);
+    convolveKernel(a,h,b->isRealOnly(),Lb,c,startIndex,outSize);
+    return c;
+  }
+
   signalVector::const_iterator aStart = a->begin();
   signalVector::const_iterator bStart = b->begin();
   signalVector::const_iterator aEnd = a->end();
@@ -531,6 +675,23 @@ signalVector* correlate(signalVector *a,
 {
   signalVector *tmp = NULL;
 
+  // vectorized path, the taps are conjugated in place of a reversed copy of b
+  if (!bReversedConjugated && (convolveGetKernel() != CONVOLVE_SCALAR) && !a->isRealOnly()) {
+    int Lb = b->size();
+    int startIndex;
+    unsigned outSize;
+    if (!convolveSpan(spanType,a->size(),Lb,startIx,len,&startIndex,&outSize))
+      return NULL;
+    if (c==NULL)
+      c = new signalVector(outSize);
+    else if (c->size()!=outSize)
+      return NULL;
+    float h[2*Lb];
+    loadKernelTaps(b,true,h);
+    convolveKernel(a,h,b->isRealOnly(),Lb,c,startIndex,outSize);
+    return c;
+  }
+
   if (!bReversedConjugated) {
     tmp = reverseConjugate(b);
   }
@@ -834,6 +995,56 @@ void offsetVector(signalVector &x,
   }
 }
 
+/** Build the correlation template of a modulated sequence */
+static CorrelationSequence *newCorrelationSequence(signalVector *sequence,
+						   signalVector &autocorr)
+{
+  CorrelationSequence *seq = new CorrelationSequence;
+  seq->sequence = sequence;
+  seq->sequenceReversedConjugated = reverseConjugate(sequence);
+  seq->kernelTaps = new float[2*sequence->size()];
+  loadKernelTaps(sequence,true,seq->kernelTaps);
+  seq->gain = peakDetect(autocorr,&seq->TOA,NULL);
+  seq->expectedTOAPeak = (unsigned) round(seq->TOA + (sequence->size()-1)/2);
+  return seq;
+}
+
+/**
+  Correlate a burst against a template, writing into a preallocated vector.
+  Uses the template's precomputed kernel taps, so nothing is allocated.
+*/
+static void correlateSequence(signalVector &rxBurst,
+			      const CorrelationSequence *seq,
+			      signalVector &correlation,
+			      ConvType spanType,
+			      unsigned startIx = 0,
+			      unsigned len = 0)
+{
+  if ((convolveGetKernel() == CONVOLVE_SCALAR) || rxBurst.isRealOnly()) {
+    correlate(&rxBurst,seq->sequenceReversedConjugated,&correlation,spanType,true,startIx,len);
+    return;
+  }
+
+  int Lb = seq->sequence->size();
+  int startIndex;
+  unsigned outSize;
+  if (!convolveSpan(spanType,rxBurst.size(),Lb,startIx,len,&startIndex,&outSize)) return;
+  assert(correlation.size()==outSize);
+  convolveKernel(&rxBurst,seq->kernelTaps,seq->sequence->isRealOnly(),Lb,
+		 &correlation,startIndex,outSize);
+}
+
+/**
+  Return a correlation output vector of the given length, aliasing the
+  caller's buffer when one is given and is large enough.
+*/
+static signalVector correlationVector(signalVector *buffer, unsigned len)
+{
+  if (buffer && (buffer->size() >= len))
+    return signalVector(buffer->begin(),0,len);
+  return signalVector(len);
+}
+
 bool generateMidamble(signalVector &gsmPulse,
 		      int samplesPerSymbol,
 		      int TSC)
@@ -842,10 +1053,11 @@ bool generateMidamble(signalVector &gsmPulse,
   if ((TSC < 0) || (TSC > 7)) 
     return false;
 
-  if (gMidambles[TSC]) {
-    if (gMidambles[TSC]->sequence!=NULL) delete gMidambles[TSC]->sequence;
-    if (gMidambles[TSC]->sequenceReversedConjugated!=NULL)  delete gMidambles[TSC]->sequenceReversedConjugated;
-  }
+  if ((samplesPerSymbol < 1) || (samplesPerSymbol > MAX_SAMPLES_PER_SYMBOL))
+    return false;
+
+  // already cached
+  if (gMidambles[TSC][samplesPerSymbol]) return true;
 
   signalVector emptyPulse(1); 
   *(emptyPulse.begin()) = 1.0;
@@ -875,16 +1087,15 @@ bool generateMidamble(signalVector &gsmPulse,
   
   if (autocorr == NULL) return false;
 
-  gMidambles[TSC] = new CorrelationSequence;
-  gMidambles[TSC]->sequence = middleMidamble;
-  gMidambles[TSC]->sequenceReversedConjugated = reverseConjugate(middleMidamble);
-  gMidambles[TSC]->gain = peakDetect(*autocorr,&gMidambles[TSC]->TOA,NULL);
+  CorrelationSequence *seq = newCorrelationSequence(middleMidamble,*autocorr);
 
   LOG(DEBUG) << "midamble autocorr: " << *autocorr;
 
-  LOG(DEBUG) << "TOA: " << gMidambles[TSC]->TOA;
+  LOG(DEBUG) << "TOA: " << seq->TOA;
+
+  //seq->TOA -= 5*samplesPerSymbol;
 
-  //gMidambles[TSC]->TOA -= 5*samplesPerSymbol;
+  gMidambles[TSC][samplesPerSymbol] = seq;
 
   delete autocorr;
   delete midamble;
@@ -892,14 +1103,34 @@ bool generateMidamble(signalVector &gsmPulse,
   return true;
 }
 
+const signalVector *correlationTemplate(int TSC,
+					int samplesPerSymbol,
+					complex *gain,
+					float *TOA,
+					unsigned *expectedTOAPeak)
+{
+  if ((TSC < -1) || (TSC > 7)) return NULL;
+  if ((samplesPerSymbol < 1) || (samplesPerSymbol > MAX_SAMPLES_PER_SYMBOL)) return NULL;
+
+  const CorrelationSequence *seq = (TSC < 0) ? gRACHSequence[samplesPerSymbol]
+					     : gMidambles[TSC][samplesPerSymbol];
+  if (!seq) return NULL;
+
+  if (gain) *gain = seq->gain;
+  if (TOA) *TOA = seq->TOA;
+  if (expectedTOAPeak) *expectedTOAPeak = seq->expectedTOAPeak;
+  return seq->sequence;
+}
+
 bool generateRACHSequence(signalVector &gsmPulse,
 			  int samplesPerSymbol)
 {
   
-  if (gRACHSequence) {
-    if (gRACHSequence->sequence!=NULL) delete gRACHSequence->sequence;
-    if (gRACHSequence->sequenceReversedConjugated!=NULL) delete gRACHSequence->sequenceReversedConjugated;
-  }
+  if ((samplesPerSymbol < 1) || (samplesPerSymbol > MAX_SAMPLES_PER_SYMBOL))
+    return false;
+
+  // already cached
+  if (gRACHSequence[samplesPerSymbol]) return true;
 
   signalVector *RACHSeq = modulateBurst(gRACHSynchSequence,
 					gsmPulse,
@@ -912,10 +1143,7 @@ bool generateRACHSequence(signalVector &gsmPulse,
 
   assert(autocorr);
 
-  gRACHSequence = new CorrelationSequence;
-  gRACHSequence->sequence = RACHSeq;
-  gRACHSequence->sequenceReversedConjugated = reverseConjugate(RACHSeq);
-  gRACHSequence->gain = peakDetect(*autocorr,&gRACHSequence->TOA,NULL);
+  gRACHSequence[samplesPerSymbol] = newCorrelationSequence(RACHSeq,*autocorr);
  
   delete autocorr;
 
@@ -928,14 +1156,17 @@ bool detectRACHBurst(signalVector &rxBurst,
 		     float detectThreshold,
 		     int samplesPerSymbol,
 		     complex *amplitude,
-		     float* TOA)
+		     float* TOA,
+		     signalVector *correlationBuffer)
 {
 
-  //static complex staticData[500];
- 
-  //signalVector correlatedRACH(staticData,0,rxBurst.size());
-  signalVector correlatedRACH(rxBurst.size());
-  correlate(&rxBurst,gRACHSequence->sequenceReversedConjugated,&correlatedRACH,NO_DELAY,true);
+  assert((samplesPerSymbol > 0) && (samplesPerSymbol <= MAX_SAMPLES_PER_SYMBOL));
+  const CorrelationSequence *RACHSequence = gRACHSequence[samplesPerSymbol];
+  assert(RACHSequence);
+
+  // correlate into the caller's buffer, if there is one
+  signalVector correlatedRACH = correlationVector(correlationBuffer,rxBurst.size());
+  correlateSequence(rxBurst,RACHSequence,correlatedRACH,NO_DELAY);
 
   float meanPower;
   complex peakAmpl = peakDetect(correlatedRACH,TOA,&meanPower);
@@ -968,9 +1199,9 @@ bool detectRACHBurst(signalVector &rxBurst,
   float peakToMean = peakAmpl.abs()/RMS;
 
   LOG(DEBUG) << "RACH peakAmpl=" << peakAmpl << " RMS=" << RMS << " peakToMean=" << peakToMean;
-  *amplitude = peakAmpl/(gRACHSequence->gain);
+  *amplitude = peakAmpl/(RACHSequence->gain);
 
-  *TOA = (*TOA) - gRACHSequence->TOA - 8*samplesPerSymbol;
+  *TOA = (*TOA) - RACHSequence->TOA - 8*samplesPerSymbol;
 
   LOG(DEBUG) << "RACH thresh: " << peakToMean;
 
@@ -1006,13 +1237,16 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
 			 unsigned maxTOA,
                          bool requestChannel,
                          signalVector **channelResponse,
-			 float *channelResponseOffset) 
+			 float *channelResponseOffset,
+			 signalVector *correlationBuffer) 
 {
 
   assert(TSC<8);
   assert(amplitude);
   assert(TOA);
-  assert(gMidambles[TSC]);
+  assert((samplesPerSymbol > 0) && (samplesPerSymbol <= MAX_SAMPLES_PER_SYMBOL));
+  const CorrelationSequence *midamble = gMidambles[TSC][samplesPerSymbol];
+  assert(midamble);
 
   if (maxTOA < 3*samplesPerSymbol) maxTOA = 3*samplesPerSymbol;
   unsigned spanTOA = maxTOA;
@@ -1023,16 +1257,11 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
   unsigned windowLen = endIx - startIx;
   unsigned corrLen = 2*maxTOA+1;
 
-  unsigned expectedTOAPeak = (unsigned) round(gMidambles[TSC]->TOA + (gMidambles[TSC]->sequenceReversedConjugated->size()-1)/2);
-
   signalVector burstSegment(rxBurst.begin(),startIx,windowLen);
 
-  //static complex staticData[200];
-  //signalVector correlatedBurst(staticData,0,corrLen);
-  signalVector correlatedBurst(corrLen);
-  correlate(&burstSegment, gMidambles[TSC]->sequenceReversedConjugated,
-					    &correlatedBurst, CUSTOM,true,
-					    expectedTOAPeak-maxTOA,corrLen);
+  signalVector correlatedBurst = correlationVector(correlationBuffer,corrLen);
+  correlateSequence(burstSegment,midamble,correlatedBurst,CUSTOM,
+		    midamble->expectedTOAPeak-maxTOA,corrLen);
 
   float meanPower;
   *amplitude = peakDetect(correlatedBurst,TOA,&meanPower);
@@ -1071,7 +1300,7 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
   //       due to the pi/4 frequency shift, that 
   //       needs to be accounted for.
   
-  *amplitude = (*amplitude)/gMidambles[TSC]->gain;
+  *amplitude = (*amplitude)/midamble->gain;
   *TOA = (*TOA) - (maxTOA); 
 
   LOG(DEBUG) << "TCH peakAmpl=" << amplitude->abs() << " RMS=" << RMS << " peakToMean=" << peakToMean << " TOA=" << *TOA;
@@ -1079,7 +1308,7 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
   LOG(DEBUG) << "autocorr: " << correlatedBurst;
   
   if (requestChannel && (peakToMean > detectThreshold)) {
-    float TOAoffset = maxTOA; //gMidambles[TSC]->TOA+(66*samplesPerSymbol-startIx);
+    float TOAoffset = maxTOA; //midamble->TOA+(66*samplesPerSymbol-startIx);
     delayVector(correlatedBurst,-(*TOA));
     // midamble only allows estimation of a 6-tap channel
     signalVector channelVector(6*samplesPerSymbol);
@@ -1098,7 +1327,7 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
 	
     *channelResponse = new signalVector(channelVector.size());
     correlatedBurst.segmentCopyTo(**channelResponse,(int) floor(TOAoffset+(maxI-5)*samplesPerSymbol),(*channelResponse)->size());
-    scaleVector(**channelResponse,complex(1.0,0.0)/gMidambles[TSC]->gain);
+    scaleVector(**channelResponse,complex(1.0,0.0)/midamble->gain);
     LOG(DEBUG) << "channelResponse: " << **channelResponse;
     
     if (channelResponseOffset) 
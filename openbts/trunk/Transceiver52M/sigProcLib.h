@@ -39,7 +39,12 @@ enum ConvType {
   UNDEFINED = 255
 };
 
-/** the core data structure of the Transceiver */
+/**
+  The core data structure of the Transceiver.
+  Sample storage comes from the signal pool (signalPool.h) and is
+  recycled on destruction, so the per-burst vectors of the receive and
+  transmit paths do not go through the heap in steady state.
+*/
 class signalVector: public Vector<complex> 
 {
 
@@ -47,40 +52,73 @@ class signalVector: public Vector<complex>
   
   Symmetry symmetry;   ///< the symmetry of the vector
   bool realOnly;       ///< true if vector is real-valued, not complex-valued
+  complex *pooled;     ///< pooled storage block, if any
+  size_t pooledSize;   ///< size the pooled block was requested with
+
+  /** Release pooled storage and take a new block of the given size */
+  void allocate(size_t newSize);
   
  public:
   
   /** Constructors */
   signalVector(int dSize=0, Symmetry wSymmetry = NONE):
-    Vector<complex>(dSize),
-    realOnly(false)
+    Vector<complex>(NULL,NULL,NULL),
+    realOnly(false),
+    pooled(NULL),
+    pooledSize(0)
     { 
+      allocate(dSize);
       symmetry = wSymmetry; 
     };
     
   signalVector(complex* wData, size_t start, 
 	       size_t span, Symmetry wSymmetry = NONE):
     Vector<complex>(NULL,wData+start,wData+start+span),
-    realOnly(false)
+    realOnly(false),
+    pooled(NULL),
+    pooledSize(0)
     { 
       symmetry = wSymmetry; 
     };
       
   signalVector(const signalVector &vec1, const signalVector &vec2):
-    Vector<complex>(vec1,vec2),
-    realOnly(false)
+    Vector<complex>(NULL,NULL,NULL),
+    realOnly(false),
+    pooled(NULL),
+    pooledSize(0)
     { 
+      allocate(vec1.size()+vec2.size());
+      vec1.copyToSegment(*this,0);
+      vec2.copyToSegment(*this,vec1.size());
       symmetry = vec1.symmetry; 
     };
 	
   signalVector(const signalVector &wVector):
-    Vector<complex>(wVector.size()),
-    realOnly(false)
+    Vector<complex>(NULL,NULL,NULL),
+    realOnly(false),
+    pooled(NULL),
+    pooledSize(0)
     {
+      allocate(wVector.size());
       wVector.copyTo(*this); 
       symmetry = wVector.getSymmetry();
     };
 
+  ~signalVector() { allocate(0); }
+
+  /**
+    Storage management.
+    These hide the Vector<complex> versions so that pooled blocks are
+    recycled. Do not resize a signalVector through a Vector<complex>
+    reference; the pool would lose track of its block.
+  */
+  //@{
+  void resize(size_t newSize) { allocate(newSize); }
+  void clear() { allocate(0); }
+  void clone(const Vector<complex> &other);
+  signalVector& operator=(const signalVector &other);
+  //@}
+
   /** symmetry operators */
   Symmetry getSymmetry() const { return symmetry;};
   void setSymmetry(Symmetry wSymmetry) { symmetry = wSymmetry;}; 
@@ -105,6 +143,13 @@ float vectorPower(const signalVector &x);
 /** Setup the signal processing library */
 void sigProcLibSetup(int samplesPerSymbol);
 
+/**
+	Select the SIMD kernels used by convolve() and correlate().
+	@param name One of "auto", "avx2", "sse" or "scalar".
+	@return The name of the kernel actually selected.
+*/
+const char *sigProcLibSetKernel(const char *name);
+
 /** Destroy the signal processing library */
 void sigProcLibDestroy(void);
 
@@ -228,6 +273,7 @@ void offsetVector(signalVector &x,
 
 /**
         Generate a modulated GSM midamble, stored within the library.
+        Templates are cached per TSC and samples-per-symbol, so repeated calls are cheap.
         @param gsmPulse The GSM pulse used for modulation.
         @param samplesPerSymbol The number of samples per GSM symbol.
         @param TSC The training sequence [0..7]
@@ -245,6 +291,21 @@ bool generateMidamble(signalVector &gsmPulse,
 bool generateRACHSequence(signalVector &gsmPulse,
 			  int samplesPerSymbol);
 
+/**
+        Look up a generated correlation template.
+        @param TSC The training sequence [0..7], or -1 for the RACH sequence.
+        @param samplesPerSymbol The number of samples per GSM symbol.
+        @param gain The peak of the template's autocorrelation.
+        @param TOA The index of that peak.
+        @param expectedTOAPeak The correlator index of an ideally timed midamble.
+        @return The modulated template, or NULL if it has not been generated.
+*/
+const signalVector *correlationTemplate(int TSC,
+					int samplesPerSymbol,
+					complex *gain = NULL,
+					float *TOA = NULL,
+					unsigned *expectedTOAPeak = NULL);
+
 /**
         Energy detector, checks to see if received burst energy is above a threshold.
         @param rxBurst The received GSM burst of interest.
@@ -265,13 +326,15 @@ bool energyDetect(signalVector &rxBurst,
         @param samplesPerSymbol The number of samples per GSM symbol.
         @param amplitude The estimated amplitude of received RACH burst.
         @param TOA The estimate time-of-arrival of received RACH burst.
+        @param correlationBuffer Optional scratch space for the correlator output, used if at least rxBurst.size() long.
         @return True if burst SNR is larger that the detectThreshold value.
 */
 bool detectRACHBurst(signalVector &rxBurst,
 		     float detectThreshold,
 		     int samplesPerSymbol,
 		     complex *amplitude,
-		     float* TOA);
+		     float* TOA,
+		     signalVector *correlationBuffer = NULL);
 
 /**
         Normal burst correlator, detector, channel estimator.
@@ -285,6 +348,7 @@ bool detectRACHBurst(signalVector &rxBurst,
         @param requestChannel Set to true if channel estimation is desired.
         @param channelResponse The estimated channel.
         @param channelResponseOffset The time offset b/w the first sample of the channel response and the reported TOA.
+        @param correlationBuffer Optional scratch space for the correlator output, used if at least 2*maxTOA+1 long.
         @return True if burst SNR is larger that the detectThreshold value.
 */
 bool analyzeTrafficBurst(signalVector &rxBurst,
@@ -296,7 +360,8 @@ bool analyzeTrafficBurst(signalVector &rxBurst,
                          unsigned maxTOA,
                          bool requestChannel = false,
 			 signalVector** channelResponse = NULL,
-			 float *channelResponseOffset = NULL);
+			 float *channelResponseOffset = NULL,
+			 signalVector *correlationBuffer = NULL);
 
 /**
 	Decimate a vector.
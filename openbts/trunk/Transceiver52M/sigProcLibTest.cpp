@@ -30,6 +30,8 @@ Harvind S. Samra, hssamra@kestrelsp.com
 
 
 #include "sigProcLib.h"
+#include "signalPool.h"
+#include "sigProcFixed.h"
 //#include "radioInterface.h"
 #include <Logger.h>
 #include <Configuration.h>
@@ -130,11 +132,44 @@ int main(int argc, char **argv) {
 
   cout << "ampl:" << ampl << endl;
   cout << "TOA: " << TOA << endl;
+
+  // a second setup hits the template cache; a caller buffer must not change the estimate
+  generateMidamble(*gsmPulse,samplesPerSymbol,TSC);
+  signalVector corrBuffer(157*samplesPerSymbol);
+  complex bufAmpl; float bufTOA;
+  analyzeTrafficBurst(*modBurst,TSC,8.0,samplesPerSymbol,&bufAmpl,&bufTOA,1,false,NULL,NULL,&corrBuffer);
+  cout << "buffered ampl:" << bufAmpl << " TOA: " << bufTOA << endl;
   //cout << "chanResp: " << *chanResp << endl;
+  signalVector devBurst(*modBurst);  // demodulateBurst() works in place
+  scaleVector(devBurst,complex(4000.0,0.0));
   SoftVector *demodBurst = demodulateBurst(*modBurst,*gsmPulse,samplesPerSymbol,(complex) ampl, TOA);
   
   cout << *demodBurst << endl;
 
+  // the fixed-point path should agree with the float one on bursts in device units
+  sigProcFixedSetup(samplesPerSymbol);
+  generateMidambleFixed(samplesPerSymbol,TSC);
+  generateRACHSequenceFixed(samplesPerSymbol);
+  fixedVector fixedBurst;
+  quantizeBurst(devBurst,fixedBurst);
+  complex fixedAmpl; float fixedTOA;
+  bool fixedFound = analyzeTrafficBurstFixed(fixedBurst,TSC,8.0,samplesPerSymbol,&fixedAmpl,&fixedTOA,1);
+  SoftVector *fixedDemod = fixedFound ? demodulateBurstFixed(fixedBurst,samplesPerSymbol,fixedAmpl,fixedTOA) : NULL;
+  unsigned bitErrors = 0;
+  for (unsigned i = 0; fixedDemod && (i < fixedDemod->size()); i++)
+    if (fixedDemod->bit(i) != demodBurst->bit(i)) bitErrors++;
+  cout << "fixed TSC: found " << fixedFound << " ampl:" << fixedAmpl*(1.0/4000.0)
+       << " TOA: " << fixedTOA << " bit errors " << bitErrors << endl;
+  delete fixedDemod;
+
+  signalVector devRACH(*RACHSeq);
+  scaleVector(devRACH,complex(4000.0,0.0));
+  quantizeBurst(devRACH,fixedBurst);
+  fixedFound = detectRACHBurstFixed(fixedBurst,5.0,samplesPerSymbol,&fixedAmpl,&fixedTOA);
+  cout << "fixed RACH: found " << fixedFound << " ampl:" << fixedAmpl*(1.0/4000.0)
+       << " TOA: " << fixedTOA << " (float ampl:" << a << " TOA: " << t << ")" << endl;
+  sigProcFixedDestroy();
+
   /*
   COUT("chanResp: " << *chanResp);
 
@@ -163,6 +198,36 @@ int main(int argc, char **argv) {
   delete DFEBurst;  
   */
 
+  // check the SIMD convolution kernels against the scalar loops
+  signalVector *noiseBurst = gaussianNoise(156*samplesPerSymbol,1.0);
+  const char *kernels[] = {"sse","avx2"};
+  sigProcLibSetKernel("scalar");
+  signalVector *refShaped = convolve(noiseBurst,gsmPulse,NULL,NO_DELAY);
+  signalVector *refCorr = correlate(noiseBurst,RACHSeq,NULL,NO_DELAY);
+  for (unsigned k = 0; k < 2; k++) {
+    const char *selected = sigProcLibSetKernel(kernels[k]);
+    signalVector *shaped = convolve(noiseBurst,gsmPulse,NULL,NO_DELAY);
+    signalVector *corr = correlate(noiseBurst,RACHSeq,NULL,NO_DELAY);
+    float shapedErr = 0.0, corrErr = 0.0;
+    for (unsigned i = 0; i < shaped->size(); i++)
+      shapedErr += ((*shaped)[i]-(*refShaped)[i]).norm2();
+    for (unsigned i = 0; i < corr->size(); i++)
+      corrErr += ((*corr)[i]-(*refCorr)[i]).norm2();
+    cout << "kernel " << kernels[k] << " (" << selected << "): "
+         << "convolve err " << shapedErr << ", correlate err " << corrErr << endl;
+    delete shaped;
+    delete corr;
+  }
+  delete refShaped;
+  delete refCorr;
+  delete noiseBurst;
+
+  // bursts released above should have been recycled by the storage pool
+  SignalPoolStats stats;
+  signalPoolStats(&stats);
+  cout << "signal pool: " << stats.allocs << " allocs, " << stats.recycled << " recycled, "
+       << stats.fresh << " fresh" << endl;
+
   sigProcLibDestroy();
 
 }
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#include <pthread.h>
+#include <assert.h>
+#include <vector>
+
+#include "signalPool.h"
+#include "Threads.h"
+
+/* Size classes are 2^MIN_SHIFT .. 2^MAX_SHIFT samples */
+#define MIN_SHIFT	6
+#define MAX_SHIFT	14
+#define NUM_CLASSES	(MAX_SHIFT - MIN_SHIFT + 1)
+
+/* Per-thread cache depth and shared depot limit, in blocks per class */
+#define CACHE_DEPTH	32
+#define DEPOT_LIMIT	1024
+
+struct PoolCache {
+	complex *blocks[NUM_CLASSES][CACHE_DEPTH];
+	int count[NUM_CLASSES];
+};
+
+static Mutex gDepotLock;
+static std::vector<complex *> gDepot[NUM_CLASSES];
+
+static pthread_key_t gCacheKey;
+static pthread_once_t gCacheOnce = PTHREAD_ONCE_INIT;
+
+static volatile unsigned long long gAllocs, gRecycled, gFresh;
+static volatile unsigned long long gOversize, gReleases;
+static volatile long long gOutstanding;
+
+static int sizeClass(size_t size)
+{
+	int cls = 0;
+	while (((size_t) 1 << (cls + MIN_SHIFT)) < size)
+		cls++;
+
+	return cls;
+}
+
+static size_t classSize(int cls)
+{
+	return (size_t) 1 << (cls + MIN_SHIFT);
+}
+
+/* Move the blocks of an exiting thread to the depot */
+static void releaseCache(void *arg)
+{
+	PoolCache *cache = (PoolCache *) arg;
+
+	gDepotLock.lock();
+	for (int cls = 0; cls < NUM_CLASSES; cls++) {
+		for (int i = 0; i < cache->count[cls]; i++) {
+			if (gDepot[cls].size() < DEPOT_LIMIT)
+				gDepot[cls].push_back(cache->blocks[cls][i]);
+			else
+				delete[] cache->blocks[cls][i];
+		}
+	}
+	gDepotLock.unlock();
+
+	delete cache;
+}
+
+static void createCacheKey()
+{
+	pthread_key_create(&gCacheKey, releaseCache);
+}
+
+static PoolCache *threadCache()
+{
+	pthread_once(&gCacheOnce, createCacheKey);
+
+	PoolCache *cache = (PoolCache *) pthread_getspecific(gCacheKey);
+	if (!cache) {
+		cache = new PoolCache;
+		for (int cls = 0; cls < NUM_CLASSES; cls++)
+			cache->count[cls] = 0;
+		pthread_setspecific(gCacheKey, cache);
+	}
+
+	return cache;
+}
+
+complex *signalPoolAlloc(size_t size)
+{
+	assert(size);
+	__sync_fetch_and_add(&gAllocs, 1);
+
+	int cls = sizeClass(size);
+	if (cls >= NUM_CLASSES) {
+		__sync_fetch_and_add(&gOversize, 1);
+		return new complex[size];
+	}
+
+	__sync_fetch_and_add(&gOutstanding, 1);
+
+	PoolCache *cache = threadCache();
+	int &count = cache->count[cls];
+
+	/* Refill half a cache from the depot */
+	if (!count) {
+		gDepotLock.lock();
+		std::vector<complex *> &depot = gDepot[cls];
+		while (!depot.empty() && (count < CACHE_DEPTH / 2)) {
+			cache->blocks[cls][count++] = depot.back();
+			depot.pop_back();
+		}
+		gDepotLock.unlock();
+	}
+
+	if (count) {
+		__sync_fetch_and_add(&gRecycled, 1);
+		return cache->blocks[cls][--count];
+	}
+
+	__sync_fetch_and_add(&gFresh, 1);
+	return new complex[classSize(cls)];
+}
+
+void signalPoolFree(complex *block, size_t size)
+{
+	if (!block)
+		return;
+
+	int cls = sizeClass(size);
+	if (cls >= NUM_CLASSES) {
+		delete[] block;
+		return;
+	}
+
+	__sync_fetch_and_add(&gReleases, 1);
+	__sync_fetch_and_sub(&gOutstanding, 1);
+
+	PoolCache *cache = threadCache();
+	int &count = cache->count[cls];
+
+	/* Spill half a full cache to the depot */
+	if (count == CACHE_DEPTH) {
+		gDepotLock.lock();
+		std::vector<complex *> &depot = gDepot[cls];
+		while (count > CACHE_DEPTH / 2) {
+			complex *spill = cache->blocks[cls][--count];
+			if (depot.size() < DEPOT_LIMIT)
+				depot.push_back(spill);
+			else
+				delete[] spill;
+		}
+		gDepotLock.unlock();
+	}
+
+	cache->blocks[cls][count++] = block;
+}
+
+void signalPoolStats(SignalPoolStats *stats)
+{
+	stats->allocs = gAllocs;
+	stats->recycled = gRecycled;
+	stats->fresh = gFresh;
+	stats->oversize = gOversize;
+	stats->releases = gReleases;
+	stats->outstanding = gOutstanding;
+
+	gDepotLock.lock();
+	stats->depot = 0;
+	for (int cls = 0; cls < NUM_CLASSES; cls++)
+		stats->depot += gDepot[cls].size();
+	gDepotLock.unlock();
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2013 Free Software Foundation, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#ifndef SIGNALPOOL_H
+#define SIGNALPOOL_H
+
+#include <stddef.h>
+#include "Complex.h"
+
+/*
+ * Recycling pool for signalVector sample storage.
+ *
+ * Blocks are rounded up to power-of-two size classes.  Each thread keeps
+ * a small cache of free blocks per class, so the steady state of the
+ * burst paths touches neither the heap nor a lock.  Threads that free
+ * more than they allocate (e.g. the consumer side of a FIFO) spill half
+ * of a full cache to a shared depot, and threads with an empty cache
+ * refill from it, so the depot lock is taken once per batch of blocks.
+ *
+ * Blocks are allocated with new[], so a block that escapes the pool,
+ * e.g. through Vector<complex>::resize(), is still freed correctly.
+ */
+
+struct SignalPoolStats {
+	unsigned long long allocs;	///< blocks handed out
+	unsigned long long recycled;	///< allocations served from a cache or the depot
+	unsigned long long fresh;	///< allocations that went to the heap
+	unsigned long long oversize;	///< requests larger than the largest class
+	unsigned long long releases;	///< blocks returned to the pool
+	long long outstanding;		///< pooled blocks currently in use
+	unsigned long long depot;	///< free blocks held in the shared depot
+};
+
+/**
+	Allocate sample storage.
+	@param size The number of samples, must be non-zero.
+	@return A block of at least size samples.
+*/
+complex *signalPoolAlloc(size_t size);
+
+/**
+	Return sample storage to the pool.
+	@param block A block from signalPoolAlloc().
+	@param size The size passed to signalPoolAlloc().
+*/
+void signalPoolFree(complex *block, size_t size);
+
+/** Snapshot the pool counters */
+void signalPoolStats(SignalPoolStats *stats);
+
+#endif /* SIGNALPOOL_H */
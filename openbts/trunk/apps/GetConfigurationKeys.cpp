@@ -90,6 +90,18 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("Control.DCCH.DispatcherThreads","8",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1:256",
+		true,
+		"Number of threads started to run transactions on the dedicated control channels.  "
+			"More are started when every thread is busy, up to one per channel."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("Control.GSMTAP.GPRS","0",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -394,6 +406,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("Control.Reporting.PhysStatusWritePeriod","1000",
+		"milliseconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"100:10000",
+		false,
+		"Period for writing channel measurement reports to the channel status reporting database.  "
+			"Reports arriving within one period are coalesced to the latest per channel."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("Control.Reporting.StatsCommitPeriod","10",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1:300",
+		true,
+		"Period for writing accumulated performance counters to the statistics reporting database.  "
+			"Counters are kept in memory between writes, so up to one period of events can be lost on a crash."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("Control.Reporting.StatsTable","/var/log/OpenBTSStats.db",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -416,6 +452,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("Control.Reporting.TMSITableMaxEntries","100000",
+		"entries",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1000:10000000",
+		false,
+		"Maximum number of subscribers kept in memory from the TMSI table.  "
+			"The most recently seen are loaded at startup; others are read from the database when they reappear."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("Control.Reporting.TMSITableWritePeriod","1000",
+		"milliseconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"100:60000",
+		false,
+		"Period for writing TMSI table changes to the TMSI table database.  "
+			"Changes are kept in memory between writes, so up to one period of changes can be lost on a crash."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("Control.Reporting.TransactionTable","/var/run/OpenBTS/TransactionTable.db",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
@@ -2627,6 +2687,73 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SubscriberRegistry.UpstreamServer.CacheTTL","0",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:3600",
+		false,
+		"How long answers to lookups from the upstream subscriber registry server are kept and reused.  "
+			"Updates sent upstream discard every kept answer.  "
+			"Negative answers are kept too, so a subscriber added upstream may be unknown here for this long.  "
+			"0, the default, always asks the server."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.Batch","0",
+		"bursts",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		true,
+		"Most bursts carried in one datagram between OpenBTS and the transceiver, in each direction.  "
+			"0 or 1 sends each burst in its own datagram.  "
+			"Downlink bursts are held up to 1 ms to fill a datagram.  "
+			"Needs a transceiver that accepts the SETBATCH command; otherwise one burst per datagram is used."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.DSP.DemodThreads","0",
+		"threads",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::VALRANGE,
+		"0:8",
+		true,
+		"Number of threads the transceiver uses to demodulate the timeslots of a TDMA frame in parallel.  "
+			"0 demodulates each burst on the receive thread as it arrives."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.DSP.FixedPoint","0",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::BOOLEAN,
+		"",
+		true,
+		"Run energy detection, correlation and slicing of received bursts in 16-bit fixed point, for hosts without a fast FPU.  "
+			"Normal bursts still go through the floating point equalizer when GSM.Radio.MaxExpectedDelaySpread is more than 1."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("TRX.DSP.Kernel","auto",
+		"",
+		ConfigurationKey::DEVELOPER,
+		ConfigurationKey::CHOICE,
+		"auto|Best available for this CPU,"
+			"avx2|AVX2 and FMA,"
+			"sse|SSE3,"
+			"scalar|Portable scalar code",
+		true,
+		"Vector instruction set used by the transceiver for convolution and correlation.  "
+			"Unsupported choices fall back to the best kernel the CPU supports."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("TRX.IP","127.0.0.1",
 		"",
 		ConfigurationKey::CUSTOMERWARN,
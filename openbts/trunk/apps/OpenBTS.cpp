@@ -31,7 +31,7 @@ Log dummy("openbts",gConfig.getStr("Log.Level").c_str(),LOG_LOCAL7);
 
 // Set up the performance reporter.
 #include <Reporting.h>
-ReportingTable gReports(gConfig.getStr("Control.Reporting.StatsTable").c_str());
+ReportingTable gReports(gConfig.getStr("Control.Reporting.StatsTable").c_str(),gConfig.getNum("Control.Reporting.StatsCommitPeriod"));
 
 #include <TRXManager.h>
 #include <GSML1FEC.h>
@@ -450,6 +450,9 @@ int main(int argc, char *argv[])
 		LOG(INFO) << "tuning TRX " << i << " to ARFCN " << ARFCN;
 		ARFCNManager* radio = gTRX.ARFCN(i);
 		radio->tune(ARFCN);
+		// Optional batched burst transport.
+		unsigned batch = gConfig.getNum("TRX.Batch");
+		if (batch>1) radio->setBatch(batch);
 	}
 
 	// Send either TSC or full BSIC depending on radio need
@@ -515,7 +518,6 @@ int main(int argc, char *argv[])
 		SDCCHLogicalChannel(0,0,gSDCCH_4_2),
 		SDCCHLogicalChannel(0,0,gSDCCH_4_3),
 	};
-	Thread C0T0SDCCHControlThread[4];
 	// Subchannel 2 used for CBCH if SMSCB enabled.
 	bool SMSCB = (gConfig.getStr("Control.SMSCB.Table").length() != 0);
 	CBCHLogicalChannel CBCH(gSDCCH_4_2);
@@ -523,7 +525,7 @@ int main(int argc, char *argv[])
 	for (int i=0; i<4; i++) {
 		if (SMSCB && (i==2)) continue;
 		C0T0SDCCH[i].downstream(C0radio);
-		C0T0SDCCHControlThread[i].start((void*(*)(void*))Control::DCCHDispatcher,&C0T0SDCCH[i]);
+		Control::DCCHDispatcherAdd(&C0T0SDCCH[i]);
 		C0T0SDCCH[i].open();
 		gBTS.addSDCCH(&C0T0SDCCH[i]);
 	}
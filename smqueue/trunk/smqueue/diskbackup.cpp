@@ -76,7 +76,7 @@ int SQLiteBackup::init()
     int rc = sqlite3_open(ldb.c_str(),&mDB);
     if (rc) {
 	LOG(EMERG) << "Cannot open SQLiteBackup database: " << sqlite3_errmsg(mDB);
-	sqlite3_close(mDB);
+	sqlite3_close_cached(mDB);
 	mDB = NULL;
 	return FAILURE;
     }
@@ -89,7 +89,7 @@ int SQLiteBackup::init()
 
 SQLiteBackup::~SQLiteBackup()
 {
-    if (mDB) sqlite3_close(mDB);
+    if (mDB) sqlite3_close_cached(mDB);
 }
 
 backup_msg_list* SQLiteBackup::get_stored_messages(){
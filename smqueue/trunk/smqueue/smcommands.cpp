@@ -78,7 +78,7 @@ shortcode_quick_chk (const char *imsi, const char *msgtext,
 {
 	ostringstream answer;
 	
-	answer << scp->scp_smq->time_sorted_list.size() << " queued.";
+	answer << scp->scp_smq->msg_queue.size() << " queued.";
 	scp->scp_reply = new_strdup(answer.str().c_str());
 	return SCA_REPLY;
 }
@@ -96,8 +96,8 @@ shortcode_four_one_one (const char *imsi, const char *msgtext,
         short_msg_p_list::iterator x;
         int n = 0, missing = 0, registering = 0, bouncing = 0;
         
-        for (x = scp->scp_smq->time_sorted_list.begin();
-             x != scp->scp_smq->time_sorted_list.end(); x++) {
+        for (x = scp->scp_smq->msg_queue.begin();
+             x != scp->scp_smq->msg_queue.end(); x++) {
 	    n++;
 	    switch (x->state) {
 		case REQUEST_DESTINATION_SIPURL:
@@ -187,17 +187,18 @@ shortcode_zap_queued (const char *imsi, const char *msgtext,
         // Delete all messages in queue in NO_STATE state or with
         // huge timeouts.
         short_msg_p_list::iterator x;
-        time_t toolate = 5000 
-                       + scp->scp_smq->time_sorted_list.begin()->gettime();
+        time_t toolate = 5000 + time(NULL);
         int n = 0;
         
-        for (x = scp->scp_smq->time_sorted_list.begin();
-             x != scp->scp_smq->time_sorted_list.end(); x++) {
+        for (x = scp->scp_smq->msg_queue.begin();
+             x != scp->scp_smq->msg_queue.end(); ) {
             if (x->state == NO_STATE || toolate <= x->next_action_time) {
                 n++;
-                resplist.splice(resplist.begin(),
-                                scp->scp_smq->time_sorted_list, x);
+                scp->scp_smq->msg_queue.extract(x++, resplist);
+                scp->scp_smq->forget_message(&*resplist.begin());
                 resplist.pop_front();   // pop and delete the sent_msg.
+            } else {
+                x++;
             }
         }
         answer <<  "Removed " << n << " messages.";
@@ -212,8 +213,8 @@ shortcode_zap_queued (const char *imsi, const char *msgtext,
                    << " in state " << sent_msg->state
                    << " and timeout " 
                    << sent_msg->next_action_time - sent_msg->gettime();
-           resplist.splice(resplist.begin(),
-                           scp->scp_smq->time_sorted_list, sent_msg);
+           scp->scp_smq->msg_queue.extract(sent_msg, resplist);
+           scp->scp_smq->forget_message(&*resplist.begin());
            resplist.pop_front();   // pop and delete the sent_msg.
         }
     }
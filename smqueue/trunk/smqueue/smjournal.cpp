@@ -0,0 +1,524 @@
+/*
+ * smjournal.cpp - Crash-safe journal of the Short Message queue for OpenBTS.
+ *
+ * Copyright 2012 Range Networks, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#include "smjournal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <Configuration.h>
+#include <Logger.h>
+
+extern ConfigurationTable gConfig;
+
+using namespace std;
+using namespace SMqueue;
+
+/*
+ * On disk, both files start with a header:
+ *	magic[4] ("SMQJ" or "SMQS"), u32 format, u64 generation,
+ *	u64 next journal id
+ * followed by records:
+ *	u32 payload length, u32 CRC32 of payload, payload
+ * A payload is a type byte and the message's journal id (u64), then:
+ *	'M' message:	u32 state, u64 time, u64 timestamp, u8 flags,
+ *			str srcaddr, str linktag, str text
+ *	'S' state:	u32 state, u64 time
+ *	'D' deleted:	nothing more
+ * where str is a u32 length and the bytes.  Numbers are little-endian.
+ * A snapshot holds only 'M' records.
+ */
+
+static const char journal_magic[] = "SMQJ";
+static const char snapshot_magic[] = "SMQS";
+static const uint32_t journal_format = 2;
+static const size_t header_length = 24;
+static const size_t max_record_length = 1 << 20;	// Sanity check on reads
+
+enum {
+	FLAG_MS_TO_SC = 1,
+	FLAG_NEED_REPACK = 2,
+	FLAG_FROM_RELAY = 4
+};
+
+static uint32_t crc32_of(const char *data, size_t length)
+{
+	static uint32_t table[256];
+	static bool table_ready = false;
+	if (!table_ready) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1)? 0xEDB88320 ^ (c >> 1): c >> 1;
+			table[i] = c;
+		}
+		table_ready = true;
+	}
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < length; i++)
+		crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void put32(string &out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		out += (char)(value >> (8*i));
+}
+
+static void put64(string &out, uint64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		out += (char)(value >> (8*i));
+}
+
+static void putstr(string &out, const char *str, size_t length)
+{
+	put32(out, length);
+	out.append(str, length);
+}
+
+/* Walks a buffer read back from disk; every get fails past its end.  */
+class journal_reader {
+	const string &buf;
+	size_t pos, end;
+
+	public:
+	journal_reader(const string &wbuf, size_t wpos, size_t wend) :
+		buf(wbuf), pos(wpos), end(wend)
+	{
+	}
+
+	bool get32(uint32_t *value) {
+		if (end - pos < 4) return false;
+		*value = 0;
+		for (int i = 0; i < 4; i++)
+			*value |= (uint32_t)(unsigned char)buf[pos+i] << (8*i);
+		pos += 4;
+		return true;
+	}
+
+	bool get64(uint64_t *value) {
+		if (end - pos < 8) return false;
+		*value = 0;
+		for (int i = 0; i < 8; i++)
+			*value |= (uint64_t)(unsigned char)buf[pos+i] << (8*i);
+		pos += 8;
+		return true;
+	}
+
+	bool get8(unsigned char *value) {
+		if (end - pos < 1) return false;
+		*value = buf[pos++];
+		return true;
+	}
+
+	bool getstr(string *value) {
+		uint32_t length;
+		if (!get32(&length) || end - pos < length) return false;
+		value->assign(buf, pos, length);
+		pos += length;
+		return true;
+	}
+};
+
+static string header(const char *magic, unsigned long long generation,
+		     unsigned long long next_id)
+{
+	string out(magic, 4);
+	put32(out, journal_format);
+	put64(out, generation);
+	put64(out, next_id);
+	return out;
+}
+
+/* Read a header; false if it isn't one of ours.  */
+static bool read_header(const string &buf, const char *magic,
+			unsigned long long *generation,
+			unsigned long long *next_id)
+{
+	if (buf.length() < header_length || buf.compare(0, 4, magic) != 0)
+		return false;
+	journal_reader r(buf, 4, header_length);
+	uint32_t format;
+	uint64_t gen, id;
+	if (!r.get32(&format) || format != journal_format || !r.get64(&gen)
+	 || !r.get64(&id))
+		return false;
+	*generation = gen;
+	*next_id = id;
+	return true;
+}
+
+/* Slurp a file.  False if it doesn't exist or can't be read.  */
+static bool read_file(const string &name, string *contents)
+{
+	int rfd = open(name.c_str(), O_RDONLY);
+	if (rfd < 0)
+		return false;
+	contents->clear();
+	char buf[65536];
+	ssize_t n;
+	while ((n = read(rfd, buf, sizeof(buf))) != 0) {
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) {
+			close(rfd);
+			return false;
+		}
+		contents->append(buf, n);
+	}
+	close(rfd);
+	return true;
+}
+
+static bool write_all(int wfd, const string &data)
+{
+	size_t done = 0;
+	while (done < data.length()) {
+		ssize_t n = write(wfd, data.data() + done, data.length() - done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		done += n;
+	}
+	return true;
+}
+
+/* Make a rename in the file's directory durable.  */
+static void sync_directory(const string &name)
+{
+	size_t slash = name.find_last_of('/');
+	string dir = (slash == string::npos)? ".": name.substr(0, slash+1);
+	int dfd = open(dir.c_str(), O_RDONLY);
+	if (dfd >= 0) {
+		fsync(dfd);
+		close(dfd);
+	}
+}
+
+/*
+ * Apply the records in buf[pos..] to msgs, and move next_id past
+ * every id they use.  Stops at the first record that is torn or fails
+ * its CRC; returns where the good ones end.
+ */
+static size_t replay(const string &buf, size_t pos, journal_msg_map &msgs,
+		     unsigned *count, unsigned long long *next_id)
+{
+	*count = 0;
+	while (pos < buf.length()) {
+		journal_reader r(buf, pos, buf.length());
+		uint32_t length, crc;
+		if (!r.get32(&length) || !r.get32(&crc)
+		 || length > max_record_length
+		 || buf.length() - pos - 8 < length
+		 || crc32_of(buf.data() + pos + 8, length) != crc)
+			break;
+
+		journal_reader p(buf, pos + 8, pos + 8 + length);
+		unsigned char type;
+		uint64_t id;
+		if (!p.get8(&type) || !p.get64(&id))
+			break;
+		if (type == 'M') {
+			journal_msg msg;
+			uint32_t state;
+			uint64_t when, timestamp;
+			unsigned char flags;
+			if (!p.get32(&state) || !p.get64(&when)
+			 || !p.get64(&timestamp) || !p.get8(&flags)
+			 || !p.getstr(&msg.srcaddr) || !p.getstr(&msg.linktag)
+			 || !p.getstr(&msg.text))
+				break;
+			msg.state = state;
+			msg.next_action_time = when;
+			msg.timestamp = timestamp;
+			msg.ms_to_sc = flags & FLAG_MS_TO_SC;
+			msg.need_repack = flags & FLAG_NEED_REPACK;
+			msg.from_relay = flags & FLAG_FROM_RELAY;
+			msgs[id] = msg;
+		} else if (type == 'S') {
+			uint32_t state;
+			uint64_t when;
+			if (!p.get32(&state) || !p.get64(&when))
+				break;
+			journal_msg_map::iterator x = msgs.find(id);
+			if (x != msgs.end()) {
+				x->second.state = state;
+				x->second.next_action_time = when;
+			}
+		} else if (type == 'D') {
+			msgs.erase(id);
+		} else {
+			break;
+		}
+		if (id >= *next_id)
+			*next_id = id + 1;
+		pos += 8 + length;
+		(*count)++;
+	}
+	return pos;
+}
+
+
+SMjournal::~SMjournal()
+{
+	if (fd >= 0) {
+		flush();
+		close(fd);
+	}
+}
+
+bool
+SMjournal::init()
+{
+	if (!gConfig.defines("Journal.File"))
+		return false;
+	journal_file = gConfig.getStr("Journal.File");
+	if (journal_file.empty())
+		return false;
+	snapshot_file = journal_file + ".snapshot";
+	compact_after = gConfig.defines("Journal.CompactAfter")?
+		gConfig.getNum("Journal.CompactAfter"): 10000;
+	return true;
+}
+
+bool
+SMjournal::load(journal_msg_map &msgs)
+{
+	if (journal_file.empty())
+		return false;
+
+	string buf;
+	bool have_snapshot = read_file(snapshot_file, &buf);
+	generation = 0;
+	next_id = 1;
+	if (have_snapshot) {
+		if (!read_header(buf, snapshot_magic, &generation, &next_id)) {
+			LOG(ALERT) << "Queue snapshot " << snapshot_file
+				   << " is not a snapshot; not using it";
+			return false;
+		}
+		unsigned count;
+		size_t end = replay(buf, header_length, msgs, &count, &next_id);
+		if (end != buf.length())
+			LOG(ERR) << "Queue snapshot " << snapshot_file
+				 << " is damaged after " << count << " messages";
+	}
+
+	bool have_journal = read_file(journal_file, &buf);
+	was_fresh = !have_snapshot && !have_journal;
+	unsigned long long journal_generation, journal_next_id;
+	if (have_journal
+	 && read_header(buf, journal_magic, &journal_generation, &journal_next_id)
+	 && journal_generation == generation) {
+		if (journal_next_id > next_id)
+			next_id = journal_next_id;
+		size_t end = replay(buf, header_length, msgs, &records, &next_id);
+		if (end != buf.length())
+			LOG(WARNING) << "Dropping " << buf.length() - end
+				     << " torn bytes at the end of " << journal_file;
+		fd = open(journal_file.c_str(), O_WRONLY | O_APPEND);
+		if (fd >= 0 && ftruncate(fd, end) != 0) {
+			close(fd);
+			fd = -1;
+		}
+	} else {
+		// None yet, or one from before the snapshot was taken,
+		// which the snapshot already includes.
+		if (have_journal)
+			LOG(NOTICE) << "Not replaying " << journal_file
+				    << ", which is stale or unreadable";
+		start_journal();
+	}
+	if (fd < 0) {
+		LOG(ALERT) << "Cannot open queue journal " << journal_file
+			   << ": " << strerror(errno);
+		return false;
+	}
+	LOG(INFO) << "Queue journal " << journal_file << " holds "
+		  << msgs.size() << " messages, " << records
+		  << " records since the snapshot";
+	return true;
+}
+
+/* Replace the journal with an empty one for the current generation.  */
+bool
+SMjournal::start_journal()
+{
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	string tmpname = journal_file + ".tmp";
+	int tfd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (tfd < 0)
+		return false;
+	if (!write_all(tfd, header(journal_magic, generation, next_id))
+	 || fsync(tfd) != 0
+	 || rename(tmpname.c_str(), journal_file.c_str()) != 0) {
+		close(tfd);
+		return false;
+	}
+	close(tfd);
+	sync_directory(journal_file);
+	fd = open(journal_file.c_str(), O_WRONLY | O_APPEND);
+	records = 0;
+	return fd >= 0;
+}
+
+void
+SMjournal::add_record(const string &payload)
+{
+	put32(pending, payload.length());
+	put32(pending, crc32_of(payload.data(), payload.length()));
+	pending += payload;
+	records++;
+}
+
+void
+SMjournal::message_record(char type, unsigned long long id,
+			  const journal_msg *msg)
+{
+	string payload(1, type);
+	put64(payload, id);
+	if (type == 'M' || type == 'S') {
+		put32(payload, msg->state);
+		put64(payload, msg->next_action_time);
+	}
+	if (type == 'M') {
+		put64(payload, msg->timestamp);
+		payload += (char)((msg->ms_to_sc? FLAG_MS_TO_SC: 0)
+				| (msg->need_repack? FLAG_NEED_REPACK: 0)
+				| (msg->from_relay? FLAG_FROM_RELAY: 0));
+		putstr(payload, msg->srcaddr.data(), msg->srcaddr.length());
+		putstr(payload, msg->linktag.data(), msg->linktag.length());
+		putstr(payload, msg->text.data(), msg->text.length());
+	}
+	add_record(payload);
+}
+
+unsigned long long
+SMjournal::insert(const journal_msg &msg)
+{
+	if (fd < 0)
+		return 0;
+	unsigned long long id = next_id++;
+	message_record('M', id, &msg);
+	return id;
+}
+
+void
+SMjournal::update(unsigned long long id, const journal_msg &msg)
+{
+	if (fd < 0 || !id)
+		return;
+	message_record('M', id, &msg);
+}
+
+void
+SMjournal::update_state(unsigned long long id, int state,
+			time_t next_action_time)
+{
+	if (fd < 0 || !id)
+		return;
+	journal_msg msg;
+	msg.state = state;
+	msg.next_action_time = next_action_time;
+	message_record('S', id, &msg);
+}
+
+void
+SMjournal::remove(unsigned long long id)
+{
+	if (fd < 0 || !id)
+		return;
+	message_record('D', id, NULL);
+}
+
+bool
+SMjournal::flush()
+{
+	if (fd < 0 || pending.empty())
+		return true;
+	bool ok = write_all(fd, pending) && fdatasync(fd) == 0;
+	if (!ok)
+		LOG(ERR) << "Cannot write queue journal " << journal_file
+			 << ": " << strerror(errno);
+	pending.clear();
+	return ok;
+}
+
+bool
+SMjournal::compact(const journal_msg_map &msgs)
+{
+	if (fd < 0)
+		return false;
+	flush();
+
+	string tmpname = snapshot_file + ".tmp";
+	int sfd = open(tmpname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (sfd < 0) {
+		LOG(ERR) << "Cannot write queue snapshot " << tmpname
+			 << ": " << strerror(errno);
+		return false;
+	}
+
+	// Messages go into a snapshot exactly as into the journal.
+	string saved;
+	saved.swap(pending);
+	unsigned saved_records = records;
+	pending = header(snapshot_magic, generation + 1, next_id);
+	unsigned howmany = 0;
+	bool ok = true;
+	for (journal_msg_map::const_iterator x = msgs.begin();
+	     x != msgs.end(); ++x) {
+		message_record('M', x->first, &x->second);
+		howmany++;
+		if (pending.length() > 65536) {
+			ok = ok && write_all(sfd, pending);
+			pending.clear();
+		}
+	}
+	ok = ok && write_all(sfd, pending) && fsync(sfd) == 0;
+	close(sfd);
+	pending.swap(saved);
+	records = saved_records;
+	if (!ok || rename(tmpname.c_str(), snapshot_file.c_str()) != 0) {
+		LOG(ERR) << "Cannot write queue snapshot " << snapshot_file
+			 << ": " << strerror(errno);
+		unlink(tmpname.c_str());
+		return false;
+	}
+	sync_directory(snapshot_file);
+
+	// From here on the old journal is stale, even if we crash before
+	// replacing it.
+	generation++;
+	if (!start_journal()) {
+		LOG(ALERT) << "Cannot restart queue journal " << journal_file
+			   << ": " << strerror(errno);
+		return false;
+	}
+	LOG(INFO) << "Compacted queue journal; snapshot holds "
+		  << howmany << " messages";
+	return true;
+}
@@ -0,0 +1,141 @@
+/*
+ * smjournal.h - Crash-safe journal of the Short Message queue for OpenBTS.
+ *
+ * Copyright 2012 Range Networks, Inc.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ * See the COPYING file in the main directory for details.
+ */
+
+#ifndef SM_JOURNAL_H
+#define SM_JOURNAL_H
+
+#include <time.h>
+#include <map>
+#include <string>
+
+namespace SMqueue {
+
+/*
+ * A queued message as the journal remembers it: enough to put it back
+ * in the queue, in the same state, without running it through the
+ * state machine again.
+ */
+typedef struct {
+	int state;
+	time_t next_action_time;
+	long long timestamp;		// short_msg::timestamp, not unique
+	bool ms_to_sc;
+	bool need_repack;
+	bool from_relay;
+	std::string srcaddr;
+	std::string linktag;
+	std::string text;
+} journal_msg;
+
+// Keyed by journal id, which is what identifies a message on disk.
+typedef std::map<unsigned long long,journal_msg> journal_msg_map;
+
+/*
+ * Keeps the queue on disk as a binary snapshot plus an append-only
+ * journal of what happened since: messages inserted, moved to another
+ * state, or deleted.  Every record carries a CRC32, so a record torn by
+ * a crash is noticed and dropped on the next start.
+ *
+ * Each message gets a journal id when it is inserted, from a counter
+ * that never goes back, not even across restarts; the snapshot and the
+ * journal each record where it stood when they were started.
+ *
+ * Records are collected in memory and written, and synced, by flush();
+ * call it before acknowledging a message to its sender.  Once the
+ * journal gets long, compact() writes a new snapshot and starts an
+ * empty journal.  Both files are replaced by rename, and carry a
+ * generation number so a journal left over from before the latest
+ * snapshot is never replayed over it.
+ */
+class SMjournal {
+	private:
+	std::string journal_file;
+	std::string snapshot_file;
+	int fd;				// Journal, open for appending
+	unsigned long long generation;	// Of the current snapshot
+	unsigned long long next_id;	// Journal id of the next insert
+	std::string pending;		// Records not yet written
+	unsigned records;		// In the journal since the snapshot
+	unsigned compact_after;
+	bool was_fresh;
+
+	void add_record(const std::string &payload);
+	void message_record(char type, unsigned long long id,
+			    const journal_msg *msg);
+	bool start_journal();
+
+	public:
+	SMjournal() :
+		journal_file(""),
+		snapshot_file(""),
+		fd(-1),
+		generation(0),
+		next_id(1),
+		pending(""),
+		records(0),
+		compact_after(0),
+		was_fresh(false)
+	{
+	}
+
+	~SMjournal();
+
+	/* Read the file names from gConfig.  False if journaling is off.  */
+	bool init();
+
+	/* Read the snapshot and replay the journal into msgs, then open
+	   the journal for appending.  False if it can't be opened, in
+	   which case nothing is journaled.  */
+	bool load(journal_msg_map &msgs);
+
+	bool is_open() const { return fd >= 0; }
+
+	/* True if load() found no snapshot and no journal at all.  */
+	bool fresh() const { return was_fresh; }
+
+	/* A message has been put in the queue.  Returns its journal id,
+	   or 0 if the journal isn't open.  */
+	unsigned long long insert(const journal_msg &msg);
+
+	/* A journaled message was rewritten.  */
+	void update(unsigned long long id, const journal_msg &msg);
+
+	/* A journaled message changed state or time, and nothing else.  */
+	void update_state(unsigned long long id, int state,
+			  time_t next_action_time);
+
+	/* A journaled message left the queue for good.  */
+	void remove(unsigned long long id);
+
+	/* Write and sync everything recorded so far.  */
+	bool flush();
+
+	bool needs_compaction() const {
+		return is_open() && compact_after && records >= compact_after;
+	}
+
+	/* Snapshot the journaled messages, which must be all of those
+	   still in the queue, and empty the journal.  */
+	bool compact(const journal_msg_map &msgs);
+};
+
+} // namespace SMqueue
+
+#endif
@@ -247,14 +247,12 @@ SMq::process_timeout()
 	enum sm_state newstate;
 
 	/* When we modify a timestamp below (in the set_state function),
-	   we re-queue the message within the queue, so we have to
-	   restart the iterator every time around the loop.   In effect,
-	   we're always looking at the top thing on the list (thus the
-	   earliest one in time).  */
+	   we refile the message in the queue's time index, so we have to
+	   ask for the earliest message every time around the loop.  */
 	
 	while (true) {
-		qmsg = time_sorted_list.begin();
-		if (qmsg == time_sorted_list.end())
+		qmsg = msg_queue.earliest();
+		if (qmsg == msg_queue.end())
 			return;			/* Empty queue */
 		if (qmsg->next_action_time > now)
 			return;			/* Wait til later to do more */
@@ -313,11 +311,9 @@ SMq::process_timeout()
 			// This message should quietly go away.
 	            {
 			short_msg_p_list temp;
-			// Extract the current sm from the time_sorted_list
-			temp.splice(temp.begin(), time_sorted_list, qmsg);
-			if(!my_backup.remove(temp.begin()->timestamp)){
-				LOG(INFO) << "Unable to remove message: " << temp.begin()->timestamp;
-			}
+			// Extract the current sm from the queue
+			msg_queue.extract(qmsg, temp);
+			forget_message(&*temp.begin());
 			// When we remove it from the new "temp" list,
 			// this entry will be deallocated.  qmsg still
 			// points to its (dead) storage, so be careful
@@ -438,8 +434,10 @@ SMq::process_timeout()
 }
 
 
-void
-increase_acked_msg_timeout(short_msg_pending *msg)
+/* When to resend a message that the handset's cell has acknowledged
+   but not yet delivered.  */
+time_t
+acked_msg_resend_time()
 {
 	time_t timeout = TT;
 
@@ -447,7 +445,7 @@ increase_acked_msg_timeout(short_msg_pending *msg)
 		timeout = gConfig.getNum("SIP.Timeout.ACKedMessageResend");
 	}
 
-	msg->set_state(msg->state, msg->gettime() + timeout);
+	return time(NULL) + timeout;
 }
 
 
@@ -473,7 +471,7 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 	// First, remove this response message from the queue.  That way,
 	// when we search the queue, we won't find OURSELF.  We also don't
 	// want the response hanging around in the queue anyway.
-	resplist.splice(resplist.begin(), time_sorted_list, qmsgit);
+	msg_queue.extract(qmsgit, resplist);
 	// We'll delete the list element on our way out of this function as
 	// resplist goes out of scope.
 
@@ -509,7 +507,7 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		//While a 100 doesn't mean anything really, 
 		//we should increase the timeout because 
 		//we know the network worked
-		increase_acked_msg_timeout(&(*sent_msg));
+		set_state(sent_msg, sent_msg->state, acked_msg_resend_time());
 		break;
 
 	case 2:	// 2xx -- success.
@@ -540,7 +538,7 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 				// Special code in registration processing
 				// will notice it's a re-reg and just reply
 				// with a welcome message.
-				oldsms->set_state(INITIAL_STATE);
+				set_state(oldsms, INITIAL_STATE);
 			} else {
 				// Orig SMS exists, but not in a normal state.
 				// Assume that the original SMS is in a
@@ -559,15 +557,17 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		// Whether a response to a REGISTER or a MESSAGE, delete 
 		// the datagram that we sent, which has been responded to.
 		LOG(INFO) << "Deleting sent message.";
-		resplist.splice(resplist.begin(),
-				time_sorted_list, sent_msg);
-		if(!my_backup.remove(resplist.begin()->timestamp)){
-			LOG(INFO) << "Unable to remove message: " << resplist.begin()->timestamp;
-		}	
-		resplist.pop_front();	// pop and delete the sent_msg.
-
-		// FIXME, consider breaking loose any other messages for
-		// the same destination now.
+		{
+			std::string imsi = short_msg_queue::destination_imsi(*sent_msg);
+			msg_queue.extract(sent_msg, resplist);
+			forget_message(&*resplist.begin());
+			resplist.pop_front();	// pop and delete the sent_msg.
+
+			// The handset is reachable now, so break loose any
+			// other messages for the same destination.
+			if (!imsi.empty())
+				release_held_messages(imsi);
+		}
 		break;
 
 	case 4: // 4xx -- failure by client
@@ -577,14 +577,14 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		// without unregistering from the network. Try again later.
 		// Eventually we should have a hook for their return
 		if (qmsg->parsed->status_code == 480 || qmsg->parsed->status_code == 486){
-			increase_acked_msg_timeout(&(*sent_msg));
+			set_state(sent_msg, sent_msg->state, acked_msg_resend_time());
 		}
 		// Other 4xx codes mean the original message was bad.  Bounce it.
 		else {
 			ostringstream errmsg;
 			errmsg << qmsg->parsed->status_code << " "
 			       << qmsg->parsed->reason_phrase;
-			sent_msg->set_state(
+			set_state(sent_msg,
 			    bounce_message((&*sent_msg), errmsg.str().c_str()));
 		}
 		break;
@@ -593,13 +593,13 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 		// FIXME, perhaps we should change its timeout value??  Shorter
 		// or longer???
 		LOG(WARNING) << "CONGESTION at OpenBTS\?\?!";
-		increase_acked_msg_timeout(&(*sent_msg));
+		set_state(sent_msg, sent_msg->state, acked_msg_resend_time());
 		break;
 
 	case 3: // 3xx -- message needs redirection
 	case 6: // 6xx -- message rejected (by this destination).
 		// Try going back through looking up the destination again.
-		sent_msg->set_state(REQUEST_DESTINATION_IMSI);
+		set_state(sent_msg, REQUEST_DESTINATION_IMSI);
 		break;
 
 	default:
@@ -610,9 +610,7 @@ SMq::handle_response(short_msg_p_list::iterator qmsgit)
 	// On exit, we delete the response message we've been examining
 	// when resplist goes out of scope.
 
-	if(!my_backup.remove(resplist.begin()->timestamp)){
-		LOG(INFO) << "Unable to remove message: " << resplist.begin()->timestamp;
-	}
+	forget_message(&*resplist.begin());
 }
 
 /*
@@ -623,15 +621,7 @@ bool
 SMq::find_queued_msg_by_tag(short_msg_p_list::iterator &mymsg,
 			    const char *tag, int taghash)
 {
-	short_msg_p_list::iterator x; 
-
-	for (x = time_sorted_list.begin(); x != time_sorted_list.end(); x++) {
-		if (taghash == x->qtaghash && !strcmp (tag, x->qtag)) {
-			mymsg = x;
-		    	return true;
-		}
-	}
-	return false;
+	return msg_queue.find_by_tag(mymsg, tag, taghash);
 }
 
 // Same, but figure out the taghash manually.
@@ -642,6 +632,118 @@ SMq::find_queued_msg_by_tag(short_msg_p_list::iterator &mymsg,
 	return find_queued_msg_by_tag(mymsg, tag, mymsg->taghash_of(tag));
 }
 
+void
+SMq::release_held_messages(const std::string &imsi)
+{
+	std::vector<short_msg_p_list::iterator> msgs;
+	time_t now = time(NULL);
+
+	msg_queue.find_by_imsi(imsi, msgs);
+	for (unsigned i = 0; i < msgs.size(); i++) {
+		if (msgs[i]->state == AWAITING_TRY_MSG_DELIVERY
+		 && msgs[i]->next_action_time > now) {
+			LOG(INFO) << "Retrying '" << msgs[i]->qtag
+				  << "' now, IMSI" << imsi << " is reachable.";
+			set_state(msgs[i], AWAITING_TRY_MSG_DELIVERY, now);
+		}
+	}
+}
+
+
+/*
+ * The indexed message queue.
+ */
+
+void
+short_msg_queue::index(iterator msg)
+{
+	msg->queued_time = msg->next_action_time;
+	by_time[time_key(msg->queued_time, msg->queue_seq)] = msg;
+
+	msg->queued_by_tag = (msg->qtag != NULL);
+	if (msg->queued_by_tag) {
+		msg->queued_taghash = msg->qtaghash;
+		by_tag[tag_key(msg->queued_taghash, msg->queue_seq)] = msg;
+	}
+
+	msg->queued_imsi = destination_imsi(*msg);
+	if (!msg->queued_imsi.empty())
+		by_imsi[imsi_key(msg->queued_imsi, msg->queue_seq)] = msg;
+}
+
+void
+short_msg_queue::unindex(iterator msg)
+{
+	by_time.erase(time_key(msg->queued_time, msg->queue_seq));
+	if (msg->queued_by_tag)
+		by_tag.erase(tag_key(msg->queued_taghash, msg->queue_seq));
+	if (!msg->queued_imsi.empty())
+		by_imsi.erase(imsi_key(msg->queued_imsi, msg->queue_seq));
+}
+
+short_msg_queue::iterator
+short_msg_queue::insert(short_msg_p_list &smp)
+{
+	iterator msg = smp.begin();
+	messages.splice(messages.begin(), smp, msg);
+	msg->queue_seq = ++last_seq;
+	index(msg);
+	return msg;
+}
+
+void
+short_msg_queue::extract(iterator msg, short_msg_p_list &to)
+{
+	unindex(msg);
+	msg->queue_seq = 0;
+	to.splice(to.begin(), messages, msg);
+}
+
+void
+short_msg_queue::update(iterator msg)
+{
+	unindex(msg);
+	index(msg);
+}
+
+bool
+short_msg_queue::find_by_tag(iterator &msg, const char *tag, int taghash)
+{
+	// Every message with this hash, verified with strcmp since
+	// hashes can collide.
+	tag_map::iterator x = by_tag.lower_bound(tag_key(taghash, 0));
+	for (; x != by_tag.end() && x->first.first == taghash; ++x) {
+		if (!strcmp (tag, x->second->qtag)) {
+			msg = x->second;
+			return true;
+		}
+	}
+	return false;
+}
+
+void
+short_msg_queue::find_by_imsi(const std::string &imsi,
+			      std::vector<iterator> &msgs)
+{
+	imsi_map::iterator x = by_imsi.lower_bound(imsi_key(imsi, 0));
+	for (; x != by_imsi.end() && x->first.first == imsi; ++x)
+		msgs.push_back(x->second);
+}
+
+std::string
+short_msg_queue::destination_imsi(const short_msg_pending &msg)
+{
+	// Once lookup_uri_imsi has run, the Request-URI of a MESSAGE
+	// names the destination as "IMSI" and its digits.
+	if (!msg.parsed || !MSG_IS_REQUEST(msg.parsed)
+	 || !msg.parsed->req_uri || !msg.parsed->req_uri->username)
+		return "";
+	const char *username = msg.parsed->req_uri->username;
+	if (strncasecmp(username, "imsi", 4))
+		return "";
+	return std::string(username + 4);
+}
+
 
 static bool relaxed_verify_relay(osip_list_t *vias, const char *host, const char *port)
 {
@@ -997,10 +1099,7 @@ short_msg_pending::set_qtag()
 	 || qtag[len-2] == '\0')
 		abfuckingort();
 
-	// Set the taghash too.  
-	// FIXME, if we set this with a good hash function,
-	// our linear searches will run much faster, avoiding
-	// almost all strcmp's.  For now, punt easy.
+	// Set the taghash too; the queue's tag index is keyed on it.
 	qtaghash = taghash_of(qtag);
 
 	return 0;
@@ -1008,14 +1107,18 @@ short_msg_pending::set_qtag()
 
 /* 
  * Hash a tag value for fast searches.
+ * Tags mostly differ only after the CSeq number, so hash every byte
+ * (FNV-1a) rather than just the first.
  */
-// FIXME, if we set this with a good hash function,
-// our linear searches will run much faster, avoiding
-// almost all strcmp's.  For now, punt easy.
 int
 short_msg_pending::taghash_of (const char *fromtag)
 {
-	return fromtag[0];
+	unsigned hash = 2166136261u;
+	for (const char *p = fromtag; *p; p++) {
+		hash ^= (unsigned char)*p;
+		hash *= 16777619u;
+	}
+	return (int)hash;
 }
 
 /* Check the host and port number specified.
@@ -1227,6 +1330,7 @@ SMq::set_linktag(short_msg_p_list::iterator newmsg,
 {
 	if (!oldmsg->qtag) {
 		oldmsg->set_qtag();
+		msg_queue.update(oldmsg);
 	}
 
 	size_t len = strlen(oldmsg->qtag);
@@ -2272,7 +2376,9 @@ SMq::handle_datagram(int len, char* buffer, long long timestamp, bool insert){
 			     << "BADMSG = " << smp->text;
 	}
 	// It's OK to reference "smp" here, whether it's in the
-	// smpl list, or has been moved into the main time_sorted_list.
+	// smpl list, or has been moved into the main msg_queue.
+	// Don't accept it until it's safe on disk.
+	my_journal.flush();
 	respond_sip_ack (errcode, smp, smp->srcaddr, smp->srcaddrlen);
 	
 	// We won't leak memory if we didn't queue it up, since
@@ -2302,24 +2408,39 @@ SMq::main_loop()
 	stop_main_loop = false;
 
 	//first load old datagrams into queue from storage
-	backup_msg_list* old_msgs = my_backup.get_stored_messages();
-	LOG(INFO) << old_msgs->size() << " messages in backup";
-	bmsg = old_msgs->begin();
-	while (bmsg != old_msgs->end()){
-	    LOG (INFO) << "backup got " << bmsg->text;
-	    strncpy(buffer, bmsg->text.c_str(), 5000);
-	    LOG(INFO) << "Inserting from backup " << bmsg->timestamp << ":" << buffer;
-	    handle_datagram(strnlen(buffer, 5000), buffer, bmsg->timestamp, false);
-	    bmsg++;
-	}
-	delete old_msgs;
+	// With a journal they are already queued, except the first time
+	// it's used, when they get moved into it.
+	if (!my_journal.is_open() || my_journal.fresh()) {
+		backup_msg_list* old_msgs = my_backup.get_stored_messages();
+		LOG(INFO) << old_msgs->size() << " messages in backup";
+		bmsg = old_msgs->begin();
+		while (bmsg != old_msgs->end()){
+		    LOG (INFO) << "backup got " << bmsg->text;
+		    strncpy(buffer, bmsg->text.c_str(), 5000);
+		    LOG(INFO) << "Inserting from backup " << bmsg->timestamp << ":" << buffer;
+		    handle_datagram(strnlen(buffer, 5000), buffer, bmsg->timestamp, my_journal.is_open());
+		    bmsg++;
+		}
+		// Once they're safely in the journal, take them out of the
+		// backup, or going back to it would send them all again.
+		if (my_journal.is_open()) {
+			if (my_journal.flush()) {
+				for (bmsg = old_msgs->begin();
+				     bmsg != old_msgs->end(); bmsg++)
+					my_backup.remove(bmsg->timestamp);
+			} else {
+				LOG(ERR) << "Can't write journal, leaving messages in backup";
+			}
+		}
+		delete old_msgs;
+	}
 	//TODO - KEEP THESE FROM CAUSING BILLING - kurtis
 
    while (!stop_main_loop) {
 
 	now = time(NULL);		
-	qmsg = time_sorted_list.begin();
-	if (qmsg == time_sorted_list.end()) {
+	qmsg = msg_queue.earliest();
+	if (qmsg == msg_queue.end()) {
 		timeout = -1;			// Infinite timeout
 	} else {
 		timeout = qmsg->next_action_time - now;
@@ -2339,11 +2460,11 @@ SMq::main_loop()
 
 	if (timeout < 0) {
 	    LOG(INFO) << "=== " << timebuf+4 << " "
-	     << time_sorted_list.size() << " queued; "
+	     << msg_queue.size() << " queued; "
 		<< "waiting.";
 	} else {
 	    LOG(INFO) << "=== " << timebuf+4 << " "
-	     << time_sorted_list.size() << " queued; "
+	     << msg_queue.size() << " queued; "
 		     << timeout << " seconds til "
 		     << sm_state_string(qmsg->state)
 		     << " for " << qmsg->qtag;
@@ -2363,14 +2484,20 @@ SMq::main_loop()
 	}
 
 	process_timeout();
+
+	// Everything that changed this time around goes to disk at once.
+	my_journal.flush();
+	if (my_journal.needs_compaction())
+		compact_journal();
     } /* while (!stop_main_loop) */
 }
 
 /* Debug dump of SMq and mainly the queue. */
 void SMq::debug_dump() {
-	short_msg_p_list::iterator x = time_sorted_list.begin();
+	short_msg_queue::time_iterator t = msg_queue.time_begin();
 	time_t now = time(NULL);
-	for (; x != time_sorted_list.end(); ++x) {
+	for (; t != msg_queue.time_end(); ++t) {
+		short_msg_p_list::iterator x = t->second;
 		x->make_text_valid();
 		LOG(DEBUG) << "== State: " << sm_state_string (x->state) << "\t"
 		     << (x->next_action_time - now) << endl << "MSG = "
@@ -2430,14 +2557,15 @@ netaddr_parse(const char *str, char *addr, unsigned int *len)
 bool
 SMq::save_queue_to_file(std::string qfile)
 {
-	short_msg_p_list::reverse_iterator x = time_sorted_list.rbegin();
+	short_msg_queue::time_reverse_iterator t = msg_queue.time_rbegin();
 	ofstream ofile;
 	unsigned howmany = 0;
 
 	ofile.open(qfile.c_str(), ios::out | ios::binary | ios::trunc);
 	if (!ofile.is_open())
 		return false;
-	for (; x != time_sorted_list.rend(); ++x) {
+	for (; t != msg_queue.time_rend(); ++t) {
+		short_msg_p_list::iterator x = t->second;
 		x->make_text_valid();
 		ofile << "=== " << (int) x->state << " " 
 		      << x->next_action_time << " "
@@ -2548,6 +2676,115 @@ SMq::read_queue_from_file(std::string qfile)
 	return true;
 }
 
+/* The journal's copy of a queued message.  */
+static journal_msg
+journal_entry(short_msg_pending *msg)
+{
+	journal_msg jm;
+	msg->make_text_valid();
+	jm.state = msg->state;
+	jm.next_action_time = msg->next_action_time;
+	jm.timestamp = msg->timestamp;
+	jm.ms_to_sc = msg->ms_to_sc;
+	jm.need_repack = msg->need_repack;
+	jm.from_relay = msg->from_relay;
+	jm.srcaddr.assign(msg->srcaddr, msg->srcaddrlen);
+	if (msg->linktag)
+		jm.linktag = msg->linktag;
+	jm.text = msg->text;
+	msg->journaled_version = msg->text_version;
+	return jm;
+}
+
+void
+SMq::journal_insert(short_msg_pending *msg)
+{
+	msg->journal_id = my_journal.insert(journal_entry(msg));
+}
+
+void
+SMq::journal_update(short_msg_pending *msg)
+{
+	if (!msg->journal_id)
+		return;
+	// If the message itself was rewritten (e.g. its destination was
+	// looked up), the new text has to be journaled, not just the state.
+	if (msg->parsed_is_better || msg->text_version != msg->journaled_version)
+		my_journal.update(msg->journal_id, journal_entry(msg));
+	else
+		my_journal.update_state(msg->journal_id, msg->state,
+					msg->next_action_time);
+}
+
+void
+SMq::journal_remove(short_msg_pending *msg)
+{
+	if (!msg->journal_id)
+		return;
+	my_journal.remove(msg->journal_id);
+	msg->journal_id = 0;
+}
+
+bool
+SMq::compact_journal()
+{
+	journal_msg_map msgs;
+	for (short_msg_queue::iterator x = msg_queue.begin();
+	     x != msg_queue.end(); ++x) {
+		if (x->journal_id)
+			msgs[x->journal_id] = journal_entry(&*x);
+	}
+	return my_journal.compact(msgs);
+}
+
+/*
+ * Read the queue back from the journal.  Unlike a backed-up datagram,
+ * a journaled message is already validated and comes back in the state
+ * it was in, so it is only parsed -- it doesn't go through validation,
+ * the HLR, or the short codes again.
+ */
+bool
+SMq::read_queue_from_journal()
+{
+	journal_msg_map msgs;
+	unsigned howmany = 0, howmanyerrs = 0;
+
+	if (!my_journal.load(msgs))
+		return false;
+	for (journal_msg_map::iterator x = msgs.begin(); x != msgs.end(); ++x) {
+		const journal_msg &jm = x->second;
+		short_msg_p_list smpl(1);
+		short_msg_pending *smp = &*smpl.begin();
+		smp->initialize(jm.text.length(), new_strdup(jm.text.c_str()), true);
+		smp->timestamp = jm.timestamp;
+		smp->ms_to_sc = jm.ms_to_sc;
+		smp->need_repack = jm.need_repack;
+		smp->from_relay = jm.from_relay;
+		smp->srcaddrlen = jm.srcaddr.length();
+		if (smp->srcaddrlen > sizeof(smp->srcaddr))
+			smp->srcaddrlen = 0;
+		memcpy(smp->srcaddr, jm.srcaddr.data(), smp->srcaddrlen);
+		if (jm.linktag.length())
+			smp->linktag = new_strdup(jm.linktag.c_str());
+
+		if (!smp->parse() || smp->set_qtag() != 0
+		 || jm.state <= NO_STATE || jm.state > STATE_MAX) {
+			LOG(ERR) << "Dropping unreadable journaled message "
+				 << x->first << ": " << jm.text;
+			howmanyerrs++;
+			continue;
+		}
+		smp->set_state((enum sm_state)jm.state, jm.next_action_time);
+		smp->journal_id = x->first;
+		smp->journaled_version = smp->text_version;
+		msg_queue.insert(smpl);
+		howmany++;
+	}
+	LOG(INFO) << "=== Read " << howmany << " messages from the journal, "
+		  << howmanyerrs << " bad ones.";
+	return true;
+}
+
 #if 0
 /*
  * Read in a message from a file.  Return malloc'd char block of the whole
@@ -2703,10 +2940,13 @@ main(int argc, char **argv)
 
     savefile = gConfig.getStr("savefile").c_str();
 
-    if (!smq.read_queue_from_file (savefile)) {
+    if (smq.read_queue_from_journal()) {
+	// The journal has the queue; the save file is only written
+	// without one.
+    } else if (!smq.read_queue_from_file (savefile)) {
 	LOG(WARNING) << "Failed to read queue from file " << savefile;
     }
-    LOG(INFO) << "Queue contains " << smq.time_sorted_list.size() << " msgs.";
+    LOG(INFO) << "Queue contains " << smq.msg_queue.size() << " msgs.";
 
     // smq.debug_dump();
 
@@ -2719,14 +2959,24 @@ main(int argc, char **argv)
     // based upon getting a "reboot" sms or signal or something).
     if (smq.reexec_smqueue) {
       LOG(WARNING) << "====== Re-Execing! ======";
-      if (!smq.save_queue_to_file(savefile)) {
+      if (smq.my_journal.is_open()) {
+	// Leave a fresh snapshot, so the restart needn't replay anything.
+	if (!smq.compact_journal()) {
+	  LOG(ERR) << "OUCH!  Could not snapshot the queue journal";
+	}
+      } else if (!smq.save_queue_to_file(savefile)) {
 	LOG(ERR) << "OUCH!  Could not save queue to file " << savefile;
       }
       please_re_exec = true;
       break;	// Get out of scope that contains smq, closing file descrs.
     } else {
       LOG(NOTICE) << "====== Quitting! ======";
-      if (!smq.save_queue_to_file(savefile)) {
+      if (smq.my_journal.is_open()) {
+	// Leave a fresh snapshot, so the restart needn't replay anything.
+	if (!smq.compact_journal()) {
+	  LOG(ERR) << "OUCH!  Could not snapshot the queue journal";
+	}
+      } else if (!smq.save_queue_to_file(savefile)) {
 	LOG(ERR) << "OUCH!  Could not save queue to file " << savefile;
       }
       // smq.debug_dump();
@@ -2815,6 +3065,30 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("Journal.CompactAfter","10000",
+		"records",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1000:1000000",// educated guess
+		false,
+		"Rewrite the queue snapshot and start an empty journal after this many journal records."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("Journal.File","/var/lib/OpenBTS/smq.journal",
+		"",
+		ConfigurationKey::CUSTOMERWARN,
+		ConfigurationKey::FILEPATH_OPT,
+		"",
+		true,
+		"Journal of the message queue, so queued messages survive a restart in the state they were in.  "
+		"The snapshot it is compacted into is kept beside it, with \".snapshot\" appended.  "
+		"To disable, and back up incoming messages in Backup.db instead, execute \"unconfig Journal.File\"; messages still queued in the journal are not moved back."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	tmp = new ConfigurationKey("savefile","/tmp/save",
 		"",
 		ConfigurationKey::CUSTOMER,
@@ -3360,5 +3634,19 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SubscriberRegistry.UpstreamServer.CacheTTL","0",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:3600",
+		false,
+		"How long answers to lookups from the upstream subscriber registry server are kept and reused.  "
+			"Updates sent upstream discard every kept answer.  "
+			"Negative answers are kept too, so a subscriber added upstream may be unknown here for this long.  "
+			"0, the default, always asks the server."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	return map;
 }
@@ -29,6 +29,7 @@
 #include <osip2/osip.h>			/* for osip_init */
 #include <list>
 #include <map>
+#include <vector>
 #include <string>
 #include <iostream>
 #include <stdio.h>
@@ -37,6 +38,7 @@
 #include <SubscriberRegistry.h>			// My home location register
 #include <Logger.h>
 #include "diskbackup.h"
+#include "smjournal.h"
 
 // That's awful OSIP has a CR define.
 // It clashes with our innocent L2Address::CR().
@@ -153,6 +155,9 @@ class short_msg {
 
 	long long timestamp; //timestamp for backup id'ing
 
+	unsigned text_version; // Bumped whenever the parsed copy is changed,
+	                       // so the journal can tell the text is stale.
+
 	short_msg () :
 		text_length (0),
 		text (NULL),
@@ -166,7 +171,8 @@ class short_msg {
 		ms_to_sc(false),
 		need_repack(true),
 		from_relay(false),
-		timestamp(get_msecs())
+		timestamp(get_msecs()),
+		text_version(0)
 	{
 	}
 	// Make a short message, perhaps taking responsibility for deleting
@@ -184,7 +190,8 @@ class short_msg {
 		ms_to_sc(false),
 		need_repack(true),
 		from_relay(false),
-		timestamp(get_msecs())
+		timestamp(get_msecs()),
+		text_version(0)
 	{
 		if (!use_my_memory) {
 			text = new char [text_length+1];
@@ -212,7 +219,8 @@ class short_msg {
 		ms_to_sc(false),
 		need_repack(true),
 		from_relay(sm.from_relay),
-		timestamp(get_msecs())
+		timestamp(get_msecs()),
+		text_version(0)
 	{
 		if (text_length) {
 			text = new char [text_length+1];
@@ -234,7 +242,8 @@ class short_msg {
 		tl_message(NULL),
 		ms_to_sc(false),
 		need_repack(false),
-		timestamp(get_msecs())
+		timestamp(get_msecs()),
+		text_version(0)
 	{
 		text = new char [text_length+1];
 		strncpy(text, str.data(), text_length);
@@ -345,6 +354,7 @@ class short_msg {
 	void
 	parsed_was_changed() {
 		parsed_is_better = true;
+		text_version++;
 		osip_message_force_update(parsed);   // Tell osip library too
 	}
 
@@ -493,6 +503,20 @@ class short_msg_pending: public short_msg {
 					// the original SMS message that
 					// prompted us to send the register.)
 
+	// Where short_msg_queue has this message filed.  Only the queue
+	// touches these; queue_seq is 0 while the message is not queued.
+	unsigned long queue_seq;
+	time_t queued_time;
+	bool queued_by_tag;
+	int queued_taghash;
+	std::string queued_imsi;
+
+	// The message's id in SMjournal, 0 while it isn't journaled, and
+	// which text_version was last written there.  Only SMq's journal_*
+	// methods touch these.  A copy is a new message, with no id.
+	unsigned long long journal_id;
+	unsigned journaled_version;
+
 	static const char *smp_my_ipaddress;	// Static copy of my IP address
 					// for validity checking of msgs.
 					// (We get our own copy because
@@ -511,7 +535,14 @@ class short_msg_pending: public short_msg {
 		srcaddrlen(0),
 		qtag (NULL),
 		qtaghash (0),
-		linktag (NULL)
+		linktag (NULL),
+		queue_seq (0),
+		queued_time (0),
+		queued_by_tag (false),
+		queued_taghash (0),
+		queued_imsi (),
+		journal_id (0),
+		journaled_version (0)
 	{ 
 	}
 
@@ -528,7 +559,14 @@ class short_msg_pending: public short_msg {
 		srcaddrlen(0),
 		qtag (NULL),
 		qtaghash (0),
-		linktag (NULL)
+		linktag (NULL),
+		queue_seq (0),
+		queued_time (0),
+		queued_by_tag (false),
+		queued_taghash (0),
+		queued_imsi (),
+		journal_id (0),
+		journaled_version (0)
 	{
 	}
 
@@ -566,7 +604,14 @@ class short_msg_pending: public short_msg {
 		srcaddrlen(smp.srcaddrlen),
 		qtag (NULL),
 		qtaghash (smp.qtaghash),
-		linktag (NULL)
+		linktag (NULL),
+		queue_seq (0),
+		queued_time (0),
+		queued_by_tag (false),
+		queued_taghash (0),
+		queued_imsi (),
+		journal_id (0),
+		journaled_version (0)
 	{
 		if (smp.srcaddrlen) {
 			if (smp.srcaddrlen > sizeof (srcaddr))
@@ -702,6 +747,91 @@ class short_msg_pending: public short_msg {
 
 typedef std::list<short_msg_pending> short_msg_p_list;
 
+/*
+ * The queue of pending messages.  The messages themselves sit in a list,
+ * in no particular order, so iterators to them stay good while they are
+ * queued.  Alongside are indexes by time of next action, by qtag hash and
+ * by destination IMSI, so that finding the next message to work on,
+ * matching a SIP response to the message it answers, and finding the
+ * other messages for one subscriber are all O(log n) rather than a walk
+ * over everything queued.
+ *
+ * Whenever a queued message's next_action_time, qtag or Request-URI
+ * changes, update() must be called to refile it.
+ */
+class short_msg_queue {
+  public:
+	typedef short_msg_p_list::iterator iterator;
+
+  private:
+	// Every key carries the message's queue_seq, so messages with the
+	// same time, hash or IMSI are kept apart.
+	typedef std::pair<time_t,unsigned long> time_key;
+	typedef std::pair<int,unsigned long> tag_key;
+	typedef std::pair<std::string,unsigned long> imsi_key;
+	typedef std::map<time_key,iterator> time_map;
+	typedef std::map<tag_key,iterator> tag_map;
+	typedef std::map<imsi_key,iterator> imsi_map;
+
+	short_msg_p_list messages;
+	time_map by_time;
+	tag_map by_tag;
+	imsi_map by_imsi;
+	unsigned long last_seq;
+
+	void index(iterator msg);
+	void unindex(iterator msg);
+
+  public:
+	// Walks the queue in order of next action.
+	typedef time_map::const_iterator time_iterator;
+	typedef time_map::const_reverse_iterator time_reverse_iterator;
+
+	short_msg_queue () :
+		messages (),
+		by_time (),
+		by_tag (),
+		by_imsi (),
+		last_seq (0)
+	{
+	}
+
+	// Not in any particular order.
+	iterator begin() { return messages.begin(); }
+	iterator end() { return messages.end(); }
+	size_t size() const { return messages.size(); }
+	bool empty() const { return messages.empty(); }
+
+	time_iterator time_begin() const { return by_time.begin(); }
+	time_iterator time_end() const { return by_time.end(); }
+	time_reverse_iterator time_rbegin() const { return by_time.rbegin(); }
+	time_reverse_iterator time_rend() const { return by_time.rend(); }
+
+	/* The message whose next action is due first, or end().  */
+	iterator earliest() {
+		return by_time.empty()? messages.end(): by_time.begin()->second;
+	}
+
+	/* Move the (one) message in smp into the queue.  */
+	iterator insert(short_msg_p_list &smp);
+
+	/* Move a message out of the queue, to the front of another list.  */
+	void extract(iterator msg, short_msg_p_list &to);
+
+	/* Refile a message after its time, tag or destination changed.  */
+	void update(iterator msg);
+
+	/* Find a queued message by its qtag.  */
+	bool find_by_tag(iterator &msg, const char *tag, int taghash);
+
+	/* All queued messages for one IMSI (digits only, no "IMSI").  */
+	void find_by_imsi(const std::string &imsi,
+			  std::vector<iterator> &msgs);
+
+	/* The IMSI a message is addressed to, or "" if it isn't yet.  */
+	static std::string destination_imsi(const short_msg_pending &msg);
+};
+
 /*
  * Function parameters and return value for short-code "command" functions that
  * process SMS messages internally rather than sending the SMS message
@@ -773,13 +903,10 @@ void init_smcommands (short_code_map_t *scm);
 class SMq {
 	public:
 
-	/* A list of all messages we know about, sorted by time of next
-	   action (assuming nothing arrives to change our mind before that
-	   time). */
-	short_msg_p_list time_sorted_list;
-
-	/* We may later want other accessors for faster access to various
-	   messages when things DO arrive.  For now, linear search!  */
+	/* All messages we know about, indexed by time of next action
+	   (assuming nothing arrives to change our mind before that
+	   time), by tag, and by destination IMSI.  */
+	short_msg_queue msg_queue;
 
 	/* The network sockets that we're using for I/O */
 	SMnet my_network;
@@ -790,6 +917,10 @@ class SMq {
 
 	SQLiteBackup my_backup;
 
+	/* Keeps the queue on disk, state and all, when Journal.File is
+	   set.  my_backup is only used when it isn't.  */
+	SMjournal my_journal;
+
 	/* Where to send SMS's that we can't route locally. */
 	std::string global_relay;
 	std::string global_relay_port;
@@ -820,7 +951,7 @@ class SMq {
 
 	/* Constructor */
 	SMq () : 
-		time_sorted_list (),
+		msg_queue (),
 		my_network (),
 		my_hlr(),
 		global_relay(""),
@@ -836,6 +967,7 @@ class SMq {
 	{
 		my_hlr.init();
 		my_backup.init();
+		my_journal.init();
 	}
 
 	// Override operator= so -Weffc++ doesn't complain
@@ -1020,11 +1152,13 @@ class SMq {
 	// This version lets the state and timeout be set.
 	void insert_new_message(short_msg_p_list &smp, enum sm_state s, 
 				time_t t, bool insert = true) {
-		if (insert && !my_backup.insert(smp.begin()->timestamp, smp.begin()->text)){
-			LOG(INFO) << "Unable to backup message: " << time_sorted_list.begin()->timestamp;
+		smp.begin()->set_state (s, t);
+		if (insert && my_journal.is_open()) {
+			journal_insert(&*smp.begin());
+		} else if (insert && !my_backup.insert(smp.begin()->timestamp, smp.begin()->text)){
+			LOG(INFO) << "Unable to backup message: " << smp.begin()->timestamp;
 		}
-		time_sorted_list.splice (time_sorted_list.begin(), smp);
-		time_sorted_list.begin()->set_state (s, t);
+		msg_queue.insert (smp);
 	}
 	// This version lets the initial state be set.
 	void insert_new_message(short_msg_p_list &smp, enum sm_state s, bool insert=true) {
@@ -1047,60 +1181,46 @@ class SMq {
 		      short_msg_p_list::iterator qmsg);
 
 	/*
- 	 * When we reset the state and timestamp of a message,
-	 * we need to reinsert it into the queue.  C++ doesn't seem
-	 * to have a standard container that lets one do this cleanly.
-	 * Even with lists it's a kludge -- we have to do our own search.
-	 * With multisets you can't splice an element out while keeping the
-	 * element... etc.
+	 * When we reset the state and timestamp of a message,
+	 * we need to refile it in the queue's time index.
 	 */
 	void set_state(short_msg_p_list::iterator sm, enum sm_state newstate) {
-		short_msg_p_list temp;
-		/* Extract the current sm from the time_sorted_list */
-		temp.splice(temp.begin(), time_sorted_list, sm);
 		sm->set_state(newstate);
-		// Insert it according to the new timestamp.
-		// One would think that "multisets" could do this simply,
-		// but they don't appear to have this capability.
-		// Note: if list is empty, or all are too early, insert at end.
-		for (short_msg_p_list::iterator x = time_sorted_list.begin(); 
-		     true; x++) {
-			if (x == time_sorted_list.end() 
-			    || x->next_action_time >= sm->next_action_time) {
-				time_sorted_list.splice(x, temp);
-				break;
-			}
-		}
+		msg_queue.update(sm);
+		journal_update(&*sm);
 	};
 
-	/*
- 	 * When we reset the state and timestamp of a message,
-	 * we need to reinsert it into the queue.  C++ doesn't seem
-	 * to have a standard container that lets one do this cleanly.
-	 * Even with lists it's a kludge -- we have to do our own search.
-	 * With multisets you can't splice an element out while keeping the
-	 * element... etc.
-	 */
+	/* Same, with the time of the next action given.  */
 	void set_state(short_msg_p_list::iterator sm, enum sm_state newstate,
 		time_t timestamp) {
-		short_msg_p_list temp;
-		/* Extract the current sm from the time_sorted_list */
-		temp.splice(temp.begin(), time_sorted_list, sm);
 		sm->set_state(newstate, timestamp);
-		// Insert it according to the new timestamp.
-		// One would think that "multisets" could do this simply,
-		// but they don't appear to have this capability.
-		// Note: if list is empty, or all are too early, insert at end.
-		for (short_msg_p_list::iterator x = time_sorted_list.begin(); 
-		     true; x++) {
-			if (x == time_sorted_list.end() 
-			    || x->next_action_time >= sm->next_action_time) {
-				time_sorted_list.splice(x, temp);
-				break;
-			}
-		}
+		msg_queue.update(sm);
+		journal_update(&*sm);
 	};
 
+	/* A message has been taken out of the queue for good; drop it
+	   from the journal or backup too.  */
+	void forget_message(short_msg_pending *msg) {
+		if (my_journal.is_open()) {
+			journal_remove(msg);
+		} else if (!my_backup.remove(msg->timestamp)) {
+			LOG(INFO) << "Unable to remove message: " << msg->timestamp;
+		}
+	}
+
+	/* Journal a message put in the queue; journal a change to a
+	   journaled one; drop one from the journal.  */
+	void journal_insert(short_msg_pending *msg);
+	void journal_update(short_msg_pending *msg);
+	void journal_remove(short_msg_pending *msg);
+
+	/* Snapshot the journaled messages and empty the journal.  */
+	bool compact_journal();
+
+	/* Delivery to an IMSI just worked, so stop holding back the other
+	   messages waiting to retry delivery to it.  */
+	void release_held_messages(const std::string &imsi);
+
 	/* Save the queue to a file; read it back from a file.
 	   Reading a queue file doesn't delete things that might already
  	   be in the queue; if you want a clean queue, delete anything
@@ -1109,6 +1229,12 @@ class SMq {
 	save_queue_to_file(std::string qfile);
 	bool
 	read_queue_from_file(std::string qfile);
+
+	/* Put back the queue from the journal, in the states the messages
+	   were in.  False if journaling is off or the journal can't be
+	   opened.  */
+	bool
+	read_queue_from_journal();
 };
 
 } // namespace SMqueue
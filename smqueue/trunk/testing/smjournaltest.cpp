@@ -0,0 +1,137 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+        This program is free software: you can redistribute it and/or modify
+        it under the terms of the GNU Affero General Public License as published by
+        the Free Software Foundation, either version 3 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU Affero General Public License for more details.
+
+        You should have received a copy of the GNU Affero General Public License
+        along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+ * Journals messages that share a timestamp, reloads them, and checks
+ * every one of them comes back, before and after a compaction.
+ */
+
+#include "smjournal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Configuration.h>
+
+using namespace std;
+using namespace SMqueue;
+
+ConfigurationTable gConfig;
+
+static int failures = 0;
+
+static void check(bool ok, const char *what)
+{
+	printf("%s: %s\n", ok? "ok": "FAILED", what);
+	if (!ok)
+		failures++;
+}
+
+static journal_msg make_msg(int state, long long timestamp, const char *text)
+{
+	journal_msg jm;
+	jm.state = state;
+	jm.next_action_time = 1000 + state;
+	jm.timestamp = timestamp;
+	jm.ms_to_sc = true;
+	jm.need_repack = false;
+	jm.from_relay = false;
+	jm.srcaddr = "127.0.0.1:5062";
+	jm.linktag = "";
+	jm.text = text;
+	return jm;
+}
+
+// Open a fresh SMjournal on the configured files and load it into msgs.
+static bool reload(journal_msg_map &msgs)
+{
+	SMjournal journal;
+	msgs.clear();
+	return journal.init() && journal.load(msgs);
+}
+
+int main(int argc, char **argv)
+{
+	char dir[] = "/tmp/smjournaltestXXXXXX";
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	string file = string(dir) + "/journal";
+	gConfig.set("Journal.File", file);
+
+	const long long timestamp = 1349000000LL;
+	unsigned long long first, second, third;
+	journal_msg_map msgs;
+	{
+		SMjournal journal;
+		check(journal.init() && journal.load(msgs), "open empty journal");
+		check(journal.fresh() && msgs.empty(), "new journal is empty");
+
+		first = journal.insert(make_msg(1, timestamp, "first"));
+		second = journal.insert(make_msg(1, timestamp, "second"));
+		check(first && second && first != second,
+		      "same timestamp, different ids");
+		journal.update_state(second, 5, 2000);
+		check(journal.flush(), "flush");
+	}
+
+	check(reload(msgs), "reload journal");
+	check(msgs.size() == 2, "both messages replayed");
+	check(msgs.count(first) && msgs[first].text == "first" &&
+	      msgs[first].state == 1 && msgs[first].timestamp == timestamp,
+	      "first message intact");
+	check(msgs.count(second) && msgs[second].text == "second" &&
+	      msgs[second].state == 5 && msgs[second].next_action_time == 2000 &&
+	      msgs[second].timestamp == timestamp,
+	      "second message intact");
+
+	{
+		SMjournal journal;
+		check(journal.init() && journal.load(msgs), "reopen journal");
+		check(journal.compact(msgs), "compact");
+		third = journal.insert(make_msg(2, timestamp, "third"));
+		check(third > first && third > second,
+		      "ids keep counting after a restart");
+		check(journal.flush(), "flush after compact");
+	}
+
+	check(reload(msgs), "reload snapshot and journal");
+	check(msgs.size() == 3 && msgs.count(first) && msgs.count(second) &&
+	      msgs.count(third), "all messages survive compaction");
+	check(msgs.count(third) && msgs[third].text == "third",
+	      "third message intact");
+
+	unlink(file.c_str());
+	unlink((file + ".snapshot").c_str());
+	rmdir(dir);
+
+	if (failures) {
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
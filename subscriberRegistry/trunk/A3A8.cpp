@@ -0,0 +1,383 @@
+/*
+* Copyright 2011 Kestrel Signal Processing, Inc.
+* Copyright 2011 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "A3A8.h"
+
+using namespace std;
+
+
+// From comp128.c, which is linked in with its main() compiled out.
+void A3A8(unsigned char rand[16], unsigned char key[16], unsigned char simoutput[12]);
+
+
+/** Multiply in GF(2^8) modulo the AES polynomial. */
+static unsigned char gfMul(unsigned char a, unsigned char b)
+{
+	unsigned char p = 0;
+	while (b) {
+		if (b & 1) p ^= a;
+		a = (a << 1) ^ ((a & 0x80) ? 0x1b : 0);
+		b >>= 1;
+	}
+	return p;
+}
+
+/** The AES S-box, generated from its definition (FIPS-197 5.1.1) rather than typed in. */
+static class AESSBox {
+
+	public:
+
+	unsigned char mBox[256];
+
+	AESSBox()
+	{
+		for (unsigned x=0; x<256; x++) {
+			// The multiplicative inverse is x^254; 0 maps to 0.
+			unsigned char inv = 1;
+			for (unsigned i=0; i<254; i++) inv = gfMul(inv,x);
+			if (x==0) inv = 0;
+			unsigned char s = inv;
+			for (unsigned i=1; i<5; i++) s ^= (inv << i) | (inv >> (8-i));
+			mBox[x] = s ^ 0x63;
+		}
+	}
+
+} gAESSBox;
+
+
+/** AES-128 encryption of single blocks, all Milenage needs. */
+class AES128 {
+
+	private:
+
+	unsigned char mRoundKeys[176];
+
+	public:
+
+	AES128(const unsigned char key[16])
+	{
+		const unsigned char *sbox = gAESSBox.mBox;
+		memcpy(mRoundKeys,key,16);
+		unsigned char rcon = 1;
+		for (unsigned i=16; i<176; i+=4) {
+			unsigned char t[4];
+			memcpy(t,mRoundKeys+i-4,4);
+			if (i%16 == 0) {
+				unsigned char t0 = t[0];
+				t[0] = sbox[t[1]] ^ rcon;
+				t[1] = sbox[t[2]];
+				t[2] = sbox[t[3]];
+				t[3] = sbox[t0];
+				rcon = gfMul(rcon,2);
+			}
+			for (unsigned j=0; j<4; j++) mRoundKeys[i+j] = mRoundKeys[i+j-16] ^ t[j];
+		}
+	}
+
+	void encrypt(const unsigned char in[16], unsigned char out[16]) const
+	{
+		const unsigned char *sbox = gAESSBox.mBox;
+		unsigned char s[16];
+		for (unsigned i=0; i<16; i++) s[i] = in[i] ^ mRoundKeys[i];
+		for (unsigned round=1; round<=10; round++) {
+			// SubBytes and ShiftRows; the state is column-major.
+			unsigned char t[16];
+			for (unsigned c=0; c<4; c++)
+				for (unsigned r=0; r<4; r++)
+					t[4*c+r] = sbox[s[4*((c+r)%4)+r]];
+			// MixColumns, except in the last round.
+			if (round<10) {
+				for (unsigned c=0; c<4; c++) {
+					unsigned char *col = t+4*c;
+					unsigned char a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+					col[0] = gfMul(a0,2) ^ gfMul(a1,3) ^ a2 ^ a3;
+					col[1] = a0 ^ gfMul(a1,2) ^ gfMul(a2,3) ^ a3;
+					col[2] = a0 ^ a1 ^ gfMul(a2,2) ^ gfMul(a3,3);
+					col[3] = gfMul(a0,3) ^ a1 ^ a2 ^ gfMul(a3,2);
+				}
+			}
+			// AddRoundKey
+			for (unsigned i=0; i<16; i++) s[i] = t[i] ^ mRoundKeys[16*round+i];
+		}
+		memcpy(out,s,16);
+	}
+};
+
+
+
+bool A3A8COMP128v1(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8])
+{
+	unsigned char k[16], r[16], simoutput[12];
+	memcpy(k,ki,16);
+	memcpy(r,rand,16);
+	A3A8(r,k,simoutput);
+	memcpy(sres,simoutput,4);
+	memcpy(kc,simoutput+4,8);
+	return true;
+}
+
+
+/**
+	The compression tables of COMP128v2 and v3, from the published
+	reverse engineering of the algorithms (see osmocom comp128v23.c).
+*/
+static const unsigned char sCOMP128v23Table0[256] = {
+	197, 235,  60, 151,  98,  96,   3, 100, 248, 118,  42, 117, 172, 211, 181, 203,
+	 61, 126, 156,  87, 149, 224,  55, 132, 186,  63, 238, 255,  85,  83, 152,  33,
+	160, 184, 210, 219, 159,  11, 180, 194, 130, 212, 147,   5, 215,  92,  27,  46,
+	113, 187,  52,  25, 185,  79, 221,  48,  70,  31, 101,  15, 195, 201,  50, 222,
+	137, 233, 229, 106, 122, 183, 178, 177, 144, 207, 234, 182,  37, 254, 227, 231,
+	 54, 209, 133,  65, 202,  69, 237, 220, 189, 146, 120,  68,  21, 125,  38,  30,
+	  2, 155,  53, 196, 174, 176,  51, 246, 167,  76, 110,  20,  82, 121, 103, 112,
+	 56, 173,  49, 217, 252,   0, 114, 228, 123,  12,  93, 161, 253, 232, 240, 175,
+	 67, 128,  22, 158,  89,  18,  77, 109, 190,  17,  62,   4, 153, 163,  59, 145,
+	138,   7,  74, 205,  10, 162,  80,  45, 104, 111, 150, 214, 154,  28, 191, 169,
+	213,  88, 193, 198, 200, 245,  39, 164, 124,  84,  78,   1, 188, 170,  23,  86,
+	226, 141,  32,   6, 131, 127, 199,  40, 135,  16,  57,  71,  91, 225, 168, 242,
+	206,  97, 166,  44,  14,  90, 236, 239, 230, 244, 223, 108, 102, 119, 148, 251,
+	 29, 216,   8,   9, 249, 208,  24, 105,  94,  34,  64,  95, 115,  72, 134, 204,
+	 43, 247, 243, 218,  47,  58,  73, 107, 241, 179, 116,  66,  36, 143,  81, 250,
+	139,  19,  13, 142, 140, 129, 192,  99, 171, 157, 136,  41,  75,  35, 165,  26
+};
+
+static const unsigned char sCOMP128v23Table1[256] = {
+	170,  42,  95, 141, 109,  30,  71,  89,  26, 147, 231, 205, 239, 212, 124, 129,
+	216,  79,  15, 185, 153,  14, 251, 162,   0, 241, 172, 197,  43,  10, 194, 235,
+	  6,  20,  72,  45, 143, 104, 161, 119,  41, 136,  38, 189, 135,  25,  93,  18,
+	224, 171, 252, 195,  63,  19,  58, 165,  23,  55, 133, 254, 214, 144, 220, 178,
+	156,  52, 110, 225,  97, 183, 140,  39,  53,  88, 219, 167,  16, 198,  62, 222,
+	 76, 139, 175,  94,  51, 134, 115,  22,  67,   1, 249, 217,   3,   5, 232, 138,
+	 31,  56, 116, 163,  70, 128, 234, 132, 229, 184, 244,  13,  34,  73, 233, 154,
+	179, 131, 215, 236, 142, 223,  27,  57, 246, 108, 211,   8, 253,  85,  66, 245,
+	193,  78, 190,   4,  17,   7, 150, 127, 152, 213,  37, 186,   2, 243,  46, 169,
+	 68, 101,  60, 174, 208, 158, 176,  69, 238, 191,  90,  83, 166, 125,  77,  59,
+	 21,  92,  49, 151, 168,  99,   9,  50, 146, 113, 117, 228,  65, 230,  40,  82,
+	 54, 237, 227, 102,  28,  36, 107,  24,  44, 126, 206, 201,  61, 114, 164, 207,
+	181,  29,  91,  64, 221, 255,  48, 155, 192, 111, 180, 210, 182, 247, 203, 148,
+	209,  98, 173,  11,  75, 123, 250, 118,  32,  47, 240, 202,  74, 177, 100,  80,
+	196,  33, 248,  86, 157, 137, 120, 130,  84, 204, 122,  81, 242, 188, 200, 149,
+	226, 218, 160, 187, 106,  35,  87, 105,  96, 145, 199, 159,  12, 121, 103, 112
+};
+
+/** One pass of the COMP128v2/v3 compression, on RAND and the mixed key; output may be rand. */
+static void COMP128v23Round(unsigned char output[16], const unsigned char kxor[16], const unsigned char rand[16])
+{
+	unsigned char temp[16];
+	unsigned char kmrm[32];
+	for (unsigned i=0; i<16; i++) {
+		kmrm[i] = rand[i];
+		kmrm[i+16] = kxor[i];
+	}
+
+	for (unsigned i=0; i<5; i++) {
+		for (unsigned z=0; z<16; z++)
+			temp[z] = sCOMP128v23Table0[sCOMP128v23Table1[kmrm[16+z]] ^ kmrm[z]];
+		for (unsigned j=0; j<(1U<<i); j++) {
+			for (unsigned k=0; k<(1U<<(4-i)); k++) {
+				kmrm[(((2*k)+1)<<i)+j] =
+					sCOMP128v23Table0[sCOMP128v23Table1[temp[(k<<i)+j]] ^ kmrm[(k<<i)+16+j]];
+				kmrm[(k<<(i+1))+j] = temp[(k<<i)+j];
+			}
+		}
+	}
+
+	// Bit 19n+19 (mod 256) of the state becomes bit n of the output.
+	memset(output,0,16);
+	for (unsigned i=0; i<16; i++)
+		for (unsigned j=0; j<8; j++)
+			output[i] ^= ((kmrm[((19*(j+8*i)+19)%256)/8] >> ((3*j+3)%8)) & 1) << j;
+}
+
+/** COMP128v2 and v3 differ only in v2 zeroing the last 10 bits of Kc. */
+static void COMP128v23(const unsigned char ki[16], const unsigned char rand[16],
+	unsigned char sres[4], unsigned char kc[8], bool v2)
+{
+	unsigned char kmix[16], randmix[16], katyvasz[16], output[16];
+	for (unsigned i=0; i<16; i++) {
+		kmix[i] = ki[15-i];
+		randmix[i] = rand[15-i];
+	}
+	for (unsigned i=0; i<16; i++) katyvasz[i] = kmix[i] ^ randmix[i];
+
+	for (unsigned i=0; i<8; i++) COMP128v23Round(randmix,katyvasz,randmix);
+
+	for (unsigned i=0; i<16; i++) output[i] = randmix[15-i];
+	if (v2) {
+		output[15] = 0;
+		output[14] &= 0xfc;
+	}
+	memcpy(sres,output,4);
+	memcpy(kc,output+8,8);
+}
+
+
+bool A3A8COMP128v2(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8])
+{
+	COMP128v23(ki,rand,sres,kc,true);
+	return true;
+}
+
+
+bool A3A8COMP128v3(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8])
+{
+	COMP128v23(ki,rand,sres,kc,false);
+	return true;
+}
+
+
+bool A3A8Milenage(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8])
+{
+	if (!op) return false;
+	AES128 aes(ki);
+
+	// OPc = E[OP]K xor OP
+	unsigned char opc[16];
+	aes.encrypt(op,opc);
+	for (unsigned i=0; i<16; i++) opc[i] ^= op[i];
+
+	// TEMP = E[RAND xor OPc]K
+	unsigned char temp[16];
+	for (unsigned i=0; i<16; i++) temp[i] = rand[i] ^ opc[i];
+	aes.encrypt(temp,temp);
+
+	// OUTn = E[rot(TEMP xor OPc, rn) xor cn]K xor OPc, with the default
+	// constants: r2=0, r3=32, r4=64 bits; c2=1, c3=2, c4=4.
+	unsigned char out2[16], out3[16], out4[16];
+	unsigned char *outs[3] = { out2, out3, out4 };
+	for (unsigned n=0; n<3; n++) {
+		unsigned char in[16];
+		for (unsigned i=0; i<16; i++) in[i] = temp[(i+4*n)%16] ^ opc[(i+4*n)%16];
+		in[15] ^= 1 << n;
+		aes.encrypt(in,outs[n]);
+		for (unsigned i=0; i<16; i++) outs[n][i] ^= opc[i];
+	}
+
+	// RES is f2, the last 8 bytes of OUT2; CK is OUT3 (f3); IK is OUT4 (f4).
+	const unsigned char *res = out2+8;
+	// c2: SRES = RES1 xor RES2
+	for (unsigned i=0; i<4; i++) sres[i] = res[i] ^ res[i+4];
+	// c3: Kc = CK1 xor CK2 xor IK1 xor IK2
+	for (unsigned i=0; i<8; i++) kc[i] = out3[i] ^ out3[i+8] ^ out4[i] ^ out4[i+8];
+	return true;
+}
+
+
+
+/** Parse exactly 2*len hex digits, with an optional 0x prefix. */
+static bool hexToBytes(const string& hex, unsigned char *bytes, unsigned len)
+{
+	const char *p = hex.c_str();
+	if (p[0]=='0' && (p[1]=='x' || p[1]=='X')) p += 2;
+	if (strlen(p) != 2*len) return false;
+	for (unsigned i=0; i<2*len; i++) {
+		char c = toupper(p[i]);
+		unsigned v;
+		if (c >= '0' && c <= '9') v = c - '0';
+		else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+		else return false;
+		if (i%2 == 0) bytes[i/2] = v << 4;
+		else bytes[i/2] |= v;
+	}
+	return true;
+}
+
+/** Format bytes the way comp128 prints them. */
+static string bytesToHex(const unsigned char *bytes, unsigned len)
+{
+	string hex;
+	char buf[3];
+	for (unsigned i=0; i<len; i++) {
+		sprintf(buf,"%02X",bytes[i]);
+		hex += buf;
+	}
+	return hex;
+}
+
+static string lowercase(const string& s)
+{
+	string ret = s;
+	for (unsigned i=0; i<ret.length(); i++) ret[i] = tolower(ret[i]);
+	return ret;
+}
+
+
+
+A3A8Registry gA3A8Registry;
+
+
+A3A8Registry::A3A8Registry()
+{
+	add("comp128v1",A3A8COMP128v1);
+	// the program built from comp128.c
+	add("comp128",A3A8COMP128v1);
+	add("comp128v2",A3A8COMP128v2);
+	add("comp128v3",A3A8COMP128v3);
+	add("milenage",A3A8Milenage);
+}
+
+
+void A3A8Registry::add(const string& name, A3A8Function algorithm)
+{
+	ScopedLock lock(mLock);
+	mAlgorithms[lowercase(name)] = algorithm;
+}
+
+
+A3A8Function A3A8Registry::find(const string& name) const
+{
+	string key = lowercase(name);
+	size_t slash = key.rfind('/');
+	if (slash != string::npos) key = key.substr(slash+1);
+	ScopedLock lock(mLock);
+	AlgorithmMap::const_iterator itr = mAlgorithms.find(key);
+	if (itr == mAlgorithms.end()) return NULL;
+	return itr->second;
+}
+
+
+bool A3A8Registry::run(A3A8Function algorithm, const string& ki, const string& rand,
+	const string& op, string *sres, string *kc)
+{
+	unsigned char k[16], r[16], o[16];
+	if (!hexToBytes(ki,k,16) || !hexToBytes(rand,r,16)) return false;
+	bool haveOp = op.length() != 0;
+	if (haveOp && !hexToBytes(op,o,16)) return false;
+	unsigned char s[4], c[8];
+	if (!algorithm(k,r,haveOp ? o : NULL,s,c)) return false;
+	*sres = bytesToHex(s,4);
+	*kc = bytesToHex(c,8);
+	return true;
+}
+
+// vim: ts=4 sw=4
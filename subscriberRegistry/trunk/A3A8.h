@@ -0,0 +1,115 @@
+/*
+* Copyright 2011 Kestrel Signal Processing, Inc.
+* Copyright 2011 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef A3A8_H
+#define A3A8_H
+
+#include <map>
+#include <string>
+
+#include <Threads.h>
+
+
+/**
+	An A3/A8 algorithm run in-process.
+	@param ki the subscriber's 128-bit key
+	@param rand the 128-bit challenge
+	@param op the 128-bit operator variant, or NULL if none is configured
+	@param sres the 32-bit signed response
+	@param kc the 64-bit cipher key
+	@return false if the algorithm could not run, e.g. it needs an op and has none
+*/
+typedef bool (*A3A8Function)(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8]);
+
+
+/**
+	The A3/A8 algorithms the subscriber registry can run without forking.
+	Algorithms are selected by the a3_a8 column or SubscriberRegistry.A3A8,
+	which hold either an algorithm name or the path of an external program.
+	A path whose file name is a registered name, like the stock
+	/OpenBTS/comp128, selects the built-in algorithm.
+*/
+class A3A8Registry {
+
+	private:
+
+	typedef std::map<std::string,A3A8Function> AlgorithmMap;
+
+	AlgorithmMap mAlgorithms;
+	mutable Mutex mLock;
+
+	public:
+
+	/** Create the registry with the built-in algorithms. */
+	A3A8Registry();
+
+	/** Add or replace an algorithm. Names are case-insensitive. */
+	void add(const std::string& name, A3A8Function algorithm);
+
+	/**
+		Find the algorithm for an a3_a8 value.
+		@param name an algorithm name or the path of an A3/A8 program
+		@return the algorithm, or NULL if the value should be run as a program
+	*/
+	A3A8Function find(const std::string& name) const;
+
+	/**
+		Run an algorithm on hex strings, as the A3/A8 programs do.
+		@param algorithm the algorithm to run
+		@param ki 32 hex digits
+		@param rand 32 hex digits
+		@param op 32 hex digits, or empty if none is configured
+		@param sres set to 8 hex digits
+		@param kc set to 16 hex digits
+		@return false on malformed input or if the algorithm failed
+	*/
+	static bool run(A3A8Function algorithm, const std::string& ki, const std::string& rand,
+		const std::string& op, std::string *sres, std::string *kc);
+};
+
+/** The global algorithm registry. */
+extern A3A8Registry gA3A8Registry;
+
+
+/** COMP128v1, from comp128.c. */
+bool A3A8COMP128v1(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8]);
+
+/** COMP128v2, which leaves the last 10 bits of Kc zero. */
+bool A3A8COMP128v2(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8]);
+
+/** COMP128v3, COMP128v2 with the full 64-bit Kc. */
+bool A3A8COMP128v3(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8]);
+
+/** 3GPP Milenage (TS 35.206) with the GSM conversion functions c2 and c3 (TS 33.102). */
+bool A3A8Milenage(const unsigned char ki[16], const unsigned char rand[16],
+	const unsigned char *op, unsigned char sres[4], unsigned char kc[8]);
+
+#endif
+
+// vim: ts=4 sw=4
@@ -0,0 +1,430 @@
+/*
+* Copyright 2011 Kestrel Signal Processing, Inc.
+* Copyright 2011, 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <sstream>
+
+#include <Logger.h>
+
+#include "HttpClient.h"
+
+using namespace std;
+
+
+bool HttpURL::parse(const string& url)
+{
+	string rest = url;
+	size_t scheme = rest.find("://");
+	if (scheme != string::npos) {
+		if (strcasecmp(rest.substr(0, scheme).c_str(), "http") != 0) return false;
+		rest = rest.substr(scheme+3);
+	}
+	size_t slash = rest.find('/');
+	mPath = slash == string::npos ? "/" : rest.substr(slash);
+	string hostPort = rest.substr(0, slash);
+	size_t colon = hostPort.rfind(':');
+	if (colon == string::npos) {
+		mHost = hostPort;
+		mPort = "80";
+	} else {
+		mHost = hostPort.substr(0, colon);
+		mPort = hostPort.substr(colon+1);
+	}
+	return mHost.length() != 0 && mPort.length() != 0;
+}
+
+
+
+/** Send all of a buffer; never raise SIGPIPE. */
+static bool sendAll(int fd, const string& data)
+{
+	size_t sent = 0;
+	while (sent < data.length()) {
+		ssize_t n = ::send(fd, data.data()+sent, data.length()-sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		sent += n;
+	}
+	return true;
+}
+
+/** Append whatever the socket has to a buffer; false on EOF, error or timeout. */
+static bool receiveMore(int fd, string& buffered)
+{
+	char buf[4096];
+	while (true) {
+		ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		buffered.append(buf, n);
+		return true;
+	}
+}
+
+/** Take a CRLF-terminated line from the front of a buffer, reading more as needed. */
+static bool takeLine(int fd, string& buffered, string *line)
+{
+	size_t eol;
+	while ((eol = buffered.find("\r\n")) == string::npos) {
+		if (!receiveMore(fd, buffered)) return false;
+	}
+	*line = buffered.substr(0, eol);
+	buffered.erase(0, eol+2);
+	return true;
+}
+
+/** Take exactly count bytes from the front of a buffer, reading more as needed. */
+static bool takeBytes(int fd, string& buffered, size_t count, string *bytes)
+{
+	while (buffered.length() < count) {
+		if (!receiveMore(fd, buffered)) return false;
+	}
+	bytes->append(buffered, 0, count);
+	buffered.erase(0, count);
+	return true;
+}
+
+/**
+	Read one response from a connection.  Bytes read past its end, the
+	start of the next pipelined response, stay in buffered.
+	@param keepAlive cleared if the server will close the connection
+	@return false if the connection failed before a whole response arrived
+*/
+static bool readResponse(int fd, string& buffered, string *body, int *status, bool *keepAlive)
+{
+	string line;
+	bool http10;
+	long contentLength;
+	bool chunked;
+	// Skip interim 1xx responses.
+	do {
+		if (!takeLine(fd, buffered, &line)) return false;
+		if (line.compare(0, 5, "HTTP/") != 0 || line.length() < 12) {
+			LOG(ERR) << "bad http status line: " << line;
+			return false;
+		}
+		http10 = line.compare(0, 8, "HTTP/1.0") == 0;
+		*status = atoi(line.c_str()+9);
+		*keepAlive = !http10;
+		contentLength = -1;
+		chunked = false;
+		while (true) {
+			if (!takeLine(fd, buffered, &line)) return false;
+			if (line.length() == 0) break;
+			size_t colon = line.find(':');
+			if (colon == string::npos) continue;
+			string name = line.substr(0, colon);
+			size_t start = line.find_first_not_of(" \t", colon+1);
+			string value = start == string::npos ? "" : line.substr(start);
+			if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+				contentLength = atol(value.c_str());
+			} else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+				chunked = strcasestr(value.c_str(), "chunked") != NULL;
+			} else if (strcasecmp(name.c_str(), "Connection") == 0) {
+				if (strcasestr(value.c_str(), "close")) *keepAlive = false;
+				if (strcasestr(value.c_str(), "keep-alive")) *keepAlive = true;
+			}
+		}
+	} while (*status >= 100 && *status < 200);
+
+	body->clear();
+	if (chunked) {
+		while (true) {
+			if (!takeLine(fd, buffered, &line)) return false;
+			size_t size = strtoul(line.c_str(), NULL, 16);
+			if (size == 0) break;
+			if (!takeBytes(fd, buffered, size, body)) return false;
+			if (!takeLine(fd, buffered, &line)) return false;
+		}
+		// trailers
+		do {
+			if (!takeLine(fd, buffered, &line)) return false;
+		} while (line.length() != 0);
+	} else if (contentLength >= 0) {
+		if (!takeBytes(fd, buffered, contentLength, body)) return false;
+	} else {
+		// delimited by the end of the connection
+		while (receiveMore(fd, buffered)) {}
+		body->swap(buffered);
+		buffered.clear();
+		*keepAlive = false;
+	}
+	return true;
+}
+
+
+
+HttpClient::~HttpClient()
+{
+	closeIdle();
+}
+
+
+void HttpClient::closeIdle()
+{
+	ScopedLock lock(mLock);
+	for (IdleMap::iterator itr = mIdle.begin(); itr != mIdle.end(); ++itr) {
+		for (SocketList::iterator fd = itr->second.begin(); fd != itr->second.end(); ++fd) ::close(*fd);
+	}
+	mIdle.clear();
+}
+
+
+int HttpClient::connect(const HttpURL& url)
+{
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo *addrs;
+	int rc = getaddrinfo(url.mHost.c_str(), url.mPort.c_str(), &hints, &addrs);
+	if (rc != 0) {
+		LOG(ERR) << "cannot resolve " << url.mHost << ": " << gai_strerror(rc);
+		return -1;
+	}
+	struct timeval timeout;
+	timeout.tv_sec = mTimeoutMs / 1000;
+	timeout.tv_usec = (mTimeoutMs % 1000) * 1000;
+	int fd = -1;
+	for (addrinfo *addr = addrs; addr; addr = addr->ai_next) {
+		fd = ::socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (fd < 0) continue;
+		// SO_SNDTIMEO also bounds connect().
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) break;
+		::close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addrs);
+	if (fd < 0) LOG(ERR) << "cannot connect to " << url.hostPort();
+	return fd;
+}
+
+
+/** True unless the server has closed an idle connection, or sent something unasked. */
+static bool stillOpen(int fd)
+{
+	char c;
+	ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+
+int HttpClient::checkout(const HttpURL& url, bool *reused)
+{
+	{
+		ScopedLock lock(mLock);
+		IdleMap::iterator itr = mIdle.find(url.hostPort());
+		while (itr != mIdle.end() && itr->second.size()) {
+			int fd = itr->second.back();
+			itr->second.pop_back();
+			if (!stillOpen(fd)) {
+				::close(fd);
+				continue;
+			}
+			*reused = true;
+			return fd;
+		}
+	}
+	*reused = false;
+	return connect(url);
+}
+
+
+void HttpClient::checkin(const HttpURL& url, int fd)
+{
+	ScopedLock lock(mLock);
+	SocketList& idle = mIdle[url.hostPort()];
+	if (idle.size() >= mMaxIdle) {
+		::close(fd);
+		return;
+	}
+	idle.push_back(fd);
+}
+
+
+/** Format a form-encoded POST. */
+static string postRequest(const HttpURL& url, const string& body)
+{
+	ostringstream request;
+	request << "POST " << url.mPath << " HTTP/1.1\r\n"
+		<< "Host: " << url.hostPort() << "\r\n"
+		<< "Content-Type: application/x-www-form-urlencoded\r\n"
+		<< "Content-Length: " << body.length() << "\r\n"
+		<< "\r\n"
+		<< body;
+	return request.str();
+}
+
+
+bool HttpClient::post(const string& url, const string& body, string *response, bool idempotent)
+{
+	int status = 0;
+	if (idempotent) {
+		vector<string> bodies(1, body);
+		vector<string> responses;
+		vector<int> statuses;
+		post(url, bodies, &responses, &statuses);
+		*response = responses[0];
+		status = statuses[0];
+	} else {
+		HttpURL parsed;
+		if (!parsed.parse(url)) {
+			LOG(ERR) << "cannot handle url " << url;
+			return false;
+		}
+		bool reused;
+		int fd = checkout(parsed, &reused);
+		if (fd < 0) return false;
+		// Sent once only: the server may have acted on it even if no answer comes back.
+		bool keepAlive = true;
+		string buffered;
+		bool answered = sendAll(fd, postRequest(parsed, body))
+			&& readResponse(fd, buffered, response, &status, &keepAlive);
+		if (answered && keepAlive) checkin(parsed, fd);
+		else ::close(fd);
+		if (!answered) {
+			LOG(ERR) << "no answer from " << url;
+			return false;
+		}
+	}
+	if (status < 200 || status >= 300) {
+		if (status) LOG(ERR) << "http status " << status << " from " << url;
+		return false;
+	}
+	return true;
+}
+
+
+bool HttpClient::post(const string& url, const vector<string>& bodies,
+	vector<string> *responses, vector<int> *statuses)
+{
+	responses->assign(bodies.size(), "");
+	statuses->assign(bodies.size(), 0);
+	HttpURL parsed;
+	if (!parsed.parse(url)) {
+		LOG(ERR) << "cannot handle url " << url;
+		return false;
+	}
+
+	unsigned next = 0;
+	while (next < bodies.size()) {
+		bool reused;
+		int fd = checkout(parsed, &reused);
+		if (fd < 0) break;
+
+		// Send everything still unanswered in one go.
+		string requests;
+		for (unsigned i = next; i < bodies.size(); i++) requests += postRequest(parsed, bodies[i]);
+		bool sent = sendAll(fd, requests);
+
+		unsigned first = next;
+		bool keepAlive = true;
+		string buffered;
+		while (sent && keepAlive && next < bodies.size()) {
+			if (!readResponse(fd, buffered, &(*responses)[next], &(*statuses)[next], &keepAlive)) break;
+			next++;
+		}
+
+		if (next == bodies.size() && keepAlive) checkin(parsed, fd);
+		else ::close(fd);
+
+		// A pooled connection the server has since closed answers nothing; try a new one.
+		if (next == first && reused && buffered.empty()) continue;
+		// A server that closed after answering ignored the rest, so they can be sent again.
+		if (next > first && !keepAlive) continue;
+		if (next < bodies.size()) {
+			LOG(ERR) << "no answer from " << url;
+			break;
+		}
+	}
+
+	for (unsigned i = 0; i < bodies.size(); i++) {
+		if ((*statuses)[i] < 200 || (*statuses)[i] >= 300) return false;
+	}
+	return true;
+}
+
+
+
+bool HttpCache::get(const string& key, string *value)
+{
+	ScopedLock lock(mLock);
+	EntryMap::iterator itr = mEntries.find(key);
+	if (itr == mEntries.end()) return false;
+	if (itr->second.mExpiration.passed()) {
+		mEntries.erase(itr);
+		return false;
+	}
+	*value = itr->second.mValue;
+	return true;
+}
+
+
+void HttpCache::put(const string& key, const string& value, unsigned ttlSeconds)
+{
+	ScopedLock lock(mLock);
+	if (mEntries.size() >= mMaxEntries) {
+		// Drop the expired entries, and everything if that is not enough.
+		EntryMap::iterator itr = mEntries.begin();
+		while (itr != mEntries.end()) {
+			if (itr->second.mExpiration.passed()) mEntries.erase(itr++);
+			else ++itr;
+		}
+		if (mEntries.size() >= mMaxEntries) mEntries.clear();
+	}
+	Entry& entry = mEntries[key];
+	entry.mValue = value;
+	entry.mExpiration.future(ttlSeconds*1000);
+}
+
+
+void HttpCache::clear()
+{
+	ScopedLock lock(mLock);
+	mEntries.clear();
+}
+
+
+size_t HttpCache::size()
+{
+	ScopedLock lock(mLock);
+	return mEntries.size();
+}
+
+// vim: ts=4 sw=4
@@ -0,0 +1,165 @@
+/*
+* Copyright 2011 Kestrel Signal Processing, Inc.
+* Copyright 2011, 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Threads.h>
+#include <Timeval.h>
+
+
+/** The parts of an http URL the client needs. */
+class HttpURL {
+
+	public:
+
+	std::string mHost;
+	std::string mPort;
+	std::string mPath;
+
+	/**
+		Parse "http://host[:port][/path]", or "host[:port][/path]" as curl
+		accepts it.
+		@return false for other schemes, e.g. https
+	*/
+	bool parse(const std::string& url);
+
+	/** The Host header value and the key for pooled connections. */
+	std::string hostPort() const { return mHost + ":" + mPort; }
+};
+
+
+/**
+	A minimal HTTP/1.1 client for the upstream subscriber registry.
+	Connections are kept alive and pooled per server, and several
+	idempotent POSTs can be pipelined on one connection.  Thread safe.
+*/
+class HttpClient {
+
+	private:
+
+	typedef std::list<int> SocketList;
+	typedef std::map<std::string,SocketList> IdleMap;
+
+	IdleMap mIdle;				///< idle keep-alive connections, by host:port
+	Mutex mLock;
+	unsigned mMaxIdle;			///< most idle connections kept per server
+	unsigned mTimeoutMs;		///< for connect, send and each receive
+
+	/** Open a new connection; return -1 on failure. */
+	int connect(const HttpURL& url);
+
+	/** Take an idle connection the server has not closed, or open one. */
+	int checkout(const HttpURL& url, bool *reused);
+
+	/** Keep a connection for the next request, or close it if the pool is full. */
+	void checkin(const HttpURL& url, int fd);
+
+	public:
+
+	HttpClient(unsigned wMaxIdle = 4, unsigned wTimeoutMs = 5000)
+		:mMaxIdle(wMaxIdle),mTimeoutMs(wTimeoutMs)
+	{}
+
+	/** Close the idle connections. */
+	~HttpClient();
+
+	/**
+		POST a form-encoded body.
+		@param url the server
+		@param body the request body, sent as is
+		@param response set to the response body
+		@param idempotent true if the request may be sent again when the
+			server closes the connection without answering it
+		@return true if the server answered with a 2xx status
+	*/
+	bool post(const std::string& url, const std::string& body, std::string *response,
+		bool idempotent = false);
+
+	/**
+		POST several idempotent bodies back-to-back on one connection and
+		read the answers in order.  Requests a server leaves unanswered by
+		closing the connection are sent again on a new one, so this is only
+		for requests that change nothing on the server.
+		@param url the server
+		@param bodies the request bodies
+		@param responses set to the response bodies, one per request
+		@param statuses set to the http status codes, 0 for a request that got no answer
+		@return true if every request got a 2xx answer
+	*/
+	bool post(const std::string& url, const std::vector<std::string>& bodies,
+		std::vector<std::string> *responses, std::vector<int> *statuses);
+
+	/** Drop all idle connections. */
+	void closeIdle();
+};
+
+
+/**
+	Answers from the upstream server, kept for a limited time so repeated
+	lookups do not go back over the network.  Thread safe.
+*/
+class HttpCache {
+
+	private:
+
+	class Entry {
+		public:
+		std::string mValue;
+		Timeval mExpiration;
+	};
+
+	typedef std::map<std::string,Entry> EntryMap;
+
+	EntryMap mEntries;
+	Mutex mLock;
+	unsigned mMaxEntries;
+
+	public:
+
+	HttpCache(unsigned wMaxEntries = 10000)
+		:mMaxEntries(wMaxEntries)
+	{}
+
+	/** Find an unexpired answer. */
+	bool get(const std::string& key, std::string *value);
+
+	/** Keep an answer for ttlSeconds. */
+	void put(const std::string& key, const std::string& value, unsigned ttlSeconds);
+
+	/** Forget everything, e.g. after an update upstream. */
+	void clear();
+
+	size_t size();
+};
+
+#endif
+
+// vim: ts=4 sw=4
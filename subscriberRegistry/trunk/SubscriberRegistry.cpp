@@ -24,6 +24,7 @@
 */
 
 #include "SubscriberRegistry.h"
+#include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
@@ -34,6 +35,7 @@
 #include <sstream>
 #include <fstream>
 #include <Configuration.h>
+#include "HttpClient.h"
 
 extern ConfigurationTable gConfig;
 
@@ -178,7 +180,7 @@ int SubscriberRegistry::init()
 	int rc = sqlite3_open(ldb.c_str(),&mDB);
 	if (rc) {
 		LOG(EMERG) << "Cannot open SubscriberRegistry database: " << ldb << " error: " << sqlite3_errmsg(mDB);
-		sqlite3_close(mDB);
+		sqlite3_close_cached(mDB);
 		mDB = NULL;
 		return 1;
 	}
@@ -215,7 +217,7 @@ int SubscriberRegistry::init()
 
 SubscriberRegistry::~SubscriberRegistry()
 {
-	if (mDB) sqlite3_close(mDB);
+	if (mDB) sqlite3_close_cached(mDB);
 }
 
 
@@ -681,7 +683,7 @@ void HttpQuery::send(const char *label, string value)
 	sends[label] = value;
 }
 
-void HttpQuery::log()
+string HttpQuery::body()
 {
 	ostringstream os;
 	bool first = true;
@@ -693,10 +695,54 @@ void HttpQuery::log()
 		}
 		os << it->first << "=" << it->second;
 	}
-	LOG(INFO) << os.str();
+	return os.str();
 }
 
-bool HttpQuery::http(bool sip)
+void HttpQuery::log()
+{
+	LOG(INFO) << body();
+}
+
+bool HttpQuery::cacheable()
+{
+	// rand and auth must reach the server every time
+	if (sends["req"] != "sql") return false;
+	const char *stmt = sends["stmts"].c_str();
+	while (isspace(*stmt)) stmt++;
+	return strncasecmp(stmt, "select", 6) == 0;
+}
+
+bool HttpQuery::parse(const string& answer)
+{
+	istringstream is(answer);
+	string tmp;
+	while (getline(is, tmp)) {
+		size_t pos = tmp.find('=');
+		if (pos != string::npos) {
+			string key = tmp.substr(0, pos);
+			string value = tmp.substr(pos+1);
+			if (key == "error") {
+				LOG(ERR) << "HTTPQuery::http error: " << value;
+				return false;
+			}
+			receives[key] = value;
+		} else {
+			LOG(ERR) << "HTTPQuery::http: bad server return:";
+			LOG(ERR) << answer;
+			return false;
+		}
+	}
+	return true;
+}
+
+// keep-alive connections to the servers, shared by all queries
+static HttpClient gHttpClient;
+
+// recent answers to sql selects
+static HttpCache gHttpCache;
+
+/** The old way, for servers the client cannot handle, i.e. https. */
+static bool curlPost(const string& server, const string& body, string *answer)
 {
 	// unique temporary file names
 	ostringstream os1;
@@ -712,33 +758,16 @@ bool HttpQuery::http(bool sip)
 		LOG(ERR) << "HttpQuery::http: can't write " << tmpFile1.c_str();
 		return false;
 	}
-	bool first = true;
-	for (map<string,string>::iterator it = sends.begin(); it != sends.end(); it++) {
-		if (first) {
-			first = false;
-		} else {
-			file1 << "&";
-		}
-		file1 << it->first << "=" << it->second;
-	}
+	file1 << body;
 	file1.close();
 
-	// call the server
-	string server = sip ? 
-		gConfig.getStr("SIP.Proxy.Registration"):
-		gConfig.getStr("SubscriberRegistry.UpstreamServer");
-	if (server.length() == 0 && !sip) return false;
 	ostringstream os;
 	os << "curl -s --data-binary @" << tmpFile1.c_str() << " " << server << " > " << tmpFile2.c_str();
 	LOG(INFO) << os.str();
-	if (server == "testing") {
+	int st = system(os.str().c_str());
+	if (st != 0) {
+		LOG(ERR) << "curl call returned " << st;
 		return false;
-	} else {
-		int st = system(os.str().c_str());
-		if (st != 0) {
-			LOG(ERR) << "curl call returned " << st;
-			return false;
-		}
 	}
 
 	// read the http return from another temp file
@@ -747,30 +776,53 @@ bool HttpQuery::http(bool sip)
 		LOG(ERR) << "HTTPQuery::http: can't read " << tmpFile2.c_str();
 		return false;
 	}
-	string tmp;
-	while (getline(file2, tmp)) {
-		size_t pos = tmp.find('=');
-		if (pos != string::npos) {
-			string key = tmp.substr(0, pos);
-			string value = tmp.substr(pos+1);
-			if (key == "error") {
-				LOG(ERR) << "HTTPQuery::http error: " << value;
-				file2.close();
-				return false;
-			}
-			receives[key] = value;
-		} else {
-			file2.close();
-			LOG(ERR) << "HTTPQuery::http: bad server return:";
-			ifstream file22(tmpFile2.c_str());
-			while (getline(file22, tmp)) {
-				LOG(ERR) << tmp;
-			}
-			file22.close();
-			return false;
+	ostringstream contents;
+	contents << file2.rdbuf();
+	*answer = contents.str();
+	return true;
+}
+
+static string httpServer(bool sip)
+{
+	return sip ?
+		gConfig.getStr("SIP.Proxy.Registration"):
+		gConfig.getStr("SubscriberRegistry.UpstreamServer");
+}
+
+bool HttpQuery::http(bool sip)
+{
+	// call the server
+	string server = httpServer(sip);
+	if (server.length() == 0 && !sip) return false;
+	if (server == "testing") return false;
+	unsigned ttl = gConfig.getNum("SubscriberRegistry.UpstreamServer.CacheTTL");
+
+	// answer from the cache if we can
+	string body = this->body();
+	string key = server + "\n" + body;
+	string answer;
+	bool readOnly = cacheable();
+	if (readOnly) {
+		if (ttl && gHttpCache.get(key, &answer)) {
+			LOG(INFO) << "cached " << body;
+			return parse(answer);
 		}
+	} else if (sends["req"] == "sql") {
+		// an update upstream may change any answer
+		gHttpCache.clear();
 	}
-	file2.close();
+
+	LOG(INFO) << "POST " << server << " " << body;
+	HttpURL url;
+	if (url.parse(server)) {
+		// only a read-only query is sent again if the connection drops before the answer
+		if (!gHttpClient.post(server, body, &answer, readOnly)) return false;
+	} else {
+		if (!curlPost(server, body, &answer)) return false;
+	}
+
+	if (!parse(answer)) return false;
+	if (ttl && readOnly) gHttpCache.put(key, answer, ttl);
 	return true;
 }
 
@@ -358,6 +358,21 @@ class HttpQuery {
 
 
 
+	/** The request body: the parameters, form-encoded as is. */
+	string body();
+
+
+
+	/** Whether the answer may be served from the cache: sql selects only. */
+	bool cacheable();
+
+
+
+	/** Fill receives from the server's answer. */
+	bool parse(const string& answer);
+
+
+
 };
 
 
@@ -30,11 +30,14 @@
 #include <cstdlib>
 #include <Configuration.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "servershare.h"
 #include "sqlite3.h"
+#include "sqlite3util.h"
 #include "Logger.h"
 #include "SubscriberRegistry.h"
+#include "A3A8.h"
 
 using namespace std;
 
@@ -69,7 +72,21 @@ ConfigurationKeyMap getConfigurationKeys()
 		ConfigurationKey::FILEPATH,
 		"",
 		false,
-		"Path to the program that implements the A3/A8 algorithm."
+		"Path to the program that implements the A3/A8 algorithm, or the name of a built-in algorithm: comp128v1, comp128v2, comp128v3 or milenage.  "
+			"A program named comp128 is run in-process as comp128v1.  "
+			"The a3_a8 column of a subscriber overrides this value."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("SubscriberRegistry.A3A8.Milenage.OP","",
+		"",
+		ConfigurationKey::CUSTOMERWARN,
+		ConfigurationKey::STRING_OPT,
+		"^[0-9a-fA-F]{32}$",
+		false,
+		"The 128-bit operator variant OP, as 32 hex digits, used by the built-in milenage A3/A8 algorithm.  "
+			"Subscribers using milenage fail authentication while this is unset."
 	);
 	map[tmp->getName()] = *tmp;
 	delete tmp;
@@ -132,14 +149,77 @@ ConfigurationKeyMap getConfigurationKeys()
 	map[tmp->getName()] = *tmp;
 	delete tmp;
 
+	tmp = new ConfigurationKey("SubscriberRegistry.UpstreamServer.CacheTTL","0",
+		"seconds",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"0:3600",
+		false,
+		"How long answers to lookups from the upstream subscriber registry server are kept and reused.  "
+			"Updates sent upstream discard every kept answer.  "
+			"Negative answers are kept too, so a subscriber added upstream may be unknown here for this long.  "
+			"0, the default, always asks the server."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
+	tmp = new ConfigurationKey("SubscriberRegistry.Workers","4",
+		"threads",
+		ConfigurationKey::CUSTOMERTUNE,
+		ConfigurationKey::VALRANGE,
+		"1:64",
+		true,
+		"Number of threads serving SIP authentication requests in sipauthserve.  "
+			"Each has its own database connection, so registrations are handled in parallel."
+	);
+	map[tmp->getName()] = *tmp;
+	delete tmp;
+
 	return map;
 }
 
+// The connection used by each thread for subscriber lookups, if it has its own.
+static pthread_key_t threadDBKey;
+static pthread_once_t threadDBOnce = PTHREAD_ONCE_INIT;
+
+static void threadDBKeyCreate()
+{
+	pthread_key_create(&threadDBKey, NULL);
+}
+
+void setThreadDB(sqlite3 *db)
+{
+	pthread_once(&threadDBOnce, threadDBKeyCreate);
+	pthread_setspecific(threadDBKey, db);
+}
+
+static sqlite3 *threadDB()
+{
+	pthread_once(&threadDBOnce, threadDBKeyCreate);
+	sqlite3 *db = (sqlite3*)pthread_getspecific(threadDBKey);
+	return db ? db : gSubscriberRegistry.db();
+}
+
+sqlite3 *openDB()
+{
+	string ldb = gConfig.getStr("SubscriberRegistry.db");
+	sqlite3 *db;
+	if (sqlite3_open(ldb.c_str(), &db)) {
+		LOG(EMERG) << "Cannot open SubscriberRegistry database: " << ldb << " error: " << sqlite3_errmsg(db);
+		sqlite3_close_cached(db);
+		return NULL;
+	}
+	// The workers write the same file, so wait out each other's write
+	// locks rather than giving up after SQLiteQuery's few quick retries.
+	sqlite3_busy_timeout(db, 2000);
+	return db;
+}
+
 string imsiGet(string imsi, string key)
 {
 	string name = imsi.substr(0,4) == "IMSI" ? imsi : "IMSI" + imsi;
 	char *value;
-	if (!sqlite3_single_lookup(gSubscriberRegistry.db(), "sip_buddies", "username", name.c_str(), key.c_str(), value)) {
+	if (!sqlite3_single_lookup(threadDB(), "sip_buddies", "username", name.c_str(), key.c_str(), value)) {
 		return "";
 	}
 	if (!value) { return ""; }
@@ -151,9 +231,9 @@ string imsiGet(string imsi, string key)
 void imsiSet(string imsi, string key, string value)
 {
 	string name = imsi.substr(0,4) == "IMSI" ? imsi : "IMSI" + imsi;
-	ostringstream os2;
-	os2 << "update sip_buddies set " << key << " = \"" << value << "\" where username = \"" << name << "\"";
-	if (!sqlite3_command(gSubscriberRegistry.db(), os2.str().c_str())) {
+	string query = "update sip_buddies set " + key + " = ?1 where username = ?2";
+	SQLiteQuery q(threadDB(), query.c_str());
+	if (!q.valid() || !q.bind(value).bind(name).run()) {
 		LOG(ERR) << "sqlite3_command problem";
 		return;
 	}
@@ -290,6 +370,20 @@ bool authenticate(string imsi, string randx, string sres, string *kc)
 			// config value is default
 			a3a8 = gConfig.getStr("SubscriberRegistry.A3A8");
 		}
+		// built-in algorithms run in-process, without a fork per authentication
+		A3A8Function algorithm = gA3A8Registry.find(a3a8);
+		if (algorithm) {
+			string sres2;
+			string op = gConfig.getStr("SubscriberRegistry.A3A8.Milenage.OP");
+			if (!A3A8Registry::run(algorithm, ki, randx, op, &sres2, kc)) {
+				LOG(CRIT) << "error: " << a3a8 << " failed";
+				return false;
+			}
+			LOG(INFO) << "result = " << sres2;
+			ret = sresEqual(sres, sres2);
+			LOG(INFO) << "returning = " << ret;
+			return ret;
+		}
 		os << a3a8 << " 0x" << ki << " 0x" << randx;
 		// must not put ki into the log
 		// LOG(INFO) << "running " << os.str();
@@ -88,3 +88,10 @@ void split(char separator, string tosplit, vector<string> *fields);
 	Open the database whose name is in the config table
 */
 sqlite3 *openDB();
+
+/**
+	Make the calling thread use its own database connection for imsiGet and imsiSet.
+	Threads that never call this share the SubscriberRegistry connection.
+	@param db a connection from openDB, or NULL to go back to the shared one
+*/
+void setThreadDB(sqlite3 *db);
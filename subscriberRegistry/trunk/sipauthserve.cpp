@@ -40,11 +40,14 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
 
 #include <Logger.h>
 #include <Configuration.h>
+#include <Threads.h>
 #include "servershare.h"
 #include "SubscriberRegistry.h"
 
@@ -267,28 +270,167 @@ char *processBuffer(char *buffer)
 
 
 #define BUFLEN 5000
+// most datagrams taken from the socket in one system call
+#define SIP_BATCH 16
+
+/**
+	A thread serving requests from the shared socket.  Each worker has its
+	own buffers and database connection, which WAL mode lets read alongside
+	the others, so the workers share nothing but the socket.
+*/
+class AuthWorker {
+
+	private:
+
+	int mSocket;
+	sqlite3 *mDB;
+	char mBuffers[SIP_BATCH][BUFLEN];
+	sockaddr_in mSources[SIP_BATCH];
+	Thread mThread;
+
+	/** Wait for requests and take up to SIP_BATCH of them; return the number taken. */
+	unsigned receive();
+
+	/** Send each reply to its source. */
+	void send(char **replies, sockaddr_in **destinations, unsigned count);
+
+	public:
+
+	AuthWorker(int wSocket)
+		:mSocket(wSocket),mDB(NULL)
+	{}
+
+	/** Open the database connection. */
+	bool init();
+
+	void start();
+
+	/** Serve requests forever. */
+	void run();
+};
+
+void *AuthWorkerLoopAdapter(AuthWorker *worker)
+{
+	worker->run();
+	return NULL;
+}
+
+
+bool AuthWorker::init()
+{
+	mDB = openDB();
+	return mDB != NULL;
+}
+
+void AuthWorker::start()
+{
+	mThread.start((void*(*)(void*))AuthWorkerLoopAdapter, this);
+}
+
+unsigned AuthWorker::receive()
+{
+#ifdef MSG_WAITFORONE
+	mmsghdr msgs[SIP_BATCH];
+	iovec iovs[SIP_BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i = 0; i < SIP_BATCH; i++) {
+		iovs[i].iov_base = mBuffers[i];
+		iovs[i].iov_len = BUFLEN-1;
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &mSources[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(mSources[i]);
+	}
+	// block for the first request, then take whatever else is queued
+	int count = recvmmsg(mSocket, msgs, SIP_BATCH, MSG_WAITFORONE, NULL);
+	if (count == -1) {
+		if (errno != EINTR) LOG(ERR) << "recvmmsg problem";
+		return 0;
+	}
+	for (int i = 0; i < count; i++) mBuffers[i][msgs[i].msg_len] = 0;
+	return count;
+#else
+	socklen_t slen = sizeof(mSources[0]);
+	int length = recvfrom(mSocket, mBuffers[0], BUFLEN-1, 0, (sockaddr*)&mSources[0], &slen);
+	if (length == -1) {
+		LOG(ERR) << "recvfrom problem";
+		return 0;
+	}
+	mBuffers[0][length] = 0;
+	return 1;
+#endif
+}
+
+void AuthWorker::send(char **replies, sockaddr_in **destinations, unsigned count)
+{
+#ifdef MSG_WAITFORONE
+	mmsghdr msgs[SIP_BATCH];
+	iovec iovs[SIP_BATCH];
+	memset(msgs, 0, sizeof(msgs));
+	for (unsigned i = 0; i < count; i++) {
+		iovs[i].iov_base = replies[i];
+		iovs[i].iov_len = strlen(replies[i]);
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = destinations[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+	}
+	unsigned sent = 0;
+	while (sent < count) {
+		int n = sendmmsg(mSocket, msgs+sent, count-sent, 0);
+		if (n == -1) {
+			LOG(ERR) << "sendto problem";
+			// skip the reply that failed
+			n = 1;
+		}
+		sent += n;
+	}
+#else
+	for (unsigned i = 0; i < count; i++) {
+		if (sendto(mSocket, replies[i], strlen(replies[i]), 0, (sockaddr*)destinations[i], sizeof(sockaddr_in)) == -1) {
+			LOG(ERR) << "sendto problem";
+		}
+	}
+#endif
+}
+
+void AuthWorker::run()
+{
+	setThreadDB(mDB);
+	while (true) {
+		unsigned count = receive();
+		char *replies[SIP_BATCH];
+		sockaddr_in *destinations[SIP_BATCH];
+		unsigned numReplies = 0;
+		for (unsigned i = 0; i < count; i++) {
+			LOG(INFO) << " receiving " << mBuffers[i];
+			char *dest = processBuffer(mBuffers[i]);
+			if (dest == NULL) {
+				continue;
+			}
+			replies[numReplies] = dest;
+			destinations[numReplies] = &mSources[i];
+			numReplies++;
+		}
+		send(replies, destinations, numReplies);
+		for (unsigned i = 0; i < numReplies; i++) {
+			osip_free(replies[i]);
+		}
+	}
+}
+
 
 int
 main(int argc, char **argv)
 {
 	sockaddr_in si_me;
-	sockaddr_in si_other;
 	int aSocket;
-	char buf[BUFLEN];
 
 	LOG(ALERT) << argv[0] << " (re)starting";
 	srand ( time(NULL) + (int)getpid() );
 	my_udp_port = gConfig.getNum("SubscriberRegistry.Port");
 	gSubscriberRegistry.init();
 
-	// init osip lib
-	osip_t *osip;
-	int i=osip_init(&osip);
-	if (i!=0) {
-		LOG(ALERT) << "cannot init sip lib";
-		return NULL;
-	}
-
 	if ((aSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1) {
 		LOG(ALERT) << "can't initialize socket";
 		exit(1);
@@ -305,27 +447,32 @@ main(int argc, char **argv)
 
 	LOG(NOTICE) << "binding on port " << my_udp_port;
 
-	while (true) {
-		gConfig.purge();
-		socklen_t slen = sizeof(si_other);
-		memset(buf, 0, BUFLEN);
-		if (recvfrom(aSocket, buf, BUFLEN, 0, (sockaddr*)&si_other, &slen) == -1) {
-			LOG(ERR) << "recvfrom problem";
-			continue;
-		}
-
-		LOG(INFO) << " receiving " << buf;
+	// init osip lib, which sets up the parser the workers share
+	osip_t *osip;
+	if (osip_init(&osip) != 0) {
+		LOG(ALERT) << "cannot init sip lib";
+		exit(1);
+	}
 
-		char *dest = processBuffer(buf);
-		if (dest == NULL) {
-			continue;
+	unsigned numWorkers = gConfig.getNum("SubscriberRegistry.Workers");
+	vector<AuthWorker*> workers;
+	for (unsigned i = 0; i < numWorkers; i++) {
+		AuthWorker *worker = new AuthWorker(aSocket);
+		if (!worker->init()) {
+			LOG(ALERT) << "cannot start worker " << i;
+			exit(1);
 		}
+		workers.push_back(worker);
+	}
+	for (unsigned i = 0; i < numWorkers; i++) {
+		workers[i]->start();
+	}
+	LOG(NOTICE) << "serving with " << numWorkers << " workers";
 
-		if (sendto(aSocket, dest, strlen(dest), 0, (sockaddr*)&si_other, sizeof(si_other)) == -1) {
-			LOG(ERR) << "sendto problem";
-			continue;
-		}
-		osip_free(dest);
+	// pick up configuration changes, once a second rather than on every packet
+	while (true) {
+		sleep(1);
+		gConfig.purge();
 	}
 
 	close(aSocket);
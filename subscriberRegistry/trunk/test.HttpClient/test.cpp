@@ -0,0 +1,258 @@
+/*
+	Runs HttpClient and HttpCache against a stub HTTP server on the loopback
+	interface, checking connection reuse, pipelining, servers that close
+	connections, that only idempotent requests are sent twice, chunked
+	answers and cache expiry, and compares the cost of
+	a request on a pooled connection with one on a new connection.
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Configuration.h>
+#include <Threads.h>
+#include <Timeval.h>
+
+#include "HttpClient.h"
+
+using namespace std;
+
+ConfigurationTable gConfig("test.db");
+
+
+/** How the stub server behaves; set before each case. */
+static unsigned gCloseAfter = 0;		///< close a connection after this many answers, 0 never
+static bool gChunked = false;			///< send answers chunked
+static bool gDropIdle = false;			///< close a connection once it has answered everything it was sent
+static bool gHangUp = false;			///< close a connection on receiving a request, without answering
+
+static unsigned gConnections = 0;		///< connections accepted
+static unsigned gRequests = 0;			///< requests answered
+
+static int gListener;
+static unsigned short gPort;
+
+
+/** Answer one connection; each answer is "echo=" and the request body. */
+static void serveConnection(int fd)
+{
+	string buffered;
+	unsigned answered = 0;
+	char buf[4096];
+	while (true) {
+		size_t end = buffered.find("\r\n\r\n");
+		if (end == string::npos) {
+			// Everything sent so far has been answered.
+			if (gDropIdle && answered) break;
+			ssize_t n = recv(fd, buf, sizeof(buf), 0);
+			if (n <= 0) break;
+			buffered.append(buf, n);
+			continue;
+		}
+		const char *length = strcasestr(buffered.c_str(), "Content-Length:");
+		size_t bodyLength = length && (size_t)(length - buffered.c_str()) < end ? atoi(length+15) : 0;
+		if (buffered.length() < end+4+bodyLength) {
+			ssize_t n = recv(fd, buf, sizeof(buf), 0);
+			if (n <= 0) break;
+			buffered.append(buf, n);
+			continue;
+		}
+		string body = buffered.substr(end+4, bodyLength);
+		buffered.erase(0, end+4+bodyLength);
+		if (gHangUp) break;
+		answered++;
+		gRequests++;
+		bool closing = gCloseAfter && answered == gCloseAfter;
+		string content = "echo=" + body + "\n";
+		ostringstream response;
+		response << "HTTP/1.1 200 OK\r\n";
+		if (closing) response << "Connection: close\r\n";
+		if (gChunked) {
+			// in two chunks, to exercise the reassembly
+			size_t half = content.length()/2;
+			response << "Transfer-Encoding: chunked\r\n\r\n"
+				<< hex << half << "\r\n" << content.substr(0, half) << "\r\n"
+				<< hex << content.length()-half << "\r\n" << content.substr(half) << "\r\n"
+				<< "0\r\n\r\n";
+		} else {
+			response << "Content-Length: " << content.length() << "\r\n\r\n" << content;
+		}
+		string out = response.str();
+		if (send(fd, out.data(), out.length(), MSG_NOSIGNAL) != (ssize_t)out.length()) break;
+		if (closing) break;
+	}
+	close(fd);
+}
+
+static void *serverLoop(void*)
+{
+	while (true) {
+		int fd = accept(gListener, NULL, NULL);
+		if (fd < 0) continue;
+		// answers go out one at a time, so Nagle would stall pipelines
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		gConnections++;
+		serveConnection(fd);
+	}
+	return NULL;
+}
+
+static void startServer()
+{
+	gListener = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	bind(gListener, (sockaddr*)&addr, sizeof(addr));
+	socklen_t len = sizeof(addr);
+	getsockname(gListener, (sockaddr*)&addr, &len);
+	gPort = ntohs(addr.sin_port);
+	listen(gListener, 16);
+	static Thread server;
+	server.start(serverLoop, NULL);
+}
+
+
+static bool check(const char *what, bool ok)
+{
+	cout << what << (ok ? " ok" : " FAILED") << endl;
+	return ok;
+}
+
+static void reset()
+{
+	gCloseAfter = 0;
+	gChunked = false;
+	gDropIdle = false;
+	gHangUp = false;
+	gConnections = 0;
+	gRequests = 0;
+}
+
+/** Pipeline count requests and check every answer. */
+static bool pipeline(HttpClient& client, const string& url, unsigned count)
+{
+	vector<string> bodies;
+	for (unsigned i = 0; i < count; i++) {
+		ostringstream body;
+		body << "req=sql&stmts=select " << i;
+		bodies.push_back(body.str());
+	}
+	vector<string> responses;
+	vector<int> statuses;
+	if (!client.post(url, bodies, &responses, &statuses)) return false;
+	for (unsigned i = 0; i < count; i++) {
+		if (responses[i] != "echo=" + bodies[i] + "\n") return false;
+	}
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	startServer();
+	ostringstream os;
+	os << "http://127.0.0.1:" << gPort << "/cgi/subreg.cgi";
+	string url = os.str();
+	bool ok = true;
+	string response;
+
+	HttpURL parsed;
+	ok &= check("url",
+		parsed.parse("127.0.0.1:5064") && parsed.mHost == "127.0.0.1" && parsed.mPort == "5064" && parsed.mPath == "/"
+		&& parsed.parse("http://localhost/cgi/subreg.cgi") && parsed.mPort == "80" && parsed.mPath == "/cgi/subreg.cgi"
+		&& !parsed.parse("https://localhost/cgi/subreg.cgi"));
+
+	HttpClient client;
+
+	reset();
+	bool same = true;
+	for (unsigned i = 0; i < 10; i++) {
+		same &= client.post(url, "req=rand&imsi=001010000000000", &response)
+			&& response == "echo=req=rand&imsi=001010000000000\n";
+	}
+	ok &= check("keep-alive", same && gConnections == 1 && gRequests == 10);
+
+	reset();
+	ok &= check("pipelined", pipeline(client, url, 20) && gConnections == 0 && gRequests == 20);
+
+	reset();
+	gCloseAfter = 3;
+	client.closeIdle();
+	ok &= check("server closes", pipeline(client, url, 20) && gConnections == 7 && gRequests == 20);
+
+	reset();
+	gChunked = true;
+	client.closeIdle();
+	ok &= check("chunked", pipeline(client, url, 5));
+
+	// The server drops the pooled connection between requests.
+	reset();
+	gDropIdle = true;
+	client.closeIdle();
+	same = client.post(url, "req=sql&stmts=select 1", &response);
+	usleep(100000);
+	same &= client.post(url, "req=sql&stmts=select 2", &response) && response == "echo=req=sql&stmts=select 2\n";
+	ok &= check("stale connection", same && gConnections == 2);
+
+	// The server takes a request on the pooled connection and hangs up.
+	// Only an idempotent one may be tried again, on a new connection.
+	reset();
+	client.closeIdle();
+	same = client.post(url, "req=rand&imsi=001010000000000", &response);
+	gHangUp = true;
+	same &= !client.post(url, "req=rand&imsi=001010000000000", &response);
+	ok &= check("no resend", same && gConnections == 1);
+	reset();
+	client.closeIdle();
+	same = client.post(url, "req=sql&stmts=select 1", &response, true);
+	gHangUp = true;
+	same &= !client.post(url, "req=sql&stmts=select 1", &response, true);
+	ok &= check("idempotent resend", same && gConnections == 2);
+
+	reset();
+	HttpClient dead(4, 500);
+	ok &= check("no server", !dead.post("http://127.0.0.1:1/", "req=rand", &response));
+
+	HttpCache cache;
+	string value;
+	cache.put("a", "1", 1);
+	ok &= check("cache hit", cache.get("a", &value) && value == "1" && !cache.get("b", &value));
+	usleep(1200000);
+	ok &= check("cache expiry", !cache.get("a", &value) && cache.size() == 0);
+
+	// Round-trip cost, pooled versus a new connection per request.
+	reset();
+	const unsigned numRequests = 2000;
+	Timeval start;
+	for (unsigned i = 0; i < numRequests; i++) client.post(url, "req=sql&stmts=select 1", &response, true);
+	long pooledMs = start.elapsed();
+	// the stub serves one connection at a time
+	client.closeIdle();
+	HttpClient unpooled(0);
+	start.now();
+	for (unsigned i = 0; i < numRequests; i++) unpooled.post(url, "req=sql&stmts=select 1", &response, true);
+	long unpooledMs = start.elapsed();
+	start.now();
+	for (unsigned i = 0; i < numRequests/20; i++) pipeline(client, url, 20);
+	long pipelinedMs = start.elapsed();
+	cout << "pooled " << pooledMs*1000.0/numRequests << " us/request, "
+		<< "new connection " << unpooledMs*1000.0/numRequests << " us/request, "
+		<< "pipelined " << pipelinedMs*1000.0/numRequests << " us/request" << endl;
+
+	return ok ? 0 : 1;
+}
+
+// vim: ts=4 sw=4
@@ -0,0 +1,148 @@
+/*
+	Checks the in-process A3/A8 algorithms and measures authentications/sec,
+	in-process and through a forked A3/A8 program the way authenticate()
+	used to run every one of them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+
+#include <Timeval.h>
+
+#include "A3A8.h"
+
+using namespace std;
+
+
+static string randomHex()
+{
+	char buf[33];
+	for (unsigned i=0; i<32; i++) buf[i] = "0123456789ABCDEF"[random() % 16];
+	buf[32] = 0;
+	return string(buf);
+}
+
+/** Run an A3/A8 program the way authenticate() does. */
+static bool runProgram(const string& program, const string& ki, const string& rand, string *sres, string *kc)
+{
+	string cmd = program + " 0x" + ki + " 0x" + rand;
+	FILE *f = popen(cmd.c_str(), "r");
+	if (f == NULL) return false;
+	char out[26];
+	char *str = fgets(out, 26, f);
+	pclose(f);
+	if (str != NULL && strlen(str) == 25) str[24] = 0;
+	if (str == NULL || strlen(str) != 24) return false;
+	*kc = out+8;
+	out[8] = 0;
+	*sres = out;
+	return true;
+}
+
+static bool check(const char *what, bool ok)
+{
+	cout << what << (ok ? " ok" : " FAILED") << endl;
+	return ok;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *program = argc > 1 ? argv[1] : "../comp128";
+	srandom(1);
+	bool ok = true;
+	string sres, kc;
+
+	A3A8Function comp128 = gA3A8Registry.find("/OpenBTS/comp128");
+	A3A8Function milenage = gA3A8Registry.find("Milenage");
+	ok &= check("lookup", comp128 == A3A8COMP128v1 && milenage == A3A8Milenage
+		&& gA3A8Registry.find("comp128v2") == A3A8COMP128v2 && gA3A8Registry.find("comp128v3") == A3A8COMP128v3
+		&& gA3A8Registry.find("/usr/local/bin/a3a8") == NULL);
+
+	// 3GPP TS 35.207 test set 1, with SRES and Kc from c2 and c3.
+	ok &= check("milenage test set 1",
+		A3A8Registry::run(milenage, "465b5ce8b199b49faa5f0a2ee238a6bc", "23553cbe9637a89d218ae64dae47bf35",
+			"cdc202d5123e20f62b6d676ac72cb318", &sres, &kc)
+		&& sres == "46F8416A" && kc == "EAE4BE823AF9A08B");
+	// COMP128v2 and v3 on fixed inputs.
+	A3A8Function comp128v2 = gA3A8Registry.find("COMP128v2");
+	A3A8Function comp128v3 = gA3A8Registry.find("comp128v3");
+	ok &= check("comp128v3 vector 1",
+		A3A8Registry::run(comp128v3, "000102030405060708090a0b0c0d0e0f", "00112233445566778899aabbccddeeff",
+			"", &sres, &kc)
+		&& sres == "AF28F52F" && kc == "205802E785E77F2A");
+	ok &= check("comp128v3 vector 2",
+		A3A8Registry::run(comp128v3, "465b5ce8b199b49faa5f0a2ee238a6bc", "23553cbe9637a89d218ae64dae47bf35",
+			"", &sres, &kc)
+		&& sres == "F7E96810" && kc == "63760252CB4AC140");
+	ok &= check("comp128v2 vector 1",
+		A3A8Registry::run(comp128v2, "000102030405060708090a0b0c0d0e0f", "00112233445566778899aabbccddeeff",
+			"", &sres, &kc)
+		&& sres == "AF28F52F" && kc == "205802E785E77C00");
+
+	// v2 is v3 with the last 10 bits of Kc cleared.
+	bool truncated = true;
+	for (unsigned i=0; i<20; i++) {
+		string ki = randomHex();
+		string rand = randomHex();
+		unsigned char k[16], r[16], sres2[4], kc2[8], sres3[4], kc3[8];
+		for (unsigned j=0; j<16; j++) {
+			k[j] = strtoul(ki.substr(2*j,2).c_str(),NULL,16);
+			r[j] = strtoul(rand.substr(2*j,2).c_str(),NULL,16);
+		}
+		comp128v2(k,r,NULL,sres2,kc2);
+		comp128v3(k,r,NULL,sres3,kc3);
+		kc3[6] &= 0xfc;
+		kc3[7] = 0;
+		if (memcmp(sres2,sres3,4) || memcmp(kc2,kc3,8)) truncated = false;
+	}
+	ok &= check("comp128v2 truncates comp128v3", truncated);
+
+	ok &= check("milenage without op", !A3A8Registry::run(milenage, randomHex(), randomHex(), "", &sres, &kc));
+	ok &= check("malformed ki", !A3A8Registry::run(comp128, "0x1234", randomHex(), "", &sres, &kc));
+
+	// The built-in COMP128v1 must agree with the program.
+	bool same = true;
+	for (unsigned i=0; i<20; i++) {
+		string ki = randomHex();
+		string rand = randomHex();
+		string sres2, kc2;
+		if (!A3A8Registry::run(comp128, ki, rand, "", &sres, &kc)) same = false;
+		if (!runProgram(program, ki, rand, &sres2, &kc2)) same = false;
+		if (sres != sres2 || kc != kc2) same = false;
+	}
+	ok &= check("comp128v1 matches comp128", same);
+
+	const unsigned inProcess = 100000;
+	const unsigned forked = 500;
+	string ki = randomHex();
+	string rand = randomHex();
+
+	Timeval start;
+	for (unsigned i=0; i<inProcess; i++) A3A8Registry::run(comp128, ki, rand, "", &sres, &kc);
+	long comp128Ms = start.elapsed();
+
+	start.now();
+	for (unsigned i=0; i<inProcess; i++) A3A8Registry::run(comp128v3, ki, rand, "", &sres, &kc);
+	long comp128v3Ms = start.elapsed();
+
+	start.now();
+	for (unsigned i=0; i<inProcess; i++) A3A8Registry::run(milenage, ki, rand, ki, &sres, &kc);
+	long milenageMs = start.elapsed();
+
+	start.now();
+	for (unsigned i=0; i<forked; i++) runProgram(program, ki, rand, &sres, &kc);
+	long forkMs = start.elapsed();
+
+	cout << "comp128v1 in-process: " << inProcess*1000.0/(comp128Ms ? comp128Ms : 1) << " auth/s" << endl;
+	cout << "comp128v3 in-process: " << inProcess*1000.0/(comp128v3Ms ? comp128v3Ms : 1) << " auth/s" << endl;
+	cout << "milenage in-process: " << inProcess*1000.0/(milenageMs ? milenageMs : 1) << " auth/s" << endl;
+	cout << program << " forked: " << forked*1000.0/(forkMs ? forkMs : 1) << " auth/s" << endl;
+
+	return ok ? 0 : 1;
+}
+
+// vim: ts=4 sw=4